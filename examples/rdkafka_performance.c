@@ -109,6 +109,7 @@ static struct {
 	uint64_t tx;
 	uint64_t tx_err;
         uint64_t avg_rtt;
+        uint64_t avg_batchcnt;
         uint64_t offset;
 	rd_ts_t  t_fetch_latency;
 	rd_ts_t  t_last;
@@ -405,6 +406,8 @@ static void json_parse_stats (const char *json) {
 #define MAX_AVGS 100 /* max number of brokers to scan for rtt */
         uint64_t avg_rtt[MAX_AVGS+1];
         int avg_rtt_i     = 0;
+        uint64_t batchcnt_sum = 0;
+        int batchcnt_i    = 0;
 
         /* Store totals at end of array */
         avg_rtt[MAX_AVGS]     = 0;
@@ -429,6 +432,21 @@ static void json_parse_stats (const char *json) {
                 avg_rtt[MAX_AVGS] /= avg_rtt_i;
 
         cnt.avg_rtt = avg_rtt[MAX_AVGS];
+
+        /* Extract average batch message count across topics */
+        t = json;
+        while (*t) {
+                uint64_t v = json_parse_fields(t, &t,
+                                               "\"batchcnt\":",
+                                               "\"avg\":");
+                if (v == 0)
+                        continue;
+                batchcnt_sum += v;
+                batchcnt_i++;
+        }
+
+        if (batchcnt_i > 0)
+                cnt.avg_batchcnt = batchcnt_sum / batchcnt_i;
 }
 
 
@@ -502,6 +520,7 @@ static void print_stats (rd_kafka_t *rk,
                                 COL_HDR("dr_err");
                                 COL_HDR("tx_err");
                                 COL_HDR("outq");
+                                COL_HDR("batch");
                                 if (report_offset)
                                         COL_HDR("offset");
                                 if (latency_mode) {
@@ -528,6 +547,7 @@ static void print_stats (rd_kafka_t *rk,
                         COL_PR64("tx_err", cnt.tx_err);
                         COL_PR64("outq",
                                  rk ? (uint64_t)rd_kafka_outq_len(rk) : 0);
+                        COL_PR64("batch", cnt.avg_batchcnt);
                         if (report_offset)
                                 COL_PR64("offset", (uint64_t)cnt.last_offset);
                         if (latency_mode) {
@@ -547,6 +567,7 @@ static void print_stats (rd_kafka_t *rk,
                                "in %"PRIu64"ms: %"PRIu64" msgs/s and "
                                "%.02f MB/s, "
                                "%"PRIu64" produce failures, %i in queue, "
+                               "%"PRIu64" msgs/batch, "
                                "%s compression\n",
                                cnt.msgs, cnt.bytes,
                                cnt.msgs_dr_ok, cnt.last_offset, cnt.msgs_dr_err,
@@ -555,6 +576,7 @@ static void print_stats (rd_kafka_t *rk,
                                (float)((cnt.bytes_dr_ok) / (float)t_total),
                                cnt.tx_err,
                                rk ? rd_kafka_outq_len(rk) : 0,
+                               cnt.avg_batchcnt,
                                compression);
                 }
 
@@ -0,0 +1,17 @@
+#include <inttypes.h>
+#include <arm_acle.h>
+#include <sys/auxv.h>
+
+#ifdef __clang__
+__attribute__((target("crc")))
+#else
+__attribute__((target("+crc")))
+#endif
+static uint32_t foo (uint32_t c, uint64_t v) {
+   c = __crc32cd(c, v) ^ __crc32d(c, v);
+   return c + (uint32_t)getauxval(AT_HWCAP);
+}
+
+int main (void) {
+   return (int)foo(0, 0);
+}
@@ -0,0 +1,7 @@
+#include <sys/epoll.h>
+
+int main() {
+   struct epoll_event ev[1];
+   int fd = epoll_create1(EPOLL_CLOEXEC);
+   return epoll_wait(fd, ev, 1, 0);
+}
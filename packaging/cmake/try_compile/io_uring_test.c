@@ -0,0 +1,10 @@
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+int main() {
+   struct io_uring_params p = { .flags = 0 };
+   struct io_uring_getevents_arg arg = { .ts = 0 };
+   return (int)syscall(__NR_io_uring_setup, 8, &p) +
+          (int)sizeof(arg) + IORING_ENTER_EXT_ARG + IORING_FEAT_EXT_ARG;
+}
@@ -0,0 +1,19 @@
+#include <inttypes.h>
+#include <wmmintrin.h>
+
+__attribute__((target("pclmul")))
+static uint32_t foo (const void *p) {
+   uint32_t eax = 1, ecx;
+   __m128i a = _mm_loadu_si128((const __m128i *)p);
+   __asm__("cpuid"
+           : "=c"(ecx)
+           : "a"(eax)
+           : "%ebx", "%edx");
+   a = _mm_clmulepi64_si128(a, a, 0x10);
+   return (uint32_t)_mm_cvtsi128_si32(a) + ecx;
+}
+
+int main (void) {
+   static const char buf[16];
+   return (int)foo(buf);
+}
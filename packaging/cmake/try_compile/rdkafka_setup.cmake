@@ -10,6 +10,38 @@ try_compile(
     "${TRYCOMPILE_SRC_DIR}/strndup_test.c"
 )
 
+try_compile(
+    HAVE_EPOLL
+    "${CMAKE_CURRENT_BINARY_DIR}/try_compile"
+    "${TRYCOMPILE_SRC_DIR}/epoll_test.c"
+)
+
+try_compile(
+    HAVE_IO_URING
+    "${CMAKE_CURRENT_BINARY_DIR}/try_compile"
+    "${TRYCOMPILE_SRC_DIR}/io_uring_test.c"
+)
+
+# Hardware CRC32 and CRC32C, also checked during runtime {
+try_compile(
+    WITH_CRC32C_HW
+    "${CMAKE_CURRENT_BINARY_DIR}/try_compile"
+    "${TRYCOMPILE_SRC_DIR}/crc32c_hw_test.c"
+)
+
+try_compile(
+    WITH_PCLMUL
+    "${CMAKE_CURRENT_BINARY_DIR}/try_compile"
+    "${TRYCOMPILE_SRC_DIR}/pclmul_test.c"
+)
+
+try_compile(
+    WITH_CRC_ARMV8
+    "${CMAKE_CURRENT_BINARY_DIR}/try_compile"
+    "${TRYCOMPILE_SRC_DIR}/crc_armv8_test.c"
+)
+# }
+
 # Atomic 32 tests {
 set(LINK_ATOMIC NO)
 set(HAVE_ATOMICS_32 NO)
@@ -375,7 +375,13 @@ enum ErrorCode {
         /** Security features are disabled */
         ERR_SECURITY_DISABLED = 54,
         /** Operation not attempted */
-        ERR_OPERATION_NOT_ATTEMPTED = 55
+        ERR_OPERATION_NOT_ATTEMPTED = 55,
+        /** The fetch session ID was not found */
+        ERR_FETCH_SESSION_ID_NOT_FOUND = 70,
+        /** The fetch session epoch is invalid */
+        ERR_INVALID_FETCH_SESSION_EPOCH = 71,
+        /** Unsupported compression type */
+        ERR_UNSUPPORTED_COMPRESSION_TYPE = 76
 };
 
 
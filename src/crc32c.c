@@ -4,10 +4,11 @@
  *   * global hw/sw initialization to be called once per process
  *   * HW support is determined by configure's WITH_CRC32C_HW
  *   * Windows porting (no hardware support on Windows yet)
+ *   * PCLMULQDQ folding of large buffers (WITH_PCLMUL) and
+ *     ARMv8 CRC32C instructions (WITH_CRC_ARMV8), see rdcrchw.c
  *
  * FIXME:
  *   * Hardware support on Windows (MSVC assembler)
- *   * Hardware support on ARM
  */
 
 /* crc32c.c -- compute CRC-32C using the Intel crc32 instruction
@@ -58,6 +59,7 @@
 #include "rdendian.h"
 
 #include "crc32c.h"
+#include "rdcrchw.h"
 
 /* CRC-32C (iSCSI) polynomial in reversed bit order. */
 #define POLY 0x82f63b78
@@ -355,16 +357,58 @@ static uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len)
 
 #endif /* WITH_CRC32C_HW */
 
+#if WITH_CRC32C_HW && WITH_PCLMUL
+/* Buffer lengths for which PCLMULQDQ folding outperforms the 3-way crc32
+   instruction loop of crc32c_hw(): below PCLMUL_MIN the fold setup and
+   Barrett reduction dominate, from PCLMUL_MAX on the interleaved crc32
+   instructions are as fast or faster.  See unittest_crc32c_impls(). */
+#define PCLMUL_MIN 256
+#define PCLMUL_MAX (256*1024)
+
+/* Fold the 16 byte multiples of buf using PCLMULQDQ and finish off the
+   remaining bytes with the crc32 instruction.  Folding requires len to be at
+   least RD_CRC_FOLD_MIN, shorter buffers are passed on to crc32c_hw(). */
+static uint32_t crc32c_fold(uint32_t crc, const void *buf, size_t len)
+{
+    size_t bulk = len & ~(size_t)15;
+
+    if (len < RD_CRC_FOLD_MIN)
+        return crc32c_hw(crc, buf, len);
+
+    crc = rd_crc_fold_pclmul(&rd_crc_fold_crc32c, crc ^ 0xffffffff,
+                             buf, bulk) ^ 0xffffffff;
+    return crc32c_hw(crc, (const unsigned char *)buf + bulk, len - bulk);
+}
+#endif
+
+#if WITH_CRC_ARMV8
+/* Compute CRC-32C using the ARMv8 crc32c instructions. */
+static uint32_t crc32c_armv8(uint32_t crc, const void *buf, size_t len)
+{
+    return rd_crc32c_armv8(crc ^ 0xffffffff, buf, len) ^ 0xffffffff;
+}
+#endif
+
 /* Compute a CRC-32C.  If the crc32 instruction is available, use the hardware
-   version.  Otherwise, use the software version. */
+   version, folding buffers of PCLMUL_MIN..PCLMUL_MAX bytes with PCLMULQDQ
+   where available.  Otherwise, use the software version. */
 uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
 {
 #if WITH_CRC32C_HW
-        if (sse42)
+        if (sse42) {
+#if WITH_PCLMUL
+                if (rd_crc_hw_pclmul &&
+                    len >= PCLMUL_MIN && len < PCLMUL_MAX)
+                        return crc32c_fold(crc, buf, len);
+#endif
                 return crc32c_hw(crc, buf, len);
-        else
+        }
+#endif
+#if WITH_CRC_ARMV8
+        if (rd_crc_hw_armv8)
+                return crc32c_armv8(crc, buf, len);
 #endif
-                return crc32c_sw(crc, buf, len);
+        return crc32c_sw(crc, buf, len);
 }
 
 
@@ -376,6 +420,7 @@ uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
  * @brief Populate shift tables once
  */
 void crc32c_global_init (void) {
+        rd_crc_hw_init();
 #if WITH_CRC32C_HW
         SSE42(sse42);
         if (sse42)
@@ -385,6 +430,80 @@ void crc32c_global_init (void) {
                 crc32c_init_sw();
 }
 
+/* Verify all available implementations against the software version
+ * for varying lengths and alignments, then measure their throughput. */
+static int unittest_crc32c_impls (void) {
+        const struct {
+                const char *name;
+                uint32_t (*calc) (uint32_t crc, const void *buf, size_t len);
+                int avail;
+        } impls[] = {
+                { "software", crc32c_sw, 1 },
+#if WITH_CRC32C_HW
+                { "SSE42", crc32c_hw, sse42 },
+#if WITH_PCLMUL
+                { "SSE42+PCLMUL", crc32c_fold, sse42 && rd_crc_hw_pclmul },
+#endif
+#endif
+#if WITH_CRC_ARMV8
+                { "ARMv8", crc32c_armv8, rd_crc_hw_armv8 },
+#endif
+                { "dispatched", crc32c, 1 },
+                { NULL }
+        };
+        const size_t benchsize = 1024*1024;
+        unsigned char *rnd;
+        size_t i;
+        int j;
+        uint32_t crc;
+
+        rnd = rd_malloc(benchsize);
+        for (i = 0 ; i < benchsize ; i++)
+                rnd[i] = (unsigned char)rand();
+
+        for (j = 1 ; impls[j].name ; j++) {
+                size_t of, len;
+
+                if (!impls[j].avail)
+                        continue;
+
+                for (of = 0 ; of < 8 ; of++) {
+                        for (len = 0 ; len < 1100 ; len++) {
+                                uint32_t exp = crc32c_sw((uint32_t)len,
+                                                         rnd+of, len);
+                                crc = impls[j].calc((uint32_t)len,
+                                                    rnd+of, len);
+                                RD_UT_ASSERT(crc == exp,
+                                             "%s CRC 0x%"PRIx32" != "
+                                             "software CRC 0x%"PRIx32" for "
+                                             "length %"PRIusz" at offset "
+                                             "%"PRIusz,
+                                             impls[j].name, crc, exp,
+                                             len, of);
+                        }
+                }
+        }
+
+        for (j = 0 ; impls[j].name ; j++) {
+                size_t sizes[] = { 128, 4096, benchsize };
+                size_t k;
+
+                if (!impls[j].avail)
+                        continue;
+                for (k = 0 ; k < RD_ARRAYSIZE(sizes) ; k++)
+                        RD_UT_SAY("CRC32C %s: %"PRIusz" bytes: %.2f GB/s",
+                                  impls[j].name, sizes[k],
+                                  rd_crc_bench_gbps(impls[j].calc, rnd,
+                                                    sizes[k],
+                                                    (int)(64 * benchsize /
+                                                          sizes[k])));
+        }
+
+        rd_free(rnd);
+
+        RD_UT_PASS();
+}
+
 int unittest_crc32c (void) {
         const char *buf =
 "  This software is provided 'as-is', without any express or implied\n"
@@ -410,11 +529,12 @@ int unittest_crc32c (void) {
 
 #if WITH_CRC32C_HW
         if (sse42)
-                how = "hardware (SSE42)";
+                how = rd_crc_hw_pclmul ? "hardware (SSE42+PCLMUL)" :
+                        "hardware (SSE42)";
         else
                 how = "software (SSE42 supported in build but not at runtime)";
 #else
-        how = "software";
+        how = rd_crc_hw_armv8 ? "hardware (ARMv8)" : "software";
 #endif
         RD_UT_SAY("Calculate CRC32C using %s", how);
 
@@ -434,5 +554,8 @@ int unittest_crc32c (void) {
                      " not matching expected CRC 0x%"PRIx32,
                      crc, expected_crc);
 
+        if (unittest_crc32c_impls())
+                return 1;
+
         RD_UT_PASS();
 }
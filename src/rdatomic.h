@@ -188,4 +188,108 @@ static RD_INLINE int64_t RD_UNUSED rd_atomic64_set(rd_atomic64_t *ra, int64_t v)
 #endif
 }
 
+
+/**
+ * @brief Pointer-sized atomic.
+ *
+ * Uses the same atomics interface as the 64-bit atomics, falling back
+ * on a mutex if no atomics are available.
+ */
+#if defined(_MSC_VER) || defined(__SUNPRO_C) || \
+        (HAVE_ATOMICS_32 && HAVE_ATOMICS_64)
+#define RD_ATOMICPTR_LOCKLESS 1
+#endif
+
+typedef struct {
+	void *val;
+#ifndef RD_ATOMICPTR_LOCKLESS
+	mtx_t lock;
+#endif
+} rd_atomicptr_t;
+
+
+static RD_INLINE RD_UNUSED void rd_atomicptr_init (rd_atomicptr_t *ra,
+                                                   void *v) {
+	ra->val = v;
+#ifndef RD_ATOMICPTR_LOCKLESS
+	mtx_init(&ra->lock, mtx_plain);
+#endif
+}
+
+static RD_INLINE void * RD_UNUSED rd_atomicptr_get (rd_atomicptr_t *ra) {
+#ifdef _MSC_VER
+	return InterlockedCompareExchangePointer(&ra->val, NULL, NULL);
+#elif defined(__SUNPRO_C)
+	return atomic_cas_ptr(&ra->val, NULL, NULL);
+#elif !defined(RD_ATOMICPTR_LOCKLESS)
+	void *r;
+	mtx_lock(&ra->lock);
+	r = ra->val;
+	mtx_unlock(&ra->lock);
+	return r;
+#elif HAVE_ATOMICS_64_SYNC
+	return __sync_val_compare_and_swap(&ra->val, NULL, NULL);
+#else
+	return __atomic_load_n(&ra->val, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * @brief Set the value to \p v.
+ * @returns the previous value.
+ */
+static RD_INLINE void * RD_UNUSED rd_atomicptr_exchange (rd_atomicptr_t *ra,
+                                                         void *v) {
+#ifdef _MSC_VER
+	return InterlockedExchangePointer(&ra->val, v);
+#elif defined(__SUNPRO_C)
+	return atomic_swap_ptr(&ra->val, v);
+#elif !defined(RD_ATOMICPTR_LOCKLESS)
+	void *r;
+	mtx_lock(&ra->lock);
+	r = ra->val;
+	ra->val = v;
+	mtx_unlock(&ra->lock);
+	return r;
+#elif HAVE_ATOMICS_64_SYNC
+	void *r;
+	do {
+		r = ra->val;
+	} while (!__sync_bool_compare_and_swap(&ra->val, r, v));
+	return r;
+#else
+	return __atomic_exchange_n(&ra->val, v, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * @brief Set the value to \p v if the current value is \p expected.
+ * @returns 1 if the value was set, else 0.
+ */
+static RD_INLINE int RD_UNUSED rd_atomicptr_cas (rd_atomicptr_t *ra,
+                                                 void *expected, void *v) {
+#ifdef _MSC_VER
+	return InterlockedCompareExchangePointer(&ra->val, v, expected) ==
+		expected;
+#elif defined(__SUNPRO_C)
+	return atomic_cas_ptr(&ra->val, expected, v) == expected;
+#elif !defined(RD_ATOMICPTR_LOCKLESS)
+	int r = 0;
+	mtx_lock(&ra->lock);
+	if (ra->val == expected) {
+		ra->val = v;
+		r = 1;
+	}
+	mtx_unlock(&ra->lock);
+	return r;
+#elif HAVE_ATOMICS_64_SYNC
+	return __sync_bool_compare_and_swap(&ra->val, expected, v);
+#else
+	return __atomic_compare_exchange_n(&ra->val, &expected, v,
+					   0/*strong*/,
+					   __ATOMIC_SEQ_CST,
+					   __ATOMIC_SEQ_CST);
+#endif
+}
+
 #endif /* _RDATOMIC_H_ */
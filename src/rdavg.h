@@ -44,26 +44,42 @@ typedef struct rd_avg_s {
 
 
 /**
- * @brief Add value \p v to averager \p ra.
+ * @brief Add value \p v to averager \p ra \p n times.
+ *
+ * Allows adding many values under a single lock.
+ *
+ * @locks ra_lock MUST be held and \p ra MUST be enabled.
  */
-static RD_UNUSED void rd_avg_add (rd_avg_t *ra, int64_t v) {
-        mtx_lock(&ra->ra_lock);
-        if (!ra->ra_enabled) {
-                mtx_unlock(&ra->ra_lock);
-                return;
-        }
+static RD_UNUSED void rd_avg_add0 (rd_avg_t *ra, int64_t v, int64_t n) {
 	if (v > ra->ra_v.maxv)
 		ra->ra_v.maxv = v;
 	if (ra->ra_v.minv == 0 || v < ra->ra_v.minv)
 		ra->ra_v.minv = v;
-	ra->ra_v.sum += v;
-	ra->ra_v.cnt++;
+	ra->ra_v.sum += v * n;
+	ra->ra_v.cnt += n;
 #if WITH_HDRHISTOGRAM
-        rd_hdr_histogram_record(ra->ra_hdr, v);
+        rd_hdr_histogram_record_n(ra->ra_hdr, v, n);
 #endif
+}
+
+/**
+ * @brief Add value \p v to averager \p ra \p n times, e.g., a latency
+ *        shared by \p n items.
+ */
+static RD_UNUSED void rd_avg_add_n (rd_avg_t *ra, int64_t v, int64_t n) {
+        mtx_lock(&ra->ra_lock);
+        if (ra->ra_enabled)
+                rd_avg_add0(ra, v, n);
         mtx_unlock(&ra->ra_lock);
 }
 
+/**
+ * @brief Add value \p v to averager \p ra.
+ */
+static RD_UNUSED void rd_avg_add (rd_avg_t *ra, int64_t v) {
+        rd_avg_add_n(ra, v, 1);
+}
+
 
 /**
  * @brief Calculate the average
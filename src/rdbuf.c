@@ -587,6 +587,30 @@ void rd_buf_push (rd_buf_t *rbuf, const void *payload, size_t size,
 }
 
 
+/**
+ * @brief Append the externally allocated memory \p payload of \p size bytes
+ *        as a new empty segment and make it the current write position.
+ *
+ *        \p free_cb (optional) is called to free \p payload when the
+ *        buffer is destroyed.
+ *
+ * @remark Any remaining unwritten space in the previous write segment
+ *         is skipped, which allows \p payload to be written contiguously.
+ */
+void rd_buf_push_writable (rd_buf_t *rbuf, void *payload, size_t size,
+                           void (*free_cb)(void *)) {
+        rd_segment_t *seg;
+
+        seg = rd_buf_alloc_segment0(rbuf, 0);
+        seg->seg_p    = (char *)payload;
+        seg->seg_size = size;
+        seg->seg_free = free_cb;
+
+        rd_buf_append_segment(rbuf, seg);
+        rbuf->rbuf_wpos = seg;
+}
+
+
 
 
 
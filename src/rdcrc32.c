@@ -17,6 +17,9 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include "rdcrchw.h"
+#include "rdunittest.h"
+
 /**
  * Static table used for the table_driven implementation.
  *****************************************************************************/
@@ -111,3 +114,114 @@ rd_crc32_t rd_crc32_reflect(rd_crc32_t data, size_t data_len)
 
 
 
+
+
+int rd_crc32_hw;
+
+/**
+ * @brief Update the crc value using PCLMULQDQ folding or the ARMv8
+ *        crc32 instructions, see rd_crc32_update().
+ *
+ * The hardware implementations work on the raw (inverted) CRC register,
+ * which is what the table-driven version keeps in \p crc, while zlib
+ * keeps the finalized value.
+ */
+rd_crc32_t rd_crc32_update_hw(rd_crc32_t crc, const unsigned char *data, size_t data_len)
+{
+#if WITH_ZLIB
+    uint32_t reg = (uint32_t)crc ^ 0xffffffff;
+#define RD_CRC32_REG2CRC(reg) ((rd_crc32_t)((reg) ^ 0xffffffff))
+#else
+    uint32_t reg = (uint32_t)crc;
+#define RD_CRC32_REG2CRC(reg) ((rd_crc32_t)(reg))
+#endif
+
+#if WITH_CRC_ARMV8
+    if (rd_crc_hw_armv8)
+        return RD_CRC32_REG2CRC(rd_crc32_armv8(reg, data, data_len));
+#endif
+
+#if WITH_PCLMUL
+    if (rd_crc_hw_pclmul && data_len >= RD_CRC_FOLD_MIN) {
+        size_t bulk = data_len & ~(size_t)15;
+        reg = rd_crc_fold_pclmul(&rd_crc_fold_crc32, reg, data, bulk);
+        data += bulk;
+        data_len -= bulk;
+    }
+#endif
+
+    return rd_crc32_update_sw(RD_CRC32_REG2CRC(reg), data, data_len);
+#undef RD_CRC32_REG2CRC
+}
+
+
+/**
+ * @brief Check for hardware support, called once per process.
+ */
+void rd_crc32_global_init (void) {
+        rd_crc_hw_init();
+        rd_crc32_hw = rd_crc_hw_pclmul || rd_crc_hw_armv8;
+}
+
+
+static uint32_t ut_crc32_sw (uint32_t crc, const void *buf, size_t len) {
+        return (uint32_t)rd_crc32_update_sw(crc, buf, len);
+}
+
+static uint32_t ut_crc32_hw (uint32_t crc, const void *buf, size_t len) {
+        return (uint32_t)rd_crc32_update_hw(crc, buf, len);
+}
+
+int unittest_crc32 (void) {
+        const char *buf = "123456789";
+        const rd_crc32_t expected_crc = 0xcbf43926;
+        const size_t benchsize = 1024*1024;
+        unsigned char *rnd;
+        rd_crc32_t crc;
+        size_t i, of, len;
+
+        rd_crc32_global_init();
+
+        crc = rd_crc32(buf, strlen(buf));
+        RD_UT_ASSERT(crc == expected_crc,
+                     "Calculated CRC 0x%"PRIx32
+                     " not matching expected CRC 0x%"PRIx32,
+                     (uint32_t)crc, (uint32_t)expected_crc);
+
+        rnd = rd_malloc(benchsize);
+        for (i = 0 ; i < benchsize ; i++)
+                rnd[i] = (unsigned char)rand();
+
+        RD_UT_SAY("CRC32 software: %.2f GB/s",
+                  rd_crc_bench_gbps(ut_crc32_sw, rnd, benchsize, 64));
+
+        if (!rd_crc32_hw) {
+                RD_UT_SAY("No hardware CRC32 support");
+                rd_free(rnd);
+                RD_UT_PASS();
+        }
+
+        /* Verify the hardware version against the software version
+         * for varying lengths and alignments. */
+        for (of = 0 ; of < 8 ; of++) {
+                for (len = 0 ; len < 1100 ; len++) {
+                        uint32_t exp = ut_crc32_sw((uint32_t)len,
+                                                   rnd+of, len);
+                        uint32_t hw = ut_crc32_hw((uint32_t)len,
+                                                  rnd+of, len);
+                        RD_UT_ASSERT(hw == exp,
+                                     "Hardware CRC 0x%"PRIx32" != "
+                                     "software CRC 0x%"PRIx32" for "
+                                     "length %"PRIusz" at offset %"PRIusz,
+                                     hw, exp, len, of);
+                }
+        }
+
+        RD_UT_SAY("CRC32 hardware (%s): %.2f GB/s",
+                  rd_crc_hw_armv8 ? "ARMv8" : "PCLMUL",
+                  rd_crc_bench_gbps(ut_crc32_hw, rnd, benchsize, 64));
+
+        rd_free(rnd);
+
+        RD_UT_PASS();
+}
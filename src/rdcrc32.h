@@ -8,6 +8,7 @@
  * NOTE: Contains librd modifications:
  *       - rd_crc32() helper.
  *       - __RDCRC32___H__ define (was missing the '32' part).
+ *       - Hardware accelerated rd_crc32_update() (PCLMULQDQ, ARMv8).
  *
  * using the configuration:
  *    Width        = 32
@@ -79,15 +80,7 @@ static RD_INLINE rd_crc32_t rd_crc32_init(void)
 
 
 /**
- * Update the crc value with new data.
- *
- * \param crc      The current crc value.
- * \param data     Pointer to a buffer of \a data_len bytes.
- * \param data_len Number of bytes in the \a data buffer.
- * \return         The updated crc value.
- *****************************************************************************/
-	/**
- * Update the crc value with new data.
+ * Update the crc value with new data using zlib or the lookup table.
  *
  * \param crc      The current crc value.
  * \param data     Pointer to a buffer of \a data_len bytes.
@@ -95,7 +88,7 @@ static RD_INLINE rd_crc32_t rd_crc32_init(void)
  * \return         The updated crc value.
  *****************************************************************************/
 static RD_INLINE RD_UNUSED
-rd_crc32_t rd_crc32_update(rd_crc32_t crc, const unsigned char *data, size_t data_len)
+rd_crc32_t rd_crc32_update_sw(rd_crc32_t crc, const unsigned char *data, size_t data_len)
 {
 #if WITH_ZLIB
         rd_assert(data_len <= UINT_MAX);
@@ -114,6 +107,37 @@ rd_crc32_t rd_crc32_update(rd_crc32_t crc, const unsigned char *data, size_t dat
 }
 
 
+/**
+ * Set if hardware CRC32 (PCLMULQDQ or ARMv8) is available at runtime,
+ * see rd_crc32_global_init().
+ */
+extern int rd_crc32_hw;
+
+/**
+ * Smallest buffer worth handing to the hardware implementation.
+ */
+#define RD_CRC32_HW_MIN 64
+
+rd_crc32_t rd_crc32_update_hw(rd_crc32_t crc, const unsigned char *data, size_t data_len);
+
+
+/**
+ * Update the crc value with new data.
+ *
+ * \param crc      The current crc value.
+ * \param data     Pointer to a buffer of \a data_len bytes.
+ * \param data_len Number of bytes in the \a data buffer.
+ * \return         The updated crc value.
+ *****************************************************************************/
+static RD_INLINE RD_UNUSED
+rd_crc32_t rd_crc32_update(rd_crc32_t crc, const unsigned char *data, size_t data_len)
+{
+        if (rd_crc32_hw && data_len >= RD_CRC32_HW_MIN)
+                return rd_crc32_update_hw(crc, data, data_len);
+        return rd_crc32_update_sw(crc, data, data_len);
+}
+
+
 /**
  * Calculate the final crc value.
  *
@@ -139,6 +163,11 @@ static RD_INLINE rd_crc32_t rd_crc32 (const char *data, size_t data_len) {
 						 data_len));
 }
 
+
+void rd_crc32_global_init (void);
+
+int unittest_crc32 (void);
+
 #ifdef __cplusplus
 }           /* closing brace for extern "C" */
 #endif
@@ -0,0 +1,281 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rd.h"
+#include "rdtime.h"
+#include "rdcrchw.h"
+
+#if WITH_PCLMUL
+#include <wmmintrin.h>
+#endif
+
+#if WITH_CRC_ARMV8
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+
+int rd_crc_hw_pclmul;
+int rd_crc_hw_armv8;
+
+
+/* CRC-32 (zlib, Ethernet) polynomial 0x04c11db7 */
+const rd_crc_fold_consts_t rd_crc_fold_crc32 = {
+        .k1k2 = { 0x0154442bd4, 0x01c6e41596 },
+        .k3k4 = { 0x01751997d0, 0x00ccaa009e },
+        .k5k0 = { 0x0163cd6124, 0x0000000000 },
+        .poly = { 0x01db710641, 0x01f7011641 },
+};
+
+/* CRC-32C (Castagnoli) polynomial 0x1edc6f41 */
+const rd_crc_fold_consts_t rd_crc_fold_crc32c = {
+        .k1k2 = { 0x00740eef02, 0x009e4addf8 },
+        .k3k4 = { 0x00f20c0dfe, 0x014cd00bd6 },
+        .k5k0 = { 0x00dd45aab8, 0x0000000000 },
+        .poly = { 0x0105ec76f1, 0x00dea713f1 },
+};
+
+
+/**
+ * @brief Check for hardware support at runtime, called once per process
+ *        from the CRC32 and CRC32C global init functions.
+ */
+void rd_crc_hw_init (void) {
+#if WITH_PCLMUL
+        uint32_t eax = 1, ecx;
+
+        __asm__("cpuid"
+                : "=c"(ecx)
+                : "a"(eax)
+                : "%ebx", "%edx");
+        rd_crc_hw_pclmul = (ecx >> 1) & 1;
+#endif
+#if WITH_CRC_ARMV8
+        rd_crc_hw_armv8 = !!(getauxval(AT_HWCAP) & HWCAP_CRC32);
+#endif
+}
+
+
+#if WITH_PCLMUL
+/**
+ * @brief Fold \p len bytes of \p buf into the raw CRC register \p crc
+ *        using the polynomial constants \p k.
+ *
+ * \p len must be at least RD_CRC_FOLD_MIN and a multiple of 16.
+ *
+ * Four 128-bit lanes are folded in parallel, 64 bytes per iteration,
+ * then reduced to a single lane, folded to 64 bits and finally
+ * Barrett reduced to the 32-bit CRC.
+ */
+__attribute__((target("pclmul")))
+uint32_t rd_crc_fold_pclmul (const rd_crc_fold_consts_t *k, uint32_t crc,
+                             const unsigned char *buf, size_t len) {
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+        rd_dassert(len >= RD_CRC_FOLD_MIN && (len & 15) == 0);
+
+        x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+        x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+        x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+        x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+
+        x0 = _mm_loadu_si128((const __m128i *)k->k1k2);
+
+        buf += 64;
+        len -= 64;
+
+        /* Parallel fold of 64 byte blocks */
+        while (len >= 64) {
+                x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+                x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+                x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+                x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+                x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+                x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+                x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+                x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+                y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+                y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+                y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+                y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+                x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+                x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+                x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+                x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+                buf += 64;
+                len -= 64;
+        }
+
+        /* Fold the four lanes into one */
+        x0 = _mm_loadu_si128((const __m128i *)k->k3k4);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+        /* Single fold of remaining 16 byte blocks */
+        while (len >= 16) {
+                x2 = _mm_loadu_si128((const __m128i *)buf);
+
+                x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+                x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+                x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+                buf += 16;
+                len -= 16;
+        }
+
+        /* Fold 128 bits to 64 bits */
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_srli_si128(x1, 8);
+        x1 = _mm_xor_si128(x1, x2);
+
+        x0 = _mm_loadl_epi64((const __m128i *)k->k5k0);
+
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        /* Barrett reduction to 32 bits */
+        x0 = _mm_loadu_si128((const __m128i *)k->poly);
+
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+#endif /* WITH_PCLMUL */
+
+
+#if WITH_CRC_ARMV8
+#ifdef __clang__
+#define RD_CRC_TARGET_ARMV8 __attribute__((target("crc")))
+#else
+#define RD_CRC_TARGET_ARMV8 __attribute__((target("+crc")))
+#endif
+
+/**
+ * @brief Update the raw CRC-32 register \p crc with \p len bytes of \p buf
+ *        using the ARMv8 CRC32 instructions.
+ */
+RD_CRC_TARGET_ARMV8
+uint32_t rd_crc32_armv8 (uint32_t crc, const unsigned char *buf,
+                         size_t len) {
+        uint64_t v;
+
+        while (len && ((uintptr_t)buf & 7) != 0) {
+                crc = __crc32b(crc, *buf++);
+                len--;
+        }
+
+        while (len >= 8) {
+                memcpy(&v, buf, sizeof(v));
+                crc = __crc32d(crc, v);
+                buf += 8;
+                len -= 8;
+        }
+
+        while (len--)
+                crc = __crc32b(crc, *buf++);
+
+        return crc;
+}
+
+/**
+ * @brief Update the raw CRC-32C register \p crc with \p len bytes of \p buf
+ *        using the ARMv8 CRC32C instructions.
+ */
+RD_CRC_TARGET_ARMV8
+uint32_t rd_crc32c_armv8 (uint32_t crc, const unsigned char *buf,
+                          size_t len) {
+        uint64_t v;
+
+        while (len && ((uintptr_t)buf & 7) != 0) {
+                crc = __crc32cb(crc, *buf++);
+                len--;
+        }
+
+        while (len >= 8) {
+                memcpy(&v, buf, sizeof(v));
+                crc = __crc32cd(crc, v);
+                buf += 8;
+                len -= 8;
+        }
+
+        while (len--)
+                crc = __crc32cb(crc, *buf++);
+
+        return crc;
+}
+#endif /* WITH_CRC_ARMV8 */
+
+
+/**
+ * @brief Unit test helper: run \p calc over \p buf \p iterations times.
+ *
+ * @returns the throughput in GB/s.
+ */
+double rd_crc_bench_gbps (uint32_t (*calc) (uint32_t crc,
+                                            const void *buf, size_t len),
+                          const void *buf, size_t len, int iterations) {
+        volatile uint32_t crc = 0;
+        rd_ts_t ts_start, duration;
+        int i;
+
+        ts_start = rd_clock();
+        for (i = 0 ; i < iterations ; i++)
+                crc = calc(crc, buf, len);
+        duration = rd_clock() - ts_start;
+
+        if (duration <= 0)
+                duration = 1;
+
+        return ((double)len * iterations) / ((double)duration * 1000.0);
+}
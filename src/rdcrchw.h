@@ -0,0 +1,88 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDCRCHW_H_
+#define _RDCRCHW_H_
+
+
+/**
+ * @name Hardware accelerated CRC primitives shared by CRC32 and CRC32C.
+ *
+ * On x86-64 with PCLMULQDQ the bulk of a buffer is folded 64 bytes at a
+ * time using carry-less multiplication (Intel white paper "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction"),
+ * the polynomial specific part is only the set of folding constants.
+ *
+ * On ARMv8 the CRC32 and CRC32C instructions are used directly.
+ *
+ * All functions here operate on the raw, pre-inverted, CRC register
+ * rather than on a finalized CRC value.
+ */
+
+/**
+ * @brief Bit-reflected folding and Barrett reduction constants
+ *        for a 32-bit polynomial P:
+ *          k1 = x^(4*128+32) mod P, k2 = x^(4*128-32) mod P,
+ *          k3 = x^(128+32) mod P,   k4 = x^(128-32) mod P,
+ *          k5 = x^64 mod P,
+ *          mu = x^64 / P, and P itself.
+ */
+typedef struct rd_crc_fold_consts_s {
+        uint64_t k1k2[2];
+        uint64_t k3k4[2];
+        uint64_t k5k0[2];
+        uint64_t poly[2];   /**< P, mu */
+} rd_crc_fold_consts_t;
+
+extern const rd_crc_fold_consts_t rd_crc_fold_crc32;
+extern const rd_crc_fold_consts_t rd_crc_fold_crc32c;
+
+/**< Smallest buffer the folding implementation can handle. */
+#define RD_CRC_FOLD_MIN 64
+
+extern int rd_crc_hw_pclmul;  /**< PCLMULQDQ supported at runtime */
+extern int rd_crc_hw_armv8;   /**< ARMv8 CRC32 instructions supported
+                               *   at runtime */
+
+void rd_crc_hw_init (void);
+
+#if WITH_PCLMUL
+uint32_t rd_crc_fold_pclmul (const rd_crc_fold_consts_t *k, uint32_t crc,
+                             const unsigned char *buf, size_t len);
+#endif
+
+#if WITH_CRC_ARMV8
+uint32_t rd_crc32_armv8 (uint32_t crc, const unsigned char *buf, size_t len);
+uint32_t rd_crc32c_armv8 (uint32_t crc, const unsigned char *buf, size_t len);
+#endif
+
+double rd_crc_bench_gbps (uint32_t (*calc) (uint32_t crc,
+                                            const void *buf, size_t len),
+                          const void *buf, size_t len, int iterations);
+
+#endif /* _RDCRCHW_H_ */
@@ -383,16 +383,17 @@ double rd_hdr_histogram_mean (const rd_hdr_histogram_t *hdr) {
 
 
 /**
- * @brief Records the given value.
+ * @brief Records the given value \p n times.
  *
  * @returns 1 if value was recorded or 0 if value is out of range.
  */
 
-int rd_hdr_histogram_record (rd_hdr_histogram_t *hdr, int64_t v) {
+int rd_hdr_histogram_record_n (rd_hdr_histogram_t *hdr, int64_t v,
+                               int64_t n) {
         int32_t idx = rd_hdr_countsIndexFor(hdr, v);
 
         if (idx < 0 || hdr->countsLen <= idx) {
-                hdr->outOfRangeCount++;
+                hdr->outOfRangeCount += n;
                 if (v > hdr->highestOutOfRange)
                         hdr->highestOutOfRange = v;
                 if (v < hdr->lowestOutOfRange)
@@ -400,12 +401,22 @@ int rd_hdr_histogram_record (rd_hdr_histogram_t *hdr, int64_t v) {
                 return 0;
         }
 
-        hdr->counts[idx]++;
-        hdr->totalCount++;
+        hdr->counts[idx] += n;
+        hdr->totalCount += n;
 
         return 1;
 }
 
+/**
+ * @brief Records the given value.
+ *
+ * @returns 1 if value was recorded or 0 if value is out of range.
+ */
+
+int rd_hdr_histogram_record (rd_hdr_histogram_t *hdr, int64_t v) {
+        return rd_hdr_histogram_record_n(hdr, v, 1);
+}
+
 
 /**
  * @returns the recorded value at the given quantile (0..100).
@@ -75,6 +75,8 @@ rd_hdr_histogram_t *rd_hdr_histogram_new (int64_t minValue, int64_t maxValue,
 void rd_hdr_histogram_reset (rd_hdr_histogram_t *hdr);
 
 int rd_hdr_histogram_record (rd_hdr_histogram_t *hdr, int64_t v);
+int rd_hdr_histogram_record_n (rd_hdr_histogram_t *hdr, int64_t v,
+                               int64_t n);
 
 double rd_hdr_histogram_stddev (rd_hdr_histogram_t *hdr);
 double rd_hdr_histogram_mean (const rd_hdr_histogram_t *hdr);
@@ -0,0 +1,214 @@
+/*
+ * librd - Rapid Development C library
+ *
+ * Copyright (c) 2018, Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "rd.h"
+#include "rdheap.h"
+#include "rdrand.h"
+#include "rdunittest.h"
+
+/*
+ * Binary min-heap.
+ * rh_nodes[1] is the lowest element and the children of
+ * rh_nodes[i] are rh_nodes[2i] and rh_nodes[2i+1].
+ */
+
+#define RD_HEAP_LT(rh,a,b)  ((rh)->rh_cmp((a)->rhn_elm, (b)->rhn_elm) < 0)
+
+static RD_INLINE void rd_heap_set (rd_heap_t *rh, int idx,
+                                   rd_heap_node_t *rhn) {
+        rh->rh_nodes[idx] = rhn;
+        rhn->rhn_idx = idx;
+}
+
+/**
+ * Move node at 'idx' towards the root until its parent is not higher.
+ */
+static void rd_heap_sift_up (rd_heap_t *rh, int idx) {
+        rd_heap_node_t *rhn = rh->rh_nodes[idx];
+
+        while (idx > 1 && RD_HEAP_LT(rh, rhn, rh->rh_nodes[idx / 2])) {
+                rd_heap_set(rh, idx, rh->rh_nodes[idx / 2]);
+                idx /= 2;
+        }
+
+        rd_heap_set(rh, idx, rhn);
+}
+
+/**
+ * Move node at 'idx' towards the leaves until no child is lower.
+ */
+static void rd_heap_sift_down (rd_heap_t *rh, int idx) {
+        rd_heap_node_t *rhn = rh->rh_nodes[idx];
+
+        while (idx * 2 <= rh->rh_cnt) {
+                int child = idx * 2;
+
+                if (child < rh->rh_cnt &&
+                    RD_HEAP_LT(rh, rh->rh_nodes[child + 1],
+                               rh->rh_nodes[child]))
+                        child++;
+
+                if (!RD_HEAP_LT(rh, rh->rh_nodes[child], rhn))
+                        break;
+
+                rd_heap_set(rh, idx, rh->rh_nodes[child]);
+                idx = child;
+        }
+
+        rd_heap_set(rh, idx, rhn);
+}
+
+
+void rd_heap_insert (rd_heap_t *rh, void *elm, rd_heap_node_t *rhn) {
+        rd_assert(!rhn->rhn_idx);
+
+        if (rh->rh_cnt + 1 >= rh->rh_size) {
+                rh->rh_size = rh->rh_size ? rh->rh_size * 2 : 16;
+                rh->rh_nodes = rd_realloc(rh->rh_nodes,
+                                          sizeof(*rh->rh_nodes) *
+                                          rh->rh_size);
+        }
+
+        rhn->rhn_elm = elm;
+        rh->rh_cnt++;
+        rd_heap_set(rh, rh->rh_cnt, rhn);
+        rd_heap_sift_up(rh, rh->rh_cnt);
+}
+
+
+void rd_heap_remove (rd_heap_t *rh, rd_heap_node_t *rhn) {
+        int idx = rhn->rhn_idx;
+        rd_heap_node_t *last;
+
+        rd_assert(idx > 0 && idx <= rh->rh_cnt && rh->rh_nodes[idx] == rhn);
+
+        rhn->rhn_idx = 0;
+        last = rh->rh_nodes[rh->rh_cnt--];
+        if (last == rhn)
+                return;
+
+        /* Move the last node to the vacated position */
+        rd_heap_set(rh, idx, last);
+        rd_heap_update(rh, last);
+}
+
+
+void rd_heap_update (rd_heap_t *rh, rd_heap_node_t *rhn) {
+        int idx = rhn->rhn_idx;
+
+        rd_assert(idx > 0 && idx <= rh->rh_cnt);
+
+        if (idx > 1 && RD_HEAP_LT(rh, rhn, rh->rh_nodes[idx / 2]))
+                rd_heap_sift_up(rh, idx);
+        else
+                rd_heap_sift_down(rh, idx);
+}
+
+
+void rd_heap_init (rd_heap_t *rh, rd_heap_cmp_t cmp) {
+        memset(rh, 0, sizeof(*rh));
+        rh->rh_cmp = cmp;
+}
+
+/**
+ * Destroy heap, the elements are not touched.
+ */
+void rd_heap_destroy (rd_heap_t *rh) {
+        if (rh->rh_nodes)
+                rd_free(rh->rh_nodes);
+        memset(rh, 0, sizeof(*rh));
+}
+
+
+
+/**
+ * @name Unit tests
+ */
+
+struct ut_heap_elm {
+        rd_heap_node_t node;
+        int            val;
+};
+
+static int ut_heap_elm_cmp (const void *_a, const void *_b) {
+        const struct ut_heap_elm *a = _a, *b = _b;
+        return a->val - b->val;
+}
+
+/**
+ * @brief Insert elements in random order, change and remove some of
+ *        them, and verify they are popped in order.
+ */
+int unittest_rdheap (void) {
+        const int cnt = 10000;
+        struct ut_heap_elm *elms;
+        rd_heap_t rh;
+        int i, prev = -1, popped = 0;
+
+        elms = rd_calloc(cnt, sizeof(*elms));
+        rd_heap_init(&rh, ut_heap_elm_cmp);
+
+        for (i = 0 ; i < cnt ; i++) {
+                elms[i].val = rd_jitter(0, cnt);
+                RD_HEAP_INSERT(&rh, &elms[i], node);
+        }
+        RD_UT_ASSERT(RD_HEAP_CNT(&rh) == cnt,
+                     "expected %d elements, not %d", cnt, RD_HEAP_CNT(&rh));
+
+        /* Remove every third, and change the value of every fifth */
+        for (i = 0 ; i < cnt ; i++) {
+                if (!(i % 3))
+                        RD_HEAP_REMOVE(&rh, &elms[i], node);
+                else if (!(i % 5)) {
+                        elms[i].val = rd_jitter(0, cnt);
+                        RD_HEAP_UPDATE(&rh, &elms[i], node);
+                }
+        }
+
+        while (RD_HEAP_FIRST(&rh)) {
+                struct ut_heap_elm *elm = RD_HEAP_FIRST(&rh);
+
+                RD_UT_ASSERT(elm->val >= prev,
+                             "element %d popped after %d", elm->val, prev);
+                prev = elm->val;
+                RD_HEAP_REMOVE(&rh, elm, node);
+                RD_UT_ASSERT(!RD_HEAP_IN(elm, node),
+                             "element still in heap after removal");
+                popped++;
+        }
+
+        RD_UT_ASSERT(popped == cnt - (cnt + 2) / 3,
+                     "expected %d popped elements, not %d",
+                     cnt - (cnt + 2) / 3, popped);
+
+        rd_heap_destroy(&rh);
+        rd_free(elms);
+
+        RD_UT_PASS();
+}
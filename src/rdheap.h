@@ -0,0 +1,123 @@
+/*
+ * librd - Rapid Development C library
+ *
+ * Copyright (c) 2018, Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+/*
+ * Binary min-heap of application elements.
+ */
+
+#ifndef _RDHEAP_H_
+#define _RDHEAP_H_
+
+
+/**
+ * Heap node.
+ * Add 'rd_heap_node_t ..' as field to your element's struct and
+ * provide it as the 'field' argument in the API below.
+ * The node must be zero-initialized.
+ */
+typedef struct rd_heap_node_s {
+        int   rhn_idx;   /* 1-based index in rh_nodes, or 0 if not
+                          * in a heap. */
+        void *rhn_elm;   /* Backpointer to the containing element */
+} rd_heap_node_t;
+
+
+/**
+ * Per-heap application-provided element comparator.
+ * The first element of the heap is the lowest one.
+ */
+typedef int (*rd_heap_cmp_t) (const void *, const void *);
+
+
+/**
+ * Heap.
+ * Not thread-safe: the application provides its own locking.
+ */
+typedef struct rd_heap_s {
+        rd_heap_node_t **rh_nodes;  /* rh_nodes[1..rh_cnt] */
+        int              rh_cnt;    /* Number of elements */
+        int              rh_size;   /* Allocated size of rh_nodes */
+        rd_heap_cmp_t    rh_cmp;    /* Comparator */
+} rd_heap_t;
+
+
+
+/**
+ *
+ *
+ * Public API
+ *
+ *
+ */
+
+/**
+ * Insert 'elm' in heap, it must not already be in a heap.
+ */
+#define RD_HEAP_INSERT(rh,elm,field)            \
+        rd_heap_insert(rh, elm, &(elm)->field)
+
+/**
+ * Remove 'elm' from heap, it must be in the heap.
+ */
+#define RD_HEAP_REMOVE(rh,elm,field)            \
+        rd_heap_remove(rh, &(elm)->field)
+
+/**
+ * Restore the position of 'elm' in the heap after its value
+ * (as seen by the comparator) has changed.
+ */
+#define RD_HEAP_UPDATE(rh,elm,field)            \
+        rd_heap_update(rh, &(elm)->field)
+
+/**
+ * Returns true if 'elm' is in a heap.
+ */
+#define RD_HEAP_IN(elm,field)  ((elm)->field.rhn_idx != 0)
+
+/**
+ * Returns the lowest element in the heap, or NULL if empty.
+ */
+#define RD_HEAP_FIRST(rh)                               \
+        ((rh)->rh_cnt > 0 ? (rh)->rh_nodes[1]->rhn_elm : NULL)
+
+#define RD_HEAP_CNT(rh)  ((rh)->rh_cnt)
+
+
+
+void rd_heap_insert (rd_heap_t *rh, void *elm, rd_heap_node_t *rhn);
+void rd_heap_remove (rd_heap_t *rh, rd_heap_node_t *rhn);
+void rd_heap_update (rd_heap_t *rh, rd_heap_node_t *rhn);
+
+void rd_heap_init (rd_heap_t *rh, rd_heap_cmp_t cmp);
+void rd_heap_destroy (rd_heap_t *rh);
+
+int unittest_rdheap (void);
+
+#endif /* _RDHEAP_H_ */
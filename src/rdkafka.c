@@ -89,6 +89,11 @@ int rd_kafka_thread_cnt (void) {
 	return rd_atomic32_get(&rd_kafka_thread_cnt_curr);
 }
 
+/**
+ * Process-wide consumer prefetch accounting.
+ */
+struct rd_kafka_fetchq_global_s rd_kafka_fetchq_global;
+
 /**
  * Current thread's log name (TLS)
  */
@@ -132,7 +137,10 @@ static void rd_kafka_global_init (void) {
 #if ENABLE_DEVEL
 	rd_atomic32_init(&rd_kafka_op_cnt, 0);
 #endif
+        rd_atomic64_init(&rd_kafka_fetchq_global.bytes, 0);
+        rd_atomic32_init(&rd_kafka_fetchq_global.fetch_cnt, 0);
         crc32c_global_init();
+        rd_crc32_global_init();
 }
 
 /**
@@ -537,6 +545,12 @@ static const struct rd_kafka_err_desc rd_kafka_err_descs[] = {
                   "Broker: Security features are disabled"),
         _ERR_DESC(RD_KAFKA_RESP_ERR_OPERATION_NOT_ATTEMPTED,
                   "Broker: Operation not attempted"),
+        _ERR_DESC(RD_KAFKA_RESP_ERR_FETCH_SESSION_ID_NOT_FOUND,
+                  "Broker: Fetch session ID not found"),
+        _ERR_DESC(RD_KAFKA_RESP_ERR_INVALID_FETCH_SESSION_EPOCH,
+                  "Broker: Invalid fetch session epoch"),
+        _ERR_DESC(RD_KAFKA_RESP_ERR_UNSUPPORTED_COMPRESSION_TYPE,
+                  "Broker: Unsupported compression type"),
 
 	_ERR_DESC(RD_KAFKA_RESP_ERR__END, NULL)
 };
@@ -632,6 +646,14 @@ void rd_kafka_destroy_final (rd_kafka_t *rk) {
 
         rd_kafka_metadata_cache_destroy(rk);
 
+        rd_avl_destroy(&rk->rk_topic_avl);
+
+        rd_kafka_assert(rk, RD_HEAP_CNT(&rk->rk_msgq_tmout.heap) == 0);
+        rd_heap_destroy(&rk->rk_msgq_tmout.heap);
+        mtx_destroy(&rk->rk_msgq_tmout.lock);
+
+        rd_kafka_stats_bin_obj_destroy(&rk->rk_stats_bin.obj);
+
         rd_kafka_timers_destroy(&rk->rk_timers);
 
         rd_kafka_dbg(rk, GENERIC, "TERMINATE", "Destroying op queues");
@@ -670,6 +692,9 @@ void rd_kafka_destroy_final (rd_kafka_t *rk) {
 		mtx_destroy(&rk->rk_curr_msgs.lock);
 	}
 
+        if (rk->rk_msgpool)
+                rd_kafka_msgpool_destroy(rk->rk_msgpool);
+
 	cnd_destroy(&rk->rk_broker_state_change_cnd);
 	mtx_destroy(&rk->rk_broker_state_change_lock);
 
@@ -772,6 +797,10 @@ static void rd_kafka_destroy_internal (rd_kafka_t *rk) {
         /* List of (broker) threads to join to synchronize termination */
         rd_list_init(&wait_thrds, rd_atomic32_get(&rk->rk_broker_cnt), NULL);
 
+        /* Release partitions awaiting message timeout scans,
+         * no new ones are added once terminating. */
+        rd_kafka_toppar_msgq_tmout_clear(rk);
+
 	rd_kafka_wrlock(rk);
 
         rd_kafka_dbg(rk, ALL, "DESTROY", "Removing all topics");
@@ -786,10 +815,14 @@ static void rd_kafka_destroy_internal (rd_kafka_t *rk) {
          * Broker thread holds a refcount and detects when broker refcounts
          * reaches 1 and then decommissions itself. */
         TAILQ_FOREACH_SAFE(rkb, &rk->rk_brokers, rkb_link, rkb_tmp) {
-                /* Add broker's thread to wait_thrds list for later joining */
-                thrd = malloc(sizeof(*thrd));
-                *thrd = rkb->rkb_thread;
-                rd_list_add(&wait_thrds, thrd);
+                /* Add broker's thread to wait_thrds list for later joining,
+                 * brokers served by IO threads are waited for
+                 * by rd_kafka_reactor_destroy() instead. */
+                if (!rk->rk_reactor) {
+                        thrd = malloc(sizeof(*thrd));
+                        *thrd = rkb->rkb_thread;
+                        rd_list_add(&wait_thrds, thrd);
+                }
                 rd_kafka_wrunlock(rk);
 
                 /* Send op to trigger queue/io wake-up.
@@ -799,7 +832,7 @@ static void rd_kafka_destroy_internal (rd_kafka_t *rk) {
 
 #ifndef _MSC_VER
                 /* Interrupt IO threads to speed up termination. */
-                if (rk->rk_conf.term_sig)
+                if (rk->rk_conf.term_sig && !rk->rk_reactor)
 			pthread_kill(rkb->rkb_thread, rk->rk_conf.term_sig);
 #endif
 
@@ -833,9 +866,11 @@ static void rd_kafka_destroy_internal (rd_kafka_t *rk) {
                                rd_kafka_op_new(RD_KAFKA_OP_TERMINATE));
 
                 rk->rk_internal_rkb = NULL;
-                thrd = malloc(sizeof(*thrd));
-                *thrd = rkb->rkb_thread;
-                rd_list_add(&wait_thrds, thrd);
+                if (!rk->rk_reactor) {
+                        thrd = malloc(sizeof(*thrd));
+                        *thrd = rkb->rkb_thread;
+                        rd_list_add(&wait_thrds, thrd);
+                }
         }
         mtx_unlock(&rk->rk_internal_rkb_lock);
 	if (rkb)
@@ -853,6 +888,22 @@ static void rd_kafka_destroy_internal (rd_kafka_t *rk) {
         }
 
         rd_list_destroy(&wait_thrds);
+
+        /* Join IO threads, they exit when all their brokers have
+         * been decommissioned. */
+        if (rk->rk_reactor) {
+                rd_kafka_dbg(rk, GENERIC, "TERMINATE",
+                             "Join broker IO thread(s)");
+                rd_kafka_reactor_destroy(rk->rk_reactor);
+                rk->rk_reactor = NULL;
+        }
+
+        /* Broker threads wait for their offloaded jobs to finish,
+         * so the worker pool is idle by now. */
+        if (rk->rk_offload) {
+                rd_kafka_offload_destroy(rk->rk_offload);
+                rk->rk_offload = NULL;
+        }
 }
 
 /**
@@ -894,11 +945,12 @@ struct _stats_total {
 
 
 /**
- * @brief Rollover and emit an average window.
+ * @brief Rollover and emit an average window, followed by \p sep.
  */
-static RD_INLINE void rd_kafka_stats_emit_avg (struct _stats_emit *st,
-                                               const char *name,
-                                               rd_avg_t *src_avg) {
+static RD_INLINE void rd_kafka_stats_emit_avg0 (struct _stats_emit *st,
+                                                const char *name,
+                                                rd_avg_t *src_avg,
+                                                const char *sep) {
         rd_avg_t avg;
 
         rd_avg_rollover(&avg, src_avg);
@@ -918,7 +970,7 @@ static RD_INLINE void rd_kafka_stats_emit_avg (struct _stats_emit *st,
                 " \"outofrange\": %"PRId64","
                 " \"hdrsize\": %"PRId32","
                 " \"cnt\":%i "
-                "}, ",
+                "}%s",
                 name,
                 avg.ra_v.minv,
                 avg.ra_v.maxv,
@@ -933,10 +985,14 @@ static RD_INLINE void rd_kafka_stats_emit_avg (struct _stats_emit *st,
                 avg.ra_hist.p99_99,
                 avg.ra_hist.oor,
                 avg.ra_hist.hdrsize,
-                avg.ra_v.cnt);
+                avg.ra_v.cnt,
+                sep);
         rd_avg_destroy(&avg);
 }
 
+#define rd_kafka_stats_emit_avg(st,name,src_avg)                \
+        rd_kafka_stats_emit_avg0(st, name, src_avg, ", ")
+
 /**
  * Emit stats for toppar
  */
@@ -950,6 +1006,7 @@ static RD_INLINE void rd_kafka_stats_emit_toppar (struct _stats_emit *st,
         int32_t leader_nodeid = -1;
 
         rd_kafka_toppar_lock(rktp);
+        rd_kafka_toppar_ingress_drain(rktp);
 
         if (rktp->rktp_leader) {
                 rd_kafka_broker_lock(rktp->rktp_leader);
@@ -980,7 +1037,9 @@ static RD_INLINE void rd_kafka_stats_emit_toppar (struct _stats_emit *st,
 		   "\"xmit_msgq_bytes\":%"PRIusz", "
 		   "\"fetchq_cnt\":%i, "
 		   "\"fetchq_size\":%"PRIu64", "
+		   "\"fetchq_bytes\":%"PRId64", "
 		   "\"fetch_state\":\"%s\", "
+		   "\"fetch_size\":%"PRId32", "
 		   "\"query_offset\":%"PRId64", "
 		   "\"next_offset\":%"PRId64", "
 		   "\"app_offset\":%"PRId64", "
@@ -995,9 +1054,7 @@ static RD_INLINE void rd_kafka_stats_emit_toppar (struct _stats_emit *st,
 		   "\"txbytes\":%"PRIu64", "
                    "\"rxmsgs\":%"PRIu64", "
                    "\"rxbytes\":%"PRIu64", "
-                   "\"msgs\": %"PRIu64", "
-                   "\"rx_ver_drops\": %"PRIu64" "
-		   "} ",
+                   "\"msgs\": %"PRIu64", ",
 		   first ? "" : ", ",
 		   rktp->rktp_partition,
 		   rktp->rktp_partition,
@@ -1011,7 +1068,9 @@ static RD_INLINE void rd_kafka_stats_emit_toppar (struct _stats_emit *st,
                    (size_t)0,
 		   rd_kafka_q_len(rktp->rktp_fetchq),
 		   rd_kafka_q_size(rktp->rktp_fetchq),
+                   rd_atomic64_get(&rktp->rktp_fetchq_bytes),
 		   rd_kafka_fetch_states[rktp->rktp_fetch_state],
+                   rktp->rktp_fetch_msg_max_bytes,
 		   rktp->rktp_query_offset,
                    offs.fetch_offset,
 		   rktp->rktp_app_offset,
@@ -1028,7 +1087,17 @@ static RD_INLINE void rd_kafka_stats_emit_toppar (struct _stats_emit *st,
                    rd_atomic64_get(&rktp->rktp_c.rx_msg_bytes),
                    rk->rk_type == RD_KAFKA_PRODUCER ?
                    rd_atomic64_get(&rktp->rktp_c.producer_enq_msgs) :
-                   rd_atomic64_get(&rktp->rktp_c.rx_msgs), /* legacy, same as rx_msgs */
+                   rd_atomic64_get(&rktp->rktp_c.rx_msgs)); /* legacy, same as rx_msgs */
+
+        rd_kafka_stats_emit_avg(st, "produce_latency",
+                                &rktp->rktp_avg_produce_latency);
+        rd_kafka_stats_emit_avg(st, "fetch_latency",
+                                &rktp->rktp_avg_fetch_latency);
+        rd_kafka_stats_emit_avg(st, "fetchq_latency",
+                                &rktp->rktp_avg_fetchq_latency);
+
+        _st_printf("\"rx_ver_drops\": %"PRIu64" "
+                   "} ",
                    rd_atomic64_get(&rktp->rktp_c.rx_ver_drops));
 
         if (total) {
@@ -1076,6 +1145,9 @@ static void rd_kafka_stats_emit_all (rd_kafka_t *rk) {
 		   "\"msg_size_max\":%"PRIusz", "
                    "\"simple_cnt\":%i, "
                    "\"metadata_cache_cnt\":%i, "
+                   "\"fetchq_bytes\":%"PRId64", "
+                   "\"fetchq_max_bytes\":%"PRId64", "
+                   "\"fetchq_process_bytes\":%"PRId64", "
 		   "\"brokers\":{ "/*open brokers*/,
                    rk->rk_name,
                    rk->rk_conf.client_id_str,
@@ -1086,11 +1158,21 @@ static void rd_kafka_stats_emit_all (rd_kafka_t *rk) {
 		   tot_cnt, tot_size,
 		   rk->rk_curr_msgs.max_cnt, rk->rk_curr_msgs.max_size,
                    rd_atomic32_get(&rk->rk_simple_cnt),
-                   rk->rk_metadata_cache.rkmc_cnt);
+                   rk->rk_metadata_cache.rkmc_cnt,
+                   rd_atomic64_get(&rk->rk_fetchq.bytes),
+                   rk->rk_conf.queued_max_total_bytes,
+                   rd_atomic64_get(&rd_kafka_fetchq_global.bytes));
 
 
 	TAILQ_FOREACH(rkb, &rk->rk_brokers, rkb_link) {
 		rd_kafka_toppar_t *rktp;
+                static const char *codec_names[] = {
+                        [RD_KAFKA_COMPRESSION_GZIP] = "gzip",
+                        [RD_KAFKA_COMPRESSION_SNAPPY] = "snappy",
+                        [RD_KAFKA_COMPRESSION_LZ4] = "lz4",
+                        [RD_KAFKA_COMPRESSION_ZSTD] = "zstd"
+                };
+                int i, first;
 
 		rd_kafka_broker_lock(rkb);
 		_st_printf("%s\"%s\": { "/*open broker*/
@@ -1114,7 +1196,8 @@ static void rd_kafka_stats_emit_all (rd_kafka_t *rk) {
                            "\"rxpartial\":%"PRIu64", "
                            "\"zbuf_grow\":%"PRIu64", "
                            "\"buf_grow\":%"PRIu64", "
-                           "\"wakeups\":%"PRIu64", ",
+                           "\"wakeups\":%"PRIu64", "
+                           "\"io_syscalls\":%"PRIu64", ",
 			   rkb == TAILQ_FIRST(&rk->rk_brokers) ? "" : ", ",
 			   rkb->rkb_name,
 			   rkb->rkb_name,
@@ -1137,13 +1220,67 @@ static void rd_kafka_stats_emit_all (rd_kafka_t *rk) {
 			   rd_atomic64_get(&rkb->rkb_c.rx_partial),
                            rd_atomic64_get(&rkb->rkb_c.zbuf_grow),
                            rd_atomic64_get(&rkb->rkb_c.buf_grow),
-                           rd_atomic64_get(&rkb->rkb_c.wakeups));
+                           rd_atomic64_get(&rkb->rkb_c.wakeups),
+                           rd_atomic64_get(&rkb->rkb_c.io_syscalls));
 
                 total.tx       += rd_atomic64_get(&rkb->rkb_c.tx);
                 total.tx_bytes += rd_atomic64_get(&rkb->rkb_c.tx_bytes);
                 total.rx       += rd_atomic64_get(&rkb->rkb_c.rx);
                 total.rx_bytes += rd_atomic64_get(&rkb->rkb_c.rx_bytes);
 
+                if (rk->rk_type == RD_KAFKA_CONSUMER)
+                        _st_printf("\"fetch\": { "
+                                   "\"full\":%"PRIu64", "
+                                   "\"incremental\":%"PRIu64", "
+                                   "\"txbytes\":%"PRIu64", "
+                                   "\"rxbytes\":%"PRIu64", "
+                                   "\"session_id\":%"PRId32", "
+                                   "\"session_epoch\":%"PRId32", "
+                                   "\"session_partitions\":%d, "
+                                   "\"session_errs\":%"PRIu64" }, ",
+                                   rd_atomic64_get(&rkb->rkb_c.fetch.full),
+                                   rd_atomic64_get(&rkb->rkb_c.fetch.
+                                                   incremental),
+                                   rd_atomic64_get(&rkb->rkb_c.fetch.
+                                                   tx_bytes),
+                                   rd_atomic64_get(&rkb->rkb_c.fetch.
+                                                   rx_bytes),
+                                   rkb->rkb_fetch_session.id,
+                                   rkb->rkb_fetch_session.epoch,
+                                   rd_list_cnt(&rkb->rkb_fetch_session.
+                                               toppars),
+                                   rd_atomic64_get(&rkb->rkb_c.fetch.
+                                                   session_err));
+
+                if (rkb->rkb_recvpool) {
+                        struct rd_kafka_recvpool_stats rps;
+                        rd_kafka_recvpool_stats(rkb->rkb_recvpool, &rps);
+                        _st_printf("\"recvpool\": { "
+                                   "\"hits\": %"PRId64", "
+                                   "\"misses\": %"PRId64", "
+                                   "\"chunk_cnt\": %"PRId64", "
+                                   "\"chunk_bytes\": %"PRId64" }, ",
+                                   rps.hits, rps.misses,
+                                   rps.chunk_cnt, rps.chunk_bytes);
+                }
+
+                _st_printf("\"decompress\": { "/*open decompress*/);
+                for (i = RD_KAFKA_COMPRESSION_GZIP ;
+                     i < RD_KAFKA_COMPRESSION_INHERIT ; i++)
+                        _st_printf("%s\"%s\": { "
+                                   "\"cnt\":%"PRIu64", "
+                                   "\"bytes\":%"PRIu64", "
+                                   "\"us\":%"PRIu64" } ",
+                                   i == RD_KAFKA_COMPRESSION_GZIP ? "" : ", ",
+                                   codec_names[i],
+                                   rd_atomic64_get(&rkb->rkb_c.
+                                                   decompress[i].cnt),
+                                   rd_atomic64_get(&rkb->rkb_c.
+                                                   decompress[i].bytes),
+                                   rd_atomic64_get(&rkb->rkb_c.
+                                                   decompress[i].us));
+                _st_printf("}, "/*close decompress*/);
+
                 rd_kafka_stats_emit_avg(st, "int_latency",
                                         &rkb->rkb_avg_int_latency);
                 rd_kafka_stats_emit_avg(st, "outbuf_latency",
@@ -1151,6 +1288,23 @@ static void rd_kafka_stats_emit_all (rd_kafka_t *rk) {
                 rd_kafka_stats_emit_avg(st, "rtt", &rkb->rkb_avg_rtt);
                 rd_kafka_stats_emit_avg(st, "throttle", &rkb->rkb_avg_throttle);
 
+                /* Per-ApiKey RTT, for the ApiKeys tracked.
+                 * ra_enabled is constant after rd_kafka_broker_add(). */
+                _st_printf("\"rtt_api\":{ "/*open rtt_api*/);
+                for (i = 0, first = 1 ; i < RD_KAFKAP__NUM ; i++) {
+                        if (!rkb->rkb_avg_rtt_api[i].ra_enabled)
+                                continue;
+                        if (!first)
+                                _st_printf(", ");
+                        first = 0;
+                        rd_kafka_stats_emit_avg0(st,
+                                                 rd_kafka_ApiKey2str(
+                                                         (int16_t)i),
+                                                 &rkb->rkb_avg_rtt_api[i],
+                                                 " ");
+                }
+                _st_printf("}, "/*close rtt_api*/);
+
                 _st_printf("\"toppars\":{ "/*open toppars*/);
 
 		TAILQ_FOREACH(rktp, &rkb->rkb_toppars, rktp_rkblink) {
@@ -1233,6 +1387,18 @@ static void rd_kafka_stats_emit_all (rd_kafka_t *rk) {
                            rkcg->rkcg_c.rebalance_cnt,
                            rkcg->rkcg_c.assignment_size);
         }
+
+        if (rk->rk_msgpool) {
+                struct rd_kafka_msgpool_stats mps;
+                rd_kafka_msgpool_stats(rk->rk_msgpool, &mps);
+                _st_printf(", \"msgpool\": { "
+                           "\"hits\": %"PRId64", "
+                           "\"misses\": %"PRId64", "
+                           "\"slab_cnt\": %"PRId64", "
+                           "\"slab_bytes\": %"PRId64" }",
+                           mps.hits, mps.misses,
+                           mps.slab_cnt, mps.slab_bytes);
+        }
 	rd_kafka_rdunlock(rk);
 
         /* Total counters */
@@ -1274,7 +1440,12 @@ static void rd_kafka_topic_scan_tmr_cb (rd_kafka_timers_t *rkts, void *arg) {
 
 static void rd_kafka_stats_emit_tmr_cb (rd_kafka_timers_t *rkts, void *arg) {
         rd_kafka_t *rk = rkts->rkts_rk;
-	rd_kafka_stats_emit_all(rk);
+        if (rk->rk_conf.stats_format & RD_KAFKA_STATS_FMT_JSON)
+                rd_kafka_stats_emit_all(rk);
+        /* Binary stats are only served through the stats_binary_cb */
+        if ((rk->rk_conf.stats_format & RD_KAFKA_STATS_FMT_BINARY) &&
+            rk->rk_conf.stats_binary_cb)
+                rd_kafka_stats_emit_binary(rk);
 }
 
 
@@ -1384,6 +1555,7 @@ rd_kafka_t *rd_kafka_new (rd_kafka_type_t type, rd_kafka_conf_t *app_conf,
         rd_kafka_conf_t *conf;
         rd_kafka_resp_err_t ret_err = RD_KAFKA_RESP_ERR_NO_ERROR;
         int ret_errno = 0;
+        int offload_thread_cnt;
 #ifndef _MSC_VER
         sigset_t newset, oldset;
 #endif
@@ -1485,6 +1657,8 @@ rd_kafka_t *rd_kafka_new (rd_kafka_type_t type, rd_kafka_conf_t *app_conf,
 	mtx_init(&rk->rk_broker_state_change_lock, mtx_plain);
 
 	rk->rk_rep = rd_kafka_q_new(rk);
+        if (rk->rk_conf.lockfree_queues & RD_KAFKA_LOCKFREE_Q_MAIN)
+                rd_kafka_q_lockfree_enable(rk->rk_rep);
 	rk->rk_ops = rd_kafka_q_new(rk);
         rk->rk_ops->rkq_serve = rd_kafka_poll_cb;
         rk->rk_ops->rkq_opaque = rk;
@@ -1497,6 +1671,9 @@ rd_kafka_t *rd_kafka_new (rd_kafka_type_t type, rd_kafka_conf_t *app_conf,
 
 	TAILQ_INIT(&rk->rk_brokers);
 	TAILQ_INIT(&rk->rk_topics);
+        rd_avl_init(&rk->rk_topic_avl, rd_kafka_topic_cmp_rkt, 0);
+        mtx_init(&rk->rk_msgq_tmout.lock, mtx_plain);
+        rd_heap_init(&rk->rk_msgq_tmout.heap, rd_kafka_toppar_cmp_msgq_tmout);
         rd_kafka_timers_init(&rk->rk_timers, rk);
         rd_kafka_metadata_cache_init(rk);
 
@@ -1526,6 +1703,10 @@ rd_kafka_t *rd_kafka_new (rd_kafka_type_t type, rd_kafka_conf_t *app_conf,
         /* Config fixups */
         rk->rk_conf.queued_max_msg_bytes =
                 (int64_t)rk->rk_conf.queued_max_msg_kbytes * 1000ll;
+        rk->rk_conf.queued_max_total_bytes =
+                (int64_t)rk->rk_conf.queued_max_total_kbytes * 1000ll;
+        rk->rk_conf.queued_max_process_bytes =
+                (int64_t)rk->rk_conf.queued_max_process_kbytes * 1000ll;
 
 	/* Enable api.version.request=true if fallback.broker.version
 	 * indicates a supporting broker. */
@@ -1543,8 +1724,14 @@ rd_kafka_t *rd_kafka_new (rd_kafka_type_t type, rd_kafka_conf_t *app_conf,
                 else
                         rk->rk_curr_msgs.max_size =
                         (size_t)rk->rk_conf.queue_buffering_max_kbytes * 1024;
+
+                if (rk->rk_conf.msg_pool_enable)
+                        rk->rk_msgpool = rd_kafka_msgpool_new();
 	}
 
+        rd_atomic64_init(&rk->rk_fetchq.bytes, 0);
+        rd_atomic32_init(&rk->rk_fetchq.fetch_cnt, 0);
+
         if (rd_kafka_assignors_init(rk, errstr, errstr_size) == -1) {
                 ret_err = RD_KAFKA_RESP_ERR__INVALID_ARG;
                 ret_errno = EINVAL;
@@ -1600,6 +1787,38 @@ rd_kafka_t *rd_kafka_new (rd_kafka_type_t type, rd_kafka_conf_t *app_conf,
         pthread_sigmask(SIG_SETMASK, &newset, &oldset);
 #endif
 
+        /* Create compression (producer) or decompression (consumer)
+         * worker threads (with all signals blocked) */
+        offload_thread_cnt = rk->rk_type == RD_KAFKA_PRODUCER ?
+                rk->rk_conf.compression_threads :
+                rk->rk_conf.decompression_threads;
+        if (offload_thread_cnt > 0 &&
+            !(rk->rk_offload =
+              rd_kafka_offload_new(rk, offload_thread_cnt,
+                                   errstr, errstr_size))) {
+                ret_err = RD_KAFKA_RESP_ERR__CRIT_SYS_RESOURCE;
+                ret_errno = errno;
+#ifndef _MSC_VER
+                /* Restore sigmask of caller */
+                pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+#endif
+                goto fail;
+        }
+
+        /* Create broker IO threads (with all signals blocked) */
+        if (rk->rk_conf.broker_io_threads > 0 &&
+            !(rk->rk_reactor =
+              rd_kafka_reactor_new(rk, rk->rk_conf.broker_io_threads,
+                                   errstr, errstr_size))) {
+                ret_err = RD_KAFKA_RESP_ERR__INVALID_ARG;
+                ret_errno = EINVAL;
+#ifndef _MSC_VER
+                /* Restore sigmask of caller */
+                pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+#endif
+                goto fail;
+        }
+
 	/* Lock handle here to synchronise state, i.e., hold off
 	 * the thread until we've finalized the handle. */
 	rd_kafka_wrlock(rk);
@@ -2004,6 +2223,7 @@ rd_kafka_consume_cb (rd_kafka_t *rk,
 	rkmessage = rd_kafka_message_get(rko);
 
 	rd_kafka_op_offset_store(rk, rko, rkmessage);
+        rd_kafka_op_fetchq_latency_add(rko);
 
 	ctx->consume_cb(rkmessage, ctx->opaque);
 
@@ -2131,6 +2351,7 @@ static rd_kafka_message_t *rd_kafka_consume0 (rd_kafka_t *rk,
 
 	/* Store offset */
 	rd_kafka_op_offset_store(rk, rko, rkmessage);
+        rd_kafka_op_fetchq_latency_add(rko);
 
 	rd_kafka_set_last_error(0, 0);
 
@@ -2174,6 +2395,175 @@ rd_kafka_message_t *rd_kafka_consume_queue (rd_kafka_queue_t *rkqu,
 }
 
 
+rd_kafka_recordbatch_t *
+rd_kafka_consume_recordbatch_queue (rd_kafka_queue_t *rkqu, int timeout_ms) {
+        rd_kafka_t *rk = rkqu->rkqu_rk;
+        rd_kafka_q_t *rkq = rkqu->rkqu_q;
+        rd_kafka_op_t *rko;
+        rd_ts_t abs_timeout = rd_timeout_init(timeout_ms);
+
+        rd_kafka_yield_thread = 0;
+        while ((rko = rd_kafka_q_pop_batch(rkq,
+                                           rd_timeout_remains(abs_timeout),
+                                           0))) {
+                rd_kafka_op_res_t res;
+
+                if (rko->rko_type == RD_KAFKA_OP_FETCH_BATCH)
+                        break;
+
+                res = rd_kafka_poll_cb(rk, rkq, rko,
+                                       RD_KAFKA_Q_CB_RETURN, NULL);
+
+                if (res == RD_KAFKA_OP_RES_PASS)
+                        break;
+
+                if (unlikely(res == RD_KAFKA_OP_RES_YIELD ||
+                             rd_kafka_yield_thread)) {
+                        rd_kafka_set_last_error(RD_KAFKA_RESP_ERR__INTR,
+                                                EINTR);
+                        return NULL;
+                }
+        }
+
+        if (!rko) {
+                rd_kafka_set_last_error(RD_KAFKA_RESP_ERR__TIMED_OUT,
+                                        ETIMEDOUT);
+                return NULL;
+        }
+
+        rd_kafka_assert(rk,
+                        rko->rko_type == RD_KAFKA_OP_FETCH_BATCH ||
+                        rko->rko_type == RD_KAFKA_OP_FETCH ||
+                        rko->rko_type == RD_KAFKA_OP_CONSUMER_ERR);
+
+        if (rko->rko_type == RD_KAFKA_OP_FETCH_BATCH) {
+                /* Set up the embedded message once, it is then
+                 * pointed to each record in turn by .._message_next() */
+                rd_kafka_msg_t *rkm = &rko->rko_u.fetch_batch.rkm;
+                rd_kafka_toppar_t *rktp = rd_kafka_toppar_s2i(rko->rko_rktp);
+
+                rkm->rkm_rkmessage.rkt = rd_kafka_topic_keep_a(rktp->rktp_rkt);
+                rkm->rkm_rkmessage.partition = rktp->rktp_partition;
+                rkm->rkm_rkmessage._private  = rko;
+
+                /* Skip records already materialized by another
+                 * consume call on the same queue. */
+                if (unlikely(rko->rko_u.fetch_batch.next > 0)) {
+                        rko->rko_u.fetch_batch.cnt -=
+                                rko->rko_u.fetch_batch.next;
+                        memmove(rko->rko_u.fetch_batch.recs,
+                                rko->rko_u.fetch_batch.recs +
+                                rko->rko_u.fetch_batch.next,
+                                sizeof(*rko->rko_u.fetch_batch.recs) *
+                                rko->rko_u.fetch_batch.cnt);
+                        rko->rko_u.fetch_batch.next = 0;
+                }
+        }
+
+        rd_kafka_op_fetchq_latency_add(rko);
+
+        rd_kafka_set_last_error(0, 0);
+
+        return rko;
+}
+
+
+const char *rd_kafka_recordbatch_topic (const rd_kafka_recordbatch_t *rkrb) {
+        if (!rkrb->rko_rktp)
+                return NULL;
+        return rd_kafka_toppar_s2i(rkrb->rko_rktp)->rktp_rkt->
+                rkt_topic->str;
+}
+
+int32_t rd_kafka_recordbatch_partition (const rd_kafka_recordbatch_t *rkrb) {
+        if (!rkrb->rko_rktp)
+                return RD_KAFKA_PARTITION_UA;
+        return rd_kafka_toppar_s2i(rkrb->rko_rktp)->rktp_partition;
+}
+
+int64_t rd_kafka_recordbatch_base_offset (const rd_kafka_recordbatch_t *rkrb) {
+        switch (rkrb->rko_type)
+        {
+        case RD_KAFKA_OP_FETCH_BATCH:
+                return rkrb->rko_u.fetch_batch.recs[0].offset;
+        case RD_KAFKA_OP_FETCH:
+                return rkrb->rko_u.fetch.rkm.rkm_offset;
+        default:
+                return rkrb->rko_u.err.offset;
+        }
+}
+
+size_t rd_kafka_recordbatch_message_count (const rd_kafka_recordbatch_t *rkrb) {
+        if (rkrb->rko_type == RD_KAFKA_OP_FETCH_BATCH)
+                return (size_t)rkrb->rko_u.fetch_batch.cnt;
+        return 1;
+}
+
+rd_kafka_resp_err_t
+rd_kafka_recordbatch_error (const rd_kafka_recordbatch_t *rkrb) {
+        return rkrb->rko_err;
+}
+
+const rd_kafka_message_t *
+rd_kafka_recordbatch_message_next (rd_kafka_recordbatch_t *rkrb) {
+        const rd_kafka_fetch_rec_t *rec;
+        rd_kafka_msg_t *rkm;
+        rd_kafka_itopic_t *rkt;
+
+        if (rkrb->rko_type != RD_KAFKA_OP_FETCH_BATCH) {
+                /* Single message (or error) batch:
+                 * use the op's own message. */
+                if (rkrb->rko_flags & RD_KAFKA_OP_F_ITERATED)
+                        return NULL;
+                rkrb->rko_flags |= RD_KAFKA_OP_F_ITERATED;
+                return rd_kafka_message_get(rkrb);
+        }
+
+        if (rkrb->rko_u.fetch_batch.next == rkrb->rko_u.fetch_batch.cnt)
+                return NULL;
+
+        rec = &rkrb->rko_u.fetch_batch.recs[rkrb->rko_u.fetch_batch.next++];
+        rkm = &rkrb->rko_u.fetch_batch.rkm;
+
+        /* Headers of the previous record are parsed on demand
+         * and owned by the batch. */
+        if (rkm->rkm_headers) {
+                rd_kafka_headers_destroy(rkm->rkm_headers);
+                rkm->rkm_headers = NULL;
+        }
+
+        rkm->rkm_rkmessage.offset  = rec->offset;
+        rkm->rkm_rkmessage.key     = (void *)rec->key;
+        rkm->rkm_rkmessage.key_len = (size_t)rec->key_len;
+        rkm->rkm_rkmessage.payload = (void *)rec->value;
+        rkm->rkm_rkmessage.len     = (size_t)rec->value_len;
+        rkm->rkm_u.consumer.binhdrs.len  = rec->hdrs_len;
+        rkm->rkm_u.consumer.binhdrs.data = rec->hdrs;
+        rkm->rkm_timestamp = rec->timestamp;
+        rkm->rkm_tstype    = rec->tstype;
+
+        rkt = rd_kafka_topic_a2i(rkm->rkm_rkmessage.rkt);
+        rd_kafka_interceptors_on_consume(rkt->rkt_rk, &rkm->rkm_rkmessage);
+
+        return &rkm->rkm_rkmessage;
+}
+
+void rd_kafka_recordbatch_destroy (rd_kafka_recordbatch_t *rkrb) {
+        /* Store the offset of the last message handed to the application */
+        if (rkrb->rko_type == RD_KAFKA_OP_FETCH_BATCH) {
+                if (rkrb->rko_u.fetch_batch.next > 0)
+                        rd_kafka_op_offset_store(
+                                NULL, rkrb,
+                                &rkrb->rko_u.fetch_batch.rkm.rkm_rkmessage);
+        } else if (rkrb->rko_type == RD_KAFKA_OP_FETCH &&
+                   (rkrb->rko_flags & RD_KAFKA_OP_F_ITERATED))
+                rd_kafka_op_offset_store(NULL, rkrb,
+                                         &rkrb->rko_u.fetch.rkm.rkm_rkmessage);
+
+        rd_kafka_op_destroy(rkrb);
+}
+
+
 
 
 rd_kafka_resp_err_t rd_kafka_poll_set_consumer (rd_kafka_t *rk) {
@@ -2817,6 +3207,16 @@ rd_kafka_poll_cb (rd_kafka_t *rk, rd_kafka_q_t *rkq, rd_kafka_op_t *rko,
 			rko->rko_u.stats.json = NULL; /* Application wanted json ptr */
 		break;
 
+        case RD_KAFKA_OP_STATS_BINARY:
+                if (rk->rk_conf.stats_binary_cb &&
+                    rk->rk_conf.stats_binary_cb(rk,
+                                                rko->rko_u.stats_binary.buf,
+                                                rko->rko_u.stats_binary.size,
+                                                rk->rk_conf.opaque) == 1)
+                        rko->rko_u.stats_binary.buf = NULL; /* Application
+                                                             * wanted buf */
+                break;
+
         case RD_KAFKA_OP_LOG:
                 if (likely(rk->rk_conf.log_cb &&
                            rk->rk_conf.log_level >= rko->rko_u.log.level))
@@ -467,6 +467,12 @@ typedef enum {
         RD_KAFKA_RESP_ERR_SECURITY_DISABLED = 54,
         /** Operation not attempted */
         RD_KAFKA_RESP_ERR_OPERATION_NOT_ATTEMPTED = 55,
+        /** The fetch session ID was not found */
+        RD_KAFKA_RESP_ERR_FETCH_SESSION_ID_NOT_FOUND = 70,
+        /** The fetch session epoch is invalid */
+        RD_KAFKA_RESP_ERR_INVALID_FETCH_SESSION_EPOCH = 71,
+        /** Unsupported compression type */
+        RD_KAFKA_RESP_ERR_UNSUPPORTED_COMPRESSION_TYPE = 76,
 
 	RD_KAFKA_RESP_ERR_END_ALL,
 } rd_kafka_resp_err_t;
@@ -805,6 +811,8 @@ typedef enum rd_kafka_vtype_t {
         RD_KAFKA_VTYPE_HEADER,    /**< (const char *, const void *, ssize_t)
                                    *   Message Header */
         RD_KAFKA_VTYPE_HEADERS,   /**< (rd_kafka_headers_t *) Headers list */
+        RD_KAFKA_VTYPE_VALUE_REF, /**< (rd_kafka_payload_ref_t *) Message
+                                   *   value (payload) reference */
 } rd_kafka_vtype_t;
 
 
@@ -892,6 +900,21 @@ typedef enum rd_kafka_vtype_t {
         _LRK_TYPECHECK(RD_KAFKA_VTYPE_HEADERS, rd_kafka_headers_t *, HDRS), \
                 (rd_kafka_headers_t *)HDRS
 
+/*!
+ * Message value/payload reference (rd_kafka_payload_ref_t *).
+ * The message will hold its own reference to the payload for as long
+ * as it needs it, the application's reference is not consumed.
+ * Any RD_KAFKA_MSG_F_FREE and RD_KAFKA_MSG_F_COPY flags are ignored
+ * for referenced payloads.
+ * @sa rd_kafka_payload_ref_new()
+ * @remark RD_KAFKA_V_VALUE() and RD_KAFKA_V_VALUE_REF() MUST NOT be mixed
+ *         in the same call to producev().
+ */
+#define RD_KAFKA_V_VALUE_REF(PREF)                                      \
+        _LRK_TYPECHECK(RD_KAFKA_VTYPE_VALUE_REF,                        \
+                       rd_kafka_payload_ref_t *, PREF),                 \
+                (rd_kafka_payload_ref_t *)PREF
+
 
 /**@}*/
 
@@ -1534,6 +1557,35 @@ void rd_kafka_conf_set_stats_cb(rd_kafka_conf_t *conf,
 						  void *opaque));
 
 
+/**
+ * @brief Set binary statistics callback in provided conf object.
+ *
+ * The binary statistics callback is triggered from rd_kafka_poll() every
+ * \c statistics.interval.ms when \c statistics.format includes
+ * \c binary.
+ * Function arguments:
+ *   - \p rk - Kafka handle
+ *   - \p buf - Statistics in the compact binary format, carrying only
+ *             the values that changed since the previous emit.
+ *   - \p size - Size of \p buf.
+ *   - \p opaque - Application-provided opaque.
+ *
+ * If the application wishes to hold on to the \p buf pointer and free
+ * it at a later time it must return 1 from the \p stats_binary_cb.
+ * If the application returns 0 from the \p stats_binary_cb then
+ * librdkafka will immediately free the \p buf pointer.
+ *
+ * See STATISTICS.md for a definition of the binary format.
+ */
+RD_EXPORT
+void rd_kafka_conf_set_stats_binary_cb (rd_kafka_conf_t *conf,
+                                        int (*stats_binary_cb) (
+                                                rd_kafka_t *rk,
+                                                char *buf,
+                                                size_t size,
+                                                void *opaque));
+
+
 
 /**
  * @brief Set socket callback.
@@ -1930,6 +1982,27 @@ int32_t rd_kafka_msg_partitioner_murmur2_random (const rd_kafka_topic_t *rkt,
                                                  void *msg_opaque);
 
 
+/**
+ * @brief Sticky partitioner.
+ *
+ * Uses consistent hashing to map identical keys onto identical partitions,
+ * like the Consistent-Random partitioner, but messages without keys
+ * are all assigned to the same available partition until
+ * \c batch.num.messages or \c message.max.bytes worth of messages have
+ * been assigned to it, or \c sticky.partitioning.linger.ms expires,
+ * after which a new random available partition is picked.
+ * This yields fewer and larger batches than the random partitioner.
+ *
+ * @returns a partition between 0 and \p partition_cnt - 1.
+ */
+RD_EXPORT
+int32_t rd_kafka_msg_partitioner_sticky (const rd_kafka_topic_t *rkt,
+                                         const void *key, size_t keylen,
+                                         int32_t partition_cnt,
+                                         void *rkt_opaque,
+                                         void *msg_opaque);
+
+
 /**@}*/
 
 
@@ -2643,6 +2716,101 @@ int rd_kafka_consume_callback_queue(rd_kafka_queue_t *rkqu,
 				     void *opaque);
 
 
+/**
+ * @brief A batch of consumed messages from a single partition,
+ *        see rd_kafka_consume_recordbatch_queue().
+ */
+typedef struct rd_kafka_op_s rd_kafka_recordbatch_t;
+
+/**
+ * @brief Consume a whole batch of messages from queue.
+ *
+ * Returns all messages of a fetched MessageSet or RecordBatch of a single
+ * partition as one object, rather than one message at a time.
+ * RecordBatches of more than 4096 records are returned in multiple parts
+ * of at most 4096 messages each.
+ * The messages are read directly from the fetched buffer through
+ * rd_kafka_recordbatch_message_next().
+ *
+ * With `fetch.lazy.enable=false`, or for old-format (MsgVersion 0 and 1)
+ * MessageSets, each batch holds a single message.
+ *
+ * Errors, such as RD_KAFKA_RESP_ERR__PARTITION_EOF, are returned as a
+ * batch with a single error message, see rd_kafka_recordbatch_error().
+ *
+ * The offset of the last message returned by
+ * rd_kafka_recordbatch_message_next() is stored (if
+ * `enable.auto.offset.store=true`) when the batch is destroyed.
+ *
+ * @returns a batch that must be destroyed with
+ *          rd_kafka_recordbatch_destroy(), or NULL if \p timeout_ms was
+ *          reached with no new messages fetched.
+ *
+ * @remark on_consume() interceptors are called for each message returned
+ *         by rd_kafka_recordbatch_message_next().
+ *
+ * @sa rd_kafka_consume_batch_queue()
+ */
+RD_EXPORT
+rd_kafka_recordbatch_t *
+rd_kafka_consume_recordbatch_queue (rd_kafka_queue_t *rkqu, int timeout_ms);
+
+/**
+ * @returns the topic name of the batch, or NULL if the batch
+ *          is not related to a topic (e.g., a generic consumer error).
+ */
+RD_EXPORT
+const char *rd_kafka_recordbatch_topic (const rd_kafka_recordbatch_t *rkrb);
+
+/**
+ * @returns the partition of the batch, or RD_KAFKA_PARTITION_UA if the
+ *          batch is not related to a partition.
+ */
+RD_EXPORT
+int32_t rd_kafka_recordbatch_partition (const rd_kafka_recordbatch_t *rkrb);
+
+/**
+ * @returns the offset of the first message in the batch.
+ */
+RD_EXPORT
+int64_t rd_kafka_recordbatch_base_offset (const rd_kafka_recordbatch_t *rkrb);
+
+/**
+ * @returns the number of messages in the batch.
+ */
+RD_EXPORT
+size_t rd_kafka_recordbatch_message_count (const rd_kafka_recordbatch_t *rkrb);
+
+/**
+ * @returns the error code of an error batch, else
+ *          RD_KAFKA_RESP_ERR_NO_ERROR.
+ */
+RD_EXPORT
+rd_kafka_resp_err_t
+rd_kafka_recordbatch_error (const rd_kafka_recordbatch_t *rkrb);
+
+/**
+ * @brief Iterate over the messages of the batch.
+ *
+ * @returns the next message of the batch, or NULL when all messages
+ *          have been returned.
+ *
+ * @remark The returned message, including its headers, is owned by the
+ *         batch and is only valid until the next call to this function
+ *         or until the batch is destroyed: the application \b MUST \b NOT
+ *         call rd_kafka_message_destroy() on it.
+ */
+RD_EXPORT
+const rd_kafka_message_t *
+rd_kafka_recordbatch_message_next (rd_kafka_recordbatch_t *rkrb);
+
+/**
+ * @brief Destroy a batch returned by rd_kafka_consume_recordbatch_queue().
+ */
+RD_EXPORT
+void rd_kafka_recordbatch_destroy (rd_kafka_recordbatch_t *rkrb);
+
+
 /**@}*/
 
 
@@ -3036,7 +3204,7 @@ int rd_kafka_produce(rd_kafka_topic_t *rkt, int32_t partition,
  *
  * @returns \c RD_KAFKA_RESP_ERR_NO_ERROR on success, else an error code.
  *          \c RD_KAFKA_RESP_ERR__CONFLICT is returned if _V_HEADER and
- *          _V_HEADERS are mixed.
+ *          _V_HEADERS, or _V_VALUE and _V_VALUE_REF, are mixed.
  *
  * @sa rd_kafka_produce, RD_KAFKA_V_END
  */
@@ -3044,6 +3212,57 @@ RD_EXPORT
 rd_kafka_resp_err_t rd_kafka_producev (rd_kafka_t *rk, ...);
 
 
+/**
+ * @brief Reference counted, application owned, message payload.
+ *
+ * A payload reference allows the same application buffer to be produced
+ * to any number of topics and partitions without copying it:
+ * each produced message holds a reference to the payload and
+ * the buffer is written directly to the broker socket (zero-copy),
+ * regardless of \c message.copy.max.bytes.
+ *
+ * When the last reference is released the application's \p free_cb
+ * is called to release the payload memory.
+ *
+ * @sa RD_KAFKA_V_VALUE_REF()
+ */
+typedef struct rd_kafka_payload_ref_s rd_kafka_payload_ref_t;
+
+/**
+ * @brief Create a new payload reference for \p payload of \p len bytes
+ *        with an initial reference count of 1 held by the application.
+ *
+ * \p free_cb (if not NULL) is called with \p payload, \p len and
+ * \p opaque when the last reference is released.
+ *
+ * @remark \p free_cb may be called from any thread, including librdkafka's
+ *         internal threads, and must not call back into librdkafka.
+ * @remark The payload memory must not be modified while references exist.
+ *
+ * @returns a new payload reference which the application must release
+ *          with rd_kafka_payload_ref_destroy() when it no longer
+ *          needs it.
+ */
+RD_EXPORT rd_kafka_payload_ref_t *
+rd_kafka_payload_ref_new (void *payload, size_t len,
+                          void (*free_cb) (void *payload, size_t len,
+                                           void *opaque),
+                          void *opaque);
+
+/**
+ * @brief Acquire a new reference to \p pref.
+ * @returns \p pref
+ */
+RD_EXPORT rd_kafka_payload_ref_t *
+rd_kafka_payload_ref_keep (rd_kafka_payload_ref_t *pref);
+
+/**
+ * @brief Release a reference to \p pref, calling the \c free_cb if
+ *        this was the last reference.
+ */
+RD_EXPORT void rd_kafka_payload_ref_destroy (rd_kafka_payload_ref_t *pref);
+
+
 /**
  * @brief Produce multiple messages.
  *
@@ -332,6 +332,10 @@ void rd_kafka_broker_fail (rd_kafka_broker_t *rkb,
 	rkb->rkb_err.err = errno_save;
 
 	if (rkb->rkb_transport) {
+                /* Remove socket from the IO thread's poll set
+                 * before it is closed (and its fd possibly reused). */
+                if (rkb->rkb_reactor.fd != -1)
+                        rd_kafka_reactor_transport_del(rkb);
 		rd_kafka_transport_close(rkb->rkb_transport);
 		rkb->rkb_transport = NULL;
 	}
@@ -576,15 +580,15 @@ static void rd_kafka_broker_timeout_scan (rd_kafka_broker_t *rkb, rd_ts_t now) {
 
 
 static ssize_t
-rd_kafka_broker_send (rd_kafka_broker_t *rkb, rd_slice_t *slice) {
+rd_kafka_broker_send (rd_kafka_broker_t *rkb, rd_kafka_buf_t *rkbuf) {
 	ssize_t r;
 	char errstr[128];
 
 	rd_kafka_assert(rkb->rkb_rk, rkb->rkb_state >= RD_KAFKA_BROKER_STATE_UP);
 	rd_kafka_assert(rkb->rkb_rk, rkb->rkb_transport);
 
-        r = rd_kafka_transport_send(rkb->rkb_transport, slice,
-                                    errstr, sizeof(errstr));
+        r = rd_kafka_transport_send_buf(rkb->rkb_transport, rkbuf,
+                                        errstr, sizeof(errstr));
 
 	if (r == -1) {
 		rd_kafka_broker_fail(rkb, LOG_ERR, RD_KAFKA_RESP_ERR__TRANSPORT,
@@ -1001,6 +1005,13 @@ static rd_kafka_buf_t *rd_kafka_waitresp_find (rd_kafka_broker_t *rkb,
 			/* Convert ts_sent to RTT */
 			rkbuf->rkbuf_ts_sent = now - rkbuf->rkbuf_ts_sent;
 			rd_avg_add(&rkb->rkb_avg_rtt, rkbuf->rkbuf_ts_sent);
+                        if (likely(rkbuf->rkbuf_reqhdr.ApiKey >= 0 &&
+                                   rkbuf->rkbuf_reqhdr.ApiKey <
+                                   RD_KAFKAP__NUM))
+                                rd_avg_add(&rkb->rkb_avg_rtt_api[rkbuf->
+                                                                 rkbuf_reqhdr.
+                                                                 ApiKey],
+                                           rkbuf->rkbuf_ts_sent);
 
                         if (rkbuf->rkbuf_flags & RD_KAFKA_OP_F_BLOCKING &&
 			    rd_atomic32_sub(&rkb->rkb_blocking_request_cnt,
@@ -1158,10 +1169,14 @@ int rd_kafka_recv (rd_kafka_broker_t *rkb) {
 		if (rkbuf->rkbuf_totlen > 0) {
 			/* Allocate another buffer that fits all data (short of
 			 * the common response header). We want all
-			 * data to be in contigious memory. */
-
-                        rd_buf_write_ensure_contig(&rkbuf->rkbuf_buf,
-                                                   rkbuf->rkbuf_totlen);
+			 * data to be in contigious memory.
+                         * Large responses borrow their buffer from the
+                         * broker's receive pool, if enabled, which is
+                         * returned to the pool when the last reference
+                         * to the response buffer is released. */
+                        rd_kafka_recvpool_buf_reserve(rkb->rkb_recvpool,
+                                                      &rkbuf->rkbuf_buf,
+                                                      rkbuf->rkbuf_totlen);
 		}
 	}
 
@@ -1691,7 +1706,7 @@ int rd_kafka_send (rd_kafka_broker_t *rkb) {
                                    pre_of, rd_slice_size(&rkbuf->rkbuf_reader));
 		}
 
-                if ((r = rd_kafka_broker_send(rkb, &rkbuf->rkbuf_reader)) == -1)
+                if ((r = rd_kafka_broker_send(rkb, rkbuf)) == -1)
                         return -1;
 
                 /* Partial send? Continue next time. */
@@ -1936,11 +1951,12 @@ static int rd_kafka_broker_op_serve (rd_kafka_broker_t *rkb,
 				      rd_kafka_op_t *rko) {
         shptr_rd_kafka_toppar_t *s_rktp;
         rd_kafka_toppar_t *rktp;
+        rd_kafka_msg_t *rkm;
         int ret = 1;
 
 	rd_kafka_assert(rkb->rkb_rk, thrd_is_current(rkb->rkb_thread));
 
-	switch (rko->rko_type)
+	switch ((int)rko->rko_type)
 	{
         case RD_KAFKA_OP_NODE_UPDATE:
         {
@@ -2159,7 +2175,14 @@ static int rd_kafka_broker_op_serve (rd_kafka_broker_t *rkb,
 			   "(none)", rktp);
 
                 /* Insert xmitq(broker-local) messages to the msgq(global)
-                 * at their sorted position to maintain ordering. */
+                 * at their sorted position to maintain ordering,
+                 * and have them scanned for timeouts from there. */
+                rd_kafka_toppar_ingress_drain(rktp);
+                if ((rkm = rd_kafka_msgq_oldest(
+                             &rktp->rktp_xmit_msgq,
+                             RD_KAFKA_TOPPAR_MSGQ_IS_LIFO(rktp))))
+                        rd_kafka_toppar_msgq_tmout_schedule(
+                                rktp, rkm->rkm_ts_timeout);
                 rd_kafka_msgq_insert_msgq(&rktp->rktp_msgq,
                                           &rktp->rktp_xmit_msgq,
                                           rktp->rktp_rkt->rkt_conf.
@@ -2225,7 +2248,17 @@ static int rd_kafka_broker_op_serve (rd_kafka_broker_t *rkb,
                 break;
 
         case RD_KAFKA_OP_WAKEUP:
-                ret = 0;
+                /* nop: just a wake-up.
+                 * Keep serving the ops queue since wake-ups are
+                 * enqueued with flash priority ahead of other ops,
+                 * which would otherwise only be served after the
+                 * next IO wait, one per wake-up. */
+                break;
+
+        case RD_KAFKA_OP_OFFLOAD | RD_KAFKA_OP_REPLY:
+                /* Offloaded job done: the done callback owns the op */
+                rko->rko_u.offload.done(rkb->rkb_rk, rko);
+                rko = NULL;
                 break;
 
         default:
@@ -2373,7 +2406,9 @@ static void rd_kafka_broker_toppar_msgq_scan (rd_kafka_broker_t *rkb,
                                               rd_ts_t now) {
         rd_kafka_msgq_t timedout = RD_KAFKA_MSGQ_INITIALIZER(timedout);
 
-        if (rd_kafka_msgq_age_scan(&rktp->rktp_xmit_msgq, &timedout, now)) {
+        if (rd_kafka_msgq_age_scan(&rktp->rktp_xmit_msgq, &timedout, now,
+                                   RD_KAFKA_TOPPAR_MSGQ_IS_LIFO(rktp),
+                                   NULL)) {
                 /* Trigger delivery report for timed out messages */
                 rd_kafka_dr_msgq(rktp->rktp_rkt, &timedout,
                                  RD_KAFKA_RESP_ERR__MSG_TIMED_OUT);
@@ -2401,7 +2436,8 @@ static int rd_kafka_toppar_producer_serve (rd_kafka_broker_t *rkb,
         rd_kafka_msg_t *rkm;
         int move_cnt = 0;
 
-        /* By limiting the number of not-yet-sent buffers (rkb_outbufs) we
+        /* By limiting the number of not-yet-sent buffers (rkb_outbufs,
+         * and those still being compressed by the offload pool) we
          * provide a backpressure mechanism to the producer loop
          * which allows larger message batches to accumulate and thus
          * increase throughput.
@@ -2412,7 +2448,8 @@ static int rd_kafka_toppar_producer_serve (rd_kafka_broker_t *rkb,
          * avoid having to acquire the lock in the typical case
          * (do_timeout_scan==0). */
         if (unlikely(!do_timeout_scan &&
-                     rd_atomic32_get(&rkb->rkb_outbufs.rkbq_cnt) >
+                     rd_atomic32_get(&rkb->rkb_outbufs.rkbq_cnt) +
+                     rkb->rkb_offload_cnt >
                      rkb->rkb_rk->rk_conf.queue_backpressure_thres))
                 return 0;
 
@@ -2438,8 +2475,9 @@ static int rd_kafka_toppar_producer_serve (rd_kafka_broker_t *rkb,
 
 
 
-        /* Move messages from locked partition produce queue
-         * to broker-local xmit queue. */
+        /* Move messages from the lock-free ingress list and the locked
+         * partition produce queue to broker-local xmit queue. */
+        rd_kafka_toppar_ingress_drain(rktp);
         if ((move_cnt = rktp->rktp_msgq.rkmq_msg_cnt) > 0)
                 rd_kafka_msgq_insert_msgq(&rktp->rktp_xmit_msgq,
                                           &rktp->rktp_msgq,
@@ -2545,6 +2583,41 @@ static int rd_kafka_broker_produce_toppars (rd_kafka_broker_t *rkb,
         return cnt;
 }
 
+/**
+ * @brief One round of producer serving: produce for all active partitions,
+ *        scanning for message timeouts every \p timeout_scan interval,
+ *        and move retry buffers.
+ *
+ * @returns the absolute time of the next desired round.
+ *
+ * @locality broker thread
+ */
+static rd_ts_t
+rd_kafka_broker_producer_serve_once (rd_kafka_broker_t *rkb,
+                                     rd_interval_t *timeout_scan) {
+        rd_ts_t now;
+        rd_ts_t next_wakeup;
+        int do_timeout_scan;
+
+        now = rd_clock();
+        next_wakeup = now + (rkb->rkb_rk->rk_conf.
+                             socket_blocking_max_ms * 1000);
+
+        do_timeout_scan = rd_interval(timeout_scan, 1000*1000, now) >= 0;
+
+        rd_kafka_broker_produce_toppars(rkb, now, &next_wakeup,
+                                        do_timeout_scan);
+
+        /* Check and move retry buffers */
+        if (unlikely(rd_atomic32_get(&rkb->rkb_retrybufs.rkbq_cnt) > 0))
+                rd_kafka_broker_retry_bufs_move(rkb);
+
+        rkb->rkb_blocking_max_ms = (int)
+                (next_wakeup > now ? (next_wakeup - now) / 1000 : 0);
+
+        return next_wakeup;
+}
+
 /**
  * Producer serving
  */
@@ -2559,28 +2632,13 @@ static void rd_kafka_broker_producer_serve (rd_kafka_broker_t *rkb) {
 
 	while (!rd_kafka_broker_terminating(rkb) &&
 	       rkb->rkb_state == RD_KAFKA_BROKER_STATE_UP) {
-		rd_ts_t now;
                 rd_ts_t next_wakeup;
-                int do_timeout_scan;
 
 		rd_kafka_broker_unlock(rkb);
 
-		now = rd_clock();
-                next_wakeup = now + (rkb->rkb_rk->rk_conf.
-                                     socket_blocking_max_ms * 1000);
-
-                do_timeout_scan = rd_interval(&timeout_scan, 1000*1000,
-                                              now) >= 0;
-
-                rd_kafka_broker_produce_toppars(rkb, now, &next_wakeup,
-                                                do_timeout_scan);
+                next_wakeup = rd_kafka_broker_producer_serve_once(
+                        rkb, &timeout_scan);
 
-		/* Check and move retry buffers */
-		if (unlikely(rd_atomic32_get(&rkb->rkb_retrybufs.rkbq_cnt) > 0))
-			rd_kafka_broker_retry_bufs_move(rkb);
-
-                rkb->rkb_blocking_max_ms = (int)
-                        (next_wakeup > now ? (next_wakeup - now) / 1000 : 0);
 		rd_kafka_broker_serve(rkb, next_wakeup);
 
 		rd_kafka_broker_lock(rkb);
@@ -2627,6 +2685,285 @@ static void rd_kafka_toppar_fetch_backoff (rd_kafka_broker_t *rkb,
 }
 
 
+/**
+ * @brief Offload job done callback: the partition's MessageSet has been
+ *        parsed, move the messages to the partition's fetch queue.
+ *
+ * @locality broker thread
+ */
+static void rd_kafka_fetch_reply_offload_done (rd_kafka_t *rk,
+                                               rd_kafka_op_t *rko) {
+        rd_kafka_broker_t *rkb = rko->rko_u.offload.rkbuf->rkbuf_rkb;
+        rd_kafka_resp_err_t err;
+
+        /* Don't block on IO when the last job is done: send the next
+         * Fetch, which waits for all jobs, right away. */
+        if (--rkb->rkb_offload_cnt == 0)
+                rkb->rkb_blocking_max_ms = 0;
+
+        err = rd_kafka_msgset_parse_offload_done(rkb, rko);
+
+        /* On error: back off the fetcher for this partition */
+        if (unlikely(err))
+                rd_kafka_toppar_fetch_backoff(
+                        rkb, rd_kafka_toppar_s2i(rko->rko_rktp), err);
+
+        rd_kafka_op_destroy(rko);
+}
+
+
+/**
+ * @brief A partition in the broker's fetch session (KIP-227) with the
+ *        fetch position last sent to the broker.
+ */
+typedef struct rd_kafka_fetch_session_toppar_s {
+        rd_kafka_toppar_t       *rktp;
+        shptr_rd_kafka_toppar_t *s_rktp;
+        int64_t offset;     /**< FetchOffset last sent */
+        int32_t max_bytes;  /**< MaxBytes last sent */
+        int     gen;        /**< Last FetchRequest generation the partition
+                             *   was fetchable in. */
+} rd_kafka_fetch_session_toppar_t;
+
+static void rd_kafka_fetch_session_toppar_destroy (void *ptr) {
+        rd_kafka_fetch_session_toppar_t *fstp = ptr;
+        rd_kafka_toppar_destroy(fstp->s_rktp);
+        rd_free(fstp);
+}
+
+/**
+ * @brief Session partition comparator on rktp pointer, used for lookups.
+ */
+static int rd_kafka_fetch_session_toppar_cmp (const void *_a,
+                                              const void *_b) {
+        const rd_kafka_fetch_session_toppar_t *a = _a, *b = _b;
+        return (a->rktp > b->rktp) - (a->rktp < b->rktp);
+}
+
+/**
+ * @brief Session partition comparator on topic name and partition,
+ *        used for grouping ForgottenTopicsData by topic.
+ */
+static int rd_kafka_fetch_session_toppar_name_cmp (const void *_a,
+                                                   const void *_b) {
+        const rd_kafka_fetch_session_toppar_t *a = _a, *b = _b;
+        int r;
+
+        if (a->rktp->rktp_rkt != b->rktp->rktp_rkt &&
+            (r = rd_kafkap_str_cmp(a->rktp->rktp_rkt->rkt_topic,
+                                   b->rktp->rktp_rkt->rkt_topic)))
+                return r;
+
+        return a->rktp->rktp_partition - b->rktp->rktp_partition;
+}
+
+
+/**
+ * @brief Reset the fetch session so that the next FetchRequest is a full
+ *        request.
+ *
+ * If \p keep_id is set the existing session id is sent along with the
+ * full request which makes the broker close it and create a new session,
+ * else a brand new session is requested.
+ *
+ * @locality broker thread
+ */
+static void rd_kafka_broker_fetch_session_reset (rd_kafka_broker_t *rkb,
+                                                 int keep_id,
+                                                 const char *reason) {
+        rd_kafka_fetch_session_toppar_t *fstp;
+        int i;
+
+        if (rkb->rkb_fetch_session.id)
+                rd_rkb_dbg(rkb, FETCH, "FETCHSESS",
+                           "Resetting fetch session %"PRId32" at epoch "
+                           "%"PRId32": %s",
+                           rkb->rkb_fetch_session.id,
+                           rkb->rkb_fetch_session.epoch, reason);
+
+        if (!keep_id)
+                rkb->rkb_fetch_session.id = 0;
+        if (rkb->rkb_fetch_session.epoch != -1)
+                rkb->rkb_fetch_session.epoch = 0;
+
+        /* rd_list_clear() does not free the elements. */
+        RD_LIST_FOREACH(fstp, &rkb->rkb_fetch_session.toppars, i)
+                rd_kafka_fetch_session_toppar_destroy(fstp);
+        rd_list_clear(&rkb->rkb_fetch_session.toppars);
+}
+
+
+/**
+ * @brief Update the fetch session following a successful FetchResponse
+ *        to \p request.
+ *
+ * @locality broker thread
+ */
+static void rd_kafka_broker_fetch_session_update (rd_kafka_broker_t *rkb,
+                                                  const rd_kafka_buf_t *request,
+                                                  int32_t SessionId) {
+        int32_t epoch = request->rkbuf_u.Fetch.session_epoch;
+
+        if (epoch == -1)
+                return; /* Sessionless */
+
+        if (epoch == 0) {
+                /* Full request: the broker created a new session,
+                 * unless it returned the invalid session id 0
+                 * (e.g., its session cache is full) in which case we keep
+                 * sending full requests. */
+                if (SessionId)
+                        rd_rkb_dbg(rkb, FETCH, "FETCHSESS",
+                                   "Fetch session %"PRId32" established "
+                                   "with %d partition(s)",
+                                   SessionId,
+                                   rd_list_cnt(&rkb->rkb_fetch_session.
+                                               toppars));
+                rkb->rkb_fetch_session.id = SessionId;
+                rkb->rkb_fetch_session.epoch = SessionId ? 1 : 0;
+        } else {
+                /* Incremental request: the epoch wraps to 1. */
+                rkb->rkb_fetch_session.epoch =
+                        epoch == INT32_MAX ? 1 : epoch + 1;
+        }
+}
+
+
+/**
+ * @brief Write ForgottenTopicsData for the session partitions that were
+ *        not fetchable in FetchRequest generation \p gen and remove them
+ *        from the session, then add the \p added partitions (if any).
+ *
+ * @param incremental If false (full request) the partitions are removed
+ *                    from the session without being written since the
+ *                    request itself defines the session's partitions.
+ *
+ * @locality broker thread
+ */
+static void rd_kafka_broker_fetch_session_forget (rd_kafka_broker_t *rkb,
+                                                  rd_kafka_buf_t *rkbuf,
+                                                  int gen, int incremental,
+                                                  rd_list_t *added) {
+        rd_list_t *toppars = &rkb->rkb_fetch_session.toppars;
+        rd_kafka_fetch_session_toppar_t *fstp;
+        rd_list_t forget;
+        int i;
+
+        rd_list_init(&forget, 0, NULL);
+        RD_LIST_FOREACH(fstp, toppars, i)
+                if (fstp->gen != gen)
+                        rd_list_add(&forget, fstp);
+
+        if (incremental) {
+                const rd_kafka_itopic_t *rkt_last = NULL;
+                size_t of_PartitionArrayCnt = 0;
+                int PartitionArrayCnt = 0;
+                int TopicArrayCnt = 0;
+                size_t of_TopicArrayCnt;
+
+                rd_list_sort(&forget, rd_kafka_fetch_session_toppar_name_cmp);
+
+                /* ForgottenTopicsData */
+                of_TopicArrayCnt = rd_kafka_buf_write_i32(rkbuf, 0);
+                RD_LIST_FOREACH(fstp, &forget, i) {
+                        if (rkt_last != fstp->rktp->rktp_rkt) {
+                                if (rkt_last)
+                                        rd_kafka_buf_update_i32(
+                                                rkbuf, of_PartitionArrayCnt,
+                                                PartitionArrayCnt);
+                                rd_kafka_buf_write_kstr(
+                                        rkbuf, fstp->rktp->rktp_rkt->rkt_topic);
+                                of_PartitionArrayCnt =
+                                        rd_kafka_buf_write_i32(rkbuf, 0);
+                                PartitionArrayCnt = 0;
+                                TopicArrayCnt++;
+                                rkt_last = fstp->rktp->rktp_rkt;
+                        }
+
+                        rd_kafka_buf_write_i32(rkbuf,
+                                               fstp->rktp->rktp_partition);
+                        PartitionArrayCnt++;
+
+                        rd_rkb_dbg(rkb, FETCH, "FETCHSESS",
+                                   "Forgetting %.*s [%"PRId32"] "
+                                   "in fetch session %"PRId32,
+                                   RD_KAFKAP_STR_PR(fstp->rktp->rktp_rkt->
+                                                    rkt_topic),
+                                   fstp->rktp->rktp_partition,
+                                   rkb->rkb_fetch_session.id);
+                }
+
+                if (rkt_last)
+                        rd_kafka_buf_update_i32(rkbuf, of_PartitionArrayCnt,
+                                                PartitionArrayCnt);
+                rd_kafka_buf_update_i32(rkbuf, of_TopicArrayCnt,
+                                        TopicArrayCnt);
+        } else {
+                /* ForgottenTopicsData: none */
+                rd_kafka_buf_write_i32(rkbuf, 0);
+        }
+
+        RD_LIST_FOREACH(fstp, &forget, i) {
+                rd_list_remove(toppars, fstp);
+                rd_kafka_fetch_session_toppar_destroy(fstp);
+        }
+
+        if (added) {
+                RD_LIST_FOREACH(fstp, added, i)
+                        rd_list_add(toppars, fstp);
+                rd_list_destroy(added);
+        }
+
+        if (added || rd_list_cnt(&forget) > 0)
+                rd_list_sort(toppars, rd_kafka_fetch_session_toppar_cmp);
+
+        rd_list_destroy(&forget);
+}
+
+
+/**
+ * @brief A partition that was included in an incremental FetchRequest
+ *        was omitted from the response since nothing changed for it
+ *        (no new messages, same high watermark): emit PARTITION_EOF
+ *        if the partition is at the high watermark, as a full
+ *        response would have.
+ *
+ * @locality broker thread
+ */
+static void rd_kafka_fetch_reply_unchanged (rd_kafka_broker_t *rkb,
+                                            struct rd_kafka_toppar_ver *tver) {
+        rd_kafka_toppar_t *rktp = rd_kafka_toppar_s2i(tver->s_rktp);
+        int32_t fetch_version;
+
+        rd_kafka_toppar_lock(rktp);
+        if (unlikely(rktp->rktp_leader != rkb)) {
+                rd_kafka_toppar_unlock(rktp);
+                return;
+        }
+        fetch_version = rktp->rktp_fetch_version;
+        rd_kafka_toppar_unlock(rktp);
+
+        if (tver->version < fetch_version)
+                return;
+
+        if (rktp->rktp_offsets.hi_offset != rktp->rktp_offsets.fetch_offset ||
+            rktp->rktp_offsets.eof_offset == rktp->rktp_offsets.fetch_offset)
+                return;
+
+        rktp->rktp_offsets.eof_offset = rktp->rktp_offsets.fetch_offset;
+
+        if (rkb->rkb_rk->rk_conf.enable_partition_eof)
+                rd_kafka_q_op_err(rktp->rktp_fetchq,
+                                  RD_KAFKA_OP_CONSUMER_ERR,
+                                  RD_KAFKA_RESP_ERR__PARTITION_EOF,
+                                  tver->version, rktp,
+                                  rktp->rktp_offsets.fetch_offset,
+                                  "%s",
+                                  rd_kafka_err2str(
+                                          RD_KAFKA_RESP_ERR__PARTITION_EOF));
+}
+
+
 /**
  * Parses and handles a Fetch reply.
  * Returns 0 on success or an error code on failure.
@@ -2639,6 +2976,11 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
         const int log_decode_errors = LOG_ERR;
         shptr_rd_kafka_itopic_t *s_rkt = NULL;
 
+        /* The fetched messages' ops share (a reference to) this buffer,
+         * its receive time is the start of their fetchq latency,
+         * see rd_kafka_op_fetchq_latency_add(). */
+        rkbuf->rkbuf_ts_enq = rd_clock();
+
 	if (rd_kafka_buf_ApiVersion(request) >= 1) {
 		int32_t Throttle_Time;
 		rd_kafka_buf_read_i32(rkbuf, &Throttle_Time);
@@ -2647,6 +2989,19 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
 					  Throttle_Time);
 	}
 
+        if (rd_kafka_buf_ApiVersion(request) >= 7) {
+                int16_t ErrorCode;
+                int32_t SessionId;
+                rd_kafka_buf_read_i16(rkbuf, &ErrorCode);
+                rd_kafka_buf_read_i32(rkbuf, &SessionId);
+
+                /* Top-level (request-wide) error */
+                if (unlikely(ErrorCode))
+                        return (rd_kafka_resp_err_t)ErrorCode;
+
+                rd_kafka_broker_fetch_session_update(rkb, request, SessionId);
+        }
+
 	rd_kafka_buf_read_i32(rkbuf, &TopicArrayCnt);
 	/* Verify that TopicArrayCnt seems to be in line with remaining size */
 	rd_kafka_buf_check_len(rkbuf,
@@ -2675,6 +3030,7 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
                                 int16_t ErrorCode;
                                 int64_t HighwaterMarkOffset;
                                 int64_t LastStableOffset;       /* v4 */
+                                int64_t LogStartOffset;         /* v5 */
                                 int32_t MessageSetSize;
                         } hdr;
                         rd_kafka_resp_err_t err;
@@ -2683,17 +3039,24 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
 			rd_kafka_buf_read_i16(rkbuf, &hdr.ErrorCode);
 			rd_kafka_buf_read_i64(rkbuf, &hdr.HighwaterMarkOffset);
 
-                        if (rd_kafka_buf_ApiVersion(request) == 4) {
+                        if (rd_kafka_buf_ApiVersion(request) >= 4) {
                                 int32_t AbortedTxCnt;
                                 rd_kafka_buf_read_i64(rkbuf,
                                                       &hdr.LastStableOffset);
+                                if (rd_kafka_buf_ApiVersion(request) >= 5)
+                                        rd_kafka_buf_read_i64(
+                                                rkbuf, &hdr.LogStartOffset);
+                                else
+                                        hdr.LogStartOffset = -1;
                                 rd_kafka_buf_read_i32(rkbuf, &AbortedTxCnt);
                                 /* Ignore aborted transactions for now */
                                 if (AbortedTxCnt > 0)
                                         rd_kafka_buf_skip(rkbuf,
                                                           AbortedTxCnt * (8+8));
-                        } else
+                        } else {
                                 hdr.LastStableOffset = -1;
+                                hdr.LogStartOffset = -1;
+                        }
 
 			rd_kafka_buf_read_i32(rkbuf, &hdr.MessageSetSize);
 
@@ -2757,6 +3120,8 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
 			rd_kafka_assert(NULL, tver &&
 					rd_kafka_toppar_s2i(tver->s_rktp) ==
 					rktp);
+                        tver->fetch_flags |= RD_KAFKA_TOPPAR_VER_F_RESPONDED;
+
 			if (tver->version < fetch_version) {
 				rd_rkb_dbg(rkb, MSG, "DROP",
 					   "%s [%"PRId32"]: "
@@ -2782,6 +3147,9 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
 				   hdr.HighwaterMarkOffset,
                                    tver->version, fetch_version);
 
+                        /* Throughput for adaptive fetch sizing */
+                        rktp->rktp_fetch_adapt.bytes += hdr.MessageSetSize;
+                        rktp->rktp_fetch_adapt.last_bytes = hdr.MessageSetSize;
 
                         /* Update hi offset to be able to compute
                          * consumer lag. */
@@ -2871,6 +3239,11 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
 				continue;
 			}
 
+                        /* rkbuf_ts_sent is the request's RTT by now,
+                         * see rd_kafka_waitresp_find() */
+                        rd_avg_add(&rktp->rktp_avg_fetch_latency,
+                                   request->rkbuf_ts_sent);
+
                         /**
                          * Parse MessageSet
                          */
@@ -2881,8 +3254,27 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
                                 rd_kafka_buf_check_len(rkbuf,
                                                        hdr.MessageSetSize);
 
-                        /* Parse messages */
-                        err = rd_kafka_msgset_parse(rkbuf, request, rktp, tver);
+                        if (rkb->rkb_rk->rk_offload) {
+                                /* Have the offload pool parse messages,
+                                 * see rd_kafka_fetch_reply_offload_done() */
+                                rd_kafka_op_t *rko;
+
+                                rko = rd_kafka_msgset_parse_offload_new(
+                                        rkbuf, rktp, tver);
+                                rko->rko_u.offload.done =
+                                        rd_kafka_fetch_reply_offload_done;
+                                rko->rko_replyq =
+                                        RD_KAFKA_REPLYQ(rkb->rkb_ops, 0);
+
+                                rkb->rkb_offload_cnt++;
+                                rd_kafka_offload_enq(rkb->rkb_rk->rk_offload,
+                                                     rko);
+                                err = RD_KAFKA_RESP_ERR_NO_ERROR;
+                        } else {
+                                /* Parse messages */
+                                err = rd_kafka_msgset_parse(rkbuf, request,
+                                                            rktp, tver);
+                        }
 
                         rd_slice_widen(&rkbuf->rkbuf_reader, &save_slice);
                         /* Continue with next partition regardless of
@@ -2909,6 +3301,19 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
 		RD_NOTREACHED();
 	}
 
+        /* Incremental fetch responses only include partitions that
+         * changed, check the others that were fetched for EOF. */
+        if (request->rkbuf_u.Fetch.session_epoch > 0) {
+                struct rd_kafka_toppar_ver *tver;
+
+                RD_LIST_FOREACH(tver, request->rkbuf_rktp_vers, i)
+                        if ((tver->fetch_flags &
+                             (RD_KAFKA_TOPPAR_VER_F_SENT|
+                              RD_KAFKA_TOPPAR_VER_F_RESPONDED)) ==
+                            RD_KAFKA_TOPPAR_VER_F_SENT)
+                                rd_kafka_fetch_reply_unchanged(rkb, tver);
+        }
+
 	return 0;
 
 err_parse:
@@ -2935,6 +3340,10 @@ static void rd_kafka_broker_fetch_reply (rd_kafka_t *rk,
 	rd_kafka_assert(rkb->rkb_rk, rkb->rkb_fetching > 0);
 	rkb->rkb_fetching = 0;
 
+        if (reply)
+                rd_atomic64_add(&rkb->rkb_c.fetch.rx_bytes,
+                                rd_buf_len(&reply->rkbuf_buf));
+
 	/* Parse and handle the messages (unless the request errored) */
 	if (!err && reply)
 		err = rd_kafka_fetch_reply_handle(rkb, reply, request);
@@ -2944,8 +3353,24 @@ static void rd_kafka_broker_fetch_reply (rd_kafka_t *rk,
 
                 rd_rkb_dbg(rkb, MSG, "FETCH", "Fetch reply: %s",
                            rd_kafka_err2str(err));
+
+                /* The broker's view of the session is unknown following
+                 * a failed request: start over with a full request. */
+                if (request->rkbuf_u.Fetch.session_epoch != -1)
+                        rd_kafka_broker_fetch_session_reset(
+                                rkb,
+                                err !=
+                                RD_KAFKA_RESP_ERR_FETCH_SESSION_ID_NOT_FOUND,
+                                rd_kafka_err2str(err));
+
 		switch (err)
 		{
+                case RD_KAFKA_RESP_ERR_FETCH_SESSION_ID_NOT_FOUND:
+                case RD_KAFKA_RESP_ERR_INVALID_FETCH_SESSION_EPOCH:
+                        /* Retry right away with a full request. */
+                        rd_atomic64_add(&rkb->rkb_c.fetch.session_err, 1);
+                        return;
+
 		case RD_KAFKA_RESP_ERR_UNKNOWN_TOPIC_OR_PART:
 		case RD_KAFKA_RESP_ERR_LEADER_NOT_AVAILABLE:
 		case RD_KAFKA_RESP_ERR_NOT_LEADER_FOR_PARTITION:
@@ -2999,28 +3424,53 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
 	size_t of_PartitionArrayCnt = 0;
 	int PartitionArrayCnt = 0;
 	rd_kafka_itopic_t *rkt_last = NULL;
+        rd_list_t *session_added = NULL;
+        int incremental = 0;
+        int gen = 0;
+        int32_t budget = rkb->rkb_rk->rk_conf.fetch_max_bytes;
 
 	/* Create buffer and segments:
 	 *   1 x ReplicaId MaxWaitTime MinBytes TopicArrayCnt
 	 *   N x topic name
 	 *   N x PartitionArrayCnt Partition FetchOffset MaxBytes
 	 * where N = number of toppars.
+	 * v4 adds MaxBytes and IsolationLevel, v7 adds the fetch session
+	 * fields and ForgottenTopicsData, v5 and v9 add LogStartOffset and
+	 * CurrentLeaderEpoch to each partition.
 	 * Since we dont keep track of the number of topics served by
 	 * this broker, only the partition count, we do a worst-case calc
 	 * when allocating and assume each partition is on its own topic
 	 */
 
-        if (unlikely(rkb->rkb_active_toppar_cnt == 0))
+        if (unlikely(rkb->rkb_active_toppar_cnt == 0)) {
+                /* Release the session's partitions, a new session
+                 * is created when there is something to fetch again. */
+                if (rd_list_cnt(&rkb->rkb_fetch_session.toppars) > 0)
+                        rd_kafka_broker_fetch_session_reset(
+                                rkb, 1, "no partitions to fetch");
                 return 0;
+        }
 
 	rkbuf = rd_kafka_buf_new_request(
                 rkb, RD_KAFKAP_Fetch, 1,
                 /* ReplicaId+MaxWaitTime+MinBytes+TopicCnt */
                 4+4+4+4+
-                /* N x PartCnt+Partition+FetchOffset+MaxBytes+?TopicNameLen?*/
-                (rkb->rkb_active_toppar_cnt * (4+4+8+4+40)));
-
-        if (rkb->rkb_features & RD_KAFKA_FEATURE_MSGVER2)
+                /* MaxBytes+IsolationLevel+SessionId+SessionEpoch+
+                 * ForgottenTopicCnt */
+                4+1+4+4+4+
+                /* N x PartCnt+Partition+CurrentLeaderEpoch+FetchOffset+
+                 *     LogStartOffset+MaxBytes+?TopicNameLen?*/
+                (rkb->rkb_active_toppar_cnt * (4+4+4+8+8+4+40)));
+
+        if (rkb->rkb_features & RD_KAFKA_FEATURE_ZSTD)
+                /* v10 is required to be able to receive zstd-compressed
+                 * MessageSets (KIP-110). */
+                rd_kafka_buf_ApiVersion_set(rkbuf, 10,
+                                            RD_KAFKA_FEATURE_ZSTD);
+        else if (rkb->rkb_features & RD_KAFKA_FEATURE_FETCH_SESSION)
+                rd_kafka_buf_ApiVersion_set(rkbuf, 7,
+                                            RD_KAFKA_FEATURE_FETCH_SESSION);
+        else if (rkb->rkb_features & RD_KAFKA_FEATURE_MSGVER2)
                 rd_kafka_buf_ApiVersion_set(rkbuf, 4,
                                             RD_KAFKA_FEATURE_MSGVER2);
         else if (rkb->rkb_features & RD_KAFKA_FEATURE_MSGVER1)
@@ -3039,7 +3489,7 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
 	/* MinBytes */
 	rd_kafka_buf_write_i32(rkbuf, rkb->rkb_rk->rk_conf.fetch_min_bytes);
 
-        if (rd_kafka_buf_ApiVersion(rkbuf) == 4) {
+        if (rd_kafka_buf_ApiVersion(rkbuf) >= 4) {
                 /* MaxBytes */
                 rd_kafka_buf_write_i32(rkbuf,
                                        rkb->rkb_rk->rk_conf.fetch_max_bytes);
@@ -3047,6 +3497,30 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
                 rd_kafka_buf_write_i8(rkbuf, RD_KAFKAP_READ_UNCOMMITTED);
         }
 
+        if (rd_kafka_buf_ApiVersion(rkbuf) >= 7 &&
+            (rkb->rkb_features & RD_KAFKA_FEATURE_FETCH_SESSION)) {
+                /* Incremental fetch session (KIP-227): only partitions
+                 * that are new to the session or whose fetch position
+                 * changed are included in incremental requests. */
+                if (rkb->rkb_fetch_session.epoch == -1)
+                        rkb->rkb_fetch_session.epoch = 0;
+                incremental = rkb->rkb_fetch_session.epoch > 0;
+                gen = ++rkb->rkb_fetch_session.gen;
+        } else if (rkb->rkb_fetch_session.epoch != -1) {
+                rd_kafka_broker_fetch_session_reset(rkb, 0,
+                                                    "not supported");
+                rkb->rkb_fetch_session.epoch = -1;
+        }
+
+        rkbuf->rkbuf_u.Fetch.session_epoch = rkb->rkb_fetch_session.epoch;
+
+        if (rd_kafka_buf_ApiVersion(rkbuf) >= 7) {
+                /* SessionId */
+                rd_kafka_buf_write_i32(rkbuf, rkb->rkb_fetch_session.id);
+                /* SessionEpoch */
+                rd_kafka_buf_write_i32(rkbuf, rkb->rkb_fetch_session.epoch);
+        }
+
 	/* Write zero TopicArrayCnt but store pointer for later update */
 	of_TopicArrayCnt = rd_kafka_buf_write_i32(rkbuf, 0);
 
@@ -3063,6 +3537,53 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
         rktp = rkb->rkb_active_toppar_next;
         do {
 		struct rd_kafka_toppar_ver *tver;
+                int unchanged = 0;
+                int32_t max_bytes;
+
+                max_bytes = rd_kafka_toppar_fetch_size(rktp, rkb, now, budget);
+                budget = RD_MAX(0, budget - max_bytes);
+
+                if (gen) {
+                        rd_kafka_fetch_session_toppar_t skel, *fstp;
+
+                        skel.rktp = rktp;
+                        fstp = rd_list_find(&rkb->rkb_fetch_session.toppars,
+                                            &skel,
+                                            rd_kafka_fetch_session_toppar_cmp);
+                        if (!fstp) {
+                                fstp = rd_calloc(1, sizeof(*fstp));
+                                fstp->rktp = rktp;
+                                fstp->s_rktp = rd_kafka_toppar_keep(rktp);
+                                /* Added to the session after the loop
+                                 * to keep it sorted for lookups. */
+                                if (!session_added)
+                                        session_added = rd_list_new(0, NULL);
+                                rd_list_add(session_added, fstp);
+                        } else if (incremental &&
+                                   fstp->offset ==
+                                   rktp->rktp_offsets.fetch_offset &&
+                                   fstp->max_bytes == max_bytes) {
+                                /* Unchanged: not included in the request
+                                 * but the broker may still return
+                                 * messages for it. */
+                                unchanged = 1;
+                        }
+
+                        fstp->gen = gen;
+                        fstp->offset = rktp->rktp_offsets.fetch_offset;
+                        fstp->max_bytes = max_bytes;
+                }
+
+		/* Add toppar + op version mapping. */
+		tver = rd_list_add(rkbuf->rkbuf_rktp_vers, NULL);
+		tver->s_rktp = rd_kafka_toppar_keep(rktp);
+		tver->version = rktp->rktp_fetch_version;
+
+                tver->fetch_flags = 0;
+                if (unchanged)
+                        continue;
+                if (incremental)
+                        tver->fetch_flags |= RD_KAFKA_TOPPAR_VER_F_SENT;
 
 		if (rkt_last != rktp->rktp_rkt) {
 			if (rkt_last != NULL) {
@@ -3085,23 +3606,24 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
 		PartitionArrayCnt++;
 		/* Partition */
 		rd_kafka_buf_write_i32(rkbuf, rktp->rktp_partition);
+                if (rd_kafka_buf_ApiVersion(rkbuf) >= 9)
+                        /* CurrentLeaderEpoch: unknown */
+                        rd_kafka_buf_write_i32(rkbuf, -1);
 		/* FetchOffset */
 		rd_kafka_buf_write_i64(rkbuf, rktp->rktp_offsets.fetch_offset);
+                if (rd_kafka_buf_ApiVersion(rkbuf) >= 5)
+                        /* LogStartOffset: only used by followers */
+                        rd_kafka_buf_write_i64(rkbuf, -1);
 		/* MaxBytes */
-		rd_kafka_buf_write_i32(rkbuf, rktp->rktp_fetch_msg_max_bytes);
+		rd_kafka_buf_write_i32(rkbuf, max_bytes);
 
 		rd_rkb_dbg(rkb, FETCH, "FETCH",
 			   "Fetch topic %.*s [%"PRId32"] at offset %"PRId64
-			   " (v%d)",
+			   " (v%d, max %"PRId32" bytes)",
 			   RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
 			   rktp->rktp_partition,
                            rktp->rktp_offsets.fetch_offset,
-			   rktp->rktp_fetch_version);
-
-		/* Add toppar + op version mapping. */
-		tver = rd_list_add(rkbuf->rkbuf_rktp_vers, NULL);
-		tver->s_rktp = rd_kafka_toppar_keep(rktp);
-		tver->version = rktp->rktp_fetch_version;
+			   rktp->rktp_fetch_version, max_bytes);
 
 		cnt++;
 	} while ((rktp = CIRCLEQ_LOOP_NEXT(&rkb->rkb_active_toppars,
@@ -3115,12 +3637,9 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
                 CIRCLEQ_LOOP_NEXT(&rkb->rkb_active_toppars,
                                   rktp, rktp_activelink) : NULL);
 
-	rd_rkb_dbg(rkb, FETCH, "FETCH", "Fetch %i/%i/%i toppar(s)",
-                   cnt, rkb->rkb_active_toppar_cnt, rkb->rkb_toppar_cnt);
-	if (!cnt) {
-		rd_kafka_buf_destroy(rkbuf);
-		return cnt;
-	}
+	rd_rkb_dbg(rkb, FETCH, "FETCH", "Fetch %i/%i/%i toppar(s)%s",
+                   cnt, rkb->rkb_active_toppar_cnt, rkb->rkb_toppar_cnt,
+                   incremental ? " (incremental)" : "");
 
 	if (rkt_last != NULL) {
 		/* Update last topic's PartitionArrayCnt */
@@ -3132,6 +3651,22 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
 	/* Update TopicArrayCnt */
 	rd_kafka_buf_update_i32(rkbuf, of_TopicArrayCnt, TopicArrayCnt);
 
+        if (gen)
+                /* ForgottenTopicsData */
+                rd_kafka_broker_fetch_session_forget(rkb, rkbuf, gen,
+                                                     incremental,
+                                                     session_added);
+        else if (rd_kafka_buf_ApiVersion(rkbuf) >= 7)
+                /* ForgottenTopicsData: none */
+                rd_kafka_buf_write_i32(rkbuf, 0);
+
+        if (incremental)
+                rd_atomic64_add(&rkb->rkb_c.fetch.incremental, 1);
+        else
+                rd_atomic64_add(&rkb->rkb_c.fetch.full, 1);
+        rd_atomic64_add(&rkb->rkb_c.fetch.tx_bytes,
+                        rd_buf_len(&rkbuf->rkbuf_buf));
+
         /* Use configured timeout */
         rd_kafka_buf_set_timeout(rkbuf,
                                  rkb->rkb_rk->rk_conf.socket_timeout_ms +
@@ -3150,6 +3685,58 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
 
 
 
+/**
+ * @brief One round of consumer serving: serve the partitions and
+ *        send a Fetch request for all underflowed partitions,
+ *        unless backed off or a Fetch is already in progress,
+ *        and move retry buffers.
+ *
+ * @returns the absolute time of the next desired round.
+ *
+ * @locality broker thread
+ */
+static rd_ts_t rd_kafka_broker_consumer_serve_once (rd_kafka_broker_t *rkb) {
+        rd_ts_t now;
+        rd_ts_t min_backoff;
+
+        now = rd_clock();
+
+        /* Serve toppars */
+        min_backoff = rd_kafka_broker_toppars_serve(rkb);
+        if (rkb->rkb_ts_fetch_backoff > now &&
+            rkb->rkb_ts_fetch_backoff < min_backoff)
+                min_backoff = rkb->rkb_ts_fetch_backoff;
+
+        /* Send Fetch request message for all underflowed toppars,
+         * once the previous FetchResponse's MessageSets have been
+         * parsed by the offload pool (if any), to maintain
+         * the order of messages. */
+        if (!rkb->rkb_fetching && !rkb->rkb_offload_cnt) {
+                if (min_backoff < now) {
+                        rd_kafka_broker_fetch_toppars(rkb, now);
+                        rkb->rkb_blocking_max_ms =
+                                rkb->rkb_rk->rk_conf.socket_blocking_max_ms;
+                } else {
+                        if (min_backoff < RD_TS_MAX)
+                                rd_rkb_dbg(rkb, FETCH, "FETCH",
+                                           "Fetch backoff for %"PRId64"ms",
+                                           (min_backoff-now)/1000);
+
+                        /* Don't block for more than 1000 ms
+                         * or less than 1 ms. */
+                        rkb->rkb_blocking_max_ms = 1 +
+                                (int)RD_MIN(1000, (min_backoff - now) / 1000);
+                }
+        }
+
+        /* Check and move retry buffers */
+        if (unlikely(rd_atomic32_get(&rkb->rkb_retrybufs.rkbq_cnt) > 0))
+                rd_kafka_broker_retry_bufs_move(rkb);
+
+        return now + (rkb->rkb_blocking_max_ms * 1000);
+}
+
+
 /**
  * Consumer serving
  */
@@ -3161,47 +3748,10 @@ static void rd_kafka_broker_consumer_serve (rd_kafka_broker_t *rkb) {
 
 	while (!rd_kafka_broker_terminating(rkb) &&
 	       rkb->rkb_state == RD_KAFKA_BROKER_STATE_UP) {
-		rd_ts_t now;
-                rd_ts_t min_backoff;
-
 		rd_kafka_broker_unlock(rkb);
 
-		now = rd_clock();
-
-                /* Serve toppars */
-                min_backoff = rd_kafka_broker_toppars_serve(rkb);
-                if (rkb->rkb_ts_fetch_backoff > now &&
-                    rkb->rkb_ts_fetch_backoff < min_backoff)
-                        min_backoff = rkb->rkb_ts_fetch_backoff;
-
-		/* Send Fetch request message for all underflowed toppars */
-		if (!rkb->rkb_fetching) {
-                        if (min_backoff < now) {
-                                rd_kafka_broker_fetch_toppars(rkb, now);
-                                rkb->rkb_blocking_max_ms =
-                                        rkb->rkb_rk->
-                                        rk_conf.socket_blocking_max_ms;
-                        } else {
-                                if (min_backoff < RD_TS_MAX)
-                                        rd_rkb_dbg(rkb, FETCH, "FETCH",
-                                                   "Fetch backoff for %"PRId64
-                                                   "ms",
-                                                   (min_backoff-now)/1000);
-
-                                /* Don't block for more than 1000 ms
-                                 * or less than 1 ms. */
-                                rkb->rkb_blocking_max_ms = 1 +
-                                        (int)RD_MIN(1000,
-                                        (min_backoff - now) / 1000);
-                        }
-                }
-
-		/* Check and move retry buffers */
-		if (unlikely(rd_atomic32_get(&rkb->rkb_retrybufs.rkbq_cnt) > 0))
-			rd_kafka_broker_retry_bufs_move(rkb);
-
 		rd_kafka_broker_serve(rkb,
-                                      now + (rkb->rkb_blocking_max_ms * 1000));
+                                      rd_kafka_broker_consumer_serve_once(rkb));
 
 		rd_kafka_broker_lock(rkb);
 	}
@@ -3210,6 +3760,80 @@ static void rd_kafka_broker_consumer_serve (rd_kafka_broker_t *rkb) {
 }
 
 
+/**
+ * @returns true if all resolved addresses of the broker have been tried
+ *          (or there are none), in which case the next connection attempt
+ *          should be delayed to avoid busy looping.
+ */
+static RD_INLINE int
+rd_kafka_broker_addrs_exhausted (const rd_kafka_broker_t *rkb) {
+        return !rkb->rkb_rsal ||
+                rkb->rkb_rsal->rsal_cnt == 0 ||
+                rkb->rkb_rsal->rsal_curr + 1 == rkb->rkb_rsal->rsal_cnt;
+}
+
+
+/**
+ * @brief Handle is terminating: fail the send+retry queue
+ *        to speed up termination, otherwise we'll
+ *        need to wait for request timeouts.
+ *
+ * @locality broker thread
+ */
+static void rd_kafka_broker_terminating_fail_bufs (rd_kafka_broker_t *rkb) {
+        int r;
+
+        r = rd_kafka_broker_bufq_timeout_scan(
+                rkb, 0, &rkb->rkb_outbufs, NULL,
+                RD_KAFKA_RESP_ERR__DESTROY, 0);
+        r += rd_kafka_broker_bufq_timeout_scan(
+                rkb, 0, &rkb->rkb_retrybufs, NULL,
+                RD_KAFKA_RESP_ERR__DESTROY, 0);
+        rd_rkb_dbg(rkb, BROKER, "TERMINATE",
+                   "Handle is terminating: "
+                   "failed %d request(s) in "
+                   "retry+outbuf", r);
+}
+
+
+/**
+ * @brief Decommission a terminating broker: remove it from the handle,
+ *        wait for its offloaded jobs, tear down the connection,
+ *        drain its op queue and drop the broker thread's reference.
+ *
+ * @locality broker thread
+ */
+void rd_kafka_broker_decommission (rd_kafka_broker_t *rkb) {
+	if (rkb->rkb_source != RD_KAFKA_INTERNAL) {
+		rd_kafka_wrlock(rkb->rkb_rk);
+		TAILQ_REMOVE(&rkb->rkb_rk->rk_brokers, rkb, rkb_link);
+                if (rkb->rkb_nodeid != -1)
+                        rd_list_remove(&rkb->rkb_rk->rk_broker_by_id, rkb);
+		(void)rd_atomic32_sub(&rkb->rkb_rk->rk_broker_cnt, 1);
+		rd_kafka_wrunlock(rkb->rkb_rk);
+	}
+
+        /* Wait for outstanding offload jobs to be handed back on the
+         * ops queue: finalized ProduceRequests are then failed along
+         * with the other outbufs below and parsed fetch jobs are freed. */
+        while (rkb->rkb_offload_cnt > 0)
+                rd_kafka_broker_ops_serve(rkb, 100);
+
+	rd_kafka_broker_fail(rkb, LOG_DEBUG, RD_KAFKA_RESP_ERR__DESTROY, NULL);
+
+        /* Disable and drain ops queue.
+         * Simply purging the ops queue risks leaving dangling references
+         * for ops such as PARTITION_JOIN/PARTITION_LEAVE where the broker
+         * reference is not maintained in the rko (but in rktp_next_leader).
+         * #1596 */
+        rd_kafka_q_disable(rkb->rkb_ops);
+        while (rd_kafka_broker_ops_serve(rkb, RD_POLL_NOWAIT))
+                ;
+
+	rd_kafka_broker_destroy(rkb);
+}
+
+
 static int rd_kafka_broker_thread_main (void *arg) {
 	rd_kafka_broker_t *rkb = arg;
 	rd_kafka_t *rk = rkb->rkb_rk;
@@ -3276,10 +3900,7 @@ static int rd_kafka_broker_thread_main (void *arg) {
 				 * Try the next resolve result until we've
 				 * tried them all, in which case we sleep a
 				 * short while to avoid busy looping. */
-				if (!rkb->rkb_rsal ||
-                                    rkb->rkb_rsal->rsal_cnt == 0 ||
-                                    rkb->rkb_rsal->rsal_curr + 1 ==
-                                    rkb->rkb_rsal->rsal_cnt)
+				if (rd_kafka_broker_addrs_exhausted(rkb))
                                         rd_kafka_broker_ua_idle(rkb, 1000);
 			}
 			break;
@@ -3296,10 +3917,7 @@ static int rd_kafka_broker_thread_main (void *arg) {
 				 * Try the next resolve result until we've
 				 * tried them all, in which case we sleep a
 				 * short while to avoid busy looping. */
-				if (!rkb->rkb_rsal ||
-                                    rkb->rkb_rsal->rsal_cnt == 0 ||
-                                    rkb->rkb_rsal->rsal_curr + 1 ==
-                                    rkb->rkb_rsal->rsal_cnt)
+				if (rd_kafka_broker_addrs_exhausted(rkb))
                                         rd_kafka_broker_ua_idle(rkb, 1000);
 			}
 			break;
@@ -3326,46 +3944,11 @@ static int rd_kafka_broker_thread_main (void *arg) {
 			break;
 		}
 
-                if (rd_kafka_terminating(rkb->rkb_rk)) {
-                        /* Handle is terminating: fail the send+retry queue
-                         * to speed up termination, otherwise we'll
-                         * need to wait for request timeouts. */
-                        int r;
-
-                        r = rd_kafka_broker_bufq_timeout_scan(
-                                rkb, 0, &rkb->rkb_outbufs, NULL,
-                                RD_KAFKA_RESP_ERR__DESTROY, 0);
-                        r += rd_kafka_broker_bufq_timeout_scan(
-                                rkb, 0, &rkb->rkb_retrybufs, NULL,
-                                RD_KAFKA_RESP_ERR__DESTROY, 0);
-                        rd_rkb_dbg(rkb, BROKER, "TERMINATE",
-                                   "Handle is terminating: "
-                                   "failed %d request(s) in "
-                                   "retry+outbuf", r);
-                }
+                if (rd_kafka_terminating(rkb->rkb_rk))
+                        rd_kafka_broker_terminating_fail_bufs(rkb);
 	}
 
-	if (rkb->rkb_source != RD_KAFKA_INTERNAL) {
-		rd_kafka_wrlock(rkb->rkb_rk);
-		TAILQ_REMOVE(&rkb->rkb_rk->rk_brokers, rkb, rkb_link);
-                if (rkb->rkb_nodeid != -1)
-                        rd_list_remove(&rkb->rkb_rk->rk_broker_by_id, rkb);
-		(void)rd_atomic32_sub(&rkb->rkb_rk->rk_broker_cnt, 1);
-		rd_kafka_wrunlock(rkb->rkb_rk);
-	}
-
-	rd_kafka_broker_fail(rkb, LOG_DEBUG, RD_KAFKA_RESP_ERR__DESTROY, NULL);
-
-        /* Disable and drain ops queue.
-         * Simply purging the ops queue risks leaving dangling references
-         * for ops such as PARTITION_JOIN/PARTITION_LEAVE where the broker
-         * reference is not maintained in the rko (but in rktp_next_leader).
-         * #1596 */
-        rd_kafka_q_disable(rkb->rkb_ops);
-        while (rd_kafka_broker_ops_serve(rkb, RD_POLL_NOWAIT))
-                ;
-
-	rd_kafka_broker_destroy(rkb);
+        rd_kafka_broker_decommission(rkb);
 
 #if WITH_SSL
         /* Remove OpenSSL per-thread error state to avoid memory leaks */
@@ -3383,10 +3966,149 @@ static int rd_kafka_broker_thread_main (void *arg) {
 }
 
 
+/**
+ * @brief Reactor mode (`broker.io.threads` > 0) counterpart of
+ *        rd_kafka_broker_thread_main(): advance the broker state machine
+ *        one round without blocking, serving the transport IO \p events
+ *        (if any) and the broker ops.
+ *
+ * Where the broker thread would block, idle or sleep the hold-off is
+ * instead recorded in rkb_reactor and reflected in the returned time.
+ *
+ * @returns the absolute time at which the broker wants to be served again,
+ *          it is served sooner on IO events or op queue wake-ups.
+ *          0 is returned if the broker is terminating, in which case the
+ *          caller must call rd_kafka_broker_decommission().
+ *
+ * @locality broker (IO) thread
+ */
+rd_ts_t rd_kafka_broker_reactor_serve (rd_kafka_broker_t *rkb, int events) {
+        rd_kafka_t *rk = rkb->rkb_rk;
+        int prev_state;
+        rd_ts_t now, next;
+
+        if (rd_kafka_broker_terminating(rkb))
+                return 0;
+
+        rd_atomic64_add(&rkb->rkb_c.wakeups, 1);
+
+        /* Serve IO events */
+        if (events && rkb->rkb_transport)
+                rd_kafka_transport_io_events(rkb->rkb_transport, events);
+
+        /* Serve broker ops */
+        rd_kafka_broker_ops_serve(rkb, RD_POLL_NOWAIT);
+
+        now = rd_clock();
+        next = now + (rkb->rkb_blocking_max_ms * 1000);
+
+        /* State left by the previous round, to detect the transitions
+         * after which the broker thread would hold off reconnecting. */
+        prev_state = rkb->rkb_reactor.state;
+
+        switch (rkb->rkb_state)
+        {
+        case RD_KAFKA_BROKER_STATE_INIT:
+        case RD_KAFKA_BROKER_STATE_DOWN:
+                if (rkb->rkb_source == RD_KAFKA_INTERNAL) {
+                        rd_kafka_broker_lock(rkb);
+                        rd_kafka_broker_set_state(rkb,
+                                                  RD_KAFKA_BROKER_STATE_UP);
+                        rd_kafka_broker_unlock(rkb);
+                        next = now;
+                        break;
+                }
+
+                if (prev_state == RD_KAFKA_BROKER_STATE_UP ||
+                    prev_state == RD_KAFKA_BROKER_STATE_UPDATE) {
+                        /* Connection torn down, wait a short while to
+                         * avoid busy-looping on protocol errors */
+                        rkb->rkb_reactor.ts_reconnect = now + 100*1000;
+                } else if (prev_state != RD_KAFKA_BROKER_STATE_INIT &&
+                           prev_state != RD_KAFKA_BROKER_STATE_DOWN &&
+                           rd_kafka_broker_addrs_exhausted(rkb)) {
+                        /* Connect failure and all addresses tried */
+                        rkb->rkb_reactor.ts_reconnect = now + 1000*1000;
+                }
+
+                if (rkb->rkb_reactor.ts_reconnect > now) {
+                        rd_kafka_broker_toppars_serve(rkb);
+                        next = RD_MIN(next, rkb->rkb_reactor.ts_reconnect);
+                        break;
+                }
+
+                /* Throttle & jitter reconnects, see thread_main() */
+                if (rk->rk_conf.reconnect_jitter_ms) {
+                        rd_ts_t backoff = rd_interval_immediate(
+                                &rkb->rkb_connect_intvl,
+                                rd_jitter(rk->rk_conf.reconnect_jitter_ms*500,
+                                          rk->rk_conf.reconnect_jitter_ms*1500),
+                                0);
+                        if (backoff <= 0) {
+                                rd_rkb_dbg(rkb, BROKER, "RECONNECT",
+                                           "Delaying next reconnect by %dms",
+                                           (int)(-backoff/1000));
+                                rkb->rkb_reactor.ts_reconnect = now - backoff;
+                                next = rkb->rkb_reactor.ts_reconnect;
+                                break;
+                        }
+                }
+
+                /* Initiate asynchronous connection attempt.
+                 * Only the host lookup is blocking here. */
+                if (rd_kafka_broker_connect(rkb) == -1 &&
+                    rd_kafka_broker_addrs_exhausted(rkb))
+                        rkb->rkb_reactor.ts_reconnect = now + 1000*1000;
+
+                next = now;
+                break;
+
+        case RD_KAFKA_BROKER_STATE_CONNECT:
+        case RD_KAFKA_BROKER_STATE_AUTH:
+        case RD_KAFKA_BROKER_STATE_AUTH_HANDSHAKE:
+        case RD_KAFKA_BROKER_STATE_APIVERSION_QUERY:
+                /* Asynchronous connect in progress. */
+                rd_kafka_broker_toppars_serve(rkb);
+                break;
+
+        case RD_KAFKA_BROKER_STATE_UPDATE:
+                rd_kafka_broker_lock(rkb);
+                rd_kafka_broker_set_state(rkb, RD_KAFKA_BROKER_STATE_UP);
+                rd_kafka_broker_unlock(rkb);
+                /* FALLTHRU */
+        case RD_KAFKA_BROKER_STATE_UP:
+                if (rkb->rkb_nodeid == RD_KAFKA_NODEID_UA)
+                        rd_kafka_broker_toppars_serve(rkb);
+                else if (rk->rk_type == RD_KAFKA_PRODUCER)
+                        next = rd_kafka_broker_producer_serve_once(
+                                rkb, &rkb->rkb_reactor.timeout_scan);
+                else if (rk->rk_type == RD_KAFKA_CONSUMER)
+                        next = rd_kafka_broker_consumer_serve_once(rkb);
+                break;
+        }
+
+        if (rd_kafka_terminating(rk))
+                rd_kafka_broker_terminating_fail_bufs(rkb);
+
+        /* Scan wait-response queue for timeouts. */
+        now = rd_clock();
+        if (rd_interval(&rkb->rkb_timeout_scan_intvl, 1000000, now) > 0)
+                rd_kafka_broker_timeout_scan(rkb, now);
+
+        if (rd_kafka_broker_terminating(rkb))
+                return 0;
+
+        rkb->rkb_reactor.state = rkb->rkb_state;
+
+        return next;
+}
+
+
 /**
  * Final destructor. Refcnt must be 0.
  */
 void rd_kafka_broker_destroy_final (rd_kafka_broker_t *rkb) {
+        int i;
 
         rd_kafka_assert(rkb->rkb_rk, thrd_is_current(rkb->rkb_thread));
         rd_kafka_assert(rkb->rkb_rk, TAILQ_EMPTY(&rkb->rkb_outbufs.rkbq_bufs));
@@ -3409,6 +4131,11 @@ void rd_kafka_broker_destroy_final (rd_kafka_broker_t *rkb) {
 	if (rkb->rkb_recv_buf)
 		rd_kafka_buf_destroy(rkb->rkb_recv_buf);
 
+        if (rkb->rkb_recvpool)
+                rd_kafka_recvpool_destroy(rkb->rkb_recvpool);
+
+        rd_list_destroy(&rkb->rkb_fetch_session.toppars);
+
 	if (rkb->rkb_rsal)
 		rd_sockaddr_list_destroy(rkb->rkb_rsal);
 
@@ -3422,7 +4149,10 @@ void rd_kafka_broker_destroy_final (rd_kafka_broker_t *rkb) {
         rd_avg_destroy(&rkb->rkb_avg_int_latency);
         rd_avg_destroy(&rkb->rkb_avg_outbuf_latency);
         rd_avg_destroy(&rkb->rkb_avg_rtt);
+        for (i = 0 ; i < RD_KAFKAP__NUM ; i++)
+                rd_avg_destroy(&rkb->rkb_avg_rtt_api[i]);
 	rd_avg_destroy(&rkb->rkb_avg_throttle);
+        rd_kafka_stats_bin_obj_destroy(&rkb->rkb_stats_bin);
 
         mtx_lock(&rkb->rkb_logname_lock);
         rd_free(rkb->rkb_logname);
@@ -3453,6 +4183,28 @@ rd_kafka_broker_t *rd_kafka_broker_internal (rd_kafka_t *rk) {
 }
 
 
+/**
+ * @returns true if requests of \p ApiKey have their own RTT window stats
+ *          (rkb_avg_rtt_api), in addition to the all-requests rkb_avg_rtt.
+ *
+ * Limited to the latency-sensitive requests to bound the per-broker
+ * histogram memory.
+ */
+static int rd_kafka_broker_rtt_api_tracked (int16_t ApiKey) {
+        switch (ApiKey)
+        {
+        case RD_KAFKAP_Produce:
+        case RD_KAFKAP_Fetch:
+        case RD_KAFKAP_OffsetCommit:
+        case RD_KAFKAP_Metadata:
+        case RD_KAFKAP_Heartbeat:
+                return 1;
+        default:
+                return 0;
+        }
+}
+
+
 /**
  * Adds a broker with refcount set to 1.
  * If 'source' is RD_KAFKA_INTERNAL an internal broker is added
@@ -3467,6 +4219,7 @@ rd_kafka_broker_t *rd_kafka_broker_add (rd_kafka_t *rk,
 					const char *name, uint16_t port,
 					int32_t nodeid) {
 	rd_kafka_broker_t *rkb;
+        int i;
 #ifndef _MSC_VER
         int r;
         sigset_t newset, oldset;
@@ -3495,6 +4248,8 @@ rd_kafka_broker_t *rd_kafka_broker_add (rd_kafka_t *rk,
 	rd_kafka_bufq_init(&rkb->rkb_waitresps);
 	rd_kafka_bufq_init(&rkb->rkb_retrybufs);
 	rkb->rkb_ops = rd_kafka_q_new(rk);
+        if (rk->rk_conf.lockfree_queues & RD_KAFKA_LOCKFREE_Q_BROKER)
+                rd_kafka_q_lockfree_enable(rkb->rkb_ops);
         rd_interval_init(&rkb->rkb_connect_intvl);
         rd_avg_init(&rkb->rkb_avg_int_latency, RD_AVG_GAUGE, 0, 100*1000, 2,
                     rk->rk_conf.stats_interval_ms ? 1 : 0);
@@ -3502,6 +4257,11 @@ rd_kafka_broker_t *rd_kafka_broker_add (rd_kafka_t *rk,
                     rk->rk_conf.stats_interval_ms ? 1 : 0);
         rd_avg_init(&rkb->rkb_avg_rtt, RD_AVG_GAUGE, 0, 500*1000, 2,
                     rk->rk_conf.stats_interval_ms ? 1 : 0);
+        for (i = 0 ; i < RD_KAFKAP__NUM ; i++)
+                rd_avg_init(&rkb->rkb_avg_rtt_api[i], RD_AVG_GAUGE,
+                            0, 500*1000, 2,
+                            rk->rk_conf.stats_interval_ms &&
+                            rd_kafka_broker_rtt_api_tracked((int16_t)i));
         rd_avg_init(&rkb->rkb_avg_throttle, RD_AVG_GAUGE, 0, 5000*1000, 2,
                     rk->rk_conf.stats_interval_ms ? 1 : 0);
         rd_refcnt_init(&rkb->rkb_refcnt, 0);
@@ -3509,6 +4269,19 @@ rd_kafka_broker_t *rd_kafka_broker_add (rd_kafka_t *rk,
 
         rkb->rkb_blocking_max_ms = rk->rk_conf.socket_blocking_max_ms;
 
+        rd_list_init(&rkb->rkb_fetch_session.toppars, 0,
+                     rd_kafka_fetch_session_toppar_destroy);
+
+        /* Large response buffer pool, sized to fit a maximum FetchResponse
+         * plus some slack for protocol overhead. */
+        if (source != RD_KAFKA_INTERNAL &&
+            rk->rk_type == RD_KAFKA_CONSUMER &&
+            rk->rk_conf.fetch_buffer_pool_enable)
+                rkb->rkb_recvpool = rd_kafka_recvpool_new(
+                        RD_MIN((size_t)rk->rk_conf.fetch_max_bytes +
+                               RD_KAFKA_RECVPOOL_SIZE_MIN,
+                               (size_t)rk->rk_conf.recv_max_msg_size));
+
 	/* ApiVersion fallback interval */
 	if (rkb->rkb_rk->rk_conf.api_version_request) {
 		rd_interval_init(&rkb->rkb_ApiVersion_fail_intvl);
@@ -3559,7 +4332,15 @@ rd_kafka_broker_t *rd_kafka_broker_add (rd_kafka_t *rk,
                            rd_strerror(r));
 
         } else if (source == RD_KAFKA_INTERNAL) {
-                /* nop: internal broker has no IO transport. */
+                /* Internal broker has no IO transport, but when served
+                 * by an IO thread the ops queue wake-ups are needed
+                 * to wake up the IO thread. */
+                if (rk->rk_reactor) {
+                        char onebyte = 1;
+                        rd_kafka_q_io_event_enable(rkb->rkb_ops,
+                                                   rkb->rkb_wakeup_fd[1],
+                                                   &onebyte, sizeof(onebyte));
+                }
 
         } else {
                 char onebyte = 1;
@@ -3585,11 +4366,18 @@ rd_kafka_broker_t *rd_kafka_broker_add (rd_kafka_t *rk,
         }
 #endif
 
+        rkb->rkb_reactor.fd = -1;
+
         /* Lock broker's lock here to synchronise state, i.e., hold off
 	 * the broker thread until we've finalized the rkb. */
 	rd_kafka_broker_lock(rkb);
         rd_kafka_broker_keep(rkb); /* broker thread's refcnt */
-	if (thrd_create(&rkb->rkb_thread,
+        if (rk->rk_reactor) {
+                /* Served by one of the shared IO threads,
+                 * which takes over the broker thread's refcnt. */
+                rd_kafka_reactor_add(rk->rk_reactor, rkb);
+
+        } else if (thrd_create(&rkb->rkb_thread,
 			rd_kafka_broker_thread_main, rkb) != thrd_success) {
 		char tmp[512];
 		rd_snprintf(tmp, sizeof(tmp),
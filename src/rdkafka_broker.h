@@ -84,6 +84,25 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
 	rd_ts_t             rkb_ts_fetch_backoff;
 	int                 rkb_fetching;
 
+        /**
+         * KIP-227 incremental fetch session.
+         * Only modified from the broker thread.
+         */
+        struct {
+                int32_t     id;       /**< Session id, 0 if no session */
+                int32_t     epoch;    /**< Epoch of the next FetchRequest:
+                                       *   0: full request, creating a
+                                       *      new session (closing \c id),
+                                       *   >0: incremental request,
+                                       *   -1: sessionless full request. */
+                rd_list_t   toppars;  /**< Partitions in session, sorted by
+                                       *   rktp, with the fetch position
+                                       *   last sent to the broker
+                                       *   (rd_kafka_fetch_session_toppar_t*)*/
+                int         gen;      /**< FetchRequest generation, used
+                                       *   to find partitions to forget. */
+        } rkb_fetch_session;
+
 	enum {
 		RD_KAFKA_BROKER_STATE_INIT,
 		RD_KAFKA_BROKER_STATE_DOWN,
@@ -145,8 +164,31 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
                 rd_atomic64_t zbuf_grow;     /* Compression/decompression buffer grows needed */
                 rd_atomic64_t buf_grow;      /* rkbuf grows needed */
                 rd_atomic64_t wakeups;       /* Poll wakeups */
+                rd_atomic64_t io_syscalls;   /* Socket IO and poll
+                                              * system calls */
+
+                /* FetchRequests */
+                struct {
+                        rd_atomic64_t full;        /* Full requests */
+                        rd_atomic64_t incremental; /* Incremental requests */
+                        rd_atomic64_t tx_bytes;    /* Request bytes */
+                        rd_atomic64_t rx_bytes;    /* Response bytes */
+                        rd_atomic64_t session_err; /* Session resets due to
+                                                    * FETCH_SESSION_ID_NOT_FOUND
+                                                    * or INVALID_FETCH_SESSION_EPOCH */
+                } fetch;
+
+                /* Decompressed MessageSets,
+                 * indexed by codec (rd_kafka_compression_t) */
+                struct {
+                        rd_atomic64_t cnt;   /* Decompressions */
+                        rd_atomic64_t bytes; /* Decompressed bytes */
+                        rd_atomic64_t us;    /* Time spent decompressing */
+                } decompress[RD_KAFKA_COMPRESSION_INHERIT];
 	} rkb_c;
 
+        rd_kafka_stats_bin_obj_t rkb_stats_bin; /* Binary stats state */
+
         int                 rkb_req_timeouts;  /* Current value */
 
 	rd_ts_t             rkb_ts_metadata_poll; /* Next metadata poll time */
@@ -159,6 +201,9 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
         rd_kafka_t         *rkb_rk;
 
 	rd_kafka_buf_t     *rkb_recv_buf;
+        rd_kafka_recvpool_t *rkb_recvpool;      /**< Large response buffer
+                                                 *   pool, if enabled by
+                                                 *   fetch.buffer.pool.enable */
 
 	int                 rkb_max_inflight;   /* Maximum number of in-flight
 						 * requests to broker.
@@ -166,6 +211,12 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
 	rd_kafka_bufq_t     rkb_outbufs;
 	rd_kafka_bufq_t     rkb_waitresps;
 	rd_kafka_bufq_t     rkb_retrybufs;
+        int                 rkb_offload_cnt;    /**< ProduceRequests being
+                                                 *   compressed, or fetched
+                                                 *   MessageSets being
+                                                 *   parsed, by the
+                                                 *   offload pool.
+                                                 *   Broker thread. */
 
 	rd_avg_t            rkb_avg_int_latency;/* Current internal latency period*/
         rd_avg_t            rkb_avg_outbuf_latency; /**< Current latency
@@ -173,6 +224,12 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
                                                      *   and writing to socket
                                                      */
 	rd_avg_t            rkb_avg_rtt;        /* Current RTT period */
+        rd_avg_t            rkb_avg_rtt_api[RD_KAFKAP__NUM]; /**< Current RTT
+                                                           *   period per
+                                                           *   ApiKey, see
+                                                           *   rd_kafka_broker_
+                                                           *   rtt_api_tracked()
+                                                           */
 	rd_avg_t            rkb_avg_throttle;   /* Current throttle period */
 
         /* These are all protected by rkb_lock */
@@ -195,6 +252,27 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
                                                    * if enabled. */
         rd_interval_t       rkb_connect_intvl;    /* Reconnect throttling */
 
+        /**
+         * IO reactor state, only used when the broker is served by
+         * a shared IO thread (`broker.io.threads` > 0) rather than
+         * its own broker thread.
+         * Owned by the IO thread.
+         */
+        struct {
+                TAILQ_ENTRY(rd_kafka_broker_s) link; /**< IO thread's
+                                                      *   broker list */
+                struct rd_kafka_reactor_thread_s *thrd; /**< IO thread */
+                rd_ts_t       ts_wakeup;    /**< Serve again at this time */
+                rd_ts_t       ts_reconnect; /**< Hold off reconnect until */
+                rd_interval_t timeout_scan; /**< Msg timeout scan intvl */
+                int           state;        /**< Broker state as seen by
+                                             *   the previous round */
+                int           fd;           /**< Registered transport fd,
+                                             *   or -1 */
+                int           events;       /**< Registered POLL* events */
+                int           revents;      /**< Pending POLL* events */
+        } rkb_reactor;
+
 	rd_kafka_secproto_t rkb_proto;
 
 	int                 rkb_down_reported;    /* Down event reported */
@@ -325,6 +403,9 @@ void rd_kafka_broker_buf_retry (rd_kafka_broker_t *rkb, rd_kafka_buf_t *rkbuf);
 
 rd_kafka_broker_t *rd_kafka_broker_internal (rd_kafka_t *rk);
 
+void rd_kafka_broker_decommission (rd_kafka_broker_t *rkb);
+rd_ts_t rd_kafka_broker_reactor_serve (rd_kafka_broker_t *rkb, int events);
+
 void msghdr_print (rd_kafka_t *rk,
 		   const char *what, const struct msghdr *msg,
 		   int hexdump);
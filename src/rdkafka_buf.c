@@ -67,6 +67,9 @@ void rd_kafka_buf_destroy_final (rd_kafka_buf_t *rkbuf) {
         if (rkbuf->rkbuf_rkb)
                 rd_kafka_broker_destroy(rkbuf->rkbuf_rkb);
 
+        if (rkbuf->rkbuf_parent)
+                rd_kafka_buf_destroy(rkbuf->rkbuf_parent);
+
         rd_refcnt_destroy(&rkbuf->rkbuf_refcnt);
 
 	rd_free(rkbuf);
@@ -184,6 +187,43 @@ rd_kafka_buf_t *rd_kafka_buf_new_shadow (const void *ptr, size_t size,
 }
 
 
+/**
+ * @brief Create a read-only view buffer whose reader is \p slice
+ *        of \p parent's buffer.
+ *
+ * The view holds a reference to \p parent (and its broker, if any)
+ * which is thus kept alive as long as the view is. This allows the
+ * same (received) buffer to be read by multiple threads at once,
+ * each using its own view.
+ */
+rd_kafka_buf_t *rd_kafka_buf_new_view (rd_kafka_buf_t *parent,
+                                       const rd_slice_t *slice) {
+        rd_kafka_buf_t *rkbuf;
+
+        rkbuf = rd_calloc(1, sizeof(*rkbuf));
+
+        rkbuf->rkbuf_reqhdr = parent->rkbuf_reqhdr;
+        rkbuf->rkbuf_reshdr = parent->rkbuf_reshdr;
+        rkbuf->rkbuf_ts_enq = parent->rkbuf_ts_enq;
+
+        rd_buf_init(&rkbuf->rkbuf_buf, 0, 0);
+
+        rkbuf->rkbuf_reader = *slice;
+        rkbuf->rkbuf_totlen = rd_slice_remains(slice);
+
+        rd_kafka_buf_keep(parent);
+        rkbuf->rkbuf_parent = parent;
+
+        if ((rkbuf->rkbuf_rkb = parent->rkbuf_rkb))
+                rd_kafka_broker_keep(rkbuf->rkbuf_rkb);
+
+	rd_kafka_msgq_init(&rkbuf->rkbuf_msgq);
+
+        rd_refcnt_init(&rkbuf->rkbuf_refcnt, 1);
+
+        return rkbuf;
+}
+
 
 void rd_kafka_bufq_enq (rd_kafka_bufq_t *rkbufq, rd_kafka_buf_t *rkbuf) {
 	TAILQ_INSERT_TAIL(&rkbufq->rkbq_bufs, rkbuf, rkbuf_link);
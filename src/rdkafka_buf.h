@@ -493,7 +493,10 @@ struct rd_kafka_buf_s { /* rd_kafka_buf_t */
         int     rkbuf_features;   /* Required feature(s) that must be
                                    * supported by broker. */
 
-	rd_ts_t rkbuf_ts_enq;
+	rd_ts_t rkbuf_ts_enq;     /* Request: time of enqueue for transmission,
+                                   * Fetch response: time of receipt,
+                                   * inherited by its views and
+                                   * decompressed shadow buffers. */
 	rd_ts_t rkbuf_ts_sent;    /* Initially: Absolute time of transmission,
 				   * after response: RTT. */
 
@@ -547,6 +550,12 @@ struct rd_kafka_buf_s { /* rd_kafka_buf_t */
 
         rd_kafka_resp_err_t rkbuf_err;      /* Buffer parsing error code */
 
+        struct rd_kafka_buf_s *rkbuf_parent; /**< Parent buffer owning the
+                                              *   memory read by this
+                                              *   view buffer's
+                                              *   rkbuf_reader.
+                                              *   See rd_kafka_buf_new_view()*/
+
         union {
                 struct {
                         rd_list_t *topics;  /* Requested topics (char *) */
@@ -564,6 +573,11 @@ struct rd_kafka_buf_s { /* rd_kafka_buf_t */
                         mtx_t *decr_lock;
 
                 } Metadata;
+
+                struct {
+                        int32_t session_epoch; /* Fetch session epoch sent,
+                                                * -1 if sessionless. */
+                } Fetch;
         } rkbuf_u;
 
         const char *rkbuf_uflow_mitigation; /**< Buffer read underflow
@@ -643,6 +657,8 @@ rd_kafka_buf_t *rd_kafka_buf_new_request (rd_kafka_broker_t *rkb, int16_t ApiKey
                                           int segcnt, size_t size);
 rd_kafka_buf_t *rd_kafka_buf_new_shadow (const void *ptr, size_t size,
                                          void (*free_cb) (void *));
+rd_kafka_buf_t *rd_kafka_buf_new_view (rd_kafka_buf_t *parent,
+                                       const rd_slice_t *slice);
 void rd_kafka_bufq_enq (rd_kafka_bufq_t *rkbufq, rd_kafka_buf_t *rkbuf);
 void rd_kafka_bufq_deq (rd_kafka_bufq_t *rkbufq, rd_kafka_buf_t *rkbuf);
 void rd_kafka_bufq_init(rd_kafka_bufq_t *rkbufq);
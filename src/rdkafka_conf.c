@@ -130,7 +130,8 @@ rd_kafka_conf_validate_partitioner (const struct rd_kafka_property *prop,
                 !strcmp(val, "consistent") ||
                 !strcmp(val, "consistent_random") ||
                 !strcmp(val, "murmur2") ||
-                !strcmp(val, "murmur2_random");
+                !strcmp(val, "murmur2_random") ||
+                !strcmp(val, "sticky");
 }
 
 
@@ -166,6 +167,9 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 #endif
 #if WITH_PLUGINS
                 { 0x200, "plugins" },
+#endif
+#if WITH_ZSTD
+                { 0x400, "zstd" },
 #endif
 		{ 0, NULL }
 		}
@@ -278,6 +282,35 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
           "A lower value improves responsiveness at the expense of "
           "slightly higher CPU usage. **Deprecated**",
 	  1, 60*1000, 1000 },
+        { _RK_GLOBAL, "broker.io.threads", _RK_C_INT,
+          _RK(broker_io_threads),
+          "Number of IO threads serving the broker connections. "
+          "Each IO thread multiplexes the sockets and queues of its share "
+          "of the brokers using epoll, which reduces the number of threads "
+          "and context switches for clusters with many brokers. "
+          "Broker host name resolution is blocking and will stall the "
+          "other brokers served by the same IO thread while it lasts. "
+          "Only supported on platforms with epoll (Linux). "
+          "0 = one thread per broker.",
+          0, 256, 0 },
+        { _RK_GLOBAL, "lockfree.queues", _RK_C_S2F, _RK(lockfree_queues),
+          "Comma-separated list of internal op queues for which "
+          "enqueuing is lock-free: "
+          "producing threads push ops on an intrusive list which the "
+          "polling thread moves to the queue in bulk, and only the push "
+          "that finds the list empty locks the queue to wake up the "
+          "polling thread. "
+          "*broker* = the broker threads' op queues (requests from the "
+          "application and other threads), "
+          "*main* = the main queue served by `rd_kafka_poll()` "
+          "(delivery reports, errors, statistics, etc). "
+          "This reduces lock contention when many threads enqueue ops "
+          "on the same queue, with a single CPU there is no contention "
+          "and the locked queue is as fast.",
+          .s2i = {
+                        { RD_KAFKA_LOCKFREE_Q_BROKER, "broker" },
+                        { RD_KAFKA_LOCKFREE_Q_MAIN,   "main" },
+                } },
 	{ _RK_GLOBAL, "socket.send.buffer.bytes", _RK_C_INT,
 	  _RK(socket_sndbuf_size),
 	  "Broker socket send buffer size. System default is used if 0.",
@@ -294,6 +327,16 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 	  _RK(socket_nagle_disable),
           "Disable the Nagle algorithm (TCP_NODELAY).",
           0, 1, 0 },
+        { _RK_GLOBAL, "socket.io_uring.enable", _RK_C_BOOL,
+          _RK(socket_io_uring_enable),
+          "Use io_uring for broker socket IO: each broker thread IO loop "
+          "iteration submits its sends and receives and waits for their "
+          "completion with a single system call, rather than one system "
+          "call per poll, send and receive. "
+          "Only applies to plaintext connections with "
+          "`broker.io.threads=0` on Linux 5.11 or later, "
+          "otherwise (or if io_uring can't be set up) poll() is used.",
+          0, 1, 0 },
         { _RK_GLOBAL, "socket.max.fails", _RK_C_INT,
           _RK(socket_max_fails),
           "Disconnect from broker when this number of send failures "
@@ -324,6 +367,21 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 	  "register a stats callback using `rd_kafka_conf_set_stats_cb()`. "
 	  "The granularity is 1000ms. A value of 0 disables statistics.",
 	  0, 86400*1000, 0 },
+        { _RK_GLOBAL, "statistics.format", _RK_C_S2F, _RK(stats_format),
+          "Comma-separated list of statistics formats to emit: "
+          "*json* = the JSON object described in STATISTICS.md, "
+          "passed to the `stats_cb` (or stats event), "
+          "*binary* = a compact encoding carrying only the values that "
+          "changed since the previous emit, "
+          "passed to the `stats_binary_cb` "
+          "(see `rd_kafka_conf_set_stats_binary_cb()`). "
+          "The binary format avoids the cost of producing and parsing "
+          "the JSON object for handles with many partitions.",
+          0, 0x7fffffff, RD_KAFKA_STATS_FMT_JSON,
+          .s2i = {
+                        { RD_KAFKA_STATS_FMT_JSON,   "json" },
+                        { RD_KAFKA_STATS_FMT_BINARY, "binary" },
+                } },
 	{ _RK_GLOBAL, "enabled_events", _RK_C_INT,
 	  _RK(enabled_events),
 	  "See `rd_kafka_conf_set_events()`",
@@ -337,6 +395,10 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 	{ _RK_GLOBAL, "stats_cb", _RK_C_PTR,
 	  _RK(stats_cb),
 	  "Statistics callback (set with rd_kafka_conf_set_stats_cb())" },
+        { _RK_GLOBAL, "stats_binary_cb", _RK_C_PTR,
+          _RK(stats_binary_cb),
+          "Binary statistics callback "
+          "(set with rd_kafka_conf_set_stats_binary_cb())" },
 	{ _RK_GLOBAL, "log_cb", _RK_C_PTR,
 	  _RK(log_cb),
 	  "Log callback (set with rd_kafka_conf_set_log_cb())",
@@ -662,6 +724,28 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 	  "This value may be overshot by fetch.message.max.bytes. "
 	  "This property has higher priority than queued.min.messages.",
           1, INT_MAX/1024, 0x100000/*1GB*/ },
+	{ _RK_GLOBAL|_RK_CONSUMER, "queued.max.total.kbytes", _RK_C_INT,
+	  _RK(queued_max_total_kbytes),
+          "Maximum number of kilobytes of fetched messages buffered "
+          "by this instance across all partitions, including messages "
+          "returned to the application that have not yet been destroyed. "
+          "Fetching is paused while the budget is exceeded, and once "
+          "more than half of it is in use a partition may only fetch "
+          "while below its fair share of the budget "
+          "(the budget divided by the number of fetching partitions), "
+          "so that busy partitions do not starve the others. "
+          "This value may be overshot by one FetchResponse "
+          "(fetch.max.bytes) per broker. "
+          "0 disables the budget.",
+          0, INT_MAX/1024, 0 },
+	{ _RK_GLOBAL|_RK_CONSUMER, "queued.max.process.kbytes", _RK_C_INT,
+	  _RK(queued_max_process_kbytes),
+          "Like queued.max.total.kbytes but compared to the fetched "
+          "messages buffered by all consumer instances in the process, "
+          "shared fairly among all their fetching partitions. "
+          "Each instance applies its own configured value. "
+          "0 disables the budget.",
+          0, INT_MAX/1024, 0 },
 	{ _RK_GLOBAL|_RK_CONSUMER, "fetch.wait.max.ms", _RK_C_INT,
 	  _RK(fetch_wait_max_ms),
 	  "Maximum time the broker may wait to fill the response "
@@ -690,6 +774,45 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
           "`fetch.max.bytes` is automatically adjusted upwards to be "
           "at least `message.max.bytes` (consumer config).",
           0, INT_MAX-512, 50*1024*1024 /* 50MB */ },
+        { _RK_GLOBAL|_RK_CONSUMER, "fetch.adaptive.enable", _RK_C_BOOL,
+          _RK(fetch_adaptive_enable),
+          "Adapt the number of bytes to request for each partition "
+          "to its observed throughput rather than always requesting "
+          "`fetch.message.max.bytes`: "
+          "partitions that fill their fetch size are given larger fetch "
+          "sizes, up to `fetch.max.bytes`, while idle partitions "
+          "shrink to 64 kilobytes (or `fetch.message.max.bytes` "
+          "if lower), reducing the number of round trips for busy "
+          "partitions and the worst-case response size for idle ones. "
+          "Fetch sizes are also limited by the remaining space in the "
+          "partition's local queue (`queued.max.messages.kbytes`) and "
+          "the sum of all partitions' fetch sizes in a FetchRequest "
+          "is limited to `fetch.max.bytes`.",
+          0, 1, 0 },
+        { _RK_GLOBAL|_RK_CONSUMER, "fetch.lazy.enable", _RK_C_BOOL,
+          _RK(fetch_lazy_enable),
+          "Enqueue each fetched MsgVersion v2 RecordBatch as a single "
+          "view of its records, pointing into the FetchResponse buffer, "
+          "rather than as one message object per record. "
+          "The message objects are only created as the application "
+          "consumes the messages. "
+          "Since a view counts as one entry in the local consumer queue "
+          "`rd_kafka_queue_length()` counts RecordBatches rather than "
+          "messages, while `queued.min.messages` and "
+          "`queued.max.messages.kbytes` are not affected.",
+          0, 1, 0 },
+        { _RK_GLOBAL|_RK_CONSUMER, "fetch.buffer.pool.enable", _RK_C_BOOL,
+          _RK(fetch_buffer_pool_enable),
+          "Receive large responses, such as FetchResponses, into buffers "
+          "borrowed from a per-broker pool of recycled, huge-page aligned, "
+          "memory chunks (sized up to `fetch.max.bytes`) rather than "
+          "allocating new memory for each response. "
+          "Chunks are returned to the pool when all messages referencing "
+          "the response have been destroyed. "
+          "This reduces allocation and page fault overhead for "
+          "fetch-heavy consumers at the expense of up to four cached "
+          "chunks per size class being retained by each broker.",
+          0, 1, 0 },
 	{ _RK_GLOBAL|_RK_CONSUMER, "fetch.min.bytes", _RK_C_INT,
 	  _RK(fetch_min_bytes),
 	  "Minimum number of bytes the broker responds with. "
@@ -736,6 +859,15 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
           "on-disk corruption to the messages occurred. This check comes "
           "at slightly increased CPU usage.",
           0, 1, 0 },
+        { _RK_GLOBAL|_RK_CONSUMER, "decompression.threads", _RK_C_INT,
+          _RK(decompression_threads),
+          "Number of worker threads used to parse and decompress the "
+          "fetched MessageSets off the broker threads, allowing the "
+          "MessageSets of all partitions in a FetchResponse to be "
+          "decompressed in parallel. Messages are still enqueued in "
+          "offset order for each partition. "
+          "0 = parse on the broker threads.",
+          0, 256, 0 },
 	/* Global producer properties */
 	{ _RK_GLOBAL|_RK_PRODUCER, "queue.buffering.max.messages", _RK_C_INT,
 	  _RK(queue_buffering_max_msgs),
@@ -791,19 +923,50 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 			{ RD_KAFKA_COMPRESSION_SNAPPY, "snappy" },
 #endif
                         { RD_KAFKA_COMPRESSION_LZ4, "lz4" },
+#if WITH_ZSTD
+                        { RD_KAFKA_COMPRESSION_ZSTD, "zstd" },
+#endif
 			{ 0 }
 		} },
         { _RK_GLOBAL|_RK_PRODUCER, "compression.type", _RK_C_ALIAS,
           .sdef = "compression.codec" },
+        { _RK_GLOBAL|_RK_PRODUCER, "compression.threads", _RK_C_INT,
+          _RK(compression_threads),
+          "Number of worker threads used to compress large MessageSets "
+          "(of at least 32 kilobytes uncompressed) off the broker threads, "
+          "allowing multiple MessageSets, also for the same partition, to "
+          "be compressed in parallel. MessageSets are still sent in order "
+          "for each partition. "
+          "0 = compress on the broker threads.",
+          0, 256, 0 },
 	{ _RK_GLOBAL|_RK_PRODUCER, "batch.num.messages", _RK_C_INT,
 	  _RK(batch_num_messages),
 	  "Maximum number of messages batched in one MessageSet. "
 	  "The total MessageSet size is also limited by message.max.bytes.",
 	  1, 1000000, 10000 },
+        { _RK_GLOBAL|_RK_PRODUCER, "sticky.partitioning.linger.ms", _RK_C_INT,
+          _RK(sticky_linger_ms),
+          "Minimum time in milliseconds the `sticky` partitioner keeps "
+          "assigning keyless messages to the same partition before switching "
+          "to a new partition, unless the batch fills up before that "
+          "(`batch.num.messages` or `message.max.bytes`). "
+          "The effective time is the larger of this value and "
+          "`queue.buffering.max.ms`.",
+          0, 900*1000, 10 },
 	{ _RK_GLOBAL|_RK_PRODUCER, "delivery.report.only.error", _RK_C_BOOL,
 	  _RK(dr_err_only),
 	  "Only provide delivery reports for failed messages.",
 	  0, 1, 0 },
+        { _RK_GLOBAL|_RK_PRODUCER, "message.pool.enable", _RK_C_BOOL,
+          _RK(msg_pool_enable),
+          "Allocate produced messages, including copied payloads and keys "
+          "that fit in the pool's size classes (up to 8 kilobytes), from a "
+          "per-instance slab allocator with per-thread free lists rather "
+          "than the system allocator. "
+          "This reduces allocator contention at high message rates "
+          "at the expense of memory not being returned to the system "
+          "until the instance is destroyed.",
+          0, 1, 0 },
 	{ _RK_GLOBAL|_RK_PRODUCER, "dr_cb", _RK_C_PTR,
 	  _RK(dr_cb),
 	  "Delivery report callback (set with rd_kafka_conf_set_dr_cb())" },
@@ -871,7 +1034,8 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
           "`consistent` - CRC32 hash of key (Empty and NULL keys are mapped to single partition), "
           "`consistent_random` - CRC32 hash of key (Empty and NULL keys are randomly partitioned), "
           "`murmur2` - Java Producer compatible Murmur2 hash of key (NULL keys are mapped to single partition), "
-          "`murmur2_random` - Java Producer compatible Murmur2 hash of key (NULL keys are randomly partitioned. This is functionally equivalent to the default partitioner in the Java Producer.).",
+          "`murmur2_random` - Java Producer compatible Murmur2 hash of key (NULL keys are randomly partitioned. This is functionally equivalent to the default partitioner in the Java Producer.), "
+          "`sticky` - CRC32 hash of key (Empty and NULL keys are assigned to the same partition until the batch is full or `sticky.partitioning.linger.ms` expires, yielding fewer and larger batches).",
           .sdef = "consistent_random",
           .validate = rd_kafka_conf_validate_partitioner },
 	{ _RK_TOPIC|_RK_PRODUCER, "partitioner_cb", _RK_C_PTR,
@@ -900,11 +1064,21 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 		  { RD_KAFKA_COMPRESSION_SNAPPY, "snappy" },
 #endif
 		  { RD_KAFKA_COMPRESSION_LZ4, "lz4" },
+#if WITH_ZSTD
+		  { RD_KAFKA_COMPRESSION_ZSTD, "zstd" },
+#endif
 		  { RD_KAFKA_COMPRESSION_INHERIT, "inherit" },
 		  { 0 }
 		} },
         { _RK_TOPIC | _RK_PRODUCER, "compression.type", _RK_C_ALIAS,
           .sdef = "compression.codec" },
+        { _RK_TOPIC | _RK_PRODUCER, "compression.level", _RK_C_INT,
+          _RKT(compression_level),
+          "Compression level parameter for the `zstd` compression codec: "
+          "higher values give better compression ratio at the cost of "
+          "higher CPU usage. -1 = codec-dependent default compression "
+          "level. Ignored by the other codecs.",
+          -1, 22, -1 },
 
 
         /* Topic consumer properties */
@@ -1808,6 +1982,15 @@ void rd_kafka_conf_set_stats_cb (rd_kafka_conf_t *conf,
 	conf->stats_cb = stats_cb;
 }
 
+void rd_kafka_conf_set_stats_binary_cb (rd_kafka_conf_t *conf,
+                                        int (*stats_binary_cb) (
+                                                rd_kafka_t *rk,
+                                                char *buf,
+                                                size_t size,
+                                                void *opaque)) {
+        conf->stats_binary_cb = stats_binary_cb;
+}
+
 void rd_kafka_conf_set_socket_cb (rd_kafka_conf_t *conf,
                                   int (*socket_cb) (int domain, int type,
                                                     int protocol,
@@ -18,6 +18,7 @@ typedef enum {
 	RD_KAFKA_COMPRESSION_GZIP = RD_KAFKA_MSG_ATTR_GZIP,
 	RD_KAFKA_COMPRESSION_SNAPPY = RD_KAFKA_MSG_ATTR_SNAPPY,
         RD_KAFKA_COMPRESSION_LZ4 = RD_KAFKA_MSG_ATTR_LZ4,
+        RD_KAFKA_COMPRESSION_ZSTD = RD_KAFKA_MSG_ATTR_ZSTD,
 	RD_KAFKA_COMPRESSION_INHERIT /* Inherit setting from global conf */
 } rd_kafka_compression_t;
 
@@ -53,6 +54,20 @@ typedef enum {
 
 
 
+/**
+ * Queue types for lockfree.queues
+ */
+#define RD_KAFKA_LOCKFREE_Q_BROKER  0x1  /* rkb_ops */
+#define RD_KAFKA_LOCKFREE_Q_MAIN    0x2  /* rk_rep */
+
+
+/**
+ * Formats for statistics.format
+ */
+#define RD_KAFKA_STATS_FMT_JSON    0x1  /* stats_cb */
+#define RD_KAFKA_STATS_FMT_BINARY  0x2  /* stats_binary_cb */
+
+
 typedef enum {
         RD_KAFKA_OFFSET_METHOD_NONE,
         RD_KAFKA_OFFSET_METHOD_FILE,
@@ -89,14 +104,18 @@ struct rd_kafka_conf_s {
         int     broker_addr_family;
 	int     socket_timeout_ms;
 	int     socket_blocking_max_ms;
+        int     broker_io_threads;
+        int     lockfree_queues;
 	int     socket_sndbuf_size;
 	int     socket_rcvbuf_size;
         int     socket_keepalive;
 	int     socket_nagle_disable;
+        int     socket_io_uring_enable;
         int     socket_max_fails;
 	char   *client_id_str;
 	char   *brokerlist;
 	int     stats_interval_ms;
+        int     stats_format;
 	int     term_sig;
         int     reconnect_jitter_ms;
 	int     api_version_request;
@@ -178,12 +197,20 @@ struct rd_kafka_conf_s {
 	 * Consumer configuration
 	 */
         int    check_crcs;
+        int    decompression_threads;
 	int    queued_min_msgs;
         int    queued_max_msg_kbytes;
         int64_t queued_max_msg_bytes;
+        int    queued_max_total_kbytes;
+        int64_t queued_max_total_bytes;
+        int    queued_max_process_kbytes;
+        int64_t queued_max_process_bytes;
 	int    fetch_wait_max_ms;
         int    fetch_msg_max_bytes;
         int    fetch_max_bytes;
+        int    fetch_buffer_pool_enable;
+        int    fetch_adaptive_enable;
+        int    fetch_lazy_enable;
 	int    fetch_min_bytes;
 	int    fetch_error_backoff_ms;
         char  *group_id_str;
@@ -226,8 +253,11 @@ struct rd_kafka_conf_s {
 	int    max_retries;
 	int    retry_backoff_ms;
 	int    batch_num_messages;
+        int    sticky_linger_ms;
 	rd_kafka_compression_t compression_codec;
+        int    compression_threads;
 	int    dr_err_only;
+        int    msg_pool_enable;
 
 	/* Message delivery report callback.
 	 * Called once for each produced message, either on
@@ -280,6 +310,12 @@ struct rd_kafka_conf_s {
 			 size_t json_len,
 			 void *opaque);
 
+        /* Binary stats callback */
+        int (*stats_binary_cb) (rd_kafka_t *rk,
+                                char *buf,
+                                size_t size,
+                                void *opaque);
+
         /* Socket creation callback */
         int (*socket_cb) (int domain, int type, int protocol, void *opaque);
 
@@ -332,6 +368,7 @@ struct rd_kafka_topic_conf_s {
         int (*msg_order_cmp) (const void *a, const void *b);
 
 	rd_kafka_compression_t compression_codec;
+        int     compression_level;
         int     produce_offset_report;
 
         int     consume_callback_max_msgs;
@@ -98,6 +98,7 @@ rd_kafka_event_message_next (rd_kafka_event_t *rkev) {
 
 		/* Store offset */
 		rd_kafka_op_offset_store(NULL, rko, rkmessage);
+                rd_kafka_op_fetchq_latency_add(rko);
 
 		return rkmessage;
 
@@ -43,6 +43,8 @@ static const char *rd_kafka_feature_names[] = {
 	"LZ4",
         "OffsetTime",
         "MsgVer2",
+        "ZSTD",
+        "FetchSession",
 	NULL
 };
 
@@ -84,6 +86,23 @@ static const struct rd_kafka_feature_map {
                         { -1 },
                 },
         },
+        {
+                /* @brief >=2.1.0: ZSTD compression (KIP-110) */
+                .feature = RD_KAFKA_FEATURE_ZSTD,
+                .depends = {
+                        { RD_KAFKAP_Produce, 7, 7 },
+                        { RD_KAFKAP_Fetch, 10, 10 },
+                        { -1 },
+                },
+        },
+        {
+                /* @brief >=1.1.0: Incremental fetch sessions (KIP-227) */
+                .feature = RD_KAFKA_FEATURE_FETCH_SESSION,
+                .depends = {
+                        { RD_KAFKAP_Fetch, 7, 7 },
+                        { -1 },
+                },
+        },
 	{
 		
 		/* @brief >=0.10.0: ApiVersionQuery support.
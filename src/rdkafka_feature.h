@@ -66,6 +66,14 @@
  *  + EOS message format KIP-98 */
 #define RD_KAFKA_FEATURE_MSGVER2     0x200
 
+/* >= 2.1.0: ZSTD compression (KIP-110), requires
+ *  ProduceRequest v7 and FetchRequest v10 */
+#define RD_KAFKA_FEATURE_ZSTD        0x400
+
+/* >= 1.1.0: Incremental fetch sessions (KIP-227), requires
+ *  FetchRequest v7 */
+#define RD_KAFKA_FEATURE_FETCH_SESSION 0x800
+
 
 int rd_kafka_get_legacy_ApiVersions (const char *broker_version,
 				     struct rd_kafka_ApiVersion **apisp,
@@ -48,6 +48,7 @@ typedef int mode_t;
 #include "rdinterval.h"
 #include "rdavg.h"
 #include "rdlist.h"
+#include "rdheap.h"
 
 #if WITH_SSL
 #include <openssl/ssl.h>
@@ -88,12 +89,17 @@ typedef RD_SHARED_PTR_TYPE(, struct rd_kafka_itopic_s) shptr_rd_kafka_itopic_t;
 #include "rdkafka_op.h"
 #include "rdkafka_queue.h"
 #include "rdkafka_msg.h"
+#include "rdkafka_msgpool.h"
+#include "rdkafka_recvpool.h"
+#include "rdkafka_offload.h"
+#include "rdkafka_reactor.h"
 #include "rdkafka_proto.h"
 #include "rdkafka_buf.h"
 #include "rdkafka_pattern.h"
 #include "rdkafka_conf.h"
 #include "rdkafka_transport.h"
 #include "rdkafka_timer.h"
+#include "rdkafka_stats.h"
 #include "rdkafka_assignor.h"
 #include "rdkafka_metadata.h"
 
@@ -139,8 +145,26 @@ struct rd_kafka_s {
 
 
 	TAILQ_HEAD(, rd_kafka_itopic_s)  rk_topics;
+        rd_avl_t         rk_topic_avl;   /* rk_topics indexed by name */
 	int              rk_topic_cnt;
 
+        /* Partitions with messages in rktp_msgq (or its ingress list)
+         * ordered by the earliest time any of those messages may time
+         * out, so that the message timeout scan only visits partitions
+         * with timed out messages.
+         * See rd_kafka_toppar_msgq_tmout_schedule(). */
+        struct {
+                mtx_t     lock;
+                rd_heap_t heap;   /* rd_kafka_toppar_t by rktp_msgq_tmout */
+        } rk_msgq_tmout;
+
+        /* Binary statistics state, see rd_kafka_stats_emit_binary() */
+        struct {
+                int32_t  next_id;  /* Last assigned object id */
+                uint64_t seq;      /* Next emit sequence number */
+                rd_kafka_stats_bin_obj_t obj; /* Handle object */
+        } rk_stats_bin;
+
         struct rd_kafka_cgrp_s *rk_cgrp;
 
         rd_kafka_conf_t  rk_conf;
@@ -194,6 +218,27 @@ struct rd_kafka_s {
 		size_t max_size; /* Max limit */
 	} rk_curr_msgs;
 
+        /**
+         * Consumer prefetch memory budget (queued.max.total.kbytes),
+         * see rd_kafka_toppar_fetch_decide().
+         */
+        struct {
+                rd_atomic64_t bytes;     /**< Size of fetched messages
+                                          *   not yet destroyed. */
+                rd_atomic32_t fetch_cnt; /**< Partitions in
+                                          *   active fetch state. */
+        } rk_fetchq;
+
+        rd_kafka_msgpool_t *rk_msgpool;  /**< Producer message allocator,
+                                          *   if `message.pool.enable` */
+
+        rd_kafka_offload_t *rk_offload;  /**< Producer compression worker
+                                          *   pool,
+                                          *   if `compression.threads` > 0 */
+
+        rd_kafka_reactor_t *rk_reactor;  /**< Broker IO threads,
+                                          *   if `broker.io.threads` > 0 */
+
         rd_kafka_timers_t rk_timers;
 	thrd_t rk_thread;
 
@@ -429,6 +474,16 @@ rd_kafka_resp_err_t rd_kafka_set_last_error (rd_kafka_resp_err_t err,
 
 extern rd_atomic32_t rd_kafka_thread_cnt_curr;
 
+/**
+ * Process-wide consumer prefetch accounting (queued.max.process.kbytes),
+ * the sum of all instances' rk_fetchq.
+ */
+struct rd_kafka_fetchq_global_s {
+        rd_atomic64_t bytes;
+        rd_atomic32_t fetch_cnt;
+};
+extern struct rd_kafka_fetchq_global_s rd_kafka_fetchq_global;
+
 void rd_kafka_set_thread_name (const char *fmt, ...);
 void rd_kafka_set_thread_sysname (const char *fmt, ...);
 
@@ -42,6 +42,42 @@
 
 #include <stdarg.h>
 
+rd_kafka_payload_ref_t *
+rd_kafka_payload_ref_new (void *payload, size_t len,
+                          void (*free_cb) (void *payload, size_t len,
+                                           void *opaque),
+                          void *opaque) {
+        rd_kafka_payload_ref_t *pref;
+
+        pref = rd_malloc(sizeof(*pref));
+        rd_refcnt_init(&pref->pref_refcnt, 1);
+        pref->pref_payload = payload;
+        pref->pref_len     = len;
+        pref->pref_free_cb = free_cb;
+        pref->pref_opaque  = opaque;
+
+        return pref;
+}
+
+rd_kafka_payload_ref_t *
+rd_kafka_payload_ref_keep (rd_kafka_payload_ref_t *pref) {
+        rd_refcnt_add(&pref->pref_refcnt);
+        return pref;
+}
+
+void rd_kafka_payload_ref_destroy (rd_kafka_payload_ref_t *pref) {
+        if (rd_refcnt_sub(&pref->pref_refcnt) > 0)
+                return;
+
+        if (pref->pref_free_cb)
+                pref->pref_free_cb(pref->pref_payload, pref->pref_len,
+                                   pref->pref_opaque);
+
+        rd_refcnt_destroy(&pref->pref_refcnt);
+        rd_free(pref);
+}
+
+
 void rd_kafka_msg_destroy (rd_kafka_t *rk, rd_kafka_msg_t *rkm) {
 
 	if (rkm->rkm_flags & RD_KAFKA_MSG_F_ACCOUNT) {
@@ -61,9 +97,13 @@ void rd_kafka_msg_destroy (rd_kafka_t *rk, rd_kafka_msg_t *rkm) {
 
 	if (rkm->rkm_flags & RD_KAFKA_MSG_F_FREE && rkm->rkm_payload)
 		rd_free(rkm->rkm_payload);
+        else if (rkm->rkm_flags & RD_KAFKA_MSG_F_PAYLOAD_REF)
+                rd_kafka_payload_ref_destroy(rkm->rkm_u.producer.pref);
 
 	if (rkm->rkm_flags & RD_KAFKA_MSG_F_FREE_RKM)
 		rd_free(rkm);
+        else if (rkm->rkm_flags & RD_KAFKA_MSG_F_POOL_RKM)
+                rd_kafka_msgpool_free(rkm);
 }
 
 
@@ -83,6 +123,7 @@ rd_kafka_msg_t *rd_kafka_msg_new00 (rd_kafka_itopic_t *rkt,
 				    void *msg_opaque) {
 	rd_kafka_msg_t *rkm;
 	size_t mlen = sizeof(*rkm);
+        rd_kafka_msgpool_t *mpool = rkt->rkt_rk->rk_msgpool;
 	char *p;
 
 	/* If we are to make a copy of the payload, allocate space for it too */
@@ -95,10 +136,16 @@ rd_kafka_msg_t *rd_kafka_msg_new00 (rd_kafka_itopic_t *rkt,
 
 	/* Note: using rd_malloc here, not rd_calloc, so make sure all fields
 	 *       are properly set up. */
-	rkm                 = rd_malloc(mlen);
+        if (mpool) {
+                rkm            = rd_kafka_msgpool_alloc(mpool, mlen);
+                rkm->rkm_flags = (RD_KAFKA_MSG_F_PRODUCER |
+                                  RD_KAFKA_MSG_F_POOL_RKM | msgflags);
+        } else {
+                rkm            = rd_malloc(mlen);
+                rkm->rkm_flags = (RD_KAFKA_MSG_F_PRODUCER |
+                                  RD_KAFKA_MSG_F_FREE_RKM | msgflags);
+        }
 	rkm->rkm_err        = 0;
-	rkm->rkm_flags      = (RD_KAFKA_MSG_F_PRODUCER |
-                               RD_KAFKA_MSG_F_FREE_RKM | msgflags);
 	rkm->rkm_len        = len;
 	rkm->rkm_opaque     = msg_opaque;
 	rkm->rkm_rkmessage.rkt = rd_kafka_topic_keep_a(rkt);
@@ -304,6 +351,8 @@ rd_kafka_resp_err_t rd_kafka_producev (rd_kafka_t *rk, ...) {
         rd_kafka_resp_err_t err = RD_KAFKA_RESP_ERR_NO_ERROR;
         rd_kafka_headers_t *hdrs = NULL;
         rd_kafka_headers_t *app_hdrs = NULL; /* App-provided headers list */
+        rd_kafka_payload_ref_t *pref = NULL;
+        int has_value = 0;
 
         va_start(ap, rk);
         while (!err &&
@@ -327,8 +376,27 @@ rd_kafka_resp_err_t rd_kafka_producev (rd_kafka_t *rk, ...) {
                         break;
 
                 case RD_KAFKA_VTYPE_VALUE:
+                        if (unlikely(pref != NULL)) {
+                                err = RD_KAFKA_RESP_ERR__CONFLICT;
+                                break;
+                        }
                         rkm->rkm_payload = va_arg(ap, void *);
                         rkm->rkm_len = va_arg(ap, size_t);
+                        has_value = 1;
+                        break;
+
+                case RD_KAFKA_VTYPE_VALUE_REF:
+                        if (unlikely(has_value)) {
+                                err = RD_KAFKA_RESP_ERR__CONFLICT;
+                                break;
+                        }
+                        pref = va_arg(ap, rd_kafka_payload_ref_t *);
+                        if (unlikely(!pref)) {
+                                err = RD_KAFKA_RESP_ERR__INVALID_ARG;
+                                break;
+                        }
+                        rkm->rkm_payload = pref->pref_payload;
+                        rkm->rkm_len = pref->pref_len;
                         break;
 
                 case RD_KAFKA_VTYPE_KEY:
@@ -391,6 +459,11 @@ rd_kafka_resp_err_t rd_kafka_producev (rd_kafka_t *rk, ...) {
 
         rkt = rd_kafka_topic_s2i(s_rkt);
 
+        /* The payload reference is neither copied nor freed by
+         * the message, it just holds a reference to it. */
+        if (pref)
+                rkm->rkm_flags &= ~(RD_KAFKA_MSG_F_FREE|RD_KAFKA_MSG_F_COPY);
+
         if (likely(!err))
                 rkm = rd_kafka_msg_new0(rkt,
                                         rkm->rkm_partition,
@@ -410,6 +483,11 @@ rd_kafka_resp_err_t rd_kafka_producev (rd_kafka_t *rk, ...) {
                 return err;
         }
 
+        if (pref) {
+                rkm->rkm_u.producer.pref = rd_kafka_payload_ref_keep(pref);
+                rkm->rkm_flags |= RD_KAFKA_MSG_F_PAYLOAD_REF;
+        }
+
         /* Partition the message */
         err = rd_kafka_msg_partitioner(rkt, rkm, 1);
         if (unlikely(err)) {
@@ -560,19 +638,31 @@ int rd_kafka_produce_batch (rd_kafka_topic_t *app_rkt, int32_t partition,
  * Scan 'rkmq' for messages that have timed out and remove them from
  * 'rkmq' and add to 'timedout'.
  *
+ * The timeout is the same for all messages of a topic and the queue is
+ * sorted by msgseq, which follows the enqueue order, so messages time
+ * out in queue order: oldest first, or last if 'lifo'.
+ * Messages are expired from that end until a message that has not timed
+ * out is found, making the scan cost proportional to the number of
+ * timed out messages rather than the queue length.
+ *
  * Returns the number of messages timed out.
  */
 int rd_kafka_msgq_age_scan (rd_kafka_msgq_t *rkmq,
 			    rd_kafka_msgq_t *timedout,
-			    rd_ts_t now) {
-	rd_kafka_msg_t *rkm, *tmp;
+			    rd_ts_t now, int lifo,
+                            rd_ts_t *abs_next_timeout) {
+	rd_kafka_msg_t *rkm;
 	int cnt = timedout->rkmq_msg_cnt;
 
-	/* Assume messages are added in time sequencial order */
-	TAILQ_FOREACH_SAFE(rkm, &rkmq->rkmq_msgs, rkm_link, tmp) {
-                /* FIXME: this is no longer true */
-		if (likely(rkm->rkm_ts_timeout > now))
+        if (abs_next_timeout)
+                *abs_next_timeout = 0;
+
+	while ((rkm = rd_kafka_msgq_oldest(rkmq, lifo))) {
+		if (likely(rkm->rkm_ts_timeout > now)) {
+                        if (abs_next_timeout)
+                                *abs_next_timeout = rkm->rkm_ts_timeout;
 			break;
+                }
 
 		rd_kafka_msgq_deq(rkmq, rkm, 1);
 		rd_kafka_msgq_enq(timedout, rkm);
@@ -691,6 +781,81 @@ int32_t rd_kafka_msg_partitioner_murmur2_random (const rd_kafka_topic_t *rkt,
 }
 
 
+/**
+ * @brief Pick a new random available sticky partition, preferably
+ *        not \p curr.
+ */
+static int32_t
+rd_kafka_msg_partitioner_sticky_next (const rd_kafka_topic_t *rkt,
+                                      int32_t partition_cnt, int32_t curr) {
+        int32_t start = rd_jitter(0, partition_cnt-1);
+        int32_t i;
+
+        for (i = 0 ; i < partition_cnt ; i++) {
+                int32_t p = (start + i) % partition_cnt;
+                if (p != curr &&
+                    rd_kafka_topic_partition_available(rkt, p))
+                        return p;
+        }
+
+        /* No other partition available, stay on the current partition
+         * if it is still valid. */
+        if (curr >= 0 && curr < partition_cnt)
+                return curr;
+
+        return start;
+}
+
+int32_t rd_kafka_msg_partitioner_sticky (const rd_kafka_topic_t *app_rkt,
+                                         const void *key, size_t keylen,
+                                         int32_t partition_cnt,
+                                         void *rkt_opaque,
+                                         void *msg_opaque) {
+        rd_kafka_itopic_t *rkt;
+        const rd_kafka_conf_t *conf;
+        int32_t p;
+        rd_ts_t now, linger;
+
+        if (keylen > 0)
+                return rd_kafka_msg_partitioner_consistent(app_rkt,
+                                                           key, keylen,
+                                                           partition_cnt,
+                                                           rkt_opaque,
+                                                           msg_opaque);
+
+        rkt  = rd_kafka_topic_a2i(app_rkt);
+        conf = &rkt->rkt_rk->rk_conf;
+        p    = rd_atomic32_get(&rkt->rkt_sticky.partition);
+        now  = rd_clock();
+        linger = (rd_ts_t)RD_MAX(conf->sticky_linger_ms,
+                                 conf->buffering_max_ms) * 1000;
+
+        /* Switch partition if there is no current partition, the
+         * partition count changed, or the batch is full, or
+         * the linger time has expired.
+         * Concurrent producers racing to switch partition will
+         * merely cause an extra switch. */
+        if (unlikely(p < 0 || p >= partition_cnt ||
+                     rd_atomic32_get(&rkt->rkt_sticky.msgcnt) >=
+                     conf->batch_num_messages ||
+                     rd_atomic64_get(&rkt->rkt_sticky.bytes) >=
+                     (int64_t)conf->max_msg_size ||
+                     now - rd_atomic64_get(&rkt->rkt_sticky.ts_switch) >=
+                     linger)) {
+                p = rd_kafka_msg_partitioner_sticky_next(app_rkt,
+                                                         partition_cnt, p);
+                rd_atomic32_set(&rkt->rkt_sticky.msgcnt, 0);
+                rd_atomic64_set(&rkt->rkt_sticky.bytes, 0);
+                rd_atomic64_set(&rkt->rkt_sticky.ts_switch, now);
+                rd_atomic32_set(&rkt->rkt_sticky.partition, p);
+        }
+
+        rd_atomic32_add(&rkt->rkt_sticky.msgcnt, 1);
+
+        return p;
+}
+
+
 /**
  * Assigns a message to a topic partition using a partitioner.
  * Returns RD_KAFKA_RESP_ERR__UNKNOWN_PARTITION or .._UNKNOWN_TOPIC if
@@ -751,6 +916,14 @@ int rd_kafka_msg_partitioner (rd_kafka_itopic_t *rkt, rd_kafka_msg_t *rkm,
                                             rkm->rkm_opaque);
                         rd_kafka_topic_destroy0(
                                 rd_kafka_topic_a2s(app_rkt));
+
+                        /* Let the sticky partitioner know how much
+                         * is added to the current batch. */
+                        if (rkt->rkt_conf.partitioner ==
+                            rd_kafka_msg_partitioner_sticky &&
+                            rkm->rkm_key_len == 0)
+                                rd_atomic64_add(&rkt->rkt_sticky.bytes,
+                                                (int64_t)rkm->rkm_len);
                 } else
                         partition = rkm->rkm_partition;
 
@@ -1267,11 +1440,177 @@ static int unittest_msgq_order (const char *what, int fifo,
 }
 
 
+
+#define UT_INGRESS_THREADS 4
+#define UT_INGRESS_MSGS    20000
+
+struct ut_ingress_producer {
+        rd_kafka_msgq_ingress_t *rkmi;
+        int id;
+        rd_atomic32_t *wakeups;  /**< Number of empty->non-empty pushes */
+};
+
+static int ut_ingress_producer_main (void *arg) {
+        struct ut_ingress_producer *up = arg;
+        int i;
+
+        for (i = 0 ; i < UT_INGRESS_MSGS ; i++) {
+                rd_kafka_msg_t *rkm = ut_rd_kafka_msg_new();
+                rkm->rkm_partition = up->id;
+                rkm->rkm_offset    = i;
+                if (rd_kafka_msgq_ingress_push(up->rkmi, rkm))
+                        rd_atomic32_add(up->wakeups, 1);
+        }
+
+        return 0;
+}
+
+/**
+ * @brief Consume \p rkmi into \p rkmq, verifying per-producer ordering
+ *        and assigning msgseqs.
+ * @returns 1 if any messages were taken, else 0.
+ */
+static int ut_ingress_take (rd_kafka_msgq_ingress_t *rkmi,
+                            rd_kafka_msgq_t *rkmq, uint64_t *msgseq,
+                            int64_t *next_offset, int *fails) {
+        rd_kafka_msg_t *rkm, *next;
+
+        if (!(rkm = rd_kafka_msgq_ingress_take(rkmi)))
+                return 0;
+
+        for ( ; rkm ; rkm = next) {
+                next = rkm->rkm_link.tqe_next;
+                if (rkm->rkm_offset != next_offset[rkm->rkm_partition]) {
+                        if ((*fails)++ < 5)
+                                RD_UT_SAY("producer %"PRId32": expected "
+                                          "message %"PRId64", not %"PRId64,
+                                          rkm->rkm_partition,
+                                          next_offset[rkm->rkm_partition],
+                                          rkm->rkm_offset);
+                }
+                next_offset[rkm->rkm_partition] = rkm->rkm_offset + 1;
+                rkm->rkm_u.producer.msgseq = ++(*msgseq);
+                rd_kafka_msgq_enq(rkmq, rkm);
+        }
+
+        return 1;
+}
+
+/**
+ * @brief Unittest: multiple producer threads pushing on the lock-free
+ *        ingress list while it is drained, verifying that each
+ *        producer's messages are taken in order, that no messages are lost
+ *        and that wakeups are only signalled on empty->non-empty.
+ */
+static int unittest_msgq_ingress (void) {
+        rd_kafka_msgq_ingress_t rkmi;
+        rd_kafka_msgq_t rkmq = RD_KAFKA_MSGQ_INITIALIZER(rkmq);
+        struct ut_ingress_producer up[UT_INGRESS_THREADS];
+        thrd_t thrds[UT_INGRESS_THREADS];
+        int64_t next_offset[UT_INGRESS_THREADS] = { 0 };
+        rd_atomic32_t wakeups;
+        uint64_t msgseq = 0;
+        int takes = 0;
+        int fails = 0;
+        int i;
+
+        rd_kafka_msgq_ingress_init(&rkmi);
+        rd_atomic32_init(&wakeups, 0);
+
+        for (i = 0 ; i < UT_INGRESS_THREADS ; i++) {
+                up[i].rkmi    = &rkmi;
+                up[i].id      = i;
+                up[i].wakeups = &wakeups;
+                RD_UT_ASSERT(thrd_create(&thrds[i], ut_ingress_producer_main,
+                                         &up[i]) == thrd_success,
+                             "thrd_create failed");
+        }
+
+        while (rd_kafka_msgq_len(&rkmq) <
+               UT_INGRESS_THREADS * UT_INGRESS_MSGS)
+                takes += ut_ingress_take(&rkmi, &rkmq, &msgseq,
+                                         next_offset, &fails);
+
+        for (i = 0 ; i < UT_INGRESS_THREADS ; i++)
+                thrd_join(thrds[i], NULL);
+
+        RD_UT_ASSERT(!ut_ingress_take(&rkmi, &rkmq, &msgseq,
+                                      next_offset, &fails),
+                     "ingress list should be empty");
+        RD_UT_ASSERT(!fails, "%d message(s) out of order", fails);
+        RD_UT_ASSERT(rd_atomic32_get(&wakeups) == takes,
+                     "expected %d empty->non-empty pushes, not %d",
+                     takes, rd_atomic32_get(&wakeups));
+
+        RD_UT_SAY("%d messages taken in %d takes",
+                  rd_kafka_msgq_len(&rkmq), takes);
+
+        if (ut_verify_msgq_order("ingress", &rkmq, 1,
+                                 UT_INGRESS_THREADS * UT_INGRESS_MSGS))
+                return 1;
+
+        ut_rd_kafka_msgq_purge(&rkmq);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Verify that rd_kafka_msgq_age_scan() times out the oldest
+ *        messages, from the head for FIFO and the tail for LIFO queues.
+ */
+static int unittest_msgq_age_scan (const char *what, int fifo,
+                                   int (*cmp) (const void *, const void *)) {
+        rd_kafka_msgq_t rkmq = RD_KAFKA_MSGQ_INITIALIZER(rkmq);
+        rd_kafka_msgq_t timedout = RD_KAFKA_MSGQ_INITIALIZER(timedout);
+        rd_ts_t next;
+        int i, cnt;
+
+        RD_UT_SAY("%s: testing age scan in %s mode",
+                  what, fifo ? "FIFO" : "LIFO");
+
+        /* Message i times out at i*1000 */
+        for (i = 1 ; i <= 6 ; i++) {
+                rd_kafka_msg_t *rkm = ut_rd_kafka_msg_new();
+                rkm->rkm_u.producer.msgseq = i;
+                rkm->rkm_ts_timeout = i * 1000;
+                rd_kafka_msgq_enq_sorted0(&rkmq, rkm, cmp);
+        }
+
+        cnt = rd_kafka_msgq_age_scan(&rkmq, &timedout, 3500, !fifo, &next);
+        RD_UT_ASSERT(cnt == 3, "%s: expected 3 timed out messages, not %d",
+                     what, cnt);
+        RD_UT_ASSERT(next == 4000, "%s: expected next timeout 4000, "
+                     "not %"PRId64, what, next);
+        if (ut_verify_msgq_order("timed out", &timedout, 1, 3))
+                return 1;
+        if (ut_verify_msgq_order("remaining", &rkmq,
+                                 fifo ? 4 : 6, fifo ? 6 : 4))
+                return 1;
+
+        cnt = rd_kafka_msgq_age_scan(&rkmq, &timedout, 10000, !fifo, &next);
+        RD_UT_ASSERT(cnt == 3, "%s: expected 3 timed out messages, not %d",
+                     what, cnt);
+        RD_UT_ASSERT(next == 0, "%s: expected no next timeout, "
+                     "not %"PRId64, what, next);
+        RD_UT_ASSERT(rd_kafka_msgq_len(&rkmq) == 0,
+                     "%s: expected empty queue, not %d messages",
+                     what, rd_kafka_msgq_len(&rkmq));
+
+        ut_rd_kafka_msgq_purge(&timedout);
+
+        RD_UT_PASS();
+}
+
 int unittest_msg (void) {
         int fails = 0;
 
         fails += unittest_msgq_order("FIFO", 1, rd_kafka_msg_cmp_msgseq);
         fails += unittest_msgq_order("LIFO", 0, rd_kafka_msg_cmp_msgseq_lifo);
+        fails += unittest_msgq_age_scan("FIFO", 1, rd_kafka_msg_cmp_msgseq);
+        fails += unittest_msgq_age_scan("LIFO", 0,
+                                        rd_kafka_msg_cmp_msgseq_lifo);
+        fails += unittest_msgq_ingress();
 
         return fails;
 }
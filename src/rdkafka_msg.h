@@ -48,7 +48,8 @@
 #define RD_KAFKA_MSG_ATTR_GZIP             (1 << 0)
 #define RD_KAFKA_MSG_ATTR_SNAPPY           (1 << 1)
 #define RD_KAFKA_MSG_ATTR_LZ4              (3)
-#define RD_KAFKA_MSG_ATTR_COMPRESSION_MASK 0x3
+#define RD_KAFKA_MSG_ATTR_ZSTD             (4)
+#define RD_KAFKA_MSG_ATTR_COMPRESSION_MASK 0x7
 #define RD_KAFKA_MSG_ATTR_CREATE_TIME      (0 << 3)
 #define RD_KAFKA_MSG_ATTR_LOG_APPEND_TIME  (1 << 3)
 
@@ -67,6 +68,18 @@
 #define RD_KAFKA_MSGSET_V2_ATTR_CONTROL       (1 << 5)
 
 
+/**
+ * @brief Application payload reference, see rd_kafka_payload_ref_new().
+ */
+struct rd_kafka_payload_ref_s {
+        rd_refcnt_t pref_refcnt;
+        void       *pref_payload;
+        size_t      pref_len;
+        void      (*pref_free_cb) (void *payload, size_t len, void *opaque);
+        void       *pref_opaque;
+};
+
+
 typedef struct rd_kafka_msg_s {
 	rd_kafka_message_t rkm_rkmessage;  /* MUST be first field */
 #define rkm_len               rkm_rkmessage.len
@@ -86,6 +99,10 @@ typedef struct rd_kafka_msg_s {
 #define RD_KAFKA_MSG_F_FREE_RKM     0x10000 /* msg_t is allocated */
 #define RD_KAFKA_MSG_F_ACCOUNT      0x20000 /* accounted for in curr_msgs */
 #define RD_KAFKA_MSG_F_PRODUCER     0x40000 /* Producer message */
+#define RD_KAFKA_MSG_F_POOL_RKM     0x80000 /* msg_t is allocated from
+                                             * rk_msgpool */
+#define RD_KAFKA_MSG_F_PAYLOAD_REF  0x200000 /* payload is held by
+                                              * rkm_u.producer.pref */
 
 	int64_t    rkm_timestamp;  /* Message format V1.
 				    * Meaning of timestamp depends on
@@ -105,6 +122,8 @@ typedef struct rd_kafka_msg_s {
                         uint64_t msgseq;    /* Message sequence number,
                                              * used to maintain ordering. */
                         int     retries;    /* Number of retries so far */
+                        rd_kafka_payload_ref_t *pref; /* Payload reference,
+                                                       * if F_PAYLOAD_REF */
                 } producer;
 #define rkm_ts_timeout rkm_u.producer.ts_timeout
 #define rkm_ts_enq     rkm_u.producer.ts_enq
@@ -350,15 +369,104 @@ static RD_INLINE RD_UNUSED int rd_kafka_msgq_enq (rd_kafka_msgq_t *rkmq,
 }
 
 
+/**
+ * @brief Lock-free multi-producer single-consumer message ingress list.
+ *
+ * Producers push messages on the head of an intrusive singly linked
+ * list (using the rkm_link.tqe_next pointer) with a single CAS,
+ * the consumer takes the entire list in one atomic swap and
+ * reverses it to restore the push order.
+ * Messages pushed by the same thread are thus taken in the order
+ * they were pushed.
+ *
+ * Consumers must be serialized by the caller (e.g., by the toppar lock).
+ */
+typedef struct rd_kafka_msgq_ingress_s {
+        rd_atomicptr_t rkmi_head;  /**< Most recently pushed message */
+} rd_kafka_msgq_ingress_t;
+
+static RD_INLINE RD_UNUSED void
+rd_kafka_msgq_ingress_init (rd_kafka_msgq_ingress_t *rkmi) {
+        rd_atomicptr_init(&rkmi->rkmi_head, NULL);
+}
+
+/**
+ * @brief Push \p rkm on the ingress list.
+ *
+ * @returns 1 if the list was empty prior to this push, else 0.
+ *
+ * @locality any thread
+ * @locks none
+ */
+static RD_INLINE RD_UNUSED int
+rd_kafka_msgq_ingress_push (rd_kafka_msgq_ingress_t *rkmi,
+                            rd_kafka_msg_t *rkm) {
+        rd_kafka_msg_t *head;
+
+        do {
+                head = rd_atomicptr_get(&rkmi->rkmi_head);
+                rkm->rkm_link.tqe_next = head;
+        } while (!rd_atomicptr_cas(&rkmi->rkmi_head, head, rkm));
+
+        return head == NULL;
+}
+
+/**
+ * @brief Take all messages from the ingress list.
+ *
+ * @returns the oldest message, or NULL if the list is empty.
+ *          The messages are linked in push order by rkm_link.tqe_next
+ *          and are not on any msgq.
+ *
+ * @locks the caller must serialize consumers.
+ */
+static RD_INLINE RD_UNUSED rd_kafka_msg_t *
+rd_kafka_msgq_ingress_take (rd_kafka_msgq_ingress_t *rkmi) {
+        rd_kafka_msg_t *rkm, *next, *prev = NULL;
+
+        /* Cheap non-swapping check for the common empty case. */
+        if (!rd_atomicptr_get(&rkmi->rkmi_head))
+                return NULL;
+
+        rkm = rd_atomicptr_exchange(&rkmi->rkmi_head, NULL);
+
+        /* Reverse newest-first list to push order */
+        while (rkm) {
+                next = rkm->rkm_link.tqe_next;
+                rkm->rkm_link.tqe_next = prev;
+                prev = rkm;
+                rkm = next;
+        }
+
+        return prev;
+}
+
+
+/**
+ * @returns the message in \p rkmq that times out first: the head of
+ *          the queue, or the tail if \p lifo (the queue is sorted
+ *          newest first), or NULL if the queue is empty.
+ */
+static RD_INLINE RD_UNUSED
+rd_kafka_msg_t *rd_kafka_msgq_oldest (const rd_kafka_msgq_t *rkmq, int lifo) {
+        if (lifo)
+                return TAILQ_LAST(&rkmq->rkmq_msgs, rd_kafka_msgs_head_s);
+        else
+                return TAILQ_FIRST(&rkmq->rkmq_msgs);
+}
+
 /**
  * Scans a message queue for timed out messages and removes them from
  * 'rkmq' and adds them to 'timedout', returning the number of timed out
  * messages.
  * 'timedout' must be initialized.
+ * If 'abs_next_timeout' is non-NULL it is set to the timeout of the
+ * next message to time out, or 0 if the queue is empty.
  */
 int rd_kafka_msgq_age_scan (rd_kafka_msgq_t *rkmq,
 			    rd_kafka_msgq_t *timedout,
-			    rd_ts_t now);
+			    rd_ts_t now, int lifo,
+                            rd_ts_t *abs_next_timeout);
 
 rd_kafka_msg_t *rd_kafka_msgq_find_pos (const rd_kafka_msgq_t *rkmq,
                                         const rd_kafka_msg_t *rkm,
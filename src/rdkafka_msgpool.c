@@ -0,0 +1,636 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rd.h"
+#include "rdatomic.h"
+#include "rdsysqueue.h"
+#include "rdunittest.h"
+#include "rdkafka_msgpool.h"
+
+
+/**
+ * Size classes are powers of two starting at 256 bytes, including the
+ * chunk header.
+ */
+#define RD_KAFKA_MSGPOOL_CLS_CNT      6
+#define RD_KAFKA_MSGPOOL_CLS_MIN      256
+#define RD_KAFKA_MSGPOOL_CLS_MAX      \
+        (RD_KAFKA_MSGPOOL_CLS_MIN << (RD_KAFKA_MSGPOOL_CLS_CNT-1))
+
+/**< Minimum slab size, slabs for larger classes hold at least
+ *   RD_KAFKA_MSGPOOL_SLAB_MINCNT chunks. */
+#define RD_KAFKA_MSGPOOL_SLAB_SIZE    (64*1024)
+#define RD_KAFKA_MSGPOOL_SLAB_MINCNT  16
+
+/**< Maximum number of free chunks per class in a thread's magazine
+ *   before half of them are flushed back to the shared depot. */
+#define RD_KAFKA_MSGPOOL_MAG_MAX      64
+/**< Number of chunks moved between magazine and depot on refill/flush */
+#define RD_KAFKA_MSGPOOL_MAG_BATCH    (RD_KAFKA_MSGPOOL_MAG_MAX/2)
+
+/**< Number of pools a single thread keeps magazines for. */
+#define RD_KAFKA_MSGPOOL_TCACHE_CNT   4
+
+
+/**
+ * @brief Chunk header, precedes every allocation returned by the pool.
+ */
+typedef struct rd_kafka_msgpool_chunk_s {
+        rd_kafka_msgpool_t *mpc_mpool;  /**< Owning pool */
+        union {
+                struct rd_kafka_msgpool_chunk_s *next; /**< Free list link,
+                                                        *   while free. */
+                int cls;                  /**< Size class while allocated,
+                                           *   -1 for system allocations. */
+                void *_align;
+        } mpc_u;
+} rd_kafka_msgpool_chunk_t;
+
+
+/**
+ * @brief Shared per-class free list.
+ */
+struct rd_kafka_msgpool_depot {
+        mtx_t                     lock;
+        rd_kafka_msgpool_chunk_t *free;
+        int                       cnt;
+};
+
+
+struct rd_kafka_msgpool_s {
+        LIST_ENTRY(rd_kafka_msgpool_s) mpool_link; /**< Global pool list */
+        uint64_t      mpool_id;       /**< Unique pool id, used to detect
+                                       *   stale thread caches. */
+
+        struct rd_kafka_msgpool_depot mpool_depot[RD_KAFKA_MSGPOOL_CLS_CNT];
+
+        mtx_t         mpool_slab_lock;  /**< Protects mpool_slabs */
+        void         *mpool_slabs;      /**< Singly linked list of slabs,
+                                         *   first word is the next pointer. */
+
+        LIST_HEAD(, rd_kafka_msgpool_tstats) mpool_tstats; /**< Threads'
+                                                            *   unflushed
+                                                            *   counters,
+                                                            *   protected by
+                                                            *   the global
+                                                            *   lock. */
+
+        rd_atomic64_t mpool_hits;
+        rd_atomic64_t mpool_misses;
+        rd_atomic64_t mpool_slab_cnt;
+        rd_atomic64_t mpool_slab_bytes;
+};
+
+
+/**
+ * @brief Per-thread counters for a single pool, owned by the pool so that
+ *        rd_kafka_msgpool_stats() can read them from other threads.
+ */
+struct rd_kafka_msgpool_tstats {
+        LIST_ENTRY(rd_kafka_msgpool_tstats) link; /**< mpool_tstats */
+        rd_atomic64_t hits;             /**< Not yet flushed to mpool_hits.
+                                         *   Only written by the owning
+                                         *   thread, read by
+                                         *   rd_kafka_msgpool_stats(). */
+};
+
+
+/**
+ * @brief Per-thread magazine for a single pool.
+ */
+struct rd_kafka_msgpool_tcache {
+        rd_kafka_msgpool_t *tc_mpool;
+        uint64_t            tc_mpool_id;
+        struct {
+                rd_kafka_msgpool_chunk_t *free;
+                int                       cnt;
+        } tc_mag[RD_KAFKA_MSGPOOL_CLS_CNT];
+        struct rd_kafka_msgpool_tstats *tc_stats;
+};
+
+static RD_TLS struct rd_kafka_msgpool_tcache
+rd_kafka_msgpool_tcaches[RD_KAFKA_MSGPOOL_TCACHE_CNT];
+static RD_TLS int rd_kafka_msgpool_tcache_evict;
+
+
+/**
+ * Global list of live pools, used by threads to verify that a pool
+ * is still alive before flushing an evicted magazine to it.
+ */
+static once_flag rd_kafka_msgpool_global_once = ONCE_FLAG_INIT;
+static mtx_t rd_kafka_msgpool_global_lock;
+static LIST_HEAD(, rd_kafka_msgpool_s) rd_kafka_msgpool_global_list;
+static uint64_t rd_kafka_msgpool_global_id;
+
+/**< Thread-specific key whose destructor releases the exiting thread's
+ *   caches, set by threads when they set up a cache. */
+static tss_t rd_kafka_msgpool_thread_key;
+
+static void rd_kafka_msgpool_thread_exit (void *arg);
+
+static void rd_kafka_msgpool_global_init (void) {
+        mtx_init(&rd_kafka_msgpool_global_lock, mtx_plain);
+        LIST_INIT(&rd_kafka_msgpool_global_list);
+        tss_create(&rd_kafka_msgpool_thread_key,
+                   rd_kafka_msgpool_thread_exit);
+}
+
+
+/**
+ * @returns the size class for an allocation of \p size bytes
+ *          (including chunk header), or -1 if too large.
+ */
+static RD_INLINE int rd_kafka_msgpool_size2cls (size_t size) {
+        size_t csize = RD_KAFKA_MSGPOOL_CLS_MIN;
+        int cls;
+
+        for (cls = 0 ; cls < RD_KAFKA_MSGPOOL_CLS_CNT ; cls++, csize <<= 1)
+                if (size <= csize)
+                        return cls;
+
+        return -1;
+}
+
+#define rd_kafka_msgpool_cls2size(cls) \
+        ((size_t)RD_KAFKA_MSGPOOL_CLS_MIN << (cls))
+
+
+/**
+ * @brief Allocate a new slab for class \p cls and put its chunks
+ *        on the depot's free list.
+ *
+ * @locks depot->lock MUST be held.
+ */
+static void rd_kafka_msgpool_slab_new (rd_kafka_msgpool_t *mpool, int cls) {
+        struct rd_kafka_msgpool_depot *depot = &mpool->mpool_depot[cls];
+        size_t csize = rd_kafka_msgpool_cls2size(cls);
+        size_t hdrsize = RD_ROUNDUP(sizeof(void *), 16);
+        size_t slabsize = RD_MAX(RD_KAFKA_MSGPOOL_SLAB_SIZE,
+                                 csize * RD_KAFKA_MSGPOOL_SLAB_MINCNT);
+        int cnt = (int)((slabsize - hdrsize) / csize);
+        char *slab, *p;
+        int i;
+
+        slab = rd_malloc(slabsize);
+
+        mtx_lock(&mpool->mpool_slab_lock);
+        *(void **)slab = mpool->mpool_slabs;
+        mpool->mpool_slabs = slab;
+        mtx_unlock(&mpool->mpool_slab_lock);
+
+        for (i = 0, p = slab + hdrsize ; i < cnt ; i++, p += csize) {
+                rd_kafka_msgpool_chunk_t *chunk = (void *)p;
+                chunk->mpc_mpool = mpool;
+                chunk->mpc_u.next = depot->free;
+                depot->free = chunk;
+        }
+        depot->cnt += cnt;
+
+        rd_atomic64_add(&mpool->mpool_slab_cnt, 1);
+        rd_atomic64_add(&mpool->mpool_slab_bytes, (int64_t)slabsize);
+}
+
+
+/**
+ * @brief Move up to \p cnt chunks of class \p cls from the thread's
+ *        magazine \p tc back to the pool's depot.
+ */
+static void rd_kafka_msgpool_mag_flush (rd_kafka_msgpool_t *mpool,
+                                        struct rd_kafka_msgpool_tcache *tc,
+                                        int cls, int cnt) {
+        struct rd_kafka_msgpool_depot *depot = &mpool->mpool_depot[cls];
+        rd_kafka_msgpool_chunk_t *first, *last;
+        int i;
+
+        if (!(first = tc->tc_mag[cls].free))
+                return;
+
+        /* Detach the first cnt chunks from the magazine */
+        last = first;
+        for (i = 1 ; i < cnt && last->mpc_u.next ; i++)
+                last = last->mpc_u.next;
+
+        tc->tc_mag[cls].free = last->mpc_u.next;
+        tc->tc_mag[cls].cnt -= i;
+
+        mtx_lock(&depot->lock);
+        last->mpc_u.next = depot->free;
+        depot->free = first;
+        depot->cnt += i;
+        mtx_unlock(&depot->lock);
+}
+
+
+/**
+ * @brief Refill the thread's magazine for class \p cls from the depot,
+ *        growing the pool with a new slab if the depot is empty.
+ */
+static void rd_kafka_msgpool_mag_refill (rd_kafka_msgpool_t *mpool,
+                                         struct rd_kafka_msgpool_tcache *tc,
+                                         int cls) {
+        struct rd_kafka_msgpool_depot *depot = &mpool->mpool_depot[cls];
+        rd_kafka_msgpool_chunk_t *first, *last;
+        int i;
+
+        mtx_lock(&depot->lock);
+        if (!depot->free)
+                rd_kafka_msgpool_slab_new(mpool, cls);
+
+        first = last = depot->free;
+        for (i = 1 ; i < RD_KAFKA_MSGPOOL_MAG_BATCH && last->mpc_u.next ; i++)
+                last = last->mpc_u.next;
+
+        depot->free = last->mpc_u.next;
+        depot->cnt -= i;
+        mtx_unlock(&depot->lock);
+
+        last->mpc_u.next = tc->tc_mag[cls].free;
+        tc->tc_mag[cls].free = first;
+        tc->tc_mag[cls].cnt += i;
+}
+
+
+/**
+ * @brief Release the thread cache \p tc: flush all its chunks back to the
+ *        owning pool if the pool is still alive, then reset the cache.
+ */
+static void
+rd_kafka_msgpool_tcache_release (struct rd_kafka_msgpool_tcache *tc) {
+        rd_kafka_msgpool_t *mpool;
+
+        mtx_lock(&rd_kafka_msgpool_global_lock);
+        LIST_FOREACH(mpool, &rd_kafka_msgpool_global_list, mpool_link)
+                if (mpool == tc->tc_mpool &&
+                    mpool->mpool_id == tc->tc_mpool_id)
+                        break;
+
+        if (mpool) {
+                int cls;
+                for (cls = 0 ; cls < RD_KAFKA_MSGPOOL_CLS_CNT ; cls++)
+                        rd_kafka_msgpool_mag_flush(mpool, tc, cls,
+                                                   tc->tc_mag[cls].cnt);
+                rd_atomic64_add(&mpool->mpool_hits,
+                                rd_atomic64_get(&tc->tc_stats->hits));
+                LIST_REMOVE(tc->tc_stats, link);
+                rd_free(tc->tc_stats);
+        }
+        /* else: the pool has been destroyed along with its slabs
+         *       and the threads' counters, the cached chunks are gone. */
+        mtx_unlock(&rd_kafka_msgpool_global_lock);
+
+        memset(tc, 0, sizeof(*tc));
+}
+
+
+/**
+ * @brief Thread-exit destructor: release all the exiting thread's caches
+ *        so that their chunks are returned to their pools rather than
+ *        stranded until the pools are destroyed.
+ */
+static void rd_kafka_msgpool_thread_exit (void *arg) {
+        int i;
+
+        for (i = 0 ; i < RD_KAFKA_MSGPOOL_TCACHE_CNT ; i++)
+                if (rd_kafka_msgpool_tcaches[i].tc_mpool)
+                        rd_kafka_msgpool_tcache_release(
+                                &rd_kafka_msgpool_tcaches[i]);
+}
+
+
+/**
+ * @returns the calling thread's cache for \p mpool, setting one up
+ *          (possibly evicting another pool's cache) if needed.
+ */
+static RD_INLINE struct rd_kafka_msgpool_tcache *
+rd_kafka_msgpool_tcache_get (rd_kafka_msgpool_t *mpool) {
+        struct rd_kafka_msgpool_tcache *tc = NULL;
+        int i;
+
+        for (i = 0 ; i < RD_KAFKA_MSGPOOL_TCACHE_CNT ; i++) {
+                if (likely(rd_kafka_msgpool_tcaches[i].tc_mpool == mpool &&
+                           rd_kafka_msgpool_tcaches[i].tc_mpool_id ==
+                           mpool->mpool_id))
+                        return &rd_kafka_msgpool_tcaches[i];
+                else if (!tc && !rd_kafka_msgpool_tcaches[i].tc_mpool)
+                        tc = &rd_kafka_msgpool_tcaches[i];
+        }
+
+        if (!tc) {
+                /* All slots in use: evict one in round-robin order. */
+                tc = &rd_kafka_msgpool_tcaches[rd_kafka_msgpool_tcache_evict++ %
+                                               RD_KAFKA_MSGPOOL_TCACHE_CNT];
+                rd_kafka_msgpool_tcache_release(tc);
+        }
+
+        tc->tc_mpool    = mpool;
+        tc->tc_mpool_id = mpool->mpool_id;
+
+        tc->tc_stats    = rd_calloc(1, sizeof(*tc->tc_stats));
+        rd_atomic64_init(&tc->tc_stats->hits, 0);
+
+        mtx_lock(&rd_kafka_msgpool_global_lock);
+        LIST_INSERT_HEAD(&mpool->mpool_tstats, tc->tc_stats, link);
+        mtx_unlock(&rd_kafka_msgpool_global_lock);
+
+        /* Have the caches released on thread exit. */
+        tss_set(rd_kafka_msgpool_thread_key, rd_kafka_msgpool_tcaches);
+
+        return tc;
+}
+
+
+void *rd_kafka_msgpool_alloc (rd_kafka_msgpool_t *mpool, size_t size) {
+        struct rd_kafka_msgpool_tcache *tc;
+        rd_kafka_msgpool_chunk_t *chunk;
+        int cls;
+
+        cls = rd_kafka_msgpool_size2cls(sizeof(*chunk) + size);
+        if (unlikely(cls == -1)) {
+                /* Too large for pool: use system allocator */
+                chunk = rd_malloc(sizeof(*chunk) + size);
+                chunk->mpc_mpool  = mpool;
+                chunk->mpc_u.cls  = -1;
+                rd_atomic64_add(&mpool->mpool_misses, 1);
+                return chunk+1;
+        }
+
+        tc = rd_kafka_msgpool_tcache_get(mpool);
+
+        if (unlikely(!tc->tc_mag[cls].free))
+                rd_kafka_msgpool_mag_refill(mpool, tc, cls);
+
+        chunk = tc->tc_mag[cls].free;
+        tc->tc_mag[cls].free = chunk->mpc_u.next;
+        tc->tc_mag[cls].cnt--;
+        rd_atomic64_add(&tc->tc_stats->hits, 1);
+
+        chunk->mpc_u.cls = cls;
+
+        return chunk+1;
+}
+
+
+void rd_kafka_msgpool_free (void *ptr) {
+        rd_kafka_msgpool_chunk_t *chunk = ((rd_kafka_msgpool_chunk_t *)ptr)-1;
+        struct rd_kafka_msgpool_tcache *tc;
+        int cls = chunk->mpc_u.cls;
+
+        if (unlikely(cls == -1)) {
+                rd_free(chunk);
+                return;
+        }
+
+        rd_dassert(cls >= 0 && cls < RD_KAFKA_MSGPOOL_CLS_CNT);
+
+        tc = rd_kafka_msgpool_tcache_get(chunk->mpc_mpool);
+
+        chunk->mpc_u.next = tc->tc_mag[cls].free;
+        tc->tc_mag[cls].free = chunk;
+
+        if (unlikely(++tc->tc_mag[cls].cnt > RD_KAFKA_MSGPOOL_MAG_MAX))
+                rd_kafka_msgpool_mag_flush(chunk->mpc_mpool, tc, cls,
+                                           RD_KAFKA_MSGPOOL_MAG_BATCH);
+}
+
+
+/**
+ * @brief Get the pool's statistics, including the hits not yet flushed
+ *        from the threads' caches.
+ */
+void rd_kafka_msgpool_stats (rd_kafka_msgpool_t *mpool,
+                             struct rd_kafka_msgpool_stats *stats) {
+        struct rd_kafka_msgpool_tstats *tstats;
+
+        stats->hits       = rd_atomic64_get(&mpool->mpool_hits);
+        mtx_lock(&rd_kafka_msgpool_global_lock);
+        LIST_FOREACH(tstats, &mpool->mpool_tstats, link)
+                stats->hits += rd_atomic64_get(&tstats->hits);
+        mtx_unlock(&rd_kafka_msgpool_global_lock);
+        stats->misses     = rd_atomic64_get(&mpool->mpool_misses);
+        stats->slab_cnt   = rd_atomic64_get(&mpool->mpool_slab_cnt);
+        stats->slab_bytes = rd_atomic64_get(&mpool->mpool_slab_bytes);
+}
+
+
+rd_kafka_msgpool_t *rd_kafka_msgpool_new (void) {
+        rd_kafka_msgpool_t *mpool;
+        int cls;
+
+        call_once(&rd_kafka_msgpool_global_once,
+                  rd_kafka_msgpool_global_init);
+
+        mpool = rd_calloc(1, sizeof(*mpool));
+
+        for (cls = 0 ; cls < RD_KAFKA_MSGPOOL_CLS_CNT ; cls++)
+                mtx_init(&mpool->mpool_depot[cls].lock, mtx_plain);
+        mtx_init(&mpool->mpool_slab_lock, mtx_plain);
+        LIST_INIT(&mpool->mpool_tstats);
+
+        rd_atomic64_init(&mpool->mpool_hits, 0);
+        rd_atomic64_init(&mpool->mpool_misses, 0);
+        rd_atomic64_init(&mpool->mpool_slab_cnt, 0);
+        rd_atomic64_init(&mpool->mpool_slab_bytes, 0);
+
+        mtx_lock(&rd_kafka_msgpool_global_lock);
+        mpool->mpool_id = ++rd_kafka_msgpool_global_id;
+        LIST_INSERT_HEAD(&rd_kafka_msgpool_global_list, mpool, mpool_link);
+        mtx_unlock(&rd_kafka_msgpool_global_lock);
+
+        return mpool;
+}
+
+
+/**
+ * @brief Destroy the pool and all its slabs.
+ *
+ * @warning All chunks allocated from the pool must have been freed.
+ *          Other threads' caches for this pool are invalidated lazily.
+ */
+void rd_kafka_msgpool_destroy (rd_kafka_msgpool_t *mpool) {
+        void *slab;
+        int i;
+
+        mtx_lock(&rd_kafka_msgpool_global_lock);
+        LIST_REMOVE(mpool, mpool_link);
+        /* Other threads' caches are reset when next used or released,
+         * without touching their counters. */
+        while (!LIST_EMPTY(&mpool->mpool_tstats)) {
+                struct rd_kafka_msgpool_tstats *tstats =
+                        LIST_FIRST(&mpool->mpool_tstats);
+                LIST_REMOVE(tstats, link);
+                rd_free(tstats);
+        }
+        mtx_unlock(&rd_kafka_msgpool_global_lock);
+
+        /* Reset the calling thread's cache right away. */
+        for (i = 0 ; i < RD_KAFKA_MSGPOOL_TCACHE_CNT ; i++)
+                if (rd_kafka_msgpool_tcaches[i].tc_mpool == mpool &&
+                    rd_kafka_msgpool_tcaches[i].tc_mpool_id ==
+                    mpool->mpool_id)
+                        memset(&rd_kafka_msgpool_tcaches[i], 0,
+                               sizeof(rd_kafka_msgpool_tcaches[i]));
+
+        while ((slab = mpool->mpool_slabs)) {
+                mpool->mpool_slabs = *(void **)slab;
+                rd_free(slab);
+        }
+
+        for (i = 0 ; i < RD_KAFKA_MSGPOOL_CLS_CNT ; i++)
+                mtx_destroy(&mpool->mpool_depot[i].lock);
+        mtx_destroy(&mpool->mpool_slab_lock);
+
+        rd_free(mpool);
+}
+
+
+
+/**
+ * @name Unit tests
+ */
+
+struct ut_msgpool_thread_arg {
+        void **ptrs;
+        int    cnt;
+};
+
+/**
+ * @returns the number of free chunks in the pool's depots.
+ */
+static int ut_msgpool_depot_cnt (rd_kafka_msgpool_t *mpool) {
+        int cls, cnt = 0;
+
+        for (cls = 0 ; cls < RD_KAFKA_MSGPOOL_CLS_CNT ; cls++) {
+                mtx_lock(&mpool->mpool_depot[cls].lock);
+                cnt += mpool->mpool_depot[cls].cnt;
+                mtx_unlock(&mpool->mpool_depot[cls].lock);
+        }
+
+        return cnt;
+}
+
+static int ut_msgpool_free_thread (void *arg) {
+        struct ut_msgpool_thread_arg *ta = arg;
+        int i;
+
+        for (i = 0 ; i < ta->cnt ; i++)
+                rd_kafka_msgpool_free(ta->ptrs[i]);
+
+        return 0;
+}
+
+int unittest_msgpool (void) {
+        rd_kafka_msgpool_t *mpool, *mpools[RD_KAFKA_MSGPOOL_TCACHE_CNT+1];
+        struct rd_kafka_msgpool_stats stats;
+        struct ut_msgpool_thread_arg ta;
+        const int cnt = 1000;
+        void *ptrs[1000];
+        void *big;
+        thrd_t thrd;
+        int i, r;
+
+        mpool = rd_kafka_msgpool_new();
+
+        /* Allocate a range of sizes, fill them and verify contents. */
+        for (i = 0 ; i < cnt ; i++) {
+                size_t size = 1 + (i * 7) % RD_KAFKA_MSGPOOL_CLS_MAX / 2;
+                ptrs[i] = rd_kafka_msgpool_alloc(mpool, size);
+                memset(ptrs[i], i & 0xff, size);
+        }
+
+        /* The hits are published on stats collection, not only when
+         * the thread's magazine is refilled or released. */
+        rd_kafka_msgpool_stats(mpool, &stats);
+        RD_UT_ASSERT(stats.hits == cnt,
+                     "expected %d hits, not %"PRId64, cnt, stats.hits);
+
+        for (i = 0 ; i < cnt ; i++) {
+                size_t size = 1 + (i * 7) % RD_KAFKA_MSGPOOL_CLS_MAX / 2;
+                RD_UT_ASSERT(((unsigned char *)ptrs[i])[0] == (i & 0xff) &&
+                             ((unsigned char *)ptrs[i])[size-1] == (i & 0xff),
+                             "chunk #%d overwritten", i);
+                rd_kafka_msgpool_free(ptrs[i]);
+        }
+
+        /* Second round should be served entirely from freed chunks. */
+        rd_kafka_msgpool_stats(mpool, &stats);
+        r = (int)stats.slab_cnt;
+        for (i = 0 ; i < cnt ; i++)
+                ptrs[i] = rd_kafka_msgpool_alloc(mpool,
+                                                 1 + (i * 7) %
+                                                 RD_KAFKA_MSGPOOL_CLS_MAX / 2);
+        rd_kafka_msgpool_stats(mpool, &stats);
+        RD_UT_ASSERT(stats.slab_cnt == r,
+                     "expected no new slabs, went from %d to %"PRId64,
+                     r, stats.slab_cnt);
+
+        /* Free from another thread, as is the case for delivery reports
+         * served by a different thread than the producer. */
+        ta.ptrs = ptrs;
+        ta.cnt  = cnt;
+        r = ut_msgpool_depot_cnt(mpool);
+        RD_UT_ASSERT(thrd_create(&thrd, ut_msgpool_free_thread, &ta) ==
+                     thrd_success, "thrd_create failed");
+        thrd_join(thrd, NULL);
+
+        /* The exited thread's magazines are flushed back to the depots */
+        RD_UT_ASSERT(ut_msgpool_depot_cnt(mpool) == r + cnt,
+                     "expected %d chunks in depots after thread exit, "
+                     "not %d", r + cnt, ut_msgpool_depot_cnt(mpool));
+
+        /* Oversized allocations bypass the pool */
+        big = rd_kafka_msgpool_alloc(mpool, RD_KAFKA_MSGPOOL_CLS_MAX);
+        memset(big, 0x55, RD_KAFKA_MSGPOOL_CLS_MAX);
+        rd_kafka_msgpool_free(big);
+
+        rd_kafka_msgpool_stats(mpool, &stats);
+        RD_UT_ASSERT(stats.misses == 1,
+                     "expected 1 miss, not %"PRId64, stats.misses);
+        RD_UT_ASSERT(stats.hits >= cnt,
+                     "expected at least %d published hits, not %"PRId64,
+                     cnt, stats.hits);
+
+        rd_kafka_msgpool_destroy(mpool);
+
+        /* More pools than thread cache slots: exercise eviction
+         * to both live and destroyed pools. */
+        for (i = 0 ; i < RD_KAFKA_MSGPOOL_TCACHE_CNT+1 ; i++) {
+                mpools[i] = rd_kafka_msgpool_new();
+                rd_kafka_msgpool_free(rd_kafka_msgpool_alloc(mpools[i], 10));
+        }
+        rd_kafka_msgpool_destroy(mpools[1]);
+        for (i = 0 ; i < RD_KAFKA_MSGPOOL_TCACHE_CNT+1 ; i++) {
+                if (i == 1)
+                        continue;
+                rd_kafka_msgpool_free(rd_kafka_msgpool_alloc(mpools[i], 100));
+        }
+        for (i = 0 ; i < RD_KAFKA_MSGPOOL_TCACHE_CNT+1 ; i++)
+                if (i != 1)
+                        rd_kafka_msgpool_destroy(mpools[i]);
+
+        RD_UT_PASS();
+}
@@ -0,0 +1,74 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDKAFKA_MSGPOOL_H_
+#define _RDKAFKA_MSGPOOL_H_
+
+
+/**
+ * @name Per-handle slab allocator for producer messages.
+ *
+ * Producer messages (rd_kafka_msg_t plus the inline key and copied payload)
+ * are allocated from a small number of size classes.
+ * Each thread keeps a private cache (magazine) of free chunks per
+ * size class and pool so that the common alloc/free pair does not touch
+ * any shared lock, only refills and flushes of the magazine do,
+ * and then in batches. A thread's magazines are flushed back to their
+ * pools when the thread exits.
+ *
+ * Allocations larger than the largest size class are passed through
+ * to the system allocator.
+ *
+ * All slab memory is owned by the pool and released when the pool
+ * is destroyed, which thus must not happen until all messages allocated
+ * from the pool have been freed.
+ */
+
+typedef struct rd_kafka_msgpool_s rd_kafka_msgpool_t;
+
+/**
+ * @brief Pool statistics, see rd_kafka_msgpool_stats().
+ */
+struct rd_kafka_msgpool_stats {
+        int64_t hits;        /**< Allocations served from the pool */
+        int64_t misses;      /**< Allocations passed through to the
+                              *   system allocator (too large) */
+        int64_t slab_cnt;    /**< Number of slabs allocated */
+        int64_t slab_bytes;  /**< Total memory held by slabs */
+};
+
+rd_kafka_msgpool_t *rd_kafka_msgpool_new (void);
+void rd_kafka_msgpool_destroy (rd_kafka_msgpool_t *mpool);
+void *rd_kafka_msgpool_alloc (rd_kafka_msgpool_t *mpool, size_t size);
+void rd_kafka_msgpool_free (void *ptr);
+void rd_kafka_msgpool_stats (rd_kafka_msgpool_t *mpool,
+                             struct rd_kafka_msgpool_stats *stats);
+
+int unittest_msgpool (void);
+
+#endif /* _RDKAFKA_MSGPOOL_H_ */
@@ -36,7 +36,8 @@
 rd_kafka_buf_t *
 rd_kafka_msgset_create_ProduceRequest (rd_kafka_broker_t *rkb,
                                        rd_kafka_toppar_t *rktp,
-                                       size_t *MessageSetSizep);
+                                       size_t *MessageSetSizep,
+                                       rd_kafka_op_t **offload_rkopp);
 
 /**
  * @name MessageSet readers
@@ -46,5 +47,12 @@ rd_kafka_msgset_parse (rd_kafka_buf_t *rkbuf,
                        rd_kafka_buf_t *request,
                        rd_kafka_toppar_t *rktp,
                        const struct rd_kafka_toppar_ver *tver);
+rd_kafka_op_t *
+rd_kafka_msgset_parse_offload_new (rd_kafka_buf_t *rkbuf,
+                                   rd_kafka_toppar_t *rktp,
+                                   const struct rd_kafka_toppar_ver *tver);
+rd_kafka_resp_err_t
+rd_kafka_msgset_parse_offload_done (rd_kafka_broker_t *rkb,
+                                    rd_kafka_op_t *rko);
 
 #endif /* _RDKAFKA_MSGSET_H_ */
@@ -71,7 +71,17 @@
 #if WITH_SNAPPY
 #include "snappy.h"
 #endif
+#if WITH_ZSTD
+#include "rdkafka_zstd.h"
+#endif
+
 
+/**
+ * Max number of records in a RecordBatch view, larger RecordBatches are
+ * split into multiple views. The view is initially allocated for the
+ * RecordCount and grows if the RecordCount is bogus.
+ */
+#define RD_KAFKA_MSGSET_READER_BATCH_SIZE_MAX 4096
 
 
 struct msgset_v2_hdr {
@@ -108,6 +118,12 @@ typedef struct rd_kafka_msgset_reader_s {
 
         struct msgset_v2_hdr   *msetr_v2_hdr;    /**< MessageSet v2 header */
 
+        int     msetr_lazy;              /**< Bool: enqueue v2 RecordBatches
+                                          *   as views rather than one
+                                          *   op per message
+                                          *   (fetch.lazy.enable) */
+        rd_kafka_op_t *msetr_batch;      /**< Current RecordBatch view */
+
         const struct rd_kafka_toppar_ver *msetr_tver; /**< Toppar op version of
                                                        *   request. */
 
@@ -116,6 +132,15 @@ typedef struct rd_kafka_msgset_reader_s {
         rd_kafka_toppar_t *msetr_rktp;   /* @warning Not a refcounted
                                           *          reference! */
 
+        int64_t *msetr_fetch_offsetp;    /**< Partition's fetch offset
+                                          *   (rktp_offsets.fetch_offset),
+                                          *   or an offloaded parse job's
+                                          *   working copy of it. */
+        int32_t *msetr_fetch_msg_max_bytesp; /**< Partition's
+                                              *   rktp_fetch_msg_max_bytes,
+                                              *   or an offloaded parse
+                                              *   job's working copy. */
+
         int          msetr_msgcnt;      /**< Number of messages in rkq */
         int64_t      msetr_msg_bytes;   /**< Number of bytes in rkq */
         rd_kafka_q_t msetr_rkq;         /**< Temp Message and error queue */
@@ -168,6 +193,11 @@ rd_kafka_msgset_reader_init (rd_kafka_msgset_reader_t *msetr,
         msetr->msetr_tver       = tver;
         msetr->msetr_rkbuf      = rkbuf;
         msetr->msetr_srcname    = "";
+        msetr->msetr_lazy       = rkbuf->rkbuf_rkb->rkb_rk->
+                rk_conf.fetch_lazy_enable;
+
+        msetr->msetr_fetch_offsetp = &rktp->rktp_offsets.fetch_offset;
+        msetr->msetr_fetch_msg_max_bytesp = &rktp->rktp_fetch_msg_max_bytes;
 
         rkbuf->rkbuf_uflow_mitigation = "truncated response from broker (ok)";
 
@@ -205,6 +235,7 @@ rd_kafka_msgset_reader_decompress (rd_kafka_msgset_reader_t *msetr,
         int codec = Attributes & RD_KAFKA_MSG_ATTR_COMPRESSION_MASK;
         rd_kafka_resp_err_t err = RD_KAFKA_RESP_ERR_NO_ERROR;
         rd_kafka_buf_t *rkbufz;
+        rd_ts_t ts_start = rd_clock();
 
         switch (codec)
         {
@@ -343,6 +374,19 @@ rd_kafka_msgset_reader_decompress (rd_kafka_msgset_reader_t *msetr,
         }
         break;
 
+#if WITH_ZSTD
+        case RD_KAFKA_COMPRESSION_ZSTD:
+        {
+                err = rd_kafka_zstd_decompress(msetr->msetr_rkb, Offset,
+                                               (const char *)compressed,
+                                               compressed_size,
+                                               &iov.iov_base, &iov.iov_len);
+                if (err)
+                        goto err;
+        }
+        break;
+#endif
+
         default:
                 rd_rkb_dbg(msetr->msetr_rkb, MSG, "CODEC",
                            "%s [%"PRId32"]: Message at offset %"PRId64
@@ -363,12 +407,20 @@ rd_kafka_msgset_reader_decompress (rd_kafka_msgset_reader_t *msetr,
          * Decompression successful
          */
 
+        rd_atomic64_add(&msetr->msetr_rkb->rkb_c.decompress[codec].cnt, 1);
+        rd_atomic64_add(&msetr->msetr_rkb->rkb_c.decompress[codec].bytes,
+                        (int64_t)iov.iov_len);
+        rd_atomic64_add(&msetr->msetr_rkb->rkb_c.decompress[codec].us,
+                        rd_clock() - ts_start);
+
         /* Create a new buffer pointing to the uncompressed
          * allocated buffer (outbuf) and let messages keep a reference to
          * this new buffer. */
         rkbufz = rd_kafka_buf_new_shadow(iov.iov_base, iov.iov_len, rd_free);
         rkbufz->rkbuf_rkb = msetr->msetr_rkbuf->rkbuf_rkb;
         rd_kafka_broker_keep(rkbufz->rkbuf_rkb);
+        /* Fetch response receive time, for the fetchq latency */
+        rkbufz->rkbuf_ts_enq = msetr->msetr_rkbuf->rkbuf_ts_enq;
 
 
         /* In MsgVersion v0..1 the decompressed data contains
@@ -389,6 +441,11 @@ rd_kafka_msgset_reader_decompress (rd_kafka_msgset_reader_t *msetr,
 
                 inner_msetr.msetr_srcname = "compressed ";
 
+                /* Share the outer reader's fetch state */
+                inner_msetr.msetr_fetch_offsetp = msetr->msetr_fetch_offsetp;
+                inner_msetr.msetr_fetch_msg_max_bytesp =
+                        msetr->msetr_fetch_msg_max_bytesp;
+
                 if (MsgVersion == 1) {
                         /* postproc() will convert relative to
                          * absolute offsets */
@@ -573,7 +630,7 @@ rd_kafka_msgset_reader_msg_v0_1 (rd_kafka_msgset_reader_t *msetr) {
          *       we cant perform this offset check here
          *       in that case. */
         if (!relative_offsets &&
-            hdr.Offset < rktp->rktp_offsets.fetch_offset)
+            hdr.Offset < *msetr->msetr_fetch_offsetp)
                 return RD_KAFKA_RESP_ERR_NO_ERROR; /* Continue with next msg */
 
         /* Handle compressed MessageSet */
@@ -630,6 +687,119 @@ rd_kafka_msgset_reader_msg_v0_1 (rd_kafka_msgset_reader_t *msetr) {
 
 
 
+/**
+ * @brief MsgVersion v2 record header
+ */
+struct msg_v2_hdr {
+        int64_t Length;
+        int8_t  MsgAttributes;
+        int64_t TimestampDelta;
+        int64_t OffsetDelta;
+        int64_t Offset;  /* Absolute offset */
+        rd_kafkap_bytes_t Key;
+        rd_kafkap_bytes_t Value;
+        rd_kafkap_bytes_t Headers;
+};
+
+
+/**
+ * @brief Read a varint at \p *pp, bounded by \p end, into \p nump
+ *        and advance \p *pp past it.
+ *
+ * @returns 0 on success or -1 on underflow.
+ */
+static RD_INLINE int rd_kafka_msgset_reader_varint_contig (const char **pp,
+                                                           const char *end,
+                                                           int64_t *nump) {
+        size_t r = rd_varint_dec_i64(*pp, (size_t)(end - *pp), nump);
+
+        if (unlikely(RD_UVARINT_DEC_FAILED(r)))
+                return -1;
+
+        *pp += r;
+        return 0;
+}
+
+
+/**
+ * @brief Read varint-length Kafka Bytes at \p *pp, bounded by \p end,
+ *        like rd_kafka_buf_read_bytes_varint(), and advance \p *pp past it.
+ *
+ * @returns 0 on success or -1 on underflow.
+ */
+static RD_INLINE int
+rd_kafka_msgset_reader_bytes_contig (const char **pp, const char *end,
+                                     rd_kafkap_bytes_t *kbytes) {
+        int64_t len;
+
+        if (unlikely(rd_kafka_msgset_reader_varint_contig(pp, end, &len) ==
+                     -1))
+                return -1;
+
+        if (len == RD_KAFKAP_BYTES_LEN_NULL) {
+                kbytes->data = NULL;
+                kbytes->len  = 0;
+                return 0;
+        } else if (unlikely(len < 0 || len > (int64_t)(end - *pp)))
+                return -1;
+
+        kbytes->data = len == 0 ? "" : *pp;
+        kbytes->len  = (int32_t)len;
+        *pp += len;
+
+        return 0;
+}
+
+
+/**
+ * @brief Parse the MsgVersion v2 record following its Length directly
+ *        from the contiguous memory \p p .. \p end, rather than through
+ *        the buffer's slice reader.
+ *
+ * @returns 0 on success or -1 on parse failure.
+ */
+static RD_INLINE int
+rd_kafka_msgset_reader_msg_v2_contig (struct msg_v2_hdr *hdr,
+                                      const char *p, const char *end) {
+        hdr->MsgAttributes = (int8_t)*(p++);
+
+        if (unlikely(rd_kafka_msgset_reader_varint_contig(
+                             &p, end, &hdr->TimestampDelta) == -1 ||
+                     rd_kafka_msgset_reader_varint_contig(
+                             &p, end, &hdr->OffsetDelta) == -1 ||
+                     rd_kafka_msgset_reader_bytes_contig(
+                             &p, end, &hdr->Key) == -1 ||
+                     rd_kafka_msgset_reader_bytes_contig(
+                             &p, end, &hdr->Value) == -1))
+                return -1;
+
+        /* We parse the Headers later, just store the size
+         * and pointer to the headers. */
+        hdr->Headers.data = p;
+        hdr->Headers.len  = (int32_t)(end - p);
+
+        return 0;
+}
+
+
+/**
+ * @brief Enqueue the current RecordBatch view, if any, on the
+ *        temporary queue.
+ */
+static void
+rd_kafka_msgset_reader_batch_flush (rd_kafka_msgset_reader_t *msetr) {
+        rd_kafka_op_t *rko = msetr->msetr_batch;
+
+        if (!rko)
+                return;
+
+        msetr->msetr_batch = NULL;
+
+        rd_kafka_op_fetch_batch_done(rko);
+        rd_kafka_q_enq(&msetr->msetr_rkq, rko);
+}
+
+
 /**
  * @brief Message parser for MsgVersion v2
  */
@@ -637,18 +807,12 @@ static rd_kafka_resp_err_t
 rd_kafka_msgset_reader_msg_v2 (rd_kafka_msgset_reader_t *msetr) {
         rd_kafka_buf_t *rkbuf = msetr->msetr_rkbuf;
         rd_kafka_toppar_t *rktp = msetr->msetr_rktp;
-        struct {
-                int64_t Length;
-                int8_t  MsgAttributes;
-                int64_t TimestampDelta;
-                int64_t OffsetDelta;
-                int64_t Offset;  /* Absolute offset */
-                rd_kafkap_bytes_t Key;
-                rd_kafkap_bytes_t Value;
-                rd_kafkap_bytes_t Headers;
-        } hdr;
+        struct msg_v2_hdr hdr;
+        const char *p;
         rd_kafka_op_t *rko;
         rd_kafka_msg_t *rkm;
+        rd_kafka_timestamp_type_t tstype;
+        int64_t timestamp;
         /* Only log decoding errors if protocol debugging enabled. */
         int log_decode_errors = (rkbuf->rkbuf_rkb->rkb_rk->rk_conf.debug &
                                  RD_KAFKA_DBG_PROTOCOL) ? LOG_DEBUG : 0;
@@ -656,33 +820,103 @@ rd_kafka_msgset_reader_msg_v2 (rd_kafka_msgset_reader_t *msetr) {
 
         rd_kafka_buf_read_varint(rkbuf, &hdr.Length);
         message_end = rd_slice_offset(&rkbuf->rkbuf_reader)+(size_t)hdr.Length;
-        rd_kafka_buf_read_i8(rkbuf, &hdr.MsgAttributes);
 
-        rd_kafka_buf_read_varint(rkbuf, &hdr.TimestampDelta);
-        rd_kafka_buf_read_varint(rkbuf, &hdr.OffsetDelta);
+        if (likely(hdr.Length > 0 &&
+                   (p = rd_slice_ensure_contig(&rkbuf->rkbuf_reader,
+                                               (size_t)hdr.Length)))) {
+                /* Fast path: the record is contiguous in memory */
+                if (unlikely(rd_kafka_msgset_reader_msg_v2_contig(
+                                     &hdr, p, p + hdr.Length) == -1))
+                        rd_kafka_buf_parse_fail(rkbuf,
+                                                "Invalid record of "
+                                                "%"PRId64" bytes",
+                                                hdr.Length);
+        } else {
+                rd_kafka_buf_read_i8(rkbuf, &hdr.MsgAttributes);
+
+                rd_kafka_buf_read_varint(rkbuf, &hdr.TimestampDelta);
+                rd_kafka_buf_read_varint(rkbuf, &hdr.OffsetDelta);
+
+                rd_kafka_buf_read_bytes_varint(rkbuf, &hdr.Key);
+
+                rd_kafka_buf_read_bytes_varint(rkbuf, &hdr.Value);
+
+                /* We parse the Headers later, just store the size
+                 * (possibly truncated) and pointer to the headers. */
+                hdr.Headers.len = (int32_t)(message_end -
+                                            rd_slice_offset(&rkbuf->
+                                                            rkbuf_reader));
+                rd_kafka_buf_read_ptr(rkbuf, &hdr.Headers.data,
+                                      hdr.Headers.len);
+        }
+
         hdr.Offset = msetr->msetr_v2_hdr->BaseOffset + hdr.OffsetDelta;
 
         /* Skip message if outdated */
-        if (hdr.Offset < rktp->rktp_offsets.fetch_offset) {
+        if (hdr.Offset < *msetr->msetr_fetch_offsetp) {
                 rd_rkb_dbg(msetr->msetr_rkb, MSG, "MSG",
                            "%s [%"PRId32"]: "
                            "Skip offset %"PRId64" < fetch_offset %"PRId64,
                            rktp->rktp_rkt->rkt_topic->str,
                            rktp->rktp_partition,
-                           hdr.Offset, rktp->rktp_offsets.fetch_offset);
-                rd_kafka_buf_skip_to(rkbuf, message_end);
+                           hdr.Offset, *msetr->msetr_fetch_offsetp);
                 return RD_KAFKA_RESP_ERR_NO_ERROR; /* Continue with next msg */
         }
 
-        rd_kafka_buf_read_bytes_varint(rkbuf, &hdr.Key);
-
-        rd_kafka_buf_read_bytes_varint(rkbuf, &hdr.Value);
+        /* Set timestamp.
+         *
+         * When broker assigns the timestamps (LOG_APPEND_TIME) it will
+         * assign the same timestamp for all messages in a MessageSet
+         * using MaxTimestamp.
+         */
+        if ((msetr->msetr_v2_hdr->Attributes &
+             RD_KAFKA_MSG_ATTR_LOG_APPEND_TIME) ||
+            (hdr.MsgAttributes & RD_KAFKA_MSG_ATTR_LOG_APPEND_TIME)) {
+                tstype = RD_KAFKA_TIMESTAMP_LOG_APPEND_TIME;
+                timestamp = msetr->msetr_v2_hdr->MaxTimestamp;
+        } else {
+                tstype = RD_KAFKA_TIMESTAMP_CREATE_TIME;
+                timestamp = msetr->msetr_v2_hdr->BaseTimestamp +
+                        hdr.TimestampDelta;
+        }
 
-        /* We parse the Headers later, just store the size (possibly truncated)
-         * and pointer to the headers. */
-        hdr.Headers.len = (int32_t)(message_end -
-                                    rd_slice_offset(&rkbuf->rkbuf_reader));
-        rd_kafka_buf_read_ptr(rkbuf, &hdr.Headers.data, hdr.Headers.len);
+        if (msetr->msetr_lazy) {
+                /* Add the record to the RecordBatch view,
+                 * the message op is created when the application
+                 * consumes it. */
+                rd_kafka_fetch_rec_t *rec;
+
+                /* Split large RecordBatches into views of at most
+                 * BATCH_SIZE_MAX records. */
+                if (msetr->msetr_batch &&
+                    unlikely(msetr->msetr_batch->rko_u.fetch_batch.cnt ==
+                             RD_KAFKA_MSGSET_READER_BATCH_SIZE_MAX))
+                        rd_kafka_msgset_reader_batch_flush(msetr);
+
+                if (!msetr->msetr_batch)
+                        msetr->msetr_batch = rd_kafka_op_new_fetch_batch(
+                                rktp, msetr->msetr_tver->version, rkbuf,
+                                RD_MIN(msetr->msetr_v2_hdr->RecordCount,
+                                       RD_KAFKA_MSGSET_READER_BATCH_SIZE_MAX));
+
+                rec = rd_kafka_op_fetch_batch_add(msetr->msetr_batch);
+                rec->offset    = hdr.Offset;
+                rec->timestamp = timestamp;
+                rec->tstype    = tstype;
+                rec->key       = RD_KAFKAP_BYTES_IS_NULL(&hdr.Key) ?
+                        NULL : hdr.Key.data;
+                rec->key_len   = RD_KAFKAP_BYTES_LEN(&hdr.Key);
+                rec->value     = RD_KAFKAP_BYTES_IS_NULL(&hdr.Value) ?
+                        NULL : hdr.Value.data;
+                rec->value_len = RD_KAFKAP_BYTES_LEN(&hdr.Value);
+                rec->hdrs      = hdr.Headers.data;
+                rec->hdrs_len  = hdr.Headers.len;
+
+                msetr->msetr_msgcnt++;
+                msetr->msetr_msg_bytes += rec->key_len + rec->value_len;
+
+                return RD_KAFKA_RESP_ERR_NO_ERROR;
+        }
 
         /* Create op/message container for message. */
         rko = rd_kafka_op_new_fetch_msg(&rkm,
@@ -702,23 +936,8 @@ rd_kafka_msgset_reader_msg_v2 (rd_kafka_msgset_reader_t *msetr) {
         rkm->rkm_u.consumer.binhdrs.len  = hdr.Headers.len;
         rkm->rkm_u.consumer.binhdrs.data = hdr.Headers.data;
 
-        /* Set timestamp.
-         *
-         * When broker assigns the timestamps (LOG_APPEND_TIME) it will
-         * assign the same timestamp for all messages in a MessageSet
-         * using MaxTimestamp.
-         */
-        if ((msetr->msetr_v2_hdr->Attributes &
-             RD_KAFKA_MSG_ATTR_LOG_APPEND_TIME) ||
-            (hdr.MsgAttributes & RD_KAFKA_MSG_ATTR_LOG_APPEND_TIME)) {
-                rkm->rkm_tstype = RD_KAFKA_TIMESTAMP_LOG_APPEND_TIME;
-                rkm->rkm_timestamp = msetr->msetr_v2_hdr->MaxTimestamp;
-        } else {
-                rkm->rkm_tstype = RD_KAFKA_TIMESTAMP_CREATE_TIME;
-                rkm->rkm_timestamp =
-                        msetr->msetr_v2_hdr->BaseTimestamp + hdr.TimestampDelta;
-        }
-
+        rkm->rkm_tstype    = tstype;
+        rkm->rkm_timestamp = timestamp;
 
         /* Enqueue message on temporary queue */
         rd_kafka_q_enq(&msetr->msetr_rkq, rko);
@@ -845,7 +1064,7 @@ rd_kafka_msgset_reader_v2 (rd_kafka_msgset_reader_t *msetr) {
                                             hdr.BaseOffset, payload_size);
 
         /* If entire MessageSet contains old outdated offsets, skip it. */
-        if (LastOffset < rktp->rktp_offsets.fetch_offset) {
+        if (LastOffset < *msetr->msetr_fetch_offsetp) {
                 rd_kafka_buf_skip(rkbuf, payload_size);
                 goto done;
         }
@@ -901,6 +1120,7 @@ rd_kafka_msgset_reader_v2 (rd_kafka_msgset_reader_t *msetr) {
          * last offset.  See KAFKA-5443 */
         msetr->msetr_next_offset = LastOffset + 1;
 
+        rd_kafka_msgset_reader_batch_flush(msetr);
         msetr->msetr_v2_hdr = NULL;
 
         return RD_KAFKA_RESP_ERR_NO_ERROR;
@@ -911,6 +1131,8 @@ rd_kafka_msgset_reader_v2 (rd_kafka_msgset_reader_t *msetr) {
         err = rkbuf->rkbuf_err;
         /* FALLTHRU */
  err:
+        /* Keep the records read so far of a partial RecordBatch. */
+        rd_kafka_msgset_reader_batch_flush(msetr);
         msetr->msetr_v2_hdr = NULL;
         return err;
 }
@@ -956,7 +1178,7 @@ rd_kafka_msgset_reader (rd_kafka_msgset_reader_t *msetr) {
                            rktp->rktp_rkt->rkt_topic->str,
                            rktp->rktp_partition,
                            (int)MagicByte, Offset);
-                if (Offset >= msetr->msetr_rktp->rktp_offsets.fetch_offset) {
+                if (Offset >= *msetr->msetr_fetch_offsetp) {
                         rd_kafka_q_op_err(
                                 &msetr->msetr_rkq,
                                 RD_KAFKA_OP_CONSUMER_ERR,
@@ -966,7 +1188,7 @@ rd_kafka_msgset_reader (rd_kafka_msgset_reader_t *msetr) {
                                 "at offset %"PRId64,
                                 (int)MagicByte, Offset);
                         /* Skip message(set) */
-                        msetr->msetr_rktp->rktp_offsets.fetch_offset = Offset+1;
+                        *msetr->msetr_fetch_offsetp = Offset+1;
                 }
 
                 return RD_KAFKA_RESP_ERR__NOT_IMPLEMENTED;
@@ -1001,12 +1223,20 @@ static void rd_kafka_msgset_reader_postproc (rd_kafka_msgset_reader_t *msetr,
                  * and purge any messages older than the current
                  * fetch offset. */
                 rd_kafka_q_fix_offsets(&msetr->msetr_rkq,
-                                       msetr->msetr_rktp->rktp_offsets.
-                                       fetch_offset,
+                                       *msetr->msetr_fetch_offsetp,
                                        msetr->msetr_outer.offset -
                                        msetr->msetr_msgcnt + 1);
         }
 
+        if (msetr->msetr_lazy &&
+            (rko = rd_kafka_q_last(&msetr->msetr_rkq,
+                                   RD_KAFKA_OP_FETCH_BATCH,
+                                   0 /* no error ops */))) {
+                *last_offsetp = rko->rko_u.fetch_batch.recs[
+                        rko->rko_u.fetch_batch.cnt-1].offset;
+                return;
+        }
+
         rko = rd_kafka_q_last(&msetr->msetr_rkq,
                               RD_KAFKA_OP_FETCH,
                               0 /* no error ops */);
@@ -1043,14 +1273,14 @@ rd_kafka_msgset_reader_run (rd_kafka_msgset_reader_t *msetr) {
                  * or no error was posted on the response queue.
                  * This means the size limit perhaps was too tight,
                  * increase it automatically. */
-                if (rktp->rktp_fetch_msg_max_bytes < (1 << 30)) {
-                        rktp->rktp_fetch_msg_max_bytes *= 2;
+                if (*msetr->msetr_fetch_msg_max_bytesp < (1 << 30)) {
+                        *msetr->msetr_fetch_msg_max_bytesp *= 2;
                         rd_rkb_dbg(msetr->msetr_rkb, FETCH, "CONSUME",
                                    "Topic %s [%"PRId32"]: Increasing "
                                    "max fetch bytes to %"PRId32,
                                    rktp->rktp_rkt->rkt_topic->str,
                                    rktp->rktp_partition,
-                                   rktp->rktp_fetch_msg_max_bytes);
+                                   *msetr->msetr_fetch_msg_max_bytesp);
                 } else if (!err) {
                         rd_kafka_q_op_err(
                                 &msetr->msetr_rkq,
@@ -1058,11 +1288,11 @@ rd_kafka_msgset_reader_run (rd_kafka_msgset_reader_t *msetr) {
                                 RD_KAFKA_RESP_ERR_MSG_SIZE_TOO_LARGE,
                                 msetr->msetr_tver->version,
                                 rktp,
-                                rktp->rktp_offsets.fetch_offset,
+                                *msetr->msetr_fetch_offsetp,
                                 "Message at offset %"PRId64" "
                                 "might be too large to fetch, try increasing "
                                 "receive.message.max.bytes",
-                                rktp->rktp_offsets.fetch_offset);
+                                *msetr->msetr_fetch_offsetp);
                 }
 
         } else {
@@ -1094,13 +1324,13 @@ rd_kafka_msgset_reader_run (rd_kafka_msgset_reader_t *msetr) {
                 /* Update partition's fetch offset based on
                  * last message's offest. */
                 if (likely(last_offset != -1))
-                        rktp->rktp_offsets.fetch_offset = last_offset + 1;
+                        *msetr->msetr_fetch_offsetp = last_offset + 1;
         }
 
         /* Adjust next fetch offset if outlier code has indicated
          * an even later next offset. */
-        if (msetr->msetr_next_offset > rktp->rktp_offsets.fetch_offset)
-                rktp->rktp_offsets.fetch_offset = msetr->msetr_next_offset;
+        if (msetr->msetr_next_offset > *msetr->msetr_fetch_offsetp)
+                *msetr->msetr_fetch_offsetp = msetr->msetr_next_offset;
 
         rd_kafka_q_destroy_owner(&msetr->msetr_rkq);
 
@@ -1113,6 +1343,24 @@ rd_kafka_msgset_reader_run (rd_kafka_msgset_reader_t *msetr) {
 
 
 
+/**
+ * @brief Update partition and topic consumer statistics with the
+ *        messages read by \p msetr.
+ */
+static void
+rd_kafka_msgset_reader_stats (const rd_kafka_msgset_reader_t *msetr) {
+        rd_kafka_toppar_t *rktp = msetr->msetr_rktp;
+
+        rd_atomic64_add(&rktp->rktp_c.rx_msgs, msetr->msetr_msgcnt);
+        rd_atomic64_add(&rktp->rktp_c.rx_msg_bytes, msetr->msetr_msg_bytes);
+
+        rd_avg_add(&rktp->rktp_rkt->rkt_avg_batchcnt,
+                   (int64_t)msetr->msetr_msgcnt);
+        rd_avg_add(&rktp->rktp_rkt->rkt_avg_batchsize,
+                   (int64_t)msetr->msetr_msg_bytes);
+}
+
+
 /**
  * @brief Parse one MessageSet at the current buffer read position,
  *        enqueueing messages, propagating errors, etc.
@@ -1134,16 +1382,178 @@ rd_kafka_msgset_parse (rd_kafka_buf_t *rkbuf,
         /* Parse and handle the message set */
         err = rd_kafka_msgset_reader_run(&msetr);
 
-        rd_atomic64_add(&rktp->rktp_c.rx_msgs, msetr.msetr_msgcnt);
-        rd_atomic64_add(&rktp->rktp_c.rx_msg_bytes, msetr.msetr_msg_bytes);
-
-        rd_avg_add(&rktp->rktp_rkt->rkt_avg_batchcnt,
-                   (int64_t)msetr.msetr_msgcnt);
-        rd_avg_add(&rktp->rktp_rkt->rkt_avg_batchsize,
-                   (int64_t)msetr.msetr_msg_bytes);
+        rd_kafka_msgset_reader_stats(&msetr);
 
         return err;
 
 }
 
 
+
+/**
+ * @name Offloaded MessageSet parsing
+ *
+ * With an offload pool (`decompression.threads`) the MessageSets of a
+ * FetchResponse are parsed and decompressed by the pool's worker threads,
+ * in parallel for all partitions.
+ *
+ * Each job reads its MessageSet through a view of the response buffer
+ * and parses it onto a job-local queue using working copies of the
+ * partition's fetch state. When the job is done the broker thread
+ * moves the messages to the partition's fetch queue and commits the
+ * fetch state, see rd_kafka_msgset_parse_offload_done().
+ * Since the next Fetch is not sent until all jobs of the previous
+ * FetchResponse are done the messages are enqueued in offset order.
+ * @{
+ */
+
+typedef struct rd_kafka_msgset_parse_job_s {
+        rd_kafka_msgset_reader_t msetr;
+        struct rd_kafka_toppar_ver tver;  /**< Copy of the request's
+                                           *   toppar version. */
+        rd_kafka_q_t rkq;                 /**< Parsed messages and errors */
+        int64_t fetch_offset;             /**< Working copy of
+                                           *   rktp_offsets.fetch_offset */
+        int32_t fetch_msg_max_bytes;      /**< Working copy of
+                                           *   rktp_fetch_msg_max_bytes */
+        rd_kafka_resp_err_t err;          /**< Parse error */
+} rd_kafka_msgset_parse_job_t;
+
+
+/**
+ * @brief Offload job: parse the MessageSet.
+ *
+ * @locality offload worker thread
+ */
+static void rd_kafka_msgset_parse_offload_run (rd_kafka_t *rk,
+                                               rd_kafka_op_t *rko) {
+        rd_kafka_msgset_parse_job_t *job = rko->rko_u.offload.opaque;
+
+        job->err = rd_kafka_msgset_reader_run(&job->msetr);
+}
+
+
+/**
+ * @brief Free a parse job that was never committed, e.g., when its op
+ *        is destroyed on client termination. Parsed messages are purged.
+ *
+ * @locality any
+ */
+static void rd_kafka_msgset_parse_job_free (void *opaque) {
+        rd_kafka_msgset_parse_job_t *job = opaque;
+
+        rd_kafka_q_destroy_owner(&job->rkq);
+        rd_free(job);
+}
+
+
+/**
+ * @brief Create an offload job for parsing the MessageSet at the current
+ *        buffer read position, which is then skipped.
+ *
+ * @remark The current rkbuf_reader slice must be limited to the
+ *         MessageSet size.
+ *
+ * @returns the offload job op, without a done callback and replyq,
+ *          to be committed by rd_kafka_msgset_parse_offload_done().
+ *
+ * @locality broker thread
+ */
+rd_kafka_op_t *
+rd_kafka_msgset_parse_offload_new (rd_kafka_buf_t *rkbuf,
+                                   rd_kafka_toppar_t *rktp,
+                                   const struct rd_kafka_toppar_ver *tver) {
+        rd_kafka_msgset_parse_job_t *job;
+        rd_kafka_buf_t *rkbuf_view;
+        rd_kafka_op_t *rko;
+
+        job = rd_calloc(1, sizeof(*job));
+        job->tver                = *tver;
+        job->fetch_offset        = rktp->rktp_offsets.fetch_offset;
+        job->fetch_msg_max_bytes = rktp->rktp_fetch_msg_max_bytes;
+
+        rd_kafka_q_init(&job->rkq, rkbuf->rkbuf_rkb->rkb_rk);
+        job->rkq.rkq_serve  = rktp->rktp_fetchq->rkq_serve;
+        job->rkq.rkq_opaque = rktp->rktp_fetchq->rkq_opaque;
+
+        /* The job reads the MessageSet through its own view,
+         * skip it in the response buffer. */
+        rkbuf_view = rd_kafka_buf_new_view(rkbuf, &rkbuf->rkbuf_reader);
+        rd_slice_read(&rkbuf->rkbuf_reader, NULL,
+                      rd_slice_remains(&rkbuf->rkbuf_reader));
+
+        rd_kafka_msgset_reader_init(&job->msetr, rkbuf_view, rktp,
+                                    &job->tver, &job->rkq);
+        job->msetr.msetr_fetch_offsetp = &job->fetch_offset;
+        job->msetr.msetr_fetch_msg_max_bytesp = &job->fetch_msg_max_bytes;
+
+        rko = rd_kafka_op_new_offload(rd_kafka_msgset_parse_offload_run,
+                                      NULL, job);
+        rko->rko_u.offload.free_cb = rd_kafka_msgset_parse_job_free;
+        rko->rko_u.offload.rkbuf = rkbuf_view;
+        rko->rko_rktp = rd_kafka_toppar_keep(rktp);
+
+        return rko;
+}
+
+
+/**
+ * @brief Commit a done MessageSet parse job: move the parsed messages
+ *        and errors to the partition's fetch queue and update the
+ *        partition's fetch state.
+ *
+ * The result is discarded if the partition's fetch version or leader
+ * changed since the Fetch request was sent.
+ *
+ * The job state is freed, but not the op.
+ *
+ * @returns the parse error, see rd_kafka_msgset_reader_run().
+ *
+ * @locality broker thread
+ */
+rd_kafka_resp_err_t
+rd_kafka_msgset_parse_offload_done (rd_kafka_broker_t *rkb,
+                                    rd_kafka_op_t *rko) {
+        rd_kafka_msgset_parse_job_t *job = rko->rko_u.offload.opaque;
+        rd_kafka_toppar_t *rktp = job->msetr.msetr_rktp;
+        rd_kafka_resp_err_t err = RD_KAFKA_RESP_ERR_NO_ERROR;
+        int32_t fetch_version;
+        int outdated;
+
+        rd_kafka_toppar_lock(rktp);
+        fetch_version = rktp->rktp_fetch_version;
+        outdated = job->tver.version < fetch_version ||
+                rktp->rktp_leader != rkb;
+        rd_kafka_toppar_unlock(rktp);
+
+        if (unlikely(outdated)) {
+                rd_rkb_dbg(rkb, MSG, "DROP",
+                           "%s [%"PRId32"]: "
+                           "dropping outdated parsed fetch response "
+                           "(v%d < %d or leader changed)",
+                           rktp->rktp_rkt->rkt_topic->str,
+                           rktp->rktp_partition,
+                           job->tver.version, fetch_version);
+                rd_atomic64_add(&rktp->rktp_c.rx_ver_drops, 1);
+
+        } else {
+                if (rd_kafka_q_concat(rktp->rktp_fetchq, &job->rkq) != -1)
+                        rktp->rktp_offsets.fetch_offset = job->fetch_offset;
+                rktp->rktp_fetch_msg_max_bytes = job->fetch_msg_max_bytes;
+
+                rd_kafka_msgset_reader_stats(&job->msetr);
+
+                err = job->err;
+        }
+
+        rd_kafka_msgset_parse_job_free(job);
+        rd_kafka_buf_destroy(rko->rko_u.offload.rkbuf);
+        rko->rko_u.offload.rkbuf = NULL;
+        rko->rko_u.offload.opaque = NULL;
+
+        return err;
+}
+
+/**@}*/
+
+
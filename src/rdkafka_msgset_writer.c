@@ -35,6 +35,16 @@
 #include "rdkafka_header.h"
 #include "rdkafka_lz4.h"
 
+#if WITH_LZ4_EXT
+#include <lz4frame.h>
+#else
+#include "lz4frame.h"
+#endif
+#if WITH_ZSTD
+#include <zstd.h>
+#include "rdkafka_zstd.h"
+#endif
+
 #include "snappy.h"
 #include "rdvarint.h"
 #include "crc32c.h"
@@ -71,6 +81,37 @@ typedef struct rd_kafka_msgset_writer_s {
                 int64_t    timestamp;
         } msetw_firstmsg;
 
+        /* Streaming compression (MsgVersion 2):
+         * messages are compressed as they are written to the buffer
+         * and their uncompressed serialization is then discarded,
+         * see rd_kafka_msgset_writer_zstrm_flush(). */
+        struct {
+                rd_kafka_compression_t codec; /* Codec, or NONE if
+                                               * not streaming. */
+                int     used;                 /* Compressor was set up */
+                int     failed;               /* Compression failed */
+                size_t  inlen;                /* Uncompressed bytes fed */
+                size_t  outlen;               /* Compressed bytes produced*/
+                struct iovec *ciovs;          /* Compressed output chunks */
+                size_t  ciov_cnt;             /* Used ciovs */
+                size_t  ciov_size;            /* Allocated ciovs */
+                size_t  chunk_size;           /* Size of last chunk */
+                union {
+#if WITH_ZLIB
+                        z_stream gz;
+#endif
+                        LZ4F_compressionContext_t lz4;
+#if WITH_ZSTD
+                        ZSTD_CStream *zstd;
+#endif
+                } u;
+        } msetw_zstrm;
+
+        int     msetw_offload;           /* Compression may be offloaded:
+                                          * messages are written
+                                          * uncompressed and compressed
+                                          * when finalized. */
+
         rd_kafka_broker_t *msetw_rkb;    /* @warning Not a refcounted
                                           *          reference! */
         rd_kafka_toppar_t *msetw_rktp;   /* @warning Not a refcounted
@@ -78,6 +119,14 @@ typedef struct rd_kafka_msgset_writer_s {
 } rd_kafka_msgset_writer_t;
 
 
+/**
+ * Minimum uncompressed MessageSet size for compression to be offloaded
+ * to the offload pool (`compression.threads`), smaller MessageSets are
+ * compressed on the broker thread.
+ */
+#define RD_KAFKA_MSGSET_OFFLOAD_MIN_SIZE  (32*1024)
+
+
 
 /**
  * @brief Select ApiVersion and MsgVersion to use based on broker's
@@ -94,6 +143,17 @@ rd_kafka_msgset_writer_select_MsgVersion (rd_kafka_msgset_writer_t *msetw) {
                 msetw->msetw_ApiVersion = 3;
                 msetw->msetw_MsgVersion = 2;
                 msetw->msetw_features |= feature;
+
+                /* zstd-compressed MessageSets must be sent with
+                 * ProduceRequest v7 or later (KIP-110), the request
+                 * format is otherwise the same as v3. */
+                if (msetw->msetw_rktp->rktp_rkt->rkt_conf.compression_codec ==
+                    RD_KAFKA_COMPRESSION_ZSTD &&
+                    rd_kafka_broker_ApiVersion_supported(
+                            rkb, RD_KAFKAP_Produce, 7, 7, NULL) == 7) {
+                        msetw->msetw_ApiVersion = 7;
+                        msetw->msetw_features |= RD_KAFKA_FEATURE_ZSTD;
+                }
         } else if ((feature = rkb->rkb_features & RD_KAFKA_FEATURE_MSGVER1)) {
                 msetw->msetw_ApiVersion = 2;
                 msetw->msetw_MsgVersion = 1;
@@ -110,6 +170,506 @@ rd_kafka_msgset_writer_select_MsgVersion (rd_kafka_msgset_writer_t *msetw) {
 }
 
 
+/**
+ * @returns the current uncompressed write position of the MessageSet,
+ *          which includes the data fed to the streaming compressor.
+ */
+static RD_INLINE size_t
+rd_kafka_msgset_writer_pos (const rd_kafka_msgset_writer_t *msetw) {
+        return rd_buf_write_pos(&msetw->msetw_rkbuf->rkbuf_buf) +
+                msetw->msetw_zstrm.inlen;
+}
+
+
+/**
+ * @name Streaming compression
+ *
+ * With MsgVersion 2 the compressed records are not enveloped, which allows
+ * the records to be compressed as they are written rather than
+ * compressing the complete uncompressed MessageSet when it is finalized.
+ *
+ * Written records are fed to the compressor whenever
+ * RD_KAFKA_MSGSET_ZSTRM_FLUSH_SIZE bytes have accumulated in the buffer,
+ * after which the buffer is rewound to the first message position
+ * and the space reused.
+ * Payloads that would otherwise have been pushed to the buffer
+ * by reference are fed directly to the compressor.
+ * The compressed output is written to a list of chunks which
+ * are pushed to the buffer when the MessageSet is finalized.
+ *
+ * This keeps the peak memory use of a compressed MessageSet close to
+ * its compressed size.
+ *
+ * The compressor is only set up on the first flush: MessageSets that
+ * never reach the flush size are compressed in one go by
+ * rd_kafka_msgset_writer_compress() when finalized, which needs
+ * a single output allocation.
+ * @{
+ */
+
+/**
+ * Uncompressed bytes to accumulate in the buffer before feeding
+ * them to the compressor.
+ */
+#define RD_KAFKA_MSGSET_ZSTRM_FLUSH_SIZE  (32*1024)
+
+/**
+ * Compressed output chunks start at the MIN size and double up to
+ * the MAX size.
+ */
+#define RD_KAFKA_MSGSET_ZSTRM_CHUNK_MIN   1024
+#define RD_KAFKA_MSGSET_ZSTRM_CHUNK_MAX   (256*1024)
+
+/**
+ * Maximum input size per LZ4F_compressUpdate() call, this bounds the
+ * required output space (LZ4F_compressBound()).
+ */
+#define RD_KAFKA_MSGSET_ZSTRM_LZ4_MAX_IN  (64*1024)
+
+/* Frame preferences required by Kafka */
+static const LZ4F_preferences_t rd_kafka_msgset_writer_lz4_prefs =
+        { .frameInfo = { .blockMode = LZ4F_blockIndependent } };
+
+
+/**
+ * @returns a pointer to the unused space of the current output chunk,
+ *          which is at least \p min_size bytes, and its size in
+ *          \p *availp. A new chunk is allocated if needed.
+ */
+static char *
+rd_kafka_msgset_writer_zstrm_out (rd_kafka_msgset_writer_t *msetw,
+                                  size_t min_size, size_t *availp) {
+        struct iovec *ciov;
+
+        if (min_size == 0)
+                min_size = 1;
+
+        if (msetw->msetw_zstrm.ciov_cnt > 0) {
+                ciov = &msetw->msetw_zstrm.ciovs[msetw->msetw_zstrm.
+                                                 ciov_cnt-1];
+                if (msetw->msetw_zstrm.chunk_size - ciov->iov_len >=
+                    min_size) {
+                        *availp = msetw->msetw_zstrm.chunk_size -
+                                ciov->iov_len;
+                        return (char *)ciov->iov_base + ciov->iov_len;
+                }
+        }
+
+        if (msetw->msetw_zstrm.ciov_cnt == msetw->msetw_zstrm.ciov_size) {
+                msetw->msetw_zstrm.ciov_size =
+                        RD_MAX(4, msetw->msetw_zstrm.ciov_size * 2);
+                msetw->msetw_zstrm.ciovs =
+                        rd_realloc(msetw->msetw_zstrm.ciovs,
+                                   sizeof(*msetw->msetw_zstrm.ciovs) *
+                                   msetw->msetw_zstrm.ciov_size);
+        }
+
+        if (!msetw->msetw_zstrm.chunk_size)
+                msetw->msetw_zstrm.chunk_size =
+                        RD_KAFKA_MSGSET_ZSTRM_CHUNK_MIN;
+        else if (msetw->msetw_zstrm.chunk_size <
+                 RD_KAFKA_MSGSET_ZSTRM_CHUNK_MAX)
+                msetw->msetw_zstrm.chunk_size *= 2;
+
+        if (msetw->msetw_zstrm.chunk_size < min_size)
+                msetw->msetw_zstrm.chunk_size = min_size;
+
+        ciov = &msetw->msetw_zstrm.ciovs[msetw->msetw_zstrm.ciov_cnt++];
+        ciov->iov_base = rd_malloc(msetw->msetw_zstrm.chunk_size);
+        ciov->iov_len = 0;
+
+        *availp = msetw->msetw_zstrm.chunk_size;
+        return ciov->iov_base;
+}
+
+/**
+ * @brief Commit \p len bytes written to the space returned by
+ *        rd_kafka_msgset_writer_zstrm_out().
+ */
+static RD_INLINE void
+rd_kafka_msgset_writer_zstrm_out_commit (rd_kafka_msgset_writer_t *msetw,
+                                         size_t len) {
+        msetw->msetw_zstrm.ciovs[msetw->msetw_zstrm.ciov_cnt-1].iov_len += len;
+        msetw->msetw_zstrm.outlen += len;
+}
+
+
+/**
+ * @brief Feed \p len bytes at \p p to the compressor, or finish the
+ *        compressed stream if \p p is NULL.
+ *
+ * @returns 0 on success or -1 on error in which case \p *errstrp is set.
+ */
+static int
+rd_kafka_msgset_writer_zstrm_feed (rd_kafka_msgset_writer_t *msetw,
+                                   const void *p, size_t len,
+                                   const char **errstrp) {
+        char *out;
+        size_t avail;
+
+        switch (msetw->msetw_zstrm.codec)
+        {
+#if WITH_ZLIB
+        case RD_KAFKA_COMPRESSION_GZIP:
+        {
+                z_stream *strm = &msetw->msetw_zstrm.u.gz;
+                int r;
+
+                strm->next_in  = (void *)p;
+                strm->avail_in = (uInt)len;
+
+                do {
+                        out = rd_kafka_msgset_writer_zstrm_out(msetw, 0,
+                                                               &avail);
+                        strm->next_out  = (void *)out;
+                        strm->avail_out = (uInt)avail;
+
+                        r = deflate(strm, p ? Z_NO_FLUSH : Z_FINISH);
+
+                        rd_kafka_msgset_writer_zstrm_out_commit(
+                                msetw, avail - strm->avail_out);
+
+                        if (p ? r != Z_OK :
+                            (r != Z_OK && r != Z_STREAM_END)) {
+                                *errstrp = strm->msg ? strm->msg :
+                                        "deflate() failed";
+                                return -1;
+                        }
+
+                } while (p ? strm->avail_in > 0 : r != Z_STREAM_END);
+        }
+        break;
+#endif
+
+        case RD_KAFKA_COMPRESSION_LZ4:
+        {
+                size_t r;
+
+                if (!p) {
+                        out = rd_kafka_msgset_writer_zstrm_out(
+                                msetw,
+                                LZ4F_compressBound(
+                                        0, &rd_kafka_msgset_writer_lz4_prefs),
+                                &avail);
+                        r = LZ4F_compressEnd(msetw->msetw_zstrm.u.lz4,
+                                             out, avail, NULL);
+                        if (LZ4F_isError(r)) {
+                                *errstrp = LZ4F_getErrorName(r);
+                                return -1;
+                        }
+                        rd_kafka_msgset_writer_zstrm_out_commit(msetw, r);
+                        break;
+                }
+
+                while (len > 0) {
+                        size_t inlen = RD_MIN(len,
+                                              RD_KAFKA_MSGSET_ZSTRM_LZ4_MAX_IN);
+
+                        out = rd_kafka_msgset_writer_zstrm_out(
+                                msetw,
+                                LZ4F_compressBound(
+                                        inlen,
+                                        &rd_kafka_msgset_writer_lz4_prefs),
+                                &avail);
+                        r = LZ4F_compressUpdate(msetw->msetw_zstrm.u.lz4,
+                                                out, avail, p, inlen, NULL);
+                        if (LZ4F_isError(r)) {
+                                *errstrp = LZ4F_getErrorName(r);
+                                return -1;
+                        }
+                        rd_kafka_msgset_writer_zstrm_out_commit(msetw, r);
+
+                        p = (const char *)p + inlen;
+                        len -= inlen;
+                }
+        }
+        break;
+
+#if WITH_ZSTD
+        case RD_KAFKA_COMPRESSION_ZSTD:
+        {
+                ZSTD_inBuffer in = { p, len, 0 };
+                ZSTD_outBuffer zout;
+                size_t r;
+
+                do {
+                        out = rd_kafka_msgset_writer_zstrm_out(msetw, 0,
+                                                               &avail);
+                        zout.dst  = out;
+                        zout.size = avail;
+                        zout.pos  = 0;
+
+                        if (p)
+                                r = ZSTD_compressStream(
+                                        msetw->msetw_zstrm.u.zstd,
+                                        &zout, &in);
+                        else
+                                r = ZSTD_endStream(msetw->msetw_zstrm.u.zstd,
+                                                   &zout);
+
+                        rd_kafka_msgset_writer_zstrm_out_commit(msetw,
+                                                                zout.pos);
+
+                        if (ZSTD_isError(r)) {
+                                *errstrp = ZSTD_getErrorName(r);
+                                return -1;
+                        }
+
+                        /* Until all input is consumed, or when ending:
+                         * until the frame is fully flushed. */
+                } while (p ? in.pos < in.size : r != 0);
+        }
+        break;
+#endif
+
+        default:
+                RD_NOTREACHED();
+                break;
+        }
+
+        return 0;
+}
+
+
+/**
+ * @brief Feed \p len bytes of uncompressed data at \p p,
+ *        that is not in the buffer, to the compressor.
+ */
+static void
+rd_kafka_msgset_writer_zstrm_write (rd_kafka_msgset_writer_t *msetw,
+                                    const void *p, size_t len) {
+        const char *errstr;
+
+        if (likely(!msetw->msetw_zstrm.failed) && len > 0 &&
+            rd_kafka_msgset_writer_zstrm_feed(msetw, p, len, &errstr) == -1) {
+                rd_kafka_toppar_t *rktp = msetw->msetw_rktp;
+                rd_rkb_log(msetw->msetw_rkb, LOG_ERR, "COMPRESS",
+                           "Failed to compress "
+                           "%"PRIusz" bytes for topic %.*s [%"PRId32"]: "
+                           "%s: sending uncompressed",
+                           len,
+                           RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
+                           rktp->rktp_partition, errstr);
+                /* The data fed so far is lost, the MessageSet will be
+                 * re-written uncompressed when finalized. */
+                msetw->msetw_zstrm.failed = 1;
+        }
+
+        msetw->msetw_zstrm.inlen += len;
+}
+
+
+/**
+ * @brief Select streaming compression if supported by the configured
+ *        codec and the selected MsgVersion.
+ *
+ * MsgVersion 0 and 1 envelope the compressed MessageSet in an outer
+ * Message and snappy lacks a streaming interface: these are compressed
+ * when the MessageSet is finalized by rd_kafka_msgset_writer_compress().
+ */
+static void
+rd_kafka_msgset_writer_zstrm_select (rd_kafka_msgset_writer_t *msetw) {
+        rd_kafka_compression_t codec =
+                msetw->msetw_rktp->rktp_rkt->rkt_conf.compression_codec;
+
+        if (msetw->msetw_MsgVersion != 2)
+                return;
+
+        switch (codec)
+        {
+#if WITH_ZLIB
+        case RD_KAFKA_COMPRESSION_GZIP:
+#endif
+        case RD_KAFKA_COMPRESSION_LZ4:
+                break;
+
+#if WITH_ZSTD
+        case RD_KAFKA_COMPRESSION_ZSTD:
+                /* Broker doesn't support zstd (ProduceRequest v7) */
+                if (msetw->msetw_ApiVersion < 7)
+                        return;
+                break;
+#endif
+
+        default:
+                return;
+        }
+
+        msetw->msetw_zstrm.codec = codec;
+}
+
+
+/**
+ * @brief Free the compressor and, if \p free_chunks is true,
+ *        the compressed output.
+ */
+static void
+rd_kafka_msgset_writer_zstrm_destroy (rd_kafka_msgset_writer_t *msetw,
+                                      int free_chunks) {
+        size_t i;
+
+        switch (msetw->msetw_zstrm.codec)
+        {
+#if WITH_ZLIB
+        case RD_KAFKA_COMPRESSION_GZIP:
+                deflateEnd(&msetw->msetw_zstrm.u.gz);
+                break;
+#endif
+        case RD_KAFKA_COMPRESSION_LZ4:
+                if (msetw->msetw_zstrm.u.lz4)
+                        LZ4F_freeCompressionContext(msetw->msetw_zstrm.u.lz4);
+                break;
+#if WITH_ZSTD
+        case RD_KAFKA_COMPRESSION_ZSTD:
+                if (msetw->msetw_zstrm.u.zstd)
+                        ZSTD_freeCStream(msetw->msetw_zstrm.u.zstd);
+                break;
+#endif
+        default:
+                break;
+        }
+
+        if (free_chunks)
+                for (i = 0 ; i < msetw->msetw_zstrm.ciov_cnt ; i++)
+                        rd_free(msetw->msetw_zstrm.ciovs[i].iov_base);
+
+        if (msetw->msetw_zstrm.ciovs)
+                rd_free(msetw->msetw_zstrm.ciovs);
+
+        msetw->msetw_zstrm.ciovs = NULL;
+        msetw->msetw_zstrm.ciov_cnt = 0;
+        msetw->msetw_zstrm.codec = RD_KAFKA_COMPRESSION_NONE;
+}
+
+
+/**
+ * @brief Set up the compressor selected by
+ *        rd_kafka_msgset_writer_zstrm_select(), if any.
+ *        If this fails the MessageSet is sent uncompressed.
+ */
+static void
+rd_kafka_msgset_writer_zstrm_begin (rd_kafka_msgset_writer_t *msetw) {
+        rd_kafka_toppar_t *rktp = msetw->msetw_rktp;
+        const char *errstr = NULL;
+
+        switch (msetw->msetw_zstrm.codec)
+        {
+        case RD_KAFKA_COMPRESSION_NONE:
+                return;
+
+#if WITH_ZLIB
+        case RD_KAFKA_COMPRESSION_GZIP:
+        {
+                int r = deflateInit2(&msetw->msetw_zstrm.u.gz,
+                                     Z_DEFAULT_COMPRESSION,
+                                     Z_DEFLATED, 15+16,
+                                     8, Z_DEFAULT_STRATEGY);
+                if (r != Z_OK)
+                        errstr = msetw->msetw_zstrm.u.gz.msg ?
+                                msetw->msetw_zstrm.u.gz.msg :
+                                "deflateInit2() failed";
+        }
+        break;
+#endif
+
+        case RD_KAFKA_COMPRESSION_LZ4:
+        {
+                size_t r;
+                char *out;
+                size_t avail;
+
+                r = LZ4F_createCompressionContext(&msetw->msetw_zstrm.u.lz4,
+                                                  LZ4F_VERSION);
+                if (LZ4F_isError(r)) {
+                        msetw->msetw_zstrm.u.lz4 = NULL;
+                        errstr = LZ4F_getErrorName(r);
+                        break;
+                }
+
+                out = rd_kafka_msgset_writer_zstrm_out(msetw,
+                                                       LZ4F_HEADER_SIZE_MAX,
+                                                       &avail);
+                r = LZ4F_compressBegin(msetw->msetw_zstrm.u.lz4, out, avail,
+                                       &rd_kafka_msgset_writer_lz4_prefs);
+                if (LZ4F_isError(r))
+                        errstr = LZ4F_getErrorName(r);
+                else
+                        rd_kafka_msgset_writer_zstrm_out_commit(msetw, r);
+        }
+        break;
+
+#if WITH_ZSTD
+        case RD_KAFKA_COMPRESSION_ZSTD:
+        {
+                int level = rktp->rktp_rkt->rkt_conf.compression_level;
+                size_t r;
+
+                if (!(msetw->msetw_zstrm.u.zstd = ZSTD_createCStream())) {
+                        errstr = "ZSTD_createCStream() failed";
+                        break;
+                }
+
+                /* Level 0 selects the zstd default level */
+                r = ZSTD_initCStream(msetw->msetw_zstrm.u.zstd,
+                                     level == -1 ? 0 : level);
+                if (ZSTD_isError(r))
+                        errstr = ZSTD_getErrorName(r);
+        }
+        break;
+#endif
+
+        default:
+                RD_NOTREACHED();
+                break;
+        }
+
+        msetw->msetw_zstrm.used = 1;
+
+        if (errstr) {
+                rd_rkb_log(msetw->msetw_rkb, LOG_ERR, "COMPRESS",
+                           "Failed to initialize compression for "
+                           "topic %.*s [%"PRId32"]: %s: "
+                           "sending uncompressed",
+                           RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
+                           rktp->rktp_partition, errstr);
+                /* The MessageSet will be re-written uncompressed
+                 * when finalized. */
+                msetw->msetw_zstrm.failed = 1;
+        }
+}
+
+
+/**
+ * @brief Feed the uncompressed data accumulated in the buffer
+ *        to the compressor and rewind the buffer to reuse its space.
+ */
+static void
+rd_kafka_msgset_writer_zstrm_flush (rd_kafka_msgset_writer_t *msetw) {
+        rd_buf_t *rbuf = &msetw->msetw_rkbuf->rkbuf_buf;
+        size_t len = rd_buf_write_pos(rbuf) - msetw->msetw_firstmsg.of;
+        rd_slice_t slice;
+        const void *p;
+        size_t rlen;
+
+        if (!msetw->msetw_zstrm.used)
+                rd_kafka_msgset_writer_zstrm_begin(msetw);
+
+        if (len == 0)
+                return;
+
+        if (unlikely(rd_slice_init(&slice, rbuf,
+                                   msetw->msetw_firstmsg.of, len) == -1))
+                rd_kafka_assert(NULL, !*"invalid firstmsg position");
+
+        while ((rlen = rd_slice_reader(&slice, &p)))
+                rd_kafka_msgset_writer_zstrm_write(msetw, p, rlen);
+
+        rd_buf_write_seek(rbuf, msetw->msetw_firstmsg.of);
+}
+
+/**@}*/
+
+
 /**
  * @brief Allocate buffer for messageset writer based on a previously set
  *        up \p msetw.
@@ -139,7 +699,7 @@ rd_kafka_msgset_writer_alloc_buf (rd_kafka_msgset_writer_t *msetw) {
          *    RequiredAcks + Timeout +
          *    [Topic + [Partition + MessageSetSize]]
          *
-         *  ProduceRequest v3:
+         *  ProduceRequest v3..7:
          *    TransactionalId + RequiredAcks + Timeout +
          *    [Topic + [Partition + MessageSetSize + MessageSet]]
          */
@@ -149,6 +709,7 @@ rd_kafka_msgset_writer_alloc_buf (rd_kafka_msgset_writer_t *msetw) {
          */
         switch (msetw->msetw_ApiVersion)
         {
+        case 7:
         case 3:
                 /* Add TransactionalId */
                 hdrsize += RD_KAFKAP_STR_SIZE(rk->rk_eos.TransactionalId);
@@ -231,6 +792,15 @@ rd_kafka_msgset_writer_alloc_buf (rd_kafka_msgset_writer_t *msetw) {
         /* Add estimed per-message overhead */
         bufsize += msg_overhead * msetw->msetw_msgcntmax;
 
+        /* With streaming compression the buffer only needs to hold the
+         * messages written since the last flush to the compressor,
+         * larger payloads are not copied to the buffer. */
+        if (msetw->msetw_zstrm.codec)
+                bufsize = RD_MIN(bufsize,
+                                 hdrsize + msgsetsize + msg_overhead +
+                                 RD_KAFKA_MSGSET_ZSTRM_FLUSH_SIZE +
+                                 (size_t)rk->rk_conf.msg_copy_max_size);
+
         /* Cap allocation at message.max.bytes */
         if (bufsize > (size_t)rk->rk_conf.max_msg_size)
                 bufsize = (size_t)rk->rk_conf.max_msg_size;
@@ -322,8 +892,8 @@ rd_kafka_msgset_writer_write_Produce_header (rd_kafka_msgset_writer_t *msetw) {
         rd_kafka_t *rk = msetw->msetw_rkb->rkb_rk;
         rd_kafka_itopic_t *rkt = msetw->msetw_rktp->rktp_rkt;
 
-        /* V3: TransactionalId */
-        if (msetw->msetw_ApiVersion == 3)
+        /* V3..7: TransactionalId */
+        if (msetw->msetw_ApiVersion >= 3)
                 rd_kafka_buf_write_kstr(rkbuf, rk->rk_eos.TransactionalId);
 
         /* RequiredAcks */
@@ -373,7 +943,8 @@ rd_kafka_msgset_writer_write_Produce_header (rd_kafka_msgset_writer_t *msetw) {
  */
 static int rd_kafka_msgset_writer_init (rd_kafka_msgset_writer_t *msetw,
                                          rd_kafka_broker_t *rkb,
-                                         rd_kafka_toppar_t *rktp) {
+                                         rd_kafka_toppar_t *rktp,
+                                         int offload) {
         int msgcnt = rktp->rktp_xmit_msgq.rkmq_msg_cnt;
 
         if (msgcnt == 0)
@@ -395,6 +966,14 @@ static int rd_kafka_msgset_writer_init (rd_kafka_msgset_writer_t *msetw,
         /* Select MsgVersion to use */
         rd_kafka_msgset_writer_select_MsgVersion(msetw);
 
+        /* Select streaming compression, if applicable, unless
+         * compression may be offloaded in which case the complete
+         * MessageSet is compressed when finalized. */
+        if (offload && rktp->rktp_rkt->rkt_conf.compression_codec)
+                msetw->msetw_offload = 1;
+        else
+                rd_kafka_msgset_writer_zstrm_select(msetw);
+
         /* MsgVersion specific setup. */
         switch (msetw->msetw_MsgVersion)
         {
@@ -437,13 +1016,25 @@ rd_kafka_msgset_writer_write_msg_payload (rd_kafka_msgset_writer_t *msetw,
 
         /* If payload is below the copy limit and there is still
          * room in the buffer we'll copy the payload to the buffer,
-         * otherwise we push a reference to the memory. */
-        if (rkm->rkm_len <= (size_t)rk->rk_conf.msg_copy_max_size &&
+         * otherwise we push a reference to the memory.
+         * Application payload references are always pushed since
+         * the message holds a reference to the payload for at least
+         * as long as the request buffer is alive.
+         * With streaming compression the payload is instead fed directly
+         * to the compressor, after the preceding message fields. */
+        if (!(rkm->rkm_flags & RD_KAFKA_MSG_F_PAYLOAD_REF) &&
+            rkm->rkm_len <= (size_t)rk->rk_conf.msg_copy_max_size &&
             rd_buf_write_remains(&rkbuf->rkbuf_buf) > rkm->rkm_len) {
                 rd_kafka_buf_write(rkbuf,
                                    rkm->rkm_payload, rkm->rkm_len);
                 if (free_cb)
                         free_cb(rkm->rkm_payload);
+        } else if (msetw->msetw_zstrm.codec) {
+                rd_kafka_msgset_writer_zstrm_flush(msetw);
+                rd_kafka_msgset_writer_zstrm_write(msetw, rkm->rkm_payload,
+                                                   rkm->rkm_len);
+                if (free_cb)
+                        free_cb(rkm->rkm_payload);
         } else
                 rd_kafka_buf_push(rkbuf, rkm->rkm_payload, rkm->rkm_len,
                                   free_cb);
@@ -687,14 +1278,19 @@ rd_kafka_msgset_writer_write_msg (rd_kafka_msgset_writer_t *msetw,
         if (likely(rkm->rkm_timestamp))
                 MsgAttributes |= RD_KAFKA_MSG_ATTR_CREATE_TIME;
 
-        pre_pos = rd_buf_write_pos(&msetw->msetw_rkbuf->rkbuf_buf);
+        pre_pos = rd_kafka_msgset_writer_pos(msetw);
 
         outlen = writer[msetw->msetw_MsgVersion](msetw, rkm,
                                                  Offset, MsgAttributes,
                                                  free_cb);
 
-        actual_written = rd_buf_write_pos(&msetw->msetw_rkbuf->rkbuf_buf) -
-                pre_pos;
+        /* Feed the accumulated messages to the compressor */
+        if (msetw->msetw_zstrm.codec &&
+            rd_buf_write_pos(&msetw->msetw_rkbuf->rkbuf_buf) -
+            msetw->msetw_firstmsg.of >= RD_KAFKA_MSGSET_ZSTRM_FLUSH_SIZE)
+                rd_kafka_msgset_writer_zstrm_flush(msetw);
+
+        actual_written = rd_kafka_msgset_writer_pos(msetw) - pre_pos;
         rd_assert(outlen <=
                    rd_kafka_msg_wire_size(rkm, msetw->msetw_MsgVersion));
         rd_assert(outlen == actual_written);
@@ -944,6 +1540,22 @@ rd_kafka_msgset_writer_compress_lz4 (rd_kafka_msgset_writer_t *msetw,
 }
 
 
+#if WITH_ZSTD
+/**
+ * @brief Compress messageset using ZSTD
+ */
+static int
+rd_kafka_msgset_writer_compress_zstd (rd_kafka_msgset_writer_t *msetw,
+                                      rd_slice_t *slice, struct iovec *ciov) {
+        rd_kafka_resp_err_t err;
+        err = rd_kafka_zstd_compress(msetw->msetw_rkb,
+                                     msetw->msetw_rktp->rktp_rkt->
+                                     rkt_conf.compression_level,
+                                     slice, &ciov->iov_base, &ciov->iov_len);
+        return (err ? -1 : 0);
+}
+#endif
+
 
 /**
  * @brief Compress the message set.
@@ -993,6 +1605,16 @@ rd_kafka_msgset_writer_compress (rd_kafka_msgset_writer_t *msetw,
                 r = rd_kafka_msgset_writer_compress_lz4(msetw, &slice, &ciov);
                 break;
 
+#if WITH_ZSTD
+        case RD_KAFKA_COMPRESSION_ZSTD:
+                /* Skip ZSTD compression if broker doesn't support it,
+                 * this also rules out the older MsgVersions. */
+                if (msetw->msetw_ApiVersion < 7)
+                        return -1;
+
+                r = rd_kafka_msgset_writer_compress_zstd(msetw, &slice, &ciov);
+                break;
+#endif
 
         default:
                 rd_kafka_assert(NULL,
@@ -1051,6 +1673,81 @@ rd_kafka_msgset_writer_compress (rd_kafka_msgset_writer_t *msetw,
 
 
 
+/**
+ * @brief Finish the streaming compression and replace the messages in
+ *        the buffer with the compressed output.
+ *
+ * If compression failed, or did not reduce the size, the messages
+ * are re-written uncompressed.
+ *
+ * @param outlenp in: total uncompressed messages size,
+ *                out: the compressed or re-written messages size.
+ */
+static void
+rd_kafka_msgset_writer_zstrm_end (rd_kafka_msgset_writer_t *msetw,
+                                  size_t *outlenp) {
+        rd_kafka_buf_t *rkbuf = msetw->msetw_rkbuf;
+        rd_kafka_toppar_t *rktp = msetw->msetw_rktp;
+        const char *errstr;
+        rd_kafka_msg_t *rkm;
+        int64_t Offset = 0;
+        size_t i;
+
+        /* Feed what remains in the buffer and finish the stream */
+        rd_kafka_msgset_writer_zstrm_flush(msetw);
+
+        if (likely(!msetw->msetw_zstrm.failed) &&
+            rd_kafka_msgset_writer_zstrm_feed(msetw, NULL, 0, &errstr) == -1) {
+                rd_rkb_log(msetw->msetw_rkb, LOG_ERR, "COMPRESS",
+                           "Failed to finish compression of "
+                           "%"PRIusz" bytes for topic %.*s [%"PRId32"]: "
+                           "%s: sending uncompressed",
+                           msetw->msetw_zstrm.inlen,
+                           RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
+                           rktp->rktp_partition, errstr);
+                msetw->msetw_zstrm.failed = 1;
+        }
+
+        rd_assert(msetw->msetw_zstrm.inlen == *outlenp);
+
+        if (likely(!msetw->msetw_zstrm.failed &&
+                   msetw->msetw_zstrm.outlen <= msetw->msetw_zstrm.inlen)) {
+                /* Set compression codec in MessageSet.Attributes */
+                msetw->msetw_Attributes |= msetw->msetw_zstrm.codec;
+
+                /* The buffer is at the first message position,
+                 * push the compressed chunks in its place. */
+                for (i = 0 ; i < msetw->msetw_zstrm.ciov_cnt ; i++) {
+                        struct iovec *ciov = &msetw->msetw_zstrm.ciovs[i];
+                        if (ciov->iov_len > 0)
+                                rd_buf_push(&rkbuf->rkbuf_buf,
+                                            ciov->iov_base, ciov->iov_len,
+                                            rd_free);
+                        else
+                                rd_free(ciov->iov_base);
+                }
+
+                *outlenp = msetw->msetw_zstrm.outlen;
+
+                /* Chunks are now owned by the buffer */
+                rd_kafka_msgset_writer_zstrm_destroy(msetw, 0/*dont free*/);
+                return;
+        }
+
+        /* Compression failed or the compressed data is larger than the
+         * uncompressed size: re-write the messages uncompressed. */
+        rd_kafka_msgset_writer_zstrm_destroy(msetw, 1/*free*/);
+        msetw->msetw_zstrm.inlen = 0;
+
+        TAILQ_FOREACH(rkm, &rkbuf->rkbuf_msgq.rkmq_msgs, rkm_link)
+                rd_kafka_msgset_writer_write_msg(msetw, rkm, Offset++, 0,
+                                                 NULL);
+
+        *outlenp = rd_buf_write_pos(&rkbuf->rkbuf_buf) -
+                msetw->msetw_firstmsg.of;
+}
+
+
 /**
  * @brief Calculate MessageSet v2 CRC (CRC32C) when messageset is complete.
  */
@@ -1142,6 +1839,84 @@ rd_kafka_msgset_writer_finalize_MessageSet (rd_kafka_msgset_writer_t *msetw) {
 }
 
 
+/**
+ * @brief Compress the complete, uncompressed, MessageSet of a writer
+ *        that was set up for offloading (msetw_offload).
+ *
+ * Uses streaming compression over the written messages if supported by
+ * the codec and MsgVersion, else rd_kafka_msgset_writer_compress().
+ *
+ * @param lenp in: total uncompressed messages size,
+ *             out: the compressed (or uncompressed) messages size.
+ */
+static void
+rd_kafka_msgset_writer_compress_all (rd_kafka_msgset_writer_t *msetw,
+                                     size_t *lenp) {
+        rd_kafka_msgset_writer_zstrm_select(msetw);
+
+        if (msetw->msetw_zstrm.codec)
+                rd_kafka_msgset_writer_zstrm_end(msetw, lenp);
+        else
+                rd_kafka_msgset_writer_compress(msetw, lenp);
+}
+
+
+/**
+ * @brief Compress the messageset, unless it was compressed while
+ *        being written, and update final header values, CRCs, etc.
+ *
+ * @param len total size of the uncompressed messages.
+ *
+ * @locality broker thread or offload worker thread
+ */
+static void
+rd_kafka_msgset_writer_finalize0 (rd_kafka_msgset_writer_t *msetw,
+                                  size_t len) {
+        rd_kafka_toppar_t *rktp = msetw->msetw_rktp;
+
+        if (msetw->msetw_zstrm.used)
+                rd_kafka_msgset_writer_zstrm_end(msetw, &len);
+        else if (msetw->msetw_offload)
+                rd_kafka_msgset_writer_compress_all(msetw, &len);
+        else if (rktp->rktp_rkt->rkt_conf.compression_codec)
+                rd_kafka_msgset_writer_compress(msetw, &len);
+
+        msetw->msetw_messages_len = len;
+
+        /* Finalize MessageSet header fields */
+        rd_kafka_msgset_writer_finalize_MessageSet(msetw);
+
+        rd_rkb_dbg(msetw->msetw_rkb, MSG, "PRODUCE",
+                   "%s [%"PRId32"]: "
+                   "Produce MessageSet with %i message(s) (%"PRIusz" bytes, "
+                   "ApiVersion %d, MsgVersion %d)",
+                   rktp->rktp_rkt->rkt_topic->str, rktp->rktp_partition,
+                   rd_kafka_msgq_len(&msetw->msetw_rkbuf->rkbuf_msgq),
+                   msetw->msetw_MessageSetSize,
+                   msetw->msetw_ApiVersion, msetw->msetw_MsgVersion);
+}
+
+
+/**
+ * @brief Offload job: compress and finalize the MessageSet.
+ *
+ * The writer state is freed and the finalized buffer's MessageSetSize
+ * is set on the op.
+ *
+ * @locality offload worker thread
+ */
+static void
+rd_kafka_msgset_writer_offload_run (rd_kafka_t *rk, rd_kafka_op_t *rko) {
+        rd_kafka_msgset_writer_t *msetw = rko->rko_u.offload.opaque;
+
+        rd_kafka_msgset_writer_finalize0(msetw, msetw->msetw_messages_len);
+
+        rko->rko_u.offload.MessageSetSize = msetw->msetw_MessageSetSize;
+        rko->rko_u.offload.opaque = NULL;
+        rd_free(msetw);
+}
+
+
 /**
  * @brief Finalize the messageset - call when no more messages are to be
  *        added to the messageset.
@@ -1151,14 +1926,21 @@ rd_kafka_msgset_writer_finalize_MessageSet (rd_kafka_msgset_writer_t *msetw) {
  *        The messageset writer is destroyed and the buffer is returned
  *        and ready to be transmitted.
  *
+ *        If \p offload_rkopp is non-NULL and the messageset is to be
+ *        compressed and large enough, the compression and finalization
+ *        is instead deferred to an offload job that is returned
+ *        in \p *offload_rkopp, with the job's rkbuf set to the
+ *        (not yet finalized) buffer.
+ *
  * @param MessagetSetSizep will be set to the finalized MessageSetSize
  *
  * @returns the buffer to transmit or NULL if there were no messages
- *          in messageset.
+ *          in messageset or the messageset was offloaded.
  */
 static rd_kafka_buf_t *
 rd_kafka_msgset_writer_finalize (rd_kafka_msgset_writer_t *msetw,
-                                 size_t *MessageSetSizep) {
+                                 size_t *MessageSetSizep,
+                                 rd_kafka_op_t **offload_rkopp) {
         rd_kafka_buf_t *rkbuf = msetw->msetw_rkbuf;
         rd_kafka_toppar_t *rktp = msetw->msetw_rktp;
         size_t len;
@@ -1166,39 +1948,44 @@ rd_kafka_msgset_writer_finalize (rd_kafka_msgset_writer_t *msetw,
 
         /* No messages added, bail out early. */
         if (unlikely((cnt = rd_kafka_msgq_len(&rkbuf->rkbuf_msgq)) == 0)) {
+                rd_kafka_msgset_writer_zstrm_destroy(msetw, 1/*free*/);
                 rd_kafka_buf_destroy(rkbuf);
                 return NULL;
         }
 
         /* Total size of messages */
-        len = rd_buf_write_pos(&msetw->msetw_rkbuf->rkbuf_buf) -
-                msetw->msetw_firstmsg.of;
+        len = rd_kafka_msgset_writer_pos(msetw) - msetw->msetw_firstmsg.of;
         rd_assert(len > 0);
         rd_assert(len <= (size_t)rktp->rktp_rkt->rkt_rk->rk_conf.max_msg_size);
 
         rd_atomic64_add(&rktp->rktp_c.tx_msgs, cnt);
         rd_atomic64_add(&rktp->rktp_c.tx_msg_bytes, msetw->msetw_messages_kvlen);
 
-        /* Compress the message set */
-        if (rktp->rktp_rkt->rkt_conf.compression_codec)
-                rd_kafka_msgset_writer_compress(msetw, &len);
+        if (msetw->msetw_offload && offload_rkopp &&
+            len >= RD_KAFKA_MSGSET_OFFLOAD_MIN_SIZE) {
+                /* Compress and finalize on an offload worker thread,
+                 * the job holds on to a copy of the writer state. */
+                rd_kafka_msgset_writer_t *msetw_copy;
+                rd_kafka_op_t *rko;
 
-        msetw->msetw_messages_len = len;
+                msetw_copy = rd_malloc(sizeof(*msetw_copy));
+                *msetw_copy = *msetw;
+                msetw_copy->msetw_messages_len = len;
 
-        /* Finalize MessageSet header fields */
-        rd_kafka_msgset_writer_finalize_MessageSet(msetw);
+                rko = rd_kafka_op_new_offload(
+                        rd_kafka_msgset_writer_offload_run, NULL, msetw_copy);
+                rko->rko_u.offload.free_cb = rd_free;
+                rko->rko_u.offload.rkbuf = rkbuf;
+
+                *offload_rkopp = rko;
+                return NULL;
+        }
+
+        rd_kafka_msgset_writer_finalize0(msetw, len);
 
         /* Return final MessageSetSize */
         *MessageSetSizep = msetw->msetw_MessageSetSize;
 
-        rd_rkb_dbg(msetw->msetw_rkb, MSG, "PRODUCE",
-                   "%s [%"PRId32"]: "
-                   "Produce MessageSet with %i message(s) (%"PRIusz" bytes, "
-                   "ApiVersion %d, MsgVersion %d)",
-                   rktp->rktp_rkt->rkt_topic->str, rktp->rktp_partition,
-                   cnt, msetw->msetw_MessageSetSize,
-                   msetw->msetw_ApiVersion, msetw->msetw_MsgVersion);
-
         return rkbuf;
 }
 
@@ -1211,23 +1998,32 @@ rd_kafka_msgset_writer_finalize (rd_kafka_msgset_writer_t *msetw,
  * @param rkb broker to create buffer for
  * @param rktp toppar to transmit messages for
  * @param MessagetSetSizep will be set to the final MessageSetSize
+ * @param offload_rkopp if non-NULL the compression of large MessageSets
+ *                      may be offloaded, in which case NULL is returned
+ *                      and the offload job (without a done callback and
+ *                      replyq) is returned in \p *offload_rkopp.
+ *                      The job's opaque is owned by the job's run
+ *                      callback and the job must thus be run.
  *
  * @returns the buffer to transmit or NULL if there were no messages
- *          in messageset.
+ *          in messageset or the messageset was offloaded.
  *
  * @locality broker thread
  */
 rd_kafka_buf_t *
 rd_kafka_msgset_create_ProduceRequest (rd_kafka_broker_t *rkb,
                                        rd_kafka_toppar_t *rktp,
-                                       size_t *MessageSetSizep) {
+                                       size_t *MessageSetSizep,
+                                       rd_kafka_op_t **offload_rkopp) {
 
         rd_kafka_msgset_writer_t msetw;
 
-        if (rd_kafka_msgset_writer_init(&msetw, rkb, rktp) == 0)
+        if (rd_kafka_msgset_writer_init(&msetw, rkb, rktp,
+                                        offload_rkopp != NULL) == 0)
                 return NULL;
 
         rd_kafka_msgset_writer_write_msgq(&msetw, &rktp->rktp_xmit_msgq);
 
-        return rd_kafka_msgset_writer_finalize(&msetw, MessageSetSizep);
+        return rd_kafka_msgset_writer_finalize(&msetw, MessageSetSizep,
+                                               offload_rkopp);
 }
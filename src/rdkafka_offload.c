@@ -0,0 +1,244 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rdkafka_int.h"
+#include "rdkafka_offload.h"
+#include "rdunittest.h"
+
+
+struct rd_kafka_offload_s {
+        rd_kafka_t   *ofl_rk;
+        rd_kafka_q_t *ofl_q;         /**< Job queue */
+        thrd_t       *ofl_thrds;     /**< Worker threads */
+        int           ofl_thrd_cnt;  /**< Number of worker threads */
+};
+
+
+/**
+ * @brief Worker thread main loop: run jobs until a TERMINATE op is seen.
+ */
+static int rd_kafka_offload_thread_main (void *arg) {
+        rd_kafka_offload_t *ofl = arg;
+        rd_kafka_op_t *rko;
+
+        rd_kafka_set_thread_name("offload");
+        rd_kafka_set_thread_sysname("rdk:offload");
+
+        (void)rd_atomic32_add(&rd_kafka_thread_cnt_curr, 1);
+
+        while ((rko = rd_kafka_q_pop(ofl->ofl_q, RD_POLL_INFINITE, 0))) {
+                if (rko->rko_type == RD_KAFKA_OP_TERMINATE) {
+                        rd_kafka_op_destroy(rko);
+                        break;
+                }
+
+                rd_kafka_assert(ofl->ofl_rk,
+                                rko->rko_type == RD_KAFKA_OP_OFFLOAD);
+
+                rko->rko_u.offload.run(ofl->ofl_rk, rko);
+
+                /* Hand the job back to the originator */
+                rd_kafka_op_reply(rko, RD_KAFKA_RESP_ERR_NO_ERROR);
+        }
+
+        (void)rd_atomic32_sub(&rd_kafka_thread_cnt_curr, 1);
+
+        return 0;
+}
+
+
+/**
+ * @brief Create a new offload pool with \p thread_cnt worker threads.
+ *
+ * @returns the new pool, or NULL on failure in which case an error
+ *          string is written to \p errstr.
+ */
+rd_kafka_offload_t *rd_kafka_offload_new (rd_kafka_t *rk, int thread_cnt,
+                                          char *errstr, size_t errstr_size) {
+        rd_kafka_offload_t *ofl;
+        int i;
+
+        rd_assert(thread_cnt > 0);
+
+        ofl = rd_calloc(1, sizeof(*ofl));
+        ofl->ofl_rk    = rk;
+        ofl->ofl_q     = rd_kafka_q_new(rk);
+        ofl->ofl_thrds = rd_calloc(thread_cnt, sizeof(*ofl->ofl_thrds));
+
+        for (i = 0 ; i < thread_cnt ; i++) {
+                if (thrd_create(&ofl->ofl_thrds[i],
+                                rd_kafka_offload_thread_main, ofl) !=
+                    thrd_success) {
+                        if (errstr)
+                                rd_snprintf(errstr, errstr_size,
+                                            "Failed to create offload "
+                                            "thread: %s (%i)",
+                                            rd_strerror(errno), errno);
+                        rd_kafka_offload_destroy(ofl);
+                        return NULL;
+                }
+                ofl->ofl_thrd_cnt++;
+        }
+
+        return ofl;
+}
+
+
+/**
+ * @brief Stop the worker threads, after all enqueued jobs have been run,
+ *        and destroy the pool.
+ *
+ * @locality any thread but the pool's worker threads.
+ */
+void rd_kafka_offload_destroy (rd_kafka_offload_t *ofl) {
+        int i;
+
+        /* One TERMINATE op per thread, enqueued after any outstanding
+         * jobs, each thread exits when it sees one. */
+        for (i = 0 ; i < ofl->ofl_thrd_cnt ; i++)
+                rd_kafka_q_enq(ofl->ofl_q,
+                               rd_kafka_op_new(RD_KAFKA_OP_TERMINATE));
+
+        for (i = 0 ; i < ofl->ofl_thrd_cnt ; i++)
+                thrd_join(ofl->ofl_thrds[i], NULL);
+
+        rd_kafka_q_destroy_owner(ofl->ofl_q);
+        rd_free(ofl->ofl_thrds);
+        rd_free(ofl);
+}
+
+
+/**
+ * @brief Create a new offload job op.
+ *
+ * \p run is called on a worker thread, \p done is called by whoever
+ * serves the job's replyq when the job is received as a reply
+ * and takes ownership of the op.
+ *
+ * The caller needs to set the op's replyq before enqueuing it.
+ */
+rd_kafka_op_t *rd_kafka_op_new_offload (rd_kafka_offload_run_cb_t *run,
+                                        rd_kafka_offload_done_cb_t *done,
+                                        void *opaque) {
+        rd_kafka_op_t *rko;
+
+        rko = rd_kafka_op_new(RD_KAFKA_OP_OFFLOAD);
+        rko->rko_u.offload.run    = run;
+        rko->rko_u.offload.done   = done;
+        rko->rko_u.offload.opaque = opaque;
+
+        return rko;
+}
+
+
+/**
+ * @brief Enqueue job \p rko for execution by the pool.
+ */
+void rd_kafka_offload_enq (rd_kafka_offload_t *ofl, rd_kafka_op_t *rko) {
+        rd_dassert(rko->rko_replyq.q);
+        rd_kafka_q_enq(ofl->ofl_q, rko);
+}
+
+
+
+/**
+ * @name Unit tests
+ * @{
+ */
+
+struct ut_offload_job {
+        int    idx;
+        thrd_t thrd;       /**< Thread the job was run on */
+        int    done;
+};
+
+static void ut_offload_run (rd_kafka_t *rk, rd_kafka_op_t *rko) {
+        struct ut_offload_job *job = rko->rko_u.offload.opaque;
+        job->thrd = thrd_current();
+}
+
+static void ut_offload_done (rd_kafka_t *rk, rd_kafka_op_t *rko) {
+        struct ut_offload_job *job = rko->rko_u.offload.opaque;
+        job->done++;
+        rd_kafka_op_destroy(rko);
+}
+
+int unittest_offload (void) {
+        rd_kafka_offload_t *ofl;
+        rd_kafka_q_t *replyq;
+        struct ut_offload_job jobs[200];
+        const int cnt = (int)RD_ARRAYSIZE(jobs);
+        rd_kafka_op_t *rko;
+        char errstr[256];
+        int i, done_cnt = 0;
+
+        ofl = rd_kafka_offload_new(NULL, 4, errstr, sizeof(errstr));
+        RD_UT_ASSERT(ofl, "offload_new failed: %s", errstr);
+
+        replyq = rd_kafka_q_new(NULL);
+
+        for (i = 0 ; i < cnt ; i++) {
+                jobs[i].idx  = i;
+                jobs[i].done = 0;
+                rko = rd_kafka_op_new_offload(ut_offload_run,
+                                              ut_offload_done, &jobs[i]);
+                rko->rko_replyq = RD_KAFKA_REPLYQ(replyq, 0);
+                rd_kafka_offload_enq(ofl, rko);
+        }
+
+        /* All jobs must be run on a worker thread and returned once */
+        while (done_cnt < cnt &&
+               (rko = rd_kafka_q_pop(replyq, 5000, 0))) {
+                RD_UT_ASSERT(rko->rko_type ==
+                             (RD_KAFKA_OP_OFFLOAD|RD_KAFKA_OP_REPLY),
+                             "unexpected op %s",
+                             rd_kafka_op2str(rko->rko_type));
+                rko->rko_u.offload.done(NULL, rko);
+                done_cnt++;
+        }
+
+        RD_UT_ASSERT(done_cnt == cnt,
+                     "expected %d completed jobs, not %d", cnt, done_cnt);
+
+        for (i = 0 ; i < cnt ; i++) {
+                RD_UT_ASSERT(jobs[i].done == 1,
+                             "job #%d completed %d times", i, jobs[i].done);
+                RD_UT_ASSERT(!thrd_is_current(jobs[i].thrd),
+                             "job #%d was not run on a worker thread", i);
+        }
+
+        rd_kafka_offload_destroy(ofl);
+
+        RD_UT_ASSERT(rd_kafka_q_len(replyq) == 0,
+                     "replyq not empty: %d", rd_kafka_q_len(replyq));
+        rd_kafka_q_destroy_owner(replyq);
+
+        RD_UT_PASS();
+}
+
+/**@}*/
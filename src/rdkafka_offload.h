@@ -0,0 +1,64 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDKAFKA_OFFLOAD_H_
+#define _RDKAFKA_OFFLOAD_H_
+
+
+/**
+ * @name Offload worker pool
+ *
+ * A fixed number of worker threads serving a shared job queue,
+ * used to move CPU intensive work, such as MessageSet compression,
+ * off the broker threads.
+ *
+ * A job is an RD_KAFKA_OP_OFFLOAD op with a replyq:
+ * the op's run callback is called on a worker thread after which the op
+ * is sent back as a reply (RD_KAFKA_OP_OFFLOAD|RD_KAFKA_OP_REPLY) on the
+ * replyq, where the originator finishes the job.
+ *
+ * Jobs are run in the order they were enqueued but may complete in any
+ * order, it is up to the originator to restore ordering if needed.
+ * All enqueued jobs are run before the pool is destroyed.
+ * A job op destroyed before the originator is done with it has its
+ * opaque freed by the op's free_cb (if set) and its ProduceRequest
+ * buffer (if any) failed, see rd_kafka_op_destroy().
+ */
+
+rd_kafka_offload_t *rd_kafka_offload_new (rd_kafka_t *rk, int thread_cnt,
+                                          char *errstr, size_t errstr_size);
+void rd_kafka_offload_destroy (rd_kafka_offload_t *ofl);
+
+rd_kafka_op_t *rd_kafka_op_new_offload (rd_kafka_offload_run_cb_t *run,
+                                        rd_kafka_offload_done_cb_t *done,
+                                        void *opaque);
+void rd_kafka_offload_enq (rd_kafka_offload_t *ofl, rd_kafka_op_t *rko);
+
+int unittest_offload (void);
+
+#endif /* _RDKAFKA_OFFLOAD_H_ */
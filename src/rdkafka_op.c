@@ -47,6 +47,7 @@ const char *rd_kafka_op2str (rd_kafka_op_type_t type) {
                 [RD_KAFKA_OP_CONSUMER_ERR] = "REPLY:CONSUMER_ERR",
                 [RD_KAFKA_OP_DR] = "REPLY:DR",
                 [RD_KAFKA_OP_STATS] = "REPLY:STATS",
+                [RD_KAFKA_OP_STATS_BINARY] = "REPLY:STATS_BINARY",
                 [RD_KAFKA_OP_OFFSET_COMMIT] = "REPLY:OFFSET_COMMIT",
                 [RD_KAFKA_OP_NODE_UPDATE] = "REPLY:NODE_UPDATE",
                 [RD_KAFKA_OP_XMIT_BUF] = "REPLY:XMIT_BUF",
@@ -72,6 +73,8 @@ const char *rd_kafka_op2str (rd_kafka_op_type_t type) {
                 [RD_KAFKA_OP_METADATA] = "REPLY:METADATA",
                 [RD_KAFKA_OP_LOG] = "REPLY:LOG",
                 [RD_KAFKA_OP_WAKEUP] = "REPLY:WAKEUP",
+                [RD_KAFKA_OP_OFFLOAD] = "REPLY:OFFLOAD",
+                [RD_KAFKA_OP_FETCH_BATCH] = "REPLY:FETCH_BATCH",
         };
 
         if (type & RD_KAFKA_OP_REPLY)
@@ -115,6 +118,11 @@ void rd_kafka_op_print (FILE *fp, const char *prefix, rd_kafka_op_t *rko) {
 		fprintf(fp,  "%s Offset: %"PRId64"\n",
 			prefix, rko->rko_u.fetch.rkm.rkm_offset);
 		break;
+        case RD_KAFKA_OP_FETCH_BATCH:
+                fprintf(fp, "%s Records: %d/%d\n",
+                        prefix, rko->rko_u.fetch_batch.next,
+                        rko->rko_u.fetch_batch.cnt);
+                break;
 	case RD_KAFKA_OP_CONSUMER_ERR:
 		fprintf(fp,  "%s Offset: %"PRId64"\n",
 			prefix, rko->rko_u.err.offset);
@@ -160,6 +168,7 @@ rd_kafka_op_t *rd_kafka_op_new0 (const char *source, rd_kafka_op_type_t type) {
                 [RD_KAFKA_OP_CONSUMER_ERR] = sizeof(rko->rko_u.err),
                 [RD_KAFKA_OP_DR] = sizeof(rko->rko_u.dr),
                 [RD_KAFKA_OP_STATS] = sizeof(rko->rko_u.stats),
+                [RD_KAFKA_OP_STATS_BINARY] = sizeof(rko->rko_u.stats_binary),
                 [RD_KAFKA_OP_OFFSET_COMMIT] = sizeof(rko->rko_u.offset_commit),
                 [RD_KAFKA_OP_NODE_UPDATE] = sizeof(rko->rko_u.node),
                 [RD_KAFKA_OP_XMIT_BUF] = sizeof(rko->rko_u.xbuf),
@@ -185,6 +194,8 @@ rd_kafka_op_t *rd_kafka_op_new0 (const char *source, rd_kafka_op_type_t type) {
                 [RD_KAFKA_OP_METADATA] = sizeof(rko->rko_u.metadata),
                 [RD_KAFKA_OP_LOG] = sizeof(rko->rko_u.log),
                 [RD_KAFKA_OP_WAKEUP] = 0,
+                [RD_KAFKA_OP_OFFLOAD] = sizeof(rko->rko_u.offload),
+                [RD_KAFKA_OP_FETCH_BATCH] = sizeof(rko->rko_u.fetch_batch),
 	};
 	size_t tsize = op2size[type & ~RD_KAFKA_OP_FLAGMASK];
 
@@ -199,11 +210,27 @@ rd_kafka_op_t *rd_kafka_op_new0 (const char *source, rd_kafka_op_type_t type) {
 }
 
 
+/**
+ * @brief Add \p delta bytes of the fetch op \p rko to the prefetch memory
+ *        budget accounting (rk_fetchq).
+ */
+static RD_INLINE void rd_kafka_op_fetchq_account (rd_kafka_op_t *rko,
+                                                  int64_t delta) {
+        rd_kafka_toppar_t *rktp = rd_kafka_toppar_s2i(rko->rko_rktp);
+
+        rd_atomic64_add(&rktp->rktp_fetchq_bytes, delta);
+        rd_atomic64_add(&rktp->rktp_rkt->rkt_rk->rk_fetchq.bytes, delta);
+        rd_atomic64_add(&rd_kafka_fetchq_global.bytes, delta);
+}
+
+
 void rd_kafka_op_destroy (rd_kafka_op_t *rko) {
 
 	switch (rko->rko_type & ~RD_KAFKA_OP_FLAGMASK)
 	{
 	case RD_KAFKA_OP_FETCH:
+                if (rko->rko_flags & RD_KAFKA_OP_F_FETCHQ)
+                        rd_kafka_op_fetchq_account(rko, -rko->rko_len);
 		rd_kafka_msg_destroy(NULL, &rko->rko_u.fetch.rkm);
 		/* Decrease refcount on rkbuf to eventually rd_free shared buf*/
 		if (rko->rko_u.fetch.rkbuf)
@@ -211,6 +238,16 @@ void rd_kafka_op_destroy (rd_kafka_op_t *rko) {
 
 		break;
 
+        case RD_KAFKA_OP_FETCH_BATCH:
+                if (rko->rko_flags & RD_KAFKA_OP_F_FETCHQ)
+                        rd_kafka_op_fetchq_account(rko, -rko->rko_len);
+                RD_IF_FREE(rko->rko_u.fetch_batch.recs, rd_free);
+                rd_kafka_msg_destroy(NULL, &rko->rko_u.fetch_batch.rkm);
+                /* Decrease refcount on rkbuf to eventually rd_free shared buf*/
+                if (rko->rko_u.fetch_batch.rkbuf)
+                        rd_kafka_buf_handle_op(rko, RD_KAFKA_RESP_ERR__DESTROY);
+                break;
+
 	case RD_KAFKA_OP_OFFSET_FETCH:
 		if (rko->rko_u.offset_fetch.partitions &&
 		    rko->rko_u.offset_fetch.do_free)
@@ -261,6 +298,10 @@ void rd_kafka_op_destroy (rd_kafka_op_t *rko) {
 		RD_IF_FREE(rko->rko_u.stats.json, rd_free);
 		break;
 
+        case RD_KAFKA_OP_STATS_BINARY:
+                RD_IF_FREE(rko->rko_u.stats_binary.buf, rd_free);
+                break;
+
 	case RD_KAFKA_OP_XMIT_RETRY:
 	case RD_KAFKA_OP_XMIT_BUF:
 	case RD_KAFKA_OP_RECV_BUF:
@@ -291,6 +332,23 @@ void rd_kafka_op_destroy (rd_kafka_op_t *rko) {
                 rd_free(rko->rko_u.log.str);
                 break;
 
+        case RD_KAFKA_OP_OFFLOAD:
+                /* Job destroyed before its originator was done with it:
+                 * free the job state and fail the messages of an
+                 * attached ProduceRequest. */
+                if (rko->rko_u.offload.opaque && rko->rko_u.offload.free_cb)
+                        rko->rko_u.offload.free_cb(rko->rko_u.offload.opaque);
+                if (rko->rko_u.offload.rkbuf) {
+                        rd_kafka_buf_t *rkbuf = rko->rko_u.offload.rkbuf;
+                        if (rd_kafka_msgq_len(&rkbuf->rkbuf_msgq) > 0)
+                                rd_kafka_dr_msgq(
+                                        rd_kafka_toppar_s2i(rko->rko_rktp)->
+                                        rktp_rkt, &rkbuf->rkbuf_msgq,
+                                        RD_KAFKA_RESP_ERR__DESTROY);
+                        rd_kafka_buf_destroy(rkbuf);
+                }
+                break;
+
 	default:
 		break;
 	}
@@ -540,10 +598,124 @@ rd_kafka_op_new_fetch_msg (rd_kafka_msg_t **rkmp,
 
         rkm->rkm_partition = rktp->rktp_partition;
 
+        /* Account the message to the prefetch memory budget
+         * until the op is destroyed. */
+        rko->rko_flags    |= RD_KAFKA_OP_F_FETCHQ;
+        rd_kafka_op_fetchq_account(rko, rko->rko_len);
+
+        return rko;
+}
+
+
+/**
+ * @brief Creates a new RD_KAFKA_OP_FETCH_BATCH op: a view of the records
+ *        of a RecordBatch in \p rkbuf, added by
+ *        rd_kafka_op_fetch_batch_add().
+ *
+ * The view replaces the RD_KAFKA_OP_FETCH op per record: these are only
+ * created when the application consumes a message, see
+ * rd_kafka_op_fetch_batch_materialize().
+ *
+ * @param size is the expected number of records (RecordCount).
+ */
+rd_kafka_op_t *rd_kafka_op_new_fetch_batch (rd_kafka_toppar_t *rktp,
+                                            int32_t version,
+                                            rd_kafka_buf_t *rkbuf,
+                                            int size) {
+        rd_kafka_op_t *rko;
+
+        rko = rd_kafka_op_new(RD_KAFKA_OP_FETCH_BATCH);
+        rko->rko_rktp    = rd_kafka_toppar_keep(rktp);
+        rko->rko_version = version;
+
+        /* The records point into the payload buffer,
+         * see rd_kafka_op_new_fetch_msg(). */
+        rko->rko_u.fetch_batch.rkbuf = rkbuf;
+        rd_kafka_buf_keep(rkbuf);
+
+        rko->rko_u.fetch_batch.size = RD_MAX(size, 1);
+        rko->rko_u.fetch_batch.recs =
+                rd_malloc(sizeof(*rko->rko_u.fetch_batch.recs) *
+                          rko->rko_u.fetch_batch.size);
+
         return rko;
 }
 
 
+/**
+ * @returns a new record to be set up by the caller at the end of the
+ *          RecordBatch view \p rko.
+ */
+rd_kafka_fetch_rec_t *rd_kafka_op_fetch_batch_add (rd_kafka_op_t *rko) {
+
+        if (unlikely(rko->rko_u.fetch_batch.cnt ==
+                     rko->rko_u.fetch_batch.size)) {
+                rko->rko_u.fetch_batch.size *= 2;
+                rko->rko_u.fetch_batch.recs =
+                        rd_realloc(rko->rko_u.fetch_batch.recs,
+                                   sizeof(*rko->rko_u.fetch_batch.recs) *
+                                   rko->rko_u.fetch_batch.size);
+        }
+
+        return &rko->rko_u.fetch_batch.recs[rko->rko_u.fetch_batch.cnt++];
+}
+
+
+/**
+ * @brief All records have been added to the RecordBatch view \p rko:
+ *        sum up the record sizes and account them to the prefetch
+ *        memory budget until they are materialized or destroyed.
+ */
+void rd_kafka_op_fetch_batch_done (rd_kafka_op_t *rko) {
+        int i;
+
+        rko->rko_len = 0;
+        for (i = 0 ; i < rko->rko_u.fetch_batch.cnt ; i++)
+                rko->rko_len += rko->rko_u.fetch_batch.recs[i].value_len;
+
+        rko->rko_flags |= RD_KAFKA_OP_F_FETCHQ;
+        rd_kafka_op_fetchq_account(rko, rko->rko_len);
+}
+
+
+/**
+ * @brief Create an RD_KAFKA_OP_FETCH op for the next record of the
+ *        RecordBatch view \p rko, moving the record's size from
+ *        the view to the new op.
+ *
+ * @remark The caller must adjust the size of the queue the view is on
+ *         and dequeue and destroy the view after its last record,
+ *         see rd_kafka_q_deq_msg0().
+ */
+rd_kafka_op_t *rd_kafka_op_fetch_batch_materialize (rd_kafka_op_t *rko) {
+        const rd_kafka_fetch_rec_t *rec;
+        rd_kafka_op_t *rko_msg;
+        rd_kafka_msg_t *rkm;
+
+        rd_dassert(rko->rko_u.fetch_batch.next < rko->rko_u.fetch_batch.cnt);
+        rec = &rko->rko_u.fetch_batch.recs[rko->rko_u.fetch_batch.next++];
+
+        rko_msg = rd_kafka_op_new_fetch_msg(
+                &rkm, rd_kafka_toppar_s2i(rko->rko_rktp), rko->rko_version,
+                rko->rko_u.fetch_batch.rkbuf, rec->offset,
+                (size_t)rec->key_len, rec->key,
+                (size_t)rec->value_len, rec->value);
+
+        /* Headers are parsed on the first access, see
+         * rd_kafka_op_new_fetch_msg() callers. */
+        rkm->rkm_u.consumer.binhdrs.len  = rec->hdrs_len;
+        rkm->rkm_u.consumer.binhdrs.data = rec->hdrs;
+
+        rkm->rkm_timestamp = rec->timestamp;
+        rkm->rkm_tstype    = rec->tstype;
+
+        rko->rko_len -= rko_msg->rko_len;
+        rd_kafka_op_fetchq_account(rko, -rko_msg->rko_len);
+
+        return rko_msg;
+}
+
+
 /**
  * Enqueue ERR__THROTTLE op, if desired.
  */
@@ -644,7 +816,9 @@ void rd_kafka_op_offset_store (rd_kafka_t *rk, rd_kafka_op_t *rko,
 			       const rd_kafka_message_t *rkmessage) {
 	rd_kafka_toppar_t *rktp;
 
-	if (unlikely(rko->rko_type != RD_KAFKA_OP_FETCH || rko->rko_err))
+	if (unlikely((rko->rko_type != RD_KAFKA_OP_FETCH &&
+                      rko->rko_type != RD_KAFKA_OP_FETCH_BATCH) ||
+                     rko->rko_err))
 		return;
 
 	rktp = rd_kafka_toppar_s2i(rko->rko_rktp);
@@ -658,3 +832,37 @@ void rd_kafka_op_offset_store (rd_kafka_t *rk, rd_kafka_op_t *rko,
 		rd_kafka_offset_store0(rktp, rkmessage->offset+1, 0/*no lock*/);
 	rd_kafka_toppar_unlock(rktp);
 }
+
+
+/**
+ * @brief Record the time the fetched message(s) of \p rko spent between
+ *        their Fetch response being received and being handed to the
+ *        application in the partition's fetchq latency window stats.
+ *
+ * Called once for each op handed to the application. The latency is
+ * recorded once per message, also for a RecordBatch handed over whole.
+ */
+void rd_kafka_op_fetchq_latency_add (rd_kafka_op_t *rko) {
+        rd_kafka_toppar_t *rktp;
+        const rd_kafka_buf_t *rkbuf;
+        int cnt;
+
+        if (rko->rko_type == RD_KAFKA_OP_FETCH) {
+                rkbuf = rko->rko_u.fetch.rkbuf;
+                cnt = 1;
+        } else if (rko->rko_type == RD_KAFKA_OP_FETCH_BATCH) {
+                rkbuf = rko->rko_u.fetch_batch.rkbuf;
+                cnt = rko->rko_u.fetch_batch.cnt - rko->rko_u.fetch_batch.next;
+        } else
+                return;
+
+        rktp = rd_kafka_toppar_s2i(rko->rko_rktp);
+
+        /* ra_enabled is constant after rd_kafka_toppar_new0() */
+        if (!rktp->rktp_avg_fetchq_latency.ra_enabled ||
+            unlikely(!rkbuf || !rkbuf->rkbuf_ts_enq || cnt <= 0))
+                return;
+
+        rd_avg_add_n(&rktp->rktp_avg_fetchq_latency,
+                     rd_clock() - rkbuf->rkbuf_ts_enq, cnt);
+}
@@ -64,6 +64,9 @@ typedef struct rd_kafka_replyq_s {
 #define RD_KAFKA_OP_F_CRC         0x8  /* rkbuf: Perform CRC calculation */
 #define RD_KAFKA_OP_F_BLOCKING    0x10 /* rkbuf: blocking protocol request */
 #define RD_KAFKA_OP_F_REPROCESS   0x20 /* cgrp: Reprocess at a later time. */
+#define RD_KAFKA_OP_F_FETCHQ      0x40 /* fetch: Accounted in rk_fetchq */
+#define RD_KAFKA_OP_F_ITERATED    0x80 /* fetch: Message returned by
+                                        * rd_kafka_recordbatch_message_next()*/
 
 
 typedef enum {
@@ -108,6 +111,13 @@ typedef enum {
         RD_KAFKA_OP_METADATA,        /* Metadata response */
         RD_KAFKA_OP_LOG,             /* Log */
         RD_KAFKA_OP_WAKEUP,          /* Wake-up signaling */
+        RD_KAFKA_OP_OFFLOAD,         /* Offload job:
+                                      * any -> offload worker -> replyq */
+        RD_KAFKA_OP_FETCH_BATCH,     /* RecordBatch view:
+                                      * Kafka thread -> Application,
+                                      * see rd_kafka_q_deq_msg0() */
+        RD_KAFKA_OP_STATS_BINARY,    /* Binary stats:
+                                      * Kafka thread -> Application */
         RD_KAFKA_OP__END
 } rd_kafka_op_type_t;
 
@@ -179,6 +189,33 @@ typedef rd_kafka_op_res_t (rd_kafka_op_cb_t) (rd_kafka_t *rk,
                 RD_WARN_UNUSED_RESULT;
 
 
+/**
+ * @brief Offload job callback types, see rdkafka_offload.h
+ */
+typedef struct rd_kafka_offload_s rd_kafka_offload_t;
+typedef void (rd_kafka_offload_run_cb_t) (rd_kafka_t *rk,
+                                          struct rd_kafka_op_s *rko);
+typedef void (rd_kafka_offload_done_cb_t) (rd_kafka_t *rk,
+                                           struct rd_kafka_op_s *rko);
+
+
+/**
+ * @brief A record of a RecordBatch view (RD_KAFKA_OP_FETCH_BATCH),
+ *        with pointers into the view's payload buffer.
+ */
+typedef struct rd_kafka_fetch_rec_s {
+        int64_t     offset;
+        int64_t     timestamp;
+        const void *key;         /* NULL for a Null key */
+        const void *value;       /* NULL for a Null value */
+        const void *hdrs;        /* Unparsed headers */
+        int32_t     key_len;
+        int32_t     value_len;
+        int32_t     hdrs_len;
+        rd_kafka_timestamp_type_t tstype;
+} rd_kafka_fetch_rec_t;
+
+
 #define RD_KAFKA_OP_TYPE_ASSERT(rko,type) \
 	rd_kafka_assert(NULL, (rko)->rko_type == (type) && # type)
 
@@ -278,6 +315,11 @@ struct rd_kafka_op_s {
 			size_t json_len;
 		} stats;
 
+                struct {
+                        char *buf;
+                        size_t size;
+                } stats_binary;
+
 		struct {
 			rd_kafka_buf_t *rkbuf;
 		} xbuf; /* XMIT_BUF and RECV_BUF */
@@ -321,6 +363,42 @@ struct rd_kafka_op_s {
                         int  level;
                         char *str;
                 } log;
+
+                /* RD_KAFKA_OP_OFFLOAD */
+                struct {
+                        rd_kafka_offload_run_cb_t *run;   /**< Worker thread */
+                        rd_kafka_offload_done_cb_t *done; /**< Originator,
+                                                           *   owns the op */
+                        void *opaque;
+                        void (*free_cb) (void *opaque);   /**< Frees opaque
+                                                           *   if the op is
+                                                           *   destroyed
+                                                           *   before done */
+
+                        /* Producer compression offload */
+                        struct rd_kafka_buf_s *rkbuf;     /**< ProduceRequest */
+                        size_t MessageSetSize;
+                        int64_t seq;                      /**< Per-toppar
+                                                           *   sequence */
+                } offload;
+
+                /* RD_KAFKA_OP_FETCH_BATCH */
+                struct {
+                        rd_kafka_buf_t *rkbuf;       /**< Payload buffer,
+                                                      *   shared with the
+                                                      *   materialized
+                                                      *   messages. */
+                        rd_kafka_fetch_rec_t *recs;  /**< Records */
+                        int cnt;                     /**< Records in .recs */
+                        int size;                    /**< .recs allocation */
+                        int next;                    /**< Next record to
+                                                      *   materialize */
+                        rd_kafka_msg_t rkm;          /**< Current record of
+                                                      *   a batch consumed
+                                                      *   as a whole,
+                                                      *   see rd_kafka_
+                                                      *   recordbatch_..() */
+                } fetch_batch;
 	} rko_u;
 };
 
@@ -382,6 +460,14 @@ rd_kafka_op_new_fetch_msg (rd_kafka_msg_t **rkmp,
                            size_t key_len, const void *key,
                            size_t val_len, const void *val);
 
+rd_kafka_op_t *rd_kafka_op_new_fetch_batch (rd_kafka_toppar_t *rktp,
+                                            int32_t version,
+                                            rd_kafka_buf_t *rkbuf,
+                                            int size);
+rd_kafka_fetch_rec_t *rd_kafka_op_fetch_batch_add (rd_kafka_op_t *rko);
+void rd_kafka_op_fetch_batch_done (rd_kafka_op_t *rko);
+rd_kafka_op_t *rd_kafka_op_fetch_batch_materialize (rd_kafka_op_t *rko);
+
 void rd_kafka_op_throttle_time (struct rd_kafka_broker_s *rkb,
 				rd_kafka_q_t *rkq,
 				int throttle_time);
@@ -399,5 +485,6 @@ void rd_kafka_op_print (FILE *fp, const char *prefix, rd_kafka_op_t *rko);
 
 void rd_kafka_op_offset_store (rd_kafka_t *rk, rd_kafka_op_t *rko,
 			       const rd_kafka_message_t *rkmessage);
+void rd_kafka_op_fetchq_latency_add (rd_kafka_op_t *rko);
 
 #endif /* _RDKAFKA_OP_H_ */
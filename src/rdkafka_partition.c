@@ -181,6 +181,11 @@ shptr_rd_kafka_toppar_t *rd_kafka_toppar_new0 (rd_kafka_itopic_t *rkt,
 	rktp->rktp_fetch_state = RD_KAFKA_TOPPAR_FETCH_NONE;
         rktp->rktp_fetch_msg_max_bytes
             = rkt->rkt_rk->rk_conf.fetch_msg_max_bytes;
+        rktp->rktp_fetch_adapt.min_size =
+                RD_MIN(rkt->rkt_rk->rk_conf.fetch_msg_max_bytes,
+                       RD_KAFKA_FETCH_ADAPT_SIZE_MIN);
+        rd_atomic64_init(&rktp->rktp_fetchq_bytes, 0);
+        rd_atomic64_init(&rktp->rktp_msgq_tmout, 0);
 	rktp->rktp_offset_fp = NULL;
         rd_kafka_offset_stats_reset(&rktp->rktp_offsets);
         rd_kafka_offset_stats_reset(&rktp->rktp_offsets_fin);
@@ -190,8 +195,10 @@ shptr_rd_kafka_toppar_t *rd_kafka_toppar_new0 (rd_kafka_itopic_t *rkt,
         rktp->rktp_stored_offset = RD_KAFKA_OFFSET_INVALID;
         rktp->rktp_committed_offset = RD_KAFKA_OFFSET_INVALID;
 	rd_kafka_msgq_init(&rktp->rktp_msgq);
+        rd_kafka_msgq_ingress_init(&rktp->rktp_msgq_ingress);
         rktp->rktp_msgq_wakeup_fd = -1;
 	rd_kafka_msgq_init(&rktp->rktp_xmit_msgq);
+        TAILQ_INIT(&rktp->rktp_offload.doneq);
 	mtx_init(&rktp->rktp_lock, mtx_plain);
 
         rd_refcnt_init(&rktp->rktp_refcnt, 0);
@@ -202,6 +209,25 @@ shptr_rd_kafka_toppar_t *rd_kafka_toppar_new0 (rd_kafka_itopic_t *rkt,
         rd_atomic32_init(&rktp->rktp_version, 1);
 	rktp->rktp_op_version = rd_atomic32_get(&rktp->rktp_version);
 
+        /* Latency histograms are kept for every partition, so use a
+         * single significant figure (~5% resolution) to keep the
+         * per-partition memory small. */
+        rd_avg_init(&rktp->rktp_avg_produce_latency, RD_AVG_GAUGE,
+                    0, 1000*1000, 1,
+                    rkt->rkt_rk->rk_conf.stats_interval_ms &&
+                    rkt->rkt_rk->rk_type == RD_KAFKA_PRODUCER &&
+                    rktp->rktp_partition != RD_KAFKA_PARTITION_UA);
+        rd_avg_init(&rktp->rktp_avg_fetch_latency, RD_AVG_GAUGE,
+                    0, 1000*1000, 1,
+                    rkt->rkt_rk->rk_conf.stats_interval_ms &&
+                    rkt->rkt_rk->rk_type == RD_KAFKA_CONSUMER &&
+                    rktp->rktp_partition != RD_KAFKA_PARTITION_UA);
+        rd_avg_init(&rktp->rktp_avg_fetchq_latency, RD_AVG_GAUGE,
+                    0, 1000*1000, 1,
+                    rkt->rkt_rk->rk_conf.stats_interval_ms &&
+                    rkt->rkt_rk->rk_type == RD_KAFKA_CONSUMER &&
+                    rktp->rktp_partition != RD_KAFKA_PARTITION_UA);
+
         /* Consumer: If statistics is available we query the oldest offset
          * of each partition.
          * Since the oldest offset only moves on log retention, we cap this
@@ -268,13 +294,28 @@ void rd_kafka_toppar_destroy_final (rd_kafka_toppar_t *rktp) {
 	/* Clear queues */
 	rd_kafka_assert(rktp->rktp_rkt->rkt_rk,
 			rd_kafka_msgq_len(&rktp->rktp_xmit_msgq) == 0);
+        rd_kafka_assert(rktp->rktp_rkt->rkt_rk,
+                        TAILQ_EMPTY(&rktp->rktp_offload.doneq));
+        rd_kafka_toppar_ingress_drain(rktp);
 	rd_kafka_dr_msgq(rktp->rktp_rkt, &rktp->rktp_msgq,
 			 RD_KAFKA_RESP_ERR__DESTROY);
 	rd_kafka_q_destroy_owner(rktp->rktp_fetchq);
         rd_kafka_q_destroy_owner(rktp->rktp_ops);
 
+        if (rktp->rktp_fetch_state == RD_KAFKA_TOPPAR_FETCH_ACTIVE) {
+                rd_atomic32_sub(&rktp->rktp_rkt->rkt_rk->rk_fetchq.fetch_cnt,
+                                1);
+                rd_atomic32_sub(&rd_kafka_fetchq_global.fetch_cnt, 1);
+        }
+
 	rd_kafka_replyq_destroy(&rktp->rktp_replyq);
 
+        rd_kafka_stats_bin_obj_destroy(&rktp->rktp_stats_bin);
+
+        rd_avg_destroy(&rktp->rktp_avg_produce_latency);
+        rd_avg_destroy(&rktp->rktp_avg_fetch_latency);
+        rd_avg_destroy(&rktp->rktp_avg_fetchq_latency);
+
 	rd_kafka_topic_destroy0(rktp->rktp_s_rkt);
 
 	mtx_destroy(&rktp->rktp_lock);
@@ -306,6 +347,18 @@ void rd_kafka_toppar_set_fetch_state (rd_kafka_toppar_t *rktp,
                      rd_kafka_fetch_states[rktp->rktp_fetch_state],
                      rd_kafka_fetch_states[fetch_state]);
 
+        /* Maintain the number of partitions sharing the
+         * prefetch memory budget. */
+        if (fetch_state == RD_KAFKA_TOPPAR_FETCH_ACTIVE) {
+                rd_atomic32_add(&rktp->rktp_rkt->rkt_rk->rk_fetchq.fetch_cnt,
+                                1);
+                rd_atomic32_add(&rd_kafka_fetchq_global.fetch_cnt, 1);
+        } else if (rktp->rktp_fetch_state == RD_KAFKA_TOPPAR_FETCH_ACTIVE) {
+                rd_atomic32_sub(&rktp->rktp_rkt->rkt_rk->rk_fetchq.fetch_cnt,
+                                1);
+                rd_atomic32_sub(&rd_kafka_fetchq_global.fetch_cnt, 1);
+        }
+
         rktp->rktp_fetch_state = fetch_state;
 
         if (fetch_state == RD_KAFKA_TOPPAR_FETCH_ACTIVE)
@@ -619,31 +672,72 @@ void rd_kafka_toppar_desired_del (rd_kafka_toppar_t *rktp) {
 
 
 /**
- * Append message at tail of 'rktp' message queue.
+ * @brief Move all messages from the lock-free ingress list to the
+ *        partition's message queue, assigning message sequence numbers
+ *        in the order the messages were enqueued.
+ *
+ * Must be called prior to accessing rktp_msgq.
+ *
+ * @returns the number of messages moved.
+ *
+ * @locks rd_kafka_toppar_lock() MUST be held.
  */
-void rd_kafka_toppar_enq_msg (rd_kafka_toppar_t *rktp, rd_kafka_msg_t *rkm) {
-        int wakeup_fd, queue_len;
+int rd_kafka_toppar_ingress_drain (rd_kafka_toppar_t *rktp) {
+        rd_kafka_msg_t *rkm, *next;
+        int fifo, cnt = 0;
 
-        rd_kafka_toppar_lock(rktp);
+        if (likely(!(rkm = rd_kafka_msgq_ingress_take(
+                             &rktp->rktp_msgq_ingress))))
+                return 0;
 
-        if (!rkm->rkm_u.producer.msgseq &&
-            rktp->rktp_partition != RD_KAFKA_PARTITION_UA)
-                rkm->rkm_u.producer.msgseq = ++rktp->rktp_msgseq;
+        fifo = !RD_KAFKA_TOPPAR_MSGQ_IS_LIFO(rktp);
 
-        if (rktp->rktp_partition == RD_KAFKA_PARTITION_UA ||
-            rktp->rktp_rkt->rkt_conf.queuing_strategy == RD_KAFKA_QUEUE_FIFO) {
-                /* No need for enq_sorted(), this is the oldest message. */
-                queue_len = rd_kafka_msgq_enq(&rktp->rktp_msgq, rkm);
-        } else {
-                queue_len = rd_kafka_msgq_enq_sorted(rktp->rktp_rkt,
-                                                     &rktp->rktp_msgq, rkm);
+        for ( ; rkm ; rkm = next, cnt++) {
+                next = rkm->rkm_link.tqe_next;
+
+                if (!rkm->rkm_u.producer.msgseq &&
+                    rktp->rktp_partition != RD_KAFKA_PARTITION_UA)
+                        rkm->rkm_u.producer.msgseq = ++rktp->rktp_msgseq;
+
+                if (fifo)
+                        /* No need for enq_sorted(), this is the
+                         * newest message. */
+                        rd_kafka_msgq_enq(&rktp->rktp_msgq, rkm);
+                else
+                        rd_kafka_msgq_enq_sorted(rktp->rktp_rkt,
+                                                 &rktp->rktp_msgq, rkm);
         }
 
+        return cnt;
+}
+
+
+/**
+ * @brief Append message at tail of \p rktp 's message queue.
+ *
+ * The message is pushed on the lock-free ingress list and moved to
+ * rktp_msgq by the broker thread, which is only woken up when the
+ * ingress list goes from empty to non-empty.
+ *
+ * @locks none
+ */
+void rd_kafka_toppar_enq_msg (rd_kafka_toppar_t *rktp, rd_kafka_msg_t *rkm) {
+        int wakeup_fd;
+        rd_ts_t ts_timeout = rkm->rkm_ts_timeout; /* rkm may be dequeued
+                                                   * once pushed */
+        int r;
+
+        r = rd_kafka_msgq_ingress_push(&rktp->rktp_msgq_ingress, rkm);
+
+        rd_kafka_toppar_msgq_tmout_schedule(rktp, ts_timeout);
+
+        if (!r)
+                return; /* Wake-up already pending */
+
         wakeup_fd = rktp->rktp_msgq_wakeup_fd;
-        rd_kafka_toppar_unlock(rktp);
 
 #ifndef _MSC_VER
-        if (wakeup_fd != -1 && queue_len == 1) {
+        if (wakeup_fd != -1) {
                 char one = 1;
                 int r;
                 r = rd_write(wakeup_fd, &one, sizeof(one));
@@ -660,11 +754,177 @@ void rd_kafka_toppar_enq_msg (rd_kafka_toppar_t *rktp, rd_kafka_msg_t *rkm) {
 }
 
 
+/**
+ * @brief Message timeout heap comparator: by rktp_msgq_tmout.
+ */
+int rd_kafka_toppar_cmp_msgq_tmout (const void *_a, const void *_b) {
+        rd_kafka_toppar_t *a = (rd_kafka_toppar_t *)_a;
+        rd_kafka_toppar_t *b = (rd_kafka_toppar_t *)_b;
+        int64_t ta = rd_atomic64_get(&a->rktp_msgq_tmout);
+        int64_t tb = rd_atomic64_get(&b->rktp_msgq_tmout);
+
+        return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+
+/**
+ * @brief Make sure \p rktp is scanned for message timeouts by
+ *        rd_kafka_toppar_msgq_tmout_scan() no later than \p abs_timeout,
+ *        which is the timeout of a message that is being added to
+ *        (the ingress list of) rktp_msgq.
+ *
+ * Messages are added in timeout order so this is typically a no-op
+ * that does not need the heap lock.
+ *
+ * @locks rd_kafka_toppar_lock() MAY be held.
+ * @locality any
+ */
+void rd_kafka_toppar_msgq_tmout_schedule (rd_kafka_toppar_t *rktp,
+                                          rd_ts_t abs_timeout) {
+        rd_kafka_t *rk = rktp->rktp_rkt->rkt_rk;
+        rd_ts_t curr;
+
+        if (abs_timeout == INT64_MAX)
+                return; /* message.timeout.ms=0: no timeout */
+
+        curr = rd_atomic64_get(&rktp->rktp_msgq_tmout);
+        if (likely(curr && curr <= abs_timeout))
+                return;
+
+        mtx_lock(&rk->rk_msgq_tmout.lock);
+
+        if (unlikely(rd_kafka_terminating(rk))) {
+                /* rd_kafka_toppar_msgq_tmout_clear() has been or will
+                 * be called: remaining messages are purged instead. */
+                mtx_unlock(&rk->rk_msgq_tmout.lock);
+                return;
+        }
+
+        if (!RD_HEAP_IN(rktp, rktp_msgq_tmout_node)) {
+                rd_atomic64_set(&rktp->rktp_msgq_tmout, abs_timeout);
+                rktp->rktp_s_for_msgq_tmout = rd_kafka_toppar_keep(rktp);
+                RD_HEAP_INSERT(&rk->rk_msgq_tmout.heap, rktp,
+                               rktp_msgq_tmout_node);
+        } else if (abs_timeout < rd_atomic64_get(&rktp->rktp_msgq_tmout)) {
+                rd_atomic64_set(&rktp->rktp_msgq_tmout, abs_timeout);
+                RD_HEAP_UPDATE(&rk->rk_msgq_tmout.heap, rktp,
+                               rktp_msgq_tmout_node);
+        }
+
+        mtx_unlock(&rk->rk_msgq_tmout.lock);
+}
+
+
+/**
+ * @brief Remove \p rktp from the message timeout heap.
+ *
+ * @returns the heap's reference to \p rktp, which the caller must destroy.
+ *
+ * @locks rk_msgq_tmout.lock MUST be held.
+ */
+static shptr_rd_kafka_toppar_t *
+rd_kafka_toppar_msgq_tmout_remove (rd_kafka_toppar_t *rktp) {
+        rd_kafka_t *rk = rktp->rktp_rkt->rkt_rk;
+        shptr_rd_kafka_toppar_t *s_rktp = rktp->rktp_s_for_msgq_tmout;
+
+        RD_HEAP_REMOVE(&rk->rk_msgq_tmout.heap, rktp, rktp_msgq_tmout_node);
+        /* Reset prior to the caller scanning the queues so that
+         * messages enqueued after the scan reschedule rktp. */
+        rd_atomic64_set(&rktp->rktp_msgq_tmout, 0);
+        rktp->rktp_s_for_msgq_tmout = NULL;
+
+        return s_rktp;
+}
+
+
+/**
+ * @brief Time out messages in the partition message queues (rktp_msgq)
+ *        that are due for a timeout scan, and trigger their
+ *        delivery reports.
+ *
+ * Only partitions that have messages that may have timed out are
+ * visited, and only their timed out messages are scanned.
+ *
+ * @returns the number of timed out messages.
+ *
+ * @locality rdkafka main thread
+ */
+int rd_kafka_toppar_msgq_tmout_scan (rd_kafka_t *rk, rd_ts_t now) {
+        int totcnt = 0;
+
+        while (1) {
+                rd_kafka_toppar_t *rktp;
+                shptr_rd_kafka_toppar_t *s_rktp;
+                rd_kafka_msgq_t timedout = RD_KAFKA_MSGQ_INITIALIZER(timedout);
+                rd_ts_t next;
+                int cnt;
+
+                mtx_lock(&rk->rk_msgq_tmout.lock);
+                rktp = RD_HEAP_FIRST(&rk->rk_msgq_tmout.heap);
+                if (!rktp || rd_atomic64_get(&rktp->rktp_msgq_tmout) > now) {
+                        mtx_unlock(&rk->rk_msgq_tmout.lock);
+                        break;
+                }
+                s_rktp = rd_kafka_toppar_msgq_tmout_remove(rktp);
+                mtx_unlock(&rk->rk_msgq_tmout.lock);
+
+                rd_kafka_toppar_lock(rktp);
+                rd_kafka_toppar_ingress_drain(rktp);
+                cnt = rd_kafka_msgq_age_scan(&rktp->rktp_msgq, &timedout, now,
+                                             RD_KAFKA_TOPPAR_MSGQ_IS_LIFO(rktp),
+                                             &next);
+                /* Scan again when the next message would time out */
+                if (next)
+                        rd_kafka_toppar_msgq_tmout_schedule(rktp, next);
+                rd_kafka_toppar_unlock(rktp);
+
+                if (cnt > 0) {
+                        totcnt += cnt;
+                        rd_kafka_dbg(rk, MSG, "TIMEOUT",
+                                     "%s [%"PRId32"]: %d message(s) "
+                                     "timed out",
+                                     rktp->rktp_rkt->rkt_topic->str,
+                                     rktp->rktp_partition, cnt);
+                        rd_kafka_dr_msgq(rktp->rktp_rkt, &timedout,
+                                         RD_KAFKA_RESP_ERR__MSG_TIMED_OUT);
+                }
+
+                rd_kafka_toppar_destroy(s_rktp);
+        }
+
+        return totcnt;
+}
+
+
+/**
+ * @brief Remove all partitions from the message timeout heap.
+ *
+ * @locality rdkafka main thread or application thread during
+ *           rd_kafka_new() failure, when terminating.
+ */
+void rd_kafka_toppar_msgq_tmout_clear (rd_kafka_t *rk) {
+        rd_kafka_toppar_t *rktp;
+
+        rd_kafka_assert(rk, rd_kafka_terminating(rk));
+
+        mtx_lock(&rk->rk_msgq_tmout.lock);
+        while ((rktp = RD_HEAP_FIRST(&rk->rk_msgq_tmout.heap))) {
+                shptr_rd_kafka_toppar_t *s_rktp =
+                        rd_kafka_toppar_msgq_tmout_remove(rktp);
+                mtx_unlock(&rk->rk_msgq_tmout.lock);
+                rd_kafka_toppar_destroy(s_rktp);
+                mtx_lock(&rk->rk_msgq_tmout.lock);
+        }
+        mtx_unlock(&rk->rk_msgq_tmout.lock);
+}
+
+
 /**
  * Dequeue message from 'rktp' message queue.
  */
 void rd_kafka_toppar_deq_msg (rd_kafka_toppar_t *rktp, rd_kafka_msg_t *rkm) {
 	rd_kafka_toppar_lock(rktp);
+        rd_kafka_toppar_ingress_drain(rktp);
 	rd_kafka_msgq_deq(&rktp->rktp_msgq, rkm, 1);
 	rd_kafka_toppar_unlock(rktp);
 }
@@ -820,7 +1080,14 @@ int rd_kafka_toppar_retry_msgq (rd_kafka_toppar_t *rktp, rd_kafka_msgq_t *rkmq,
  */
 void rd_kafka_toppar_insert_msgq (rd_kafka_toppar_t *rktp,
                                   rd_kafka_msgq_t *rkmq) {
+        rd_kafka_msg_t *rkm;
+
         rd_kafka_toppar_lock(rktp);
+        rd_kafka_toppar_ingress_drain(rktp);
+        if ((rkm = rd_kafka_msgq_oldest(rkmq,
+                                        RD_KAFKA_TOPPAR_MSGQ_IS_LIFO(rktp))))
+                rd_kafka_toppar_msgq_tmout_schedule(rktp,
+                                                    rkm->rkm_ts_timeout);
         rd_kafka_msgq_insert_msgq(&rktp->rktp_msgq, rkmq,
                                   rktp->rktp_rkt->rkt_conf.msg_order_cmp);
         rd_kafka_toppar_unlock(rktp);
@@ -1008,6 +1275,7 @@ void rd_kafka_toppar_broker_delegate (rd_kafka_toppar_t *rktp,
 
 
 	if (rkb) {
+                rd_kafka_toppar_ingress_drain(rktp);
 		rd_kafka_dbg(rktp->rktp_rkt->rkt_rk, TOPIC, "BRKDELGT",
 			     "%.*s [%"PRId32"]: broker %s is now leader "
 			     "for partition with %i messages "
@@ -1754,6 +2022,52 @@ static void rd_kafka_toppar_pause_resume (rd_kafka_toppar_t *rktp,
 
 
 
+/**
+ * @brief Check \p own bytes of a partition against a prefetch memory
+ *        \p budget shared by \p fetch_cnt partitions buffering a
+ *        \p total of bytes.
+ *
+ * Fetching is paused for all partitions while the budget is exceeded.
+ * Once more than half of the budget is in use a partition may only
+ * fetch while below its fair share of the budget, which leaves the
+ * remaining budget to the partitions that have not yet used theirs.
+ *
+ * @returns 0 if the partition may fetch, 1 if the budget is exceeded,
+ *          or 2 if the partition's fair share is exceeded.
+ */
+static RD_INLINE int rd_kafka_fetchq_budget_check (int64_t budget,
+                                                   int64_t total,
+                                                   int32_t fetch_cnt,
+                                                   int64_t own) {
+        if (total >= budget)
+                return 1;
+        if (total >= budget / 2 && own >= budget / RD_MAX(fetch_cnt, 1))
+                return 2;
+        return 0;
+}
+
+/**
+ * @returns the remaining prefetch memory budget of \p rk
+ *          (queued.max.total.kbytes, queued.max.process.kbytes),
+ *          or INT64_MAX if no budget is configured.
+ */
+static int64_t rd_kafka_fetchq_budget_remains (rd_kafka_t *rk) {
+        int64_t remains = INT64_MAX;
+
+        if (rk->rk_conf.queued_max_total_bytes)
+                remains = rk->rk_conf.queued_max_total_bytes -
+                        rd_atomic64_get(&rk->rk_fetchq.bytes);
+
+        if (rk->rk_conf.queued_max_process_bytes)
+                remains = RD_MIN(remains,
+                                 rk->rk_conf.queued_max_process_bytes -
+                                 rd_atomic64_get(&rd_kafka_fetchq_global.
+                                                 bytes));
+
+        return remains;
+}
+
+
 /**
  * @brief Decide whether this toppar should be on the fetch list or not.
  *
@@ -1772,6 +2086,7 @@ rd_ts_t rd_kafka_toppar_fetch_decide (rd_kafka_toppar_t *rktp,
         const char *reason = "";
         int32_t version;
         rd_ts_t ts_backoff = 0;
+        int r = 0;
 
 	rd_kafka_toppar_lock(rktp);
 
@@ -1836,10 +2151,11 @@ rd_ts_t rd_kafka_toppar_fetch_decide (rd_kafka_toppar_t *rktp,
                 should_fetch = 0;
                 reason = "no concrete offset";
 
-        } else if (rd_kafka_q_len(rktp->rktp_fetchq) >=
+        } else if (rd_kafka_q_msgs(rktp->rktp_fetchq) >=
 		   rkb->rkb_rk->rk_conf.queued_min_msgs) {
 		/* Skip toppars who's local message queue is already above
-		 * the lower threshold. */
+		 * the lower threshold.
+		 * The records of RecordBatch views count as messages. */
                 reason = "queued.min.messages exceeded";
                 should_fetch = 0;
 
@@ -1848,12 +2164,41 @@ rd_ts_t rd_kafka_toppar_fetch_decide (rd_kafka_toppar_t *rktp,
                 reason = "queued.max.messages.kbytes exceeded";
                 should_fetch = 0;
 
+        } else if (rkb->rkb_rk->rk_conf.queued_max_total_bytes &&
+                   (r = rd_kafka_fetchq_budget_check(
+                           rkb->rkb_rk->rk_conf.queued_max_total_bytes,
+                           rd_atomic64_get(&rkb->rkb_rk->rk_fetchq.bytes),
+                           rd_atomic32_get(&rkb->rkb_rk->rk_fetchq.fetch_cnt),
+                           rd_atomic64_get(&rktp->rktp_fetchq_bytes)))) {
+                reason = r == 1 ? "queued.max.total.kbytes exceeded" :
+                        "queued.max.total.kbytes fair share exceeded";
+                should_fetch = 0;
+
+        } else if (rkb->rkb_rk->rk_conf.queued_max_process_bytes &&
+                   (r = rd_kafka_fetchq_budget_check(
+                           rkb->rkb_rk->rk_conf.queued_max_process_bytes,
+                           rd_atomic64_get(&rd_kafka_fetchq_global.bytes),
+                           rd_atomic32_get(&rd_kafka_fetchq_global.
+                                           fetch_cnt),
+                           rd_atomic64_get(&rktp->rktp_fetchq_bytes)))) {
+                reason = r == 1 ? "queued.max.process.kbytes exceeded" :
+                        "queued.max.process.kbytes fair share exceeded";
+                should_fetch = 0;
+
         } else if (rktp->rktp_ts_fetch_backoff > rd_clock()) {
                 reason = "fetch backed off";
                 ts_backoff = rktp->rktp_ts_fetch_backoff;
                 should_fetch = 0;
         }
 
+        /* The prefetch memory budget is released by the application
+         * destroying messages, which does not wake up the broker thread:
+         * re-evaluate the partition every fetch.wait.max.ms. */
+        if (r)
+                ts_backoff = rd_clock() +
+                        (rd_ts_t)RD_MAX(rkb->rkb_rk->rk_conf.fetch_wait_max_ms,
+                                        10) * 1000;
+
  done:
         /* Copy offset stats to finalized place holder. */
         rktp->rktp_offsets_fin = rktp->rktp_offsets;
@@ -1892,6 +2237,107 @@ rd_ts_t rd_kafka_toppar_fetch_decide (rd_kafka_toppar_t *rktp,
 }
 
 
+/**
+ * @brief Decide the number of bytes to request for \p rktp in the next
+ *        FetchRequest.
+ *
+ * Without fetch.adaptive.enable this is the partition's
+ * fetch.message.max.bytes, which is increased by the MessageSet reader
+ * if not even a single message fits.
+ *
+ * With fetch.adaptive.enable the size covers the partition's observed
+ * throughput over twice the fetch wait time. If the last response
+ * (nearly) filled the fetch size the throughput was limited by the
+ * fetch size itself and the size is doubled.
+ * The size is rounded up to a power of two, so that small throughput
+ * variations do not change it (which would include the partition in
+ * incremental fetch session requests), and bounded by:
+ *  - the smallest size known to fit a message (lower bound),
+ *  - the remaining space in the partition's fetch queue
+ *    (queued.max.messages.kbytes) and in the prefetch memory budget
+ *    (queued.max.total.kbytes, queued.max.process.kbytes),
+ *  - the FetchRequest's remaining \p budget of fetch.max.bytes.
+ *
+ * @returns the fetch size.
+ *
+ * @locality broker thread
+ */
+int32_t rd_kafka_toppar_fetch_size (rd_kafka_toppar_t *rktp,
+                                    rd_kafka_broker_t *rkb,
+                                    rd_ts_t now, int32_t budget) {
+        const rd_kafka_conf_t *conf = &rkb->rkb_rk->rk_conf;
+        int64_t size, headroom, p2;
+
+        if (!conf->fetch_adaptive_enable)
+                return rktp->rktp_fetch_msg_max_bytes;
+
+        /* The MessageSet reader increased the fetch size since not
+         * even a single message fitted, raise the lower bound. */
+        if (rktp->rktp_fetch_adapt.size &&
+            rktp->rktp_fetch_msg_max_bytes > rktp->rktp_fetch_adapt.size)
+                rktp->rktp_fetch_adapt.min_size =
+                        RD_MAX(rktp->rktp_fetch_adapt.min_size,
+                               rktp->rktp_fetch_msg_max_bytes);
+
+        /* Sample the throughput, increases are picked up immediately
+         * while decreases are smoothed over a couple of samples. */
+        if (!rktp->rktp_fetch_adapt.ts_sample) {
+                rktp->rktp_fetch_adapt.ts_sample = now;
+        } else if (now - rktp->rktp_fetch_adapt.ts_sample >= 100*1000) {
+                int64_t rate = (rktp->rktp_fetch_adapt.bytes * 1000000) /
+                        (now - rktp->rktp_fetch_adapt.ts_sample);
+
+                if (rate > rktp->rktp_fetch_adapt.rate)
+                        rktp->rktp_fetch_adapt.rate = rate;
+                else
+                        rktp->rktp_fetch_adapt.rate =
+                                (rktp->rktp_fetch_adapt.rate * 3 + rate) / 4;
+
+                rktp->rktp_fetch_adapt.bytes = 0;
+                rktp->rktp_fetch_adapt.ts_sample = now;
+        }
+
+        if (!rktp->rktp_fetch_adapt.size) {
+                /* First fetch: nothing is known about the partition yet. */
+                size = conf->fetch_msg_max_bytes;
+        } else {
+                size = (rktp->rktp_fetch_adapt.rate *
+                        RD_MAX(conf->fetch_wait_max_ms, 100) * 2) / 1000;
+
+                if (rktp->rktp_fetch_adapt.last_bytes >=
+                    rktp->rktp_fetch_adapt.size -
+                    rktp->rktp_fetch_adapt.size / 4)
+                        size = RD_MAX(size,
+                                      (int64_t)rktp->rktp_fetch_adapt.size*2);
+        }
+
+        for (p2 = 1024 ; p2 < size ; p2 <<= 1)
+                ;
+        size = p2;
+
+        headroom = RD_MIN(conf->queued_max_msg_bytes -
+                          (int64_t)rd_kafka_q_size(rktp->rktp_fetchq),
+                          rd_kafka_fetchq_budget_remains(rkb->rkb_rk));
+        if (size > headroom)
+                size = headroom;
+        if (size > budget)
+                size = budget;
+        if (size > conf->fetch_max_bytes)
+                size = conf->fetch_max_bytes;
+        if (size < rktp->rktp_fetch_adapt.min_size)
+                size = rktp->rktp_fetch_adapt.min_size;
+
+        rktp->rktp_fetch_adapt.size = (int32_t)size;
+        rktp->rktp_fetch_adapt.last_bytes = 0;
+
+        /* Let the MessageSet reader grow the fetch size from here
+         * if a message does not fit. */
+        rktp->rktp_fetch_msg_max_bytes = (int32_t)size;
+
+        return (int32_t)size;
+}
+
+
 /**
  * @brief Serve a toppar in a consumer broker thread.
  *        This is considered the fast path and should be minimal,
@@ -35,6 +35,17 @@
 extern const char *rd_kafka_fetch_states[];
 
 
+/**
+ * @returns true if \p rktp 's message queues are sorted newest first
+ *          (queuing.strategy=lifo).
+ *          The UA partition queue is always sorted in enqueue order.
+ */
+#define RD_KAFKA_TOPPAR_MSGQ_IS_LIFO(rktp)                              \
+        ((rktp)->rktp_partition != RD_KAFKA_PARTITION_UA &&             \
+         (rktp)->rktp_rkt->rkt_conf.queuing_strategy ==                 \
+         RD_KAFKA_QUEUE_LIFO)
+
+
 /**
  * @brief Offset statistics
  */
@@ -84,13 +95,45 @@ struct rd_kafka_toppar_s { /* rd_kafka_toppar_t */
 	mtx_t              rktp_lock;
 
         //LOCK: toppar_lock. toppar_insert_msg(), concat_msgq()
-        //LOCK: toppar_lock. toppar_enq_msg(), deq_msg(), toppar_retry_msgq()
+        //LOCK: toppar_lock. deq_msg(), toppar_retry_msgq(), ingress_drain()
         int                rktp_msgq_wakeup_fd; /* Wake-up fd */
 	rd_kafka_msgq_t    rktp_msgq;      /* application->rdkafka queue.
 					    * protected by rktp_lock */
+        rd_kafka_msgq_ingress_t rktp_msgq_ingress; /* application->rktp_msgq
+                                                    * lock-free ingress list,
+                                                    * drained into rktp_msgq
+                                                    * by
+                                                    * toppar_ingress_drain()
+                                                    * with rktp_lock held. */
         rd_kafka_msgq_t    rktp_xmit_msgq; /* internal broker xmit queue.
                                             * local to broker thread. */
 
+        //LOCK: rk_msgq_tmout.lock
+        rd_heap_node_t     rktp_msgq_tmout_node; /* rk_msgq_tmout.heap */
+        rd_atomic64_t      rktp_msgq_tmout; /* No message in rktp_msgq
+                                             * or its ingress list times
+                                             * out before this time,
+                                             * or 0 if not in
+                                             * rk_msgq_tmout.heap.
+                                             * Read without lock by
+                                             * toppar_enq_msg(). */
+        shptr_rd_kafka_toppar_t *rktp_s_for_msgq_tmout; /* Shared pointer
+                                                         * for rk_msgq_tmout
+                                                         * heap */
+
+        /* Per-partition ordering of ProduceRequests whose compression
+         * was offloaded to the compression offload pool
+         * (compression.threads): requests are transmitted in
+         * creation (next_seq) order.
+         * Protected by rktp_lock. */
+        struct {
+                int64_t next_seq;  /* Next sequence to assign */
+                int64_t xmit_seq;  /* Next sequence to transmit */
+                struct rd_kafka_op_head_s doneq; /* Finalized requests
+                                                  * waiting for their turn,
+                                                  * sorted by seq. */
+        } rktp_offload;
+
         int                rktp_fetch;     /* On rkb_active_toppars list */
 
 	/* Consumer */
@@ -171,6 +214,27 @@ struct rd_kafka_toppar_s { /* rd_kafka_toppar_t */
                                                       * Locality: broker thread
                                                       */
 
+        /* Adaptive fetch sizing (fetch.adaptive.enable),
+         * see rd_kafka_toppar_fetch_size().
+         * Locality: broker thread */
+        struct {
+                int32_t size;        /* Fetch size of the last request,
+                                      * 0 if not yet fetched. */
+                int32_t min_size;    /* Smallest size known to fit
+                                      * a full message (batch). */
+                int32_t last_bytes;  /* MessageSet bytes received in
+                                      * response to the last request. */
+                int64_t bytes;       /* MessageSet bytes received since
+                                      * ts_sample. */
+                rd_ts_t ts_sample;   /* Start of current rate sample */
+                int64_t rate;        /* Moving average of received
+                                      * bytes per second. */
+        } rktp_fetch_adapt;
+
+        rd_atomic64_t      rktp_fetchq_bytes;  /* Size of fetched messages
+                                                * not yet destroyed,
+                                                * see rk_fetchq. */
+
         rd_ts_t            rktp_ts_fetch_backoff; /* Back off fetcher for
                                                    * this partition until this
                                                    * absolute timestamp
@@ -269,6 +333,17 @@ struct rd_kafka_toppar_s { /* rd_kafka_toppar_t */
                                               *             drops. */
         } rktp_c;
 
+        rd_kafka_stats_bin_obj_t rktp_stats_bin; /**< Binary stats state */
+
+        /* Latency window stats, only enabled for the client type
+         * they apply to. See rd_kafka_toppar_new0(). */
+        rd_avg_t rktp_avg_produce_latency; /**< Producer: message enqueue
+                                            *   to ProduceResponse */
+        rd_avg_t rktp_avg_fetch_latency;   /**< Consumer: FetchRequest to
+                                            *   response with messages */
+        rd_avg_t rktp_avg_fetchq_latency;  /**< Consumer: Fetch response
+                                            *   to application */
+
 };
 
 
@@ -334,6 +409,12 @@ void rd_kafka_toppar_purge_queues (rd_kafka_toppar_t *rktp);
 void rd_kafka_toppar_set_fetch_state (rd_kafka_toppar_t *rktp,
                                       int fetch_state);
 void rd_kafka_toppar_insert_msg (rd_kafka_toppar_t *rktp, rd_kafka_msg_t *rkm);
+int rd_kafka_toppar_ingress_drain (rd_kafka_toppar_t *rktp);
+int rd_kafka_toppar_cmp_msgq_tmout (const void *_a, const void *_b);
+void rd_kafka_toppar_msgq_tmout_schedule (rd_kafka_toppar_t *rktp,
+                                          rd_ts_t abs_timeout);
+int rd_kafka_toppar_msgq_tmout_scan (rd_kafka_t *rk, rd_ts_t now);
+void rd_kafka_toppar_msgq_tmout_clear (rd_kafka_t *rk);
 void rd_kafka_toppar_enq_msg (rd_kafka_toppar_t *rktp, rd_kafka_msg_t *rkm);
 void rd_kafka_toppar_deq_msg (rd_kafka_toppar_t *rktp, rd_kafka_msg_t *rkm);
 int rd_kafka_retry_msgq (rd_kafka_msgq_t *destq,
@@ -412,6 +493,16 @@ rd_ts_t rd_kafka_toppar_fetch_decide (rd_kafka_toppar_t *rktp,
                                       rd_kafka_broker_t *rkb,
                                       int force_remove);
 
+/**
+ * Smallest adaptive fetch size (fetch.adaptive.enable), unless
+ * fetch.message.max.bytes is lower.
+ */
+#define RD_KAFKA_FETCH_ADAPT_SIZE_MIN (64 * 1024)
+
+int32_t rd_kafka_toppar_fetch_size (rd_kafka_toppar_t *rktp,
+                                    rd_kafka_broker_t *rkb,
+                                    rd_ts_t now, int32_t budget);
+
 
 
 rd_ts_t rd_kafka_broker_consumer_toppar_serve (rd_kafka_broker_t *rkb,
@@ -555,6 +646,10 @@ int rd_kafka_topic_partition_list_regex_cnt (
 struct rd_kafka_toppar_ver {
 	shptr_rd_kafka_toppar_t *s_rktp;
 	int32_t version;
+        int     fetch_flags;   /**< FetchRequest partition flags */
+#define RD_KAFKA_TOPPAR_VER_F_SENT      0x1 /**< Included in an incremental
+                                             *   FetchRequest */
+#define RD_KAFKA_TOPPAR_VER_F_RESPONDED 0x2 /**< Present in FetchResponse */
 };
 
 
@@ -30,6 +30,7 @@
 #include "rdkafka_offset.h"
 #include "rdkafka_topic.h"
 #include "rdkafka_interceptor.h"
+#include "rdunittest.h"
 
 int RD_TLS rd_kafka_yield_thread = 0;
 
@@ -78,6 +79,8 @@ void rd_kafka_q_init (rd_kafka_q_t *rkq, rd_kafka_t *rk) {
 	rkq->rkq_qio    = NULL;
         rkq->rkq_serve  = NULL;
         rkq->rkq_opaque = NULL;
+        rd_atomicptr_init(&rkq->rkq_ingress, RD_KAFKA_Q_INGRESS_CLOSED);
+        rd_atomic32_init(&rkq->rkq_waiters, 0);
 	mtx_init(&rkq->rkq_lock, mtx_plain);
 	cnd_init(&rkq->rkq_cond);
 }
@@ -98,6 +101,73 @@ rd_kafka_q_t *rd_kafka_q_new0 (rd_kafka_t *rk, const char *func, int line) {
         return rkq;
 }
 
+/**
+ * @brief Enable lock-free enqueues (rd_kafka_q_enq()) on \p rkq.
+ *
+ * Producers push ops on an intrusive lock-free list which the
+ * consumer moves to the queue proper, under the queue lock, the next
+ * time it serves or inspects the queue.
+ * This is mainly useful for queues with many producer threads and
+ * a single consumer, such as the broker and main (reply) queues.
+ *
+ * Lock-free enqueues are suspended while the queue is forwarded.
+ */
+void rd_kafka_q_lockfree_enable (rd_kafka_q_t *rkq) {
+        mtx_lock(&rkq->rkq_lock);
+        rkq->rkq_flags |= RD_KAFKA_Q_F_LOCKFREE;
+        if ((rkq->rkq_flags & RD_KAFKA_Q_F_READY) && !rkq->rkq_fwdq)
+                rd_atomicptr_exchange(&rkq->rkq_ingress, NULL);
+        mtx_unlock(&rkq->rkq_lock);
+}
+
+
+/**
+ * @brief Close the lock-free ingress list of \p rkq, moving any ops
+ *        on it to rkq_q, so that subsequent rd_kafka_q_enq()s use
+ *        the locked path.
+ *
+ * @locks rkq_lock MUST be held
+ */
+void rd_kafka_q_ingress_close0 (rd_kafka_q_t *rkq) {
+        rd_kafka_op_t *rko;
+
+        rko = rd_atomicptr_exchange(&rkq->rkq_ingress,
+                                    RD_KAFKA_Q_INGRESS_CLOSED);
+        if (rko != RD_KAFKA_Q_INGRESS_CLOSED)
+                rd_kafka_q_ingress_move0(rkq, rko);
+}
+
+
+/**
+ * @brief Wait up to \p timeout_ms for ops to be enqueued on \p rkq,
+ *        which had no ops when last checked by the caller.
+ *
+ * @returns thrd_success if woken up (or if ops were enqueued lock-free
+ *          since the caller checked), thrd_timedout on timeout,
+ *          else thrd_error.
+ *
+ * @locks rkq_lock MUST be held
+ */
+static int rd_kafka_q_wait0 (rd_kafka_q_t *rkq, int timeout_ms) {
+        int r;
+
+        /* Register as waiter prior to checking the ingress list,
+         * see rd_kafka_q_ingress_push(). */
+        rd_atomic32_add(&rkq->rkq_waiters, 1);
+        rd_kafka_q_ingress_drain0(rkq);
+
+        if (!TAILQ_EMPTY(&rkq->rkq_q))
+                r = thrd_success;
+        else
+                r = cnd_timedwait_ms(&rkq->rkq_cond, &rkq->rkq_lock,
+                                     timeout_ms);
+
+        rd_atomic32_sub(&rkq->rkq_waiters, 1);
+
+        return r;
+}
+
+
 /**
  * Set/clear forward queue.
  * Queue forwarding enables message routing inside rdkafka.
@@ -120,6 +190,9 @@ void rd_kafka_q_fwd_set0 (rd_kafka_q_t *srcq, rd_kafka_q_t *destq,
 	if (destq) {
 		rd_kafka_q_keep(destq);
 
+                /* Enqueuers must look up the forward queue */
+                rd_kafka_q_ingress_close0(srcq);
+
 		/* If rkq has ops in queue, append them to fwdq's queue.
 		 * This is an irreversible operation. */
                 if (srcq->rkq_qlen > 0) {
@@ -128,7 +201,11 @@ void rd_kafka_q_fwd_set0 (rd_kafka_q_t *srcq, rd_kafka_q_t *destq,
 		}
 
 		srcq->rkq_fwdq = destq;
-	}
+	} else if ((srcq->rkq_flags &
+                    (RD_KAFKA_Q_F_LOCKFREE|RD_KAFKA_Q_F_READY)) ==
+                   (RD_KAFKA_Q_F_LOCKFREE|RD_KAFKA_Q_F_READY))
+                rd_atomicptr_cas(&srcq->rkq_ingress,
+                                 RD_KAFKA_Q_INGRESS_CLOSED, NULL);
         if (do_lock)
                 mtx_unlock(&srcq->rkq_lock);
 }
@@ -153,6 +230,8 @@ int rd_kafka_q_purge0 (rd_kafka_q_t *rkq, int do_lock) {
                 return cnt;
         }
 
+        rd_kafka_q_ingress_drain0(rkq);
+
 	/* Move ops queue to tmpq to avoid lock-order issue
 	 * by locks taken from rd_kafka_op_destroy(). */
 	TAILQ_MOVE(&tmpq, &rkq->rkq_q, rko_link);
@@ -186,6 +265,7 @@ void rd_kafka_q_purge_toppar_version (rd_kafka_q_t *rkq,
 	TAILQ_HEAD(, rd_kafka_op_s) tmpq = TAILQ_HEAD_INITIALIZER(tmpq);
         int32_t cnt = 0;
         int64_t size = 0;
+        int32_t msgs = 0;
         rd_kafka_q_t *fwdq;
 
 	mtx_lock(&rkq->rkq_lock);
@@ -197,6 +277,8 @@ void rd_kafka_q_purge_toppar_version (rd_kafka_q_t *rkq,
                 return;
         }
 
+        rd_kafka_q_ingress_drain0(rkq);
+
         /* Move ops to temporary queue and then destroy them from there
          * without locks to avoid lock-ordering problems in op_destroy() */
         while ((rko = TAILQ_FIRST(&rkq->rkq_q)) && rko->rko_rktp &&
@@ -206,11 +288,13 @@ void rd_kafka_q_purge_toppar_version (rd_kafka_q_t *rkq,
                 TAILQ_INSERT_TAIL(&tmpq, rko, rko_link);
                 cnt++;
                 size += rko->rko_len;
+                msgs += rd_kafka_op_qmsgs(rko);
         }
 
 
         rkq->rkq_qlen -= cnt;
         rkq->rkq_qsize -= size;
+        rkq->rkq_qmsgs -= msgs;
 	mtx_unlock(&rkq->rkq_lock);
 
 	next = TAILQ_FIRST(&tmpq);
@@ -237,8 +321,11 @@ int rd_kafka_q_move_cnt (rd_kafka_q_t *dstq, rd_kafka_q_t *srcq,
 	}
 
 	if (!dstq->rkq_fwdq && !srcq->rkq_fwdq) {
+                rd_kafka_q_ingress_drain0(srcq);
+                rd_kafka_q_ingress_drain0(dstq);
+
 		if (cnt > 0 && dstq->rkq_qlen == 0)
-			rd_kafka_q_io_event(dstq);
+			rd_kafka_q_wakeup0(dstq);
 
 		/* Optimization, if 'cnt' is equal/larger than all
 		 * items of 'srcq' we can move the entire queue. */
@@ -263,6 +350,8 @@ int rd_kafka_q_move_cnt (rd_kafka_q_t *dstq, rd_kafka_q_t *srcq,
                                 dstq->rkq_qlen++;
                                 srcq->rkq_qsize -= rko->rko_len;
                                 dstq->rkq_qsize += rko->rko_len;
+                                srcq->rkq_qmsgs -= rd_kafka_op_qmsgs(rko);
+                                dstq->rkq_qmsgs += rd_kafka_op_qmsgs(rko);
 				mcnt++;
 			}
 		}
@@ -311,15 +400,19 @@ static RD_INLINE rd_kafka_op_t *rd_kafka_op_filter (rd_kafka_q_t *rkq,
  * Serve q like rd_kafka_q_serve() until an op is found that can be returned
  * as an event to the application.
  *
+ * @param whole_batch if true RecordBatch views (RD_KAFKA_OP_FETCH_BATCH)
+ *                    are returned as is rather than one materialized
+ *                    message at a time.
+ *
  * @returns the first event:able op, or NULL on timeout.
  *
  * Locality: any thread
  */
-rd_kafka_op_t *rd_kafka_q_pop_serve (rd_kafka_q_t *rkq, int timeout_ms,
-                                     int32_t version,
-                                     rd_kafka_q_cb_type_t cb_type,
-                                     rd_kafka_q_serve_cb_t *callback,
-                                     void *opaque) {
+static rd_kafka_op_t *rd_kafka_q_pop_serve0 (rd_kafka_q_t *rkq, int timeout_ms,
+                                             int32_t version,
+                                             rd_kafka_q_cb_type_t cb_type,
+                                             rd_kafka_q_serve_cb_t *callback,
+                                             void *opaque, int whole_batch) {
 	rd_kafka_op_t *rko;
         rd_kafka_q_t *fwdq;
 
@@ -338,13 +431,17 @@ rd_kafka_op_t *rd_kafka_q_pop_serve (rd_kafka_q_t *rkq, int timeout_ms,
 
                         /* Filter out outdated ops */
                 retry:
+                        rd_kafka_q_ingress_drain0(rkq);
                         while ((rko = TAILQ_FIRST(&rkq->rkq_q)) &&
                                !(rko = rd_kafka_op_filter(rkq, rko, version)))
                                 ;
 
                         if (rko) {
                                 /* Proper versioned op */
-                                rd_kafka_q_deq0(rkq, rko);
+                                if (whole_batch)
+                                        rd_kafka_q_deq0(rkq, rko);
+                                else
+                                        rko = rd_kafka_q_deq_msg0(rkq, rko);
 
                                 /* Ops with callbacks are considered handled
                                  * and we move on to the next op, if any.
@@ -368,9 +465,7 @@ rd_kafka_op_t *rd_kafka_q_pop_serve (rd_kafka_q_t *rkq, int timeout_ms,
                                 break;
 
 			pre = rd_clock();
-			if (cnd_timedwait_ms(&rkq->rkq_cond,
-					     &rkq->rkq_lock,
-					     timeout_ms) ==
+			if (rd_kafka_q_wait0(rkq, timeout_ms) ==
 			    thrd_timedout) {
 				mtx_unlock(&rkq->rkq_lock);
 				return NULL;
@@ -388,8 +483,9 @@ rd_kafka_op_t *rd_kafka_q_pop_serve (rd_kafka_q_t *rkq, int timeout_ms,
                 /* Since the q_pop may block we need to release the parent
                  * queue's lock. */
                 mtx_unlock(&rkq->rkq_lock);
-		rko = rd_kafka_q_pop_serve(fwdq, timeout_ms, version,
-					   cb_type, callback, opaque);
+		rko = rd_kafka_q_pop_serve0(fwdq, timeout_ms, version,
+                                            cb_type, callback, opaque,
+                                            whole_batch);
                 rd_kafka_q_destroy(fwdq);
         }
 
@@ -397,6 +493,15 @@ rd_kafka_op_t *rd_kafka_q_pop_serve (rd_kafka_q_t *rkq, int timeout_ms,
 	return rko;
 }
 
+rd_kafka_op_t *rd_kafka_q_pop_serve (rd_kafka_q_t *rkq, int timeout_ms,
+                                     int32_t version,
+                                     rd_kafka_q_cb_type_t cb_type,
+                                     rd_kafka_q_serve_cb_t *callback,
+                                     void *opaque) {
+        return rd_kafka_q_pop_serve0(rkq, timeout_ms, version,
+                                     cb_type, callback, opaque, 0);
+}
+
 rd_kafka_op_t *rd_kafka_q_pop (rd_kafka_q_t *rkq, int timeout_ms,
                                int32_t version) {
 	return rd_kafka_q_pop_serve(rkq, timeout_ms, version,
@@ -404,6 +509,16 @@ rd_kafka_op_t *rd_kafka_q_pop (rd_kafka_q_t *rkq, int timeout_ms,
                                     NULL, NULL);
 }
 
+/**
+ * @brief Like rd_kafka_q_pop() but RecordBatch views are returned whole.
+ */
+rd_kafka_op_t *rd_kafka_q_pop_batch (rd_kafka_q_t *rkq, int timeout_ms,
+                                     int32_t version) {
+        return rd_kafka_q_pop_serve0(rkq, timeout_ms, version,
+                                     RD_KAFKA_Q_CB_RETURN,
+                                     NULL, NULL, 1);
+}
+
 
 /**
  * Pop all available ops from a queue and call the provided 
@@ -443,12 +558,12 @@ int rd_kafka_q_serve (rd_kafka_q_t *rkq, int timeout_ms,
 		timeout_ms = INT_MAX;
 
 	/* Wait for op */
+        rd_kafka_q_ingress_drain0(rkq);
 	while (!(rko = TAILQ_FIRST(&rkq->rkq_q)) && timeout_ms != 0) {
-		if (cnd_timedwait_ms(&rkq->rkq_cond,
-				     &rkq->rkq_lock,
-				     timeout_ms) != thrd_success)
+		if (rd_kafka_q_wait0(rkq, timeout_ms) != thrd_success)
 			break;
 
+                rd_kafka_q_ingress_drain0(rkq);
 		timeout_ms = 0;
 	}
 
@@ -470,7 +585,7 @@ int rd_kafka_q_serve (rd_kafka_q_t *rkq, int timeout_ms,
         while ((rko = TAILQ_FIRST(&localq.rkq_q))) {
                 rd_kafka_op_res_t res;
 
-                rd_kafka_q_deq0(&localq, rko);
+                rko = rd_kafka_q_deq_msg0(&localq, rko);
                 res = rd_kafka_op_handle(rk, &localq, rko, cb_type,
                                          opaque, callback);
                 /* op must have been handled */
@@ -502,6 +617,10 @@ int rd_kafka_q_serve (rd_kafka_q_t *rkq, int timeout_ms,
  * If 'auto_commit' is set, each message's offset will be committed
  * to the offset store for that toppar.
  *
+ * Up to the remaining number of messages are moved from 'rkq' to a local
+ * queue at a time under a single lock, rather than locking 'rkq' for
+ * each message. Ops not served are put back at the head of 'rkq'.
+ *
  * Returns the number of messages added.
  */
 
@@ -513,6 +632,7 @@ int rd_kafka_q_serve_rkmessages (rd_kafka_q_t *rkq, int timeout_ms,
         rd_kafka_op_t *rko, *next;
         rd_kafka_t *rk = rkq->rkq_rk;
         rd_kafka_q_t *fwdq;
+        rd_kafka_q_t localq;
 
 	mtx_lock(&rkq->rkq_lock);
         if ((fwdq = rd_kafka_q_fwd_get(rkq, 0))) {
@@ -526,26 +646,38 @@ int rd_kafka_q_serve_rkmessages (rd_kafka_q_t *rkq, int timeout_ms,
 	}
         mtx_unlock(&rkq->rkq_lock);
 
+        rd_kafka_q_init(&localq, rk);
+
         rd_kafka_yield_thread = 0;
 	while (cnt < rkmessages_size) {
                 rd_kafka_op_res_t res;
 
-                mtx_lock(&rkq->rkq_lock);
+                if (!(rko = TAILQ_FIRST(&localq.rkq_q))) {
+                        mtx_lock(&rkq->rkq_lock);
 
-		while (!(rko = TAILQ_FIRST(&rkq->rkq_q))) {
-			if (cnd_timedwait_ms(&rkq->rkq_cond, &rkq->rkq_lock,
-                                             timeout_ms) == thrd_timedout)
-				break;
-		}
+                        rd_kafka_q_ingress_drain0(rkq);
+                        while (!(rko = TAILQ_FIRST(&rkq->rkq_q))) {
+                                if (rd_kafka_q_wait0(rkq, timeout_ms) ==
+                                    thrd_timedout)
+                                        break;
+                                rd_kafka_q_ingress_drain0(rkq);
+                        }
+
+                        if (!rko) {
+                                mtx_unlock(&rkq->rkq_lock);
+                                break; /* Timed out */
+                        }
+
+                        rd_kafka_q_move_cnt(&localq, rkq,
+                                            (int)(rkmessages_size - cnt),
+                                            0/*no-locks*/);
 
-		if (!rko) {
                         mtx_unlock(&rkq->rkq_lock);
-			break; /* Timed out */
-                }
 
-		rd_kafka_q_deq0(rkq, rko);
+                        rko = TAILQ_FIRST(&localq.rkq_q);
+                }
 
-                mtx_unlock(&rkq->rkq_lock);
+		rko = rd_kafka_q_deq_msg0(&localq, rko);
 
 		if (rd_kafka_op_version_outdated(rko, 0)) {
                         /* Outdated op, put on discard queue */
@@ -580,10 +712,17 @@ int rd_kafka_q_serve_rkmessages (rd_kafka_q_t *rkq, int timeout_ms,
 			rd_kafka_toppar_unlock(rktp);
                 }
 
+                rd_kafka_op_fetchq_latency_add(rko);
+
 		/* Get rkmessage from rko and append to array. */
 		rkmessages[cnt++] = rd_kafka_message_get(rko);
 	}
 
+        /* Put back ops that were not served, in their original order. */
+        if (!TAILQ_EMPTY(&localq.rkq_q))
+                rd_kafka_q_prepend(rkq, &localq);
+        rd_kafka_q_destroy_owner(&localq);
+
         /* Discard non-desired and already handled ops */
         next = TAILQ_FIRST(&tmpq);
         while (next) {
@@ -706,10 +845,12 @@ void rd_kafka_q_io_event_enable (rd_kafka_q_t *rkq, int fd,
         if (rkq->rkq_qio) {
                 rd_free(rkq->rkq_qio);
                 rkq->rkq_qio = NULL;
+                rd_atomic32_sub(&rkq->rkq_waiters, 1);
         }
 
         if (fd != -1) {
                 rkq->rkq_qio = qio;
+                rd_atomic32_add(&rkq->rkq_waiters, 1);
         }
 
         mtx_unlock(&rkq->rkq_lock);
@@ -768,6 +909,8 @@ int rd_kafka_q_apply (rd_kafka_q_t *rkq,
 		return cnt;
 	}
 
+        rd_kafka_q_ingress_drain0(rkq);
+
 	next = TAILQ_FIRST(&rkq->rkq_q);
 	while ((rko = next)) {
 		next = TAILQ_NEXT(next, rko_link);
@@ -817,6 +960,7 @@ void rd_kafka_q_fix_offsets (rd_kafka_q_t *rkq, int64_t min_offset,
 
 	rkq->rkq_qlen  -= adj_len;
 	rkq->rkq_qsize -= adj_size;
+	rkq->rkq_qmsgs -= adj_len; /* Only FETCH ops are purged */
 }
 
 
@@ -825,6 +969,7 @@ void rd_kafka_q_fix_offsets (rd_kafka_q_t *rkq, int64_t min_offset,
  */
 void rd_kafka_q_dump (FILE *fp, rd_kafka_q_t *rkq) {
         mtx_lock(&rkq->rkq_lock);
+        rd_kafka_q_ingress_drain0(rkq);
         fprintf(fp, "Queue %p \"%s\" (refcnt %d, flags 0x%x, %d ops, "
                 "%"PRId64" bytes)\n",
                 rkq, rkq->rkq_name, rkq->rkq_refcnt, rkq->rkq_flags,
@@ -864,3 +1009,170 @@ void rd_kafka_q_dump (FILE *fp, rd_kafka_q_t *rkq) {
 
         mtx_unlock(&rkq->rkq_lock);
 }
+
+
+
+/**
+ * @name Unit tests
+ *
+ */
+
+#define UT_Q_THREADS 4
+#define UT_Q_OPS     50000
+
+struct ut_q_producer {
+        rd_kafka_q_t *rkq;
+        int id;
+};
+
+static int ut_q_producer_main (void *arg) {
+        struct ut_q_producer *up = arg;
+        int i;
+
+        for (i = 0 ; i < UT_Q_OPS ; i++) {
+                rd_kafka_op_t *rko = rd_kafka_op_new(RD_KAFKA_OP_ERR);
+                rko->rko_err = (rd_kafka_resp_err_t)up->id;
+                rko->rko_u.err.offset = i;
+                rd_kafka_q_enq(up->rkq, rko);
+        }
+
+        return 0;
+}
+
+/**
+ * @brief Multiple producer threads enqueuing on \p rkq while the
+ *        consumer pops (waiting when the queue is empty), verifying that
+ *        each producer's ops are popped in order and that none are lost.
+ * @returns the number of failures.
+ */
+static int ut_q_mpsc (const char *what, rd_kafka_q_t *rkq) {
+        struct ut_q_producer up[UT_Q_THREADS];
+        thrd_t thrds[UT_Q_THREADS];
+        int64_t next_offset[UT_Q_THREADS] = { 0 };
+        int cnt = 0, fails = 0;
+        rd_ts_t ts_start;
+        int i;
+
+        ts_start = rd_clock();
+        for (i = 0 ; i < UT_Q_THREADS ; i++) {
+                up[i].rkq = rkq;
+                up[i].id  = i;
+                RD_UT_ASSERT(thrd_create(&thrds[i], ut_q_producer_main,
+                                         &up[i]) == thrd_success,
+                             "thrd_create failed");
+        }
+
+        while (cnt < UT_Q_THREADS * UT_Q_OPS) {
+                rd_kafka_op_t *rko;
+                int id;
+
+                rko = rd_kafka_q_pop(rkq, 5000, 0);
+                RD_UT_ASSERT(rko, "%s: timed out after %d ops", what, cnt);
+
+                id = (int)rko->rko_err;
+                if (rko->rko_u.err.offset != next_offset[id] &&
+                    fails++ < 5)
+                        RD_UT_SAY("%s: producer %d: expected op %"PRId64", "
+                                  "not %"PRId64, what, id, next_offset[id],
+                                  rko->rko_u.err.offset);
+                next_offset[id] = rko->rko_u.err.offset + 1;
+                rd_kafka_op_destroy(rko);
+                cnt++;
+        }
+
+        for (i = 0 ; i < UT_Q_THREADS ; i++)
+                thrd_join(thrds[i], NULL);
+
+        RD_UT_ASSERT(rd_kafka_q_len(rkq) == 0,
+                     "%s: expected empty queue, not %d ops",
+                     what, rd_kafka_q_len(rkq));
+        RD_UT_ASSERT(!fails, "%s: %d op(s) out of order", what, fails);
+
+        RD_UT_SAY("%s: %d ops from %d threads in %.3fms",
+                  what, cnt, UT_Q_THREADS,
+                  (float)(rd_clock() - ts_start) / 1000.0f);
+
+        return 0;
+}
+
+
+/**
+ * @brief Verify that lock-free enqueued ops honour priorities and
+ *        are moved to the forward queue, in order, when the queue is
+ *        forwarded.
+ */
+static int ut_q_lockfree_prio_fwd (void) {
+        rd_kafka_q_t *rkq, *fwdq;
+        rd_kafka_op_t *rko;
+        int i;
+        const int exp[] = { 3, 0, 1, 2, 4, 5 };
+
+        rkq = rd_kafka_q_new(NULL);
+        fwdq = rd_kafka_q_new(NULL);
+        rd_kafka_q_lockfree_enable(rkq);
+
+        for (i = 0 ; i < 5 ; i++) {
+                rko = rd_kafka_op_new(RD_KAFKA_OP_ERR);
+                rko->rko_u.err.offset = i;
+                if (i == 3)
+                        rko->rko_prio = RD_KAFKA_PRIO_HIGH;
+                rd_kafka_q_enq(rkq, rko);
+                if (i == 3)
+                        /* Forward with ops still on the ingress list */
+                        rd_kafka_q_fwd_set(rkq, fwdq);
+        }
+
+        RD_UT_ASSERT(rd_atomicptr_get(&rkq->rkq_ingress) ==
+                     RD_KAFKA_Q_INGRESS_CLOSED,
+                     "ingress list should be closed when forwarded");
+
+        rd_kafka_q_fwd_set(rkq, NULL);
+        RD_UT_ASSERT(rd_atomicptr_get(&rkq->rkq_ingress) !=
+                     RD_KAFKA_Q_INGRESS_CLOSED,
+                     "ingress list should be reopened when unforwarded");
+
+        rko = rd_kafka_op_new(RD_KAFKA_OP_ERR);
+        rko->rko_u.err.offset = 5;
+        rd_kafka_q_enq(rkq, rko);
+        RD_UT_ASSERT(rd_kafka_q_len(rkq) == 1,
+                     "expected 1 op on unforwarded queue, not %d",
+                     rd_kafka_q_len(rkq));
+        rd_kafka_q_concat(fwdq, rkq);
+
+        for (i = 0 ; i < (int)RD_ARRAYSIZE(exp) ; i++) {
+                rko = rd_kafka_q_pop(fwdq, RD_POLL_NOWAIT, 0);
+                RD_UT_ASSERT(rko, "expected op #%d", i);
+                RD_UT_ASSERT(rko->rko_u.err.offset == exp[i],
+                             "op #%d: expected %d, not %"PRId64,
+                             i, exp[i], rko->rko_u.err.offset);
+                rd_kafka_op_destroy(rko);
+        }
+
+        /* Ops left on the ingress list are purged on destroy */
+        rko = rd_kafka_op_new(RD_KAFKA_OP_ERR);
+        rd_kafka_q_enq(rkq, rko);
+
+        rd_kafka_q_destroy_owner(rkq);
+        rd_kafka_q_destroy_owner(fwdq);
+
+        RD_UT_PASS();
+}
+
+
+int unittest_queue (void) {
+        rd_kafka_q_t *rkq;
+        int fails = 0;
+
+        rkq = rd_kafka_q_new(NULL);
+        fails += ut_q_mpsc("locked", rkq);
+        rd_kafka_q_destroy_owner(rkq);
+
+        rkq = rd_kafka_q_new(NULL);
+        rd_kafka_q_lockfree_enable(rkq);
+        fails += ut_q_mpsc("lock-free", rkq);
+        rd_kafka_q_destroy_owner(rkq);
+
+        fails += ut_q_lockfree_prio_fwd();
+
+        return fails;
+}
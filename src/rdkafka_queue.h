@@ -52,6 +52,8 @@ struct rd_kafka_q_s {
 	struct rd_kafka_op_tailq rkq_q;  /* TAILQ_HEAD(, rd_kafka_op_s) */
 	int           rkq_qlen;      /* Number of entries in queue */
         int64_t       rkq_qsize;     /* Size of all entries in queue */
+        int           rkq_qmsgs;     /* Number of messages in queue,
+                                      * see rd_kafka_op_qmsgs() */
         int           rkq_refcnt;
         int           rkq_flags;
 #define RD_KAFKA_Q_F_ALLOCATED  0x1  /* Allocated: rd_free on destroy */
@@ -59,6 +61,22 @@ struct rd_kafka_q_s {
                                       * Flag is cleared on destroy */
 #define RD_KAFKA_Q_F_FWD_APP    0x4  /* Queue is being forwarded by a call
                                       * to rd_kafka_queue_forward. */
+#define RD_KAFKA_Q_F_LOCKFREE   0x8  /* Lock-free enqueue (rkq_ingress)
+                                      * is enabled for this queue. */
+
+        /* Lock-free multi-producer ingress list of ops enqueued with
+         * rd_kafka_q_enq() that are yet to be moved to rkq_q
+         * by the consumer, newest first and linked through
+         * rko_link.tqe_next.
+         * Set to RD_KAFKA_Q_INGRESS_CLOSED when the queue is not
+         * lock-free, forwarded or disabled, in which case
+         * rd_kafka_q_enq() falls back to the locked path. */
+        rd_atomicptr_t rkq_ingress;
+        rd_atomic32_t  rkq_waiters;   /* Number of threads waiting on
+                                       * rkq_cond, plus one if rkq_qio
+                                       * is set: lock-free enqueuers
+                                       * only wake up the queue if
+                                       * there is anyone to wake up. */
 
         rd_kafka_t   *rkq_rk;
 	struct rd_kafka_q_io *rkq_qio;   /* FD-based application signalling */
@@ -78,6 +96,10 @@ struct rd_kafka_q_s {
 };
 
 
+/** @brief rkq_ingress value of queues not accepting lock-free enqueues */
+#define RD_KAFKA_Q_INGRESS_CLOSED  ((void *)1)
+
+
 /* FD-based application signalling state holder. */
 struct rd_kafka_q_io {
 	int    fd;
@@ -103,6 +125,7 @@ void rd_kafka_q_init (rd_kafka_q_t *rkq, rd_kafka_t *rk);
 rd_kafka_q_t *rd_kafka_q_new0 (rd_kafka_t *rk, const char *func, int line);
 #define rd_kafka_q_new(rk) rd_kafka_q_new0(rk,__FUNCTION__,__LINE__)
 void rd_kafka_q_destroy_final (rd_kafka_q_t *rkq);
+void rd_kafka_q_lockfree_enable (rd_kafka_q_t *rkq);
 
 #define rd_kafka_q_lock(rkqu) mtx_lock(&(rkqu)->rkq_lock)
 #define rd_kafka_q_unlock(rkqu) mtx_unlock(&(rkqu)->rkq_lock)
@@ -146,6 +169,8 @@ const char *rd_kafka_q_dest_name (rd_kafka_q_t *rkq) {
 	return ret;
 }
 
+void rd_kafka_q_ingress_close0 (rd_kafka_q_t *rkq);
+
 /**
  * @brief Disable a queue.
  *        Attempting to enqueue ops to the queue will destroy the ops.
@@ -155,6 +180,7 @@ void rd_kafka_q_disable0 (rd_kafka_q_t *rkq, int do_lock) {
         if (do_lock)
                 mtx_lock(&rkq->rkq_lock);
         rkq->rkq_flags &= ~RD_KAFKA_Q_F_READY;
+        rd_kafka_q_ingress_close0(rkq);
         if (do_lock)
                 mtx_unlock(&rkq->rkq_lock);
 }
@@ -222,6 +248,19 @@ void rd_kafka_q_reset (rd_kafka_q_t *rkq) {
         rd_dassert(TAILQ_EMPTY(&rkq->rkq_q));
         rkq->rkq_qlen = 0;
         rkq->rkq_qsize = 0;
+        rkq->rkq_qmsgs = 0;
+}
+
+/**
+ * @returns the number of messages \p rko counts for in a queue:
+ *          the records not yet materialized for a RecordBatch view,
+ *          else 1.
+ */
+static RD_INLINE RD_UNUSED int rd_kafka_op_qmsgs (const rd_kafka_op_t *rko) {
+        if (unlikely(rko->rko_type == RD_KAFKA_OP_FETCH_BATCH))
+                return rko->rko_u.fetch_batch.cnt -
+                        rko->rko_u.fetch_batch.next;
+        return 1;
 }
 
 
@@ -296,6 +335,7 @@ void rd_kafka_q_io_event (rd_kafka_q_t *rkq) {
 		/* FIXME: Log this, somehow */
 		rd_free(rkq->rkq_qio);
 		rkq->rkq_qio = NULL;
+                rd_atomic32_sub(&rkq->rkq_waiters, 1);
 	}
 }
 
@@ -328,6 +368,111 @@ rd_kafka_q_enq0 (rd_kafka_q_t *rkq, rd_kafka_op_t *rko, int at_head) {
                             rko_link, rd_kafka_op_cmp_prio);
     rkq->rkq_qlen++;
     rkq->rkq_qsize += rko->rko_len;
+    rkq->rkq_qmsgs += rd_kafka_op_qmsgs(rko);
+}
+
+
+/**
+ * @brief Wake up any threads waiting for ops on \p rkq and trigger its
+ *        IO event, if any.
+ *
+ * Must only be called when the queue goes from empty to non-empty:
+ * threads only wait on an empty queue, so signalling for every
+ * additional op would only cost futex calls without waking anyone.
+ * All waiters are woken since each of them may find ops to serve
+ * by the time it runs.
+ *
+ * @locks rkq_lock MUST be held
+ */
+static RD_INLINE RD_UNUSED
+void rd_kafka_q_wakeup0 (rd_kafka_q_t *rkq) {
+        cnd_broadcast(&rkq->rkq_cond);
+        rd_kafka_q_io_event(rkq);
+}
+
+
+/**
+ * @brief Move the ops of the ingress list \p rko (newest first) to the
+ *        tail of rkq_q in the order they were enqueued.
+ *
+ * @locks rkq_lock MUST be held
+ */
+static RD_INLINE RD_UNUSED
+void rd_kafka_q_ingress_move0 (rd_kafka_q_t *rkq, rd_kafka_op_t *rko) {
+        rd_kafka_op_t *next, *prev = NULL;
+
+        /* Reverse newest-first list to enqueue order */
+        while (rko) {
+                next = TAILQ_NEXT(rko, rko_link);
+                TAILQ_NEXT(rko, rko_link) = prev;
+                prev = rko;
+                rko = next;
+        }
+
+        for (rko = prev ; rko ; rko = next) {
+                next = TAILQ_NEXT(rko, rko_link);
+                rd_kafka_q_enq0(rkq, rko, 0);
+        }
+}
+
+/**
+ * @brief Move all ops enqueued lock-free on \p rkq to rkq_q.
+ *
+ * Must be called by consumer-side operations prior to looking at
+ * rkq_q, rkq_qlen, rkq_qsize or rkq_qmsgs.
+ *
+ * @locks rkq_lock MUST be held
+ */
+static RD_INLINE RD_UNUSED
+void rd_kafka_q_ingress_drain0 (rd_kafka_q_t *rkq) {
+        rd_kafka_op_t *rko = rd_atomicptr_get(&rkq->rkq_ingress);
+
+        /* Cheap non-swapping check for the common empty
+         * and non-lock-free cases. */
+        if (likely(!rko || rko == RD_KAFKA_Q_INGRESS_CLOSED))
+                return;
+
+        /* Producers never change a non-closed list to closed,
+         * so the list is still open. */
+        rd_kafka_q_ingress_move0(
+                rkq, rd_atomicptr_exchange(&rkq->rkq_ingress, NULL));
+}
+
+/**
+ * @brief Push \p rko on the lock-free ingress list of \p rkq.
+ *
+ * If the list was empty and a consumer is waiting (or IO events are
+ * enabled) the consumer is woken up, this is the only time the producer
+ * acquires the queue lock. Wakeups are not lost since a consumer
+ * registers in rkq_waiters, and then drains the entire list, before
+ * waiting on rkq_cond (see rd_kafka_q_wait0()): a producer finding the
+ * list empty will either see the waiter, and can't acquire rkq_lock
+ * until the consumer is waiting, or its op was drained by the consumer.
+ *
+ * @returns 1 if the op was enqueued, or 0 if the ingress list is closed
+ *          in which case the caller must use the locked path.
+ *
+ * @locality any thread
+ * @locks none
+ */
+static RD_INLINE RD_UNUSED
+int rd_kafka_q_ingress_push (rd_kafka_q_t *rkq, rd_kafka_op_t *rko) {
+        rd_kafka_op_t *head;
+
+        do {
+                head = rd_atomicptr_get(&rkq->rkq_ingress);
+                if (head == RD_KAFKA_Q_INGRESS_CLOSED)
+                        return 0;
+                TAILQ_NEXT(rko, rko_link) = head;
+        } while (!rd_atomicptr_cas(&rkq->rkq_ingress, head, rko));
+
+        if (!head && rd_atomic32_get(&rkq->rkq_waiters) > 0) {
+                mtx_lock(&rkq->rkq_lock);
+                rd_kafka_q_wakeup0(rkq);
+                mtx_unlock(&rkq->rkq_lock);
+        }
+
+        return 1;
 }
 
 
@@ -345,6 +490,20 @@ static RD_INLINE RD_UNUSED
 int rd_kafka_q_enq (rd_kafka_q_t *rkq, rd_kafka_op_t *rko) {
 	rd_kafka_q_t *fwdq;
 
+        if (rd_atomicptr_get(&rkq->rkq_ingress) != RD_KAFKA_Q_INGRESS_CLOSED) {
+                /* Lock-free queue: the queue is neither forwarded
+                 * nor disabled while the ingress list is open. */
+                if (!rko->rko_serve && rkq->rkq_serve) {
+                        rko->rko_serve = rkq->rkq_serve;
+                        rko->rko_serve_opaque = rkq->rkq_opaque;
+                }
+
+                if (likely(rd_kafka_q_ingress_push(rkq, rko)))
+                        return 1;
+
+                /* Closed while pushing, use the locked path. */
+        }
+
 	mtx_lock(&rkq->rkq_lock);
 
         rd_dassert(rkq->rkq_refcnt > 0);
@@ -366,9 +525,8 @@ int rd_kafka_q_enq (rd_kafka_q_t *rkq, rd_kafka_op_t *rko) {
 
 	if (!(fwdq = rd_kafka_q_fwd_get(rkq, 0))) {
 		rd_kafka_q_enq0(rkq, rko, 0);
-		cnd_signal(&rkq->rkq_cond);
 		if (rkq->rkq_qlen == 1)
-			rd_kafka_q_io_event(rkq);
+			rd_kafka_q_wakeup0(rkq);
 		mtx_unlock(&rkq->rkq_lock);
 	} else {
 		mtx_unlock(&rkq->rkq_lock);
@@ -410,9 +568,8 @@ int rd_kafka_q_reenq (rd_kafka_q_t *rkq, rd_kafka_op_t *rko) {
 
         if (!(fwdq = rd_kafka_q_fwd_get(rkq, 0))) {
                 rd_kafka_q_enq0(rkq, rko, 1/*at_head*/);
-                cnd_signal(&rkq->rkq_cond);
                 if (rkq->rkq_qlen == 1)
-                        rd_kafka_q_io_event(rkq);
+                        rd_kafka_q_wakeup0(rkq);
         } else {
                 rd_kafka_q_enq(fwdq, rko);
                 rd_kafka_q_destroy(fwdq);
@@ -431,11 +588,49 @@ int rd_kafka_q_reenq (rd_kafka_q_t *rkq, rd_kafka_op_t *rko) {
 static RD_INLINE RD_UNUSED
 void rd_kafka_q_deq0 (rd_kafka_q_t *rkq, rd_kafka_op_t *rko) {
 	rd_dassert(rkq->rkq_qlen > 0 &&
-                   rkq->rkq_qsize >= (int64_t)rko->rko_len);
+                   rkq->rkq_qsize >= (int64_t)rko->rko_len &&
+                   rkq->rkq_qmsgs >= rd_kafka_op_qmsgs(rko));
 
         TAILQ_REMOVE(&rkq->rkq_q, rko, rko_link);
         rkq->rkq_qlen--;
         rkq->rkq_qsize -= rko->rko_len;
+        rkq->rkq_qmsgs -= rd_kafka_op_qmsgs(rko);
+}
+
+/**
+ * @brief Dequeue the message op \p rko from \p rkq.
+ *
+ * If \p rko is a RecordBatch view (RD_KAFKA_OP_FETCH_BATCH) its next
+ * record is materialized and returned as an RD_KAFKA_OP_FETCH op instead,
+ * leaving the view at its position in the queue until its last record
+ * has been materialized.
+ *
+ * @returns the dequeued (or materialized) op.
+ *
+ * NOTE: rkq_lock MUST be held
+ * Locality: any thread
+ */
+static RD_INLINE RD_UNUSED
+rd_kafka_op_t *rd_kafka_q_deq_msg0 (rd_kafka_q_t *rkq, rd_kafka_op_t *rko) {
+        rd_kafka_op_t *rko_msg;
+
+        if (likely(rko->rko_type != RD_KAFKA_OP_FETCH_BATCH)) {
+                rd_kafka_q_deq0(rkq, rko);
+                return rko;
+        }
+
+        rko_msg = rd_kafka_op_fetch_batch_materialize(rko);
+        rkq->rkq_qsize -= rko_msg->rko_len;
+        rkq->rkq_qmsgs--;
+
+        if (rko->rko_u.fetch_batch.next == rko->rko_u.fetch_batch.cnt) {
+                /* The materialized message holds its own references
+                 * to the toppar and payload buffer. */
+                rd_kafka_q_deq0(rkq, rko);
+                rd_kafka_op_destroy(rko);
+        }
+
+        return rko_msg;
 }
 
 /**
@@ -468,6 +663,9 @@ int rd_kafka_q_concat0 (rd_kafka_q_t *rkq, rd_kafka_q_t *srcq, int do_lock) {
                                 mtx_unlock(&rkq->rkq_lock);
 			return -1;
 		}
+                /* Ops enqueued lock-free precede srcq's ops. */
+                rd_kafka_q_ingress_drain0(rkq);
+
                 /* First insert any prioritized ops from srcq
                  * in the right position in rkq. */
                 while ((rko = TAILQ_FIRST(&srcq->rkq_q)) && rko->rko_prio > 0) {
@@ -479,10 +677,10 @@ int rd_kafka_q_concat0 (rd_kafka_q_t *rkq, rd_kafka_q_t *srcq, int do_lock) {
 
 		TAILQ_CONCAT(&rkq->rkq_q, &srcq->rkq_q, rko_link);
 		if (rkq->rkq_qlen == 0)
-			rd_kafka_q_io_event(rkq);
+			rd_kafka_q_wakeup0(rkq);
                 rkq->rkq_qlen += srcq->rkq_qlen;
                 rkq->rkq_qsize += srcq->rkq_qsize;
-		cnd_signal(&rkq->rkq_cond);
+                rkq->rkq_qmsgs += srcq->rkq_qmsgs;
 
                 rd_kafka_q_reset(srcq);
 	} else
@@ -514,15 +712,17 @@ void rd_kafka_q_prepend0 (rd_kafka_q_t *rkq, rd_kafka_q_t *srcq,
 	if (do_lock)
 		mtx_lock(&rkq->rkq_lock);
 	if (!rkq->rkq_fwdq && !srcq->rkq_fwdq) {
+                rd_kafka_q_ingress_drain0(rkq);
                 /* FIXME: prio-aware */
                 /* Concat rkq on srcq */
                 TAILQ_CONCAT(&srcq->rkq_q, &rkq->rkq_q, rko_link);
                 /* Move srcq to rkq */
                 TAILQ_MOVE(&rkq->rkq_q, &srcq->rkq_q, rko_link);
 		if (rkq->rkq_qlen == 0 && srcq->rkq_qlen > 0)
-			rd_kafka_q_io_event(rkq);
+			rd_kafka_q_wakeup0(rkq);
                 rkq->rkq_qlen += srcq->rkq_qlen;
                 rkq->rkq_qsize += srcq->rkq_qsize;
+                rkq->rkq_qmsgs += srcq->rkq_qmsgs;
 
                 rd_kafka_q_reset(srcq);
 	} else
@@ -543,6 +743,7 @@ int rd_kafka_q_len (rd_kafka_q_t *rkq) {
         rd_kafka_q_t *fwdq;
         mtx_lock(&rkq->rkq_lock);
         if (!(fwdq = rd_kafka_q_fwd_get(rkq, 0))) {
+                rd_kafka_q_ingress_drain0(rkq);
                 qlen = rkq->rkq_qlen;
                 mtx_unlock(&rkq->rkq_lock);
         } else {
@@ -553,6 +754,27 @@ int rd_kafka_q_len (rd_kafka_q_t *rkq) {
         return qlen;
 }
 
+/**
+ * @returns the number of messages in the queue, counting each record
+ *          of a RecordBatch view, and any other op as one.
+ */
+static RD_INLINE RD_UNUSED
+int rd_kafka_q_msgs (rd_kafka_q_t *rkq) {
+        int qmsgs;
+        rd_kafka_q_t *fwdq;
+        mtx_lock(&rkq->rkq_lock);
+        if (!(fwdq = rd_kafka_q_fwd_get(rkq, 0))) {
+                rd_kafka_q_ingress_drain0(rkq);
+                qmsgs = rkq->rkq_qmsgs;
+                mtx_unlock(&rkq->rkq_lock);
+        } else {
+                mtx_unlock(&rkq->rkq_lock);
+                qmsgs = rd_kafka_q_msgs(fwdq);
+                rd_kafka_q_destroy(fwdq);
+        }
+        return qmsgs;
+}
+
 /* Returns the total size of elements in the queue */
 static RD_INLINE RD_UNUSED
 uint64_t rd_kafka_q_size (rd_kafka_q_t *rkq) {
@@ -560,6 +782,7 @@ uint64_t rd_kafka_q_size (rd_kafka_q_t *rkq) {
         rd_kafka_q_t *fwdq;
         mtx_lock(&rkq->rkq_lock);
         if (!(fwdq = rd_kafka_q_fwd_get(rkq, 0))) {
+                rd_kafka_q_ingress_drain0(rkq);
                 sz = rkq->rkq_qsize;
                 mtx_unlock(&rkq->rkq_lock);
         } else {
@@ -711,6 +934,8 @@ rd_kafka_op_t *rd_kafka_q_pop_serve (rd_kafka_q_t *rkq, int timeout_ms,
 				     void *opaque);
 rd_kafka_op_t *rd_kafka_q_pop (rd_kafka_q_t *rkq, int timeout_ms,
                                int32_t version);
+rd_kafka_op_t *rd_kafka_q_pop_batch (rd_kafka_q_t *rkq, int timeout_ms,
+                                     int32_t version);
 int rd_kafka_q_serve (rd_kafka_q_t *rkq, int timeout_ms, int max_cnt,
                       rd_kafka_q_cb_type_t cb_type,
                       rd_kafka_q_serve_cb_t *callback,
@@ -766,4 +991,6 @@ void rd_kafka_q_dump (FILE *fp, rd_kafka_q_t *rkq);
 
 extern int RD_TLS rd_kafka_yield_thread;
 
+int unittest_queue (void);
+
 #endif /* _RDKAFKA_QUEUE_H_ */
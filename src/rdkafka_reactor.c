@@ -0,0 +1,557 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rdkafka_int.h"
+#include "rdkafka_broker.h"
+#include "rdkafka_transport.h"
+#include "rdkafka_reactor.h"
+
+#if HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+#if WITH_SSL
+#include <openssl/err.h>
+#endif
+
+
+/**
+ * epoll_event.data tags:
+ *   NULL         - the IO thread's own wake-up fd.
+ *   rkb          - the broker's op queue wake-up fd (rkb_wakeup_fd[0]).
+ *   rkb|1        - the broker's transport socket.
+ */
+#define RD_KAFKA_REACTOR_TAG_TRANSPORT  0x1
+
+
+struct rd_kafka_reactor_thread_s {
+        rd_kafka_reactor_t *rtt_rktor;
+        thrd_t  rtt_thrd;
+        int     rtt_epfd;             /**< epoll instance */
+        int     rtt_wakeup_fd[2];     /**< IO thread wake-up fds (r/w) */
+
+        mtx_t   rtt_lock;             /**< Protects rtt_pending and
+                                       *   rtt_terminate */
+        TAILQ_HEAD(, rd_kafka_broker_s) rtt_pending; /**< Brokers to be
+                                                      *   picked up by
+                                                      *   the IO thread */
+        int     rtt_terminate;        /**< Exit when all brokers are
+                                       *   decommissioned */
+
+        TAILQ_HEAD(, rd_kafka_broker_s) rtt_brokers; /**< Served brokers,
+                                                      *   IO thread only */
+        int     rtt_broker_cnt;       /**< IO thread only */
+};
+
+struct rd_kafka_reactor_s {
+        rd_kafka_t                *rktor_rk;
+        rd_kafka_reactor_thread_t *rktor_thrds;     /**< IO threads */
+        int                        rktor_thrd_cnt;  /**< Number of started
+                                                     *   IO threads */
+        rd_atomic32_t              rktor_next;      /**< Round-robin
+                                                     *   assignment */
+};
+
+
+#if HAVE_EPOLL
+
+/**
+ * @returns the POLL* equivalents of the EPOLL* \p events.
+ */
+static int rd_kafka_reactor_epoll2poll (uint32_t events) {
+        int r = 0;
+
+        if (events & EPOLLIN)
+                r |= POLLIN;
+        if (events & EPOLLOUT)
+                r |= POLLOUT;
+        if (events & EPOLLERR)
+                r |= POLLERR;
+        if (events & EPOLLHUP)
+                r |= POLLHUP;
+
+        return r;
+}
+
+/**
+ * @returns the EPOLL* equivalents of the POLL* \p events.
+ */
+static uint32_t rd_kafka_reactor_poll2epoll (int events) {
+        uint32_t r = 0;
+
+        if (events & POLLIN)
+                r |= EPOLLIN;
+        if (events & POLLOUT)
+                r |= EPOLLOUT;
+
+        return r;
+}
+
+
+/**
+ * @brief Read and throw away wake-up data on \p fd.
+ */
+static void rd_kafka_reactor_drain_fd (int fd) {
+        char buf[512];
+
+        while (rd_read(fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf))
+                ;
+}
+
+
+/**
+ * @brief Wake up the IO thread.
+ *
+ * Best effort: if the pipe is full the IO thread has a wake-up
+ * pending already.
+ */
+static void rd_kafka_reactor_thread_wakeup (rd_kafka_reactor_thread_t *rtt) {
+        char onebyte = 1;
+
+        if (rd_write(rtt->rtt_wakeup_fd[1], &onebyte, 1) == -1) {
+                /* Ignore error */
+        }
+}
+
+
+/**
+ * @brief Start serving the newly assigned broker \p rkb.
+ *
+ * @locality IO thread
+ */
+static void rd_kafka_reactor_thread_adopt (rd_kafka_reactor_thread_t *rtt,
+                                           rd_kafka_broker_t *rkb) {
+
+        /* Wait for rd_kafka_broker_add() to finalize the broker */
+        rd_kafka_broker_lock(rkb);
+        rd_kafka_broker_unlock(rkb);
+
+        rd_rkb_dbg(rkb, BROKER, "BRKMAIN",
+                   "Enter main broker IO thread loop");
+
+        if (rkb->rkb_wakeup_fd[0] != -1) {
+                struct epoll_event ev = { .events = EPOLLIN,
+                                          .data.ptr = rkb };
+
+                if (epoll_ctl(rtt->rtt_epfd, EPOLL_CTL_ADD,
+                              rkb->rkb_wakeup_fd[0], &ev) == -1)
+                        rd_rkb_log(rkb, LOG_ERR, "WAKEUPFD",
+                                   "Failed to add broker queue wake-up fd "
+                                   "to IO thread: %s: "
+                                   "disabling low-latency mode",
+                                   rd_strerror(errno));
+        }
+
+        rd_interval_init(&rkb->rkb_reactor.timeout_scan);
+        rkb->rkb_reactor.ts_wakeup = 0; /* Serve immediately */
+
+        TAILQ_INSERT_TAIL(&rtt->rtt_brokers, rkb, rkb_reactor.link);
+        rtt->rtt_broker_cnt++;
+}
+
+
+/**
+ * @brief Register, update or remove the broker's transport socket in the
+ *        IO thread's poll set according to the current transport and
+ *        its wanted events.
+ *
+ * @locality IO thread
+ */
+static void rd_kafka_reactor_transport_sync (rd_kafka_reactor_thread_t *rtt,
+                                             rd_kafka_broker_t *rkb) {
+        struct epoll_event ev;
+        int fd = -1, events = 0;
+        int op;
+
+        if (rkb->rkb_transport) {
+                fd = rd_kafka_transport_fd(rkb->rkb_transport);
+                events = rd_kafka_transport_poll_prepare(rkb->rkb_transport);
+        }
+
+        if (fd != rkb->rkb_reactor.fd) {
+                if (rkb->rkb_reactor.fd != -1)
+                        rd_kafka_reactor_transport_del(rkb);
+                if (fd == -1)
+                        return;
+                op = EPOLL_CTL_ADD;
+
+        } else if (fd == -1 || events == rkb->rkb_reactor.events)
+                return;
+        else
+                op = EPOLL_CTL_MOD;
+
+        ev.events = rd_kafka_reactor_poll2epoll(events);
+        ev.data.ptr = (void *)((uintptr_t)rkb |
+                               RD_KAFKA_REACTOR_TAG_TRANSPORT);
+
+        if (epoll_ctl(rtt->rtt_epfd, op, fd, &ev) == -1) {
+                rd_rkb_log(rkb, LOG_ERR, "IOTHREAD",
+                           "Failed to %s broker socket %d in IO thread "
+                           "poll set: %s",
+                           op == EPOLL_CTL_ADD ? "add" : "modify",
+                           fd, rd_strerror(errno));
+                return;
+        }
+
+        rkb->rkb_reactor.fd = fd;
+        rkb->rkb_reactor.events = events;
+}
+
+
+/**
+ * @brief Serve broker \p rkb one round and reschedule it,
+ *        or decommission it if it is terminating.
+ *
+ * @locality IO thread
+ */
+static void rd_kafka_reactor_thread_serve (rd_kafka_reactor_thread_t *rtt,
+                                           rd_kafka_broker_t *rkb) {
+        int revents = rkb->rkb_reactor.revents;
+        rd_ts_t next;
+
+        rkb->rkb_reactor.revents = 0;
+
+        next = rd_kafka_broker_reactor_serve(rkb, revents);
+
+        if (unlikely(!next)) {
+                /* Broker is terminating */
+                if (rkb->rkb_wakeup_fd[0] != -1)
+                        epoll_ctl(rtt->rtt_epfd, EPOLL_CTL_DEL,
+                                  rkb->rkb_wakeup_fd[0], NULL);
+
+                TAILQ_REMOVE(&rtt->rtt_brokers, rkb, rkb_reactor.link);
+                rtt->rtt_broker_cnt--;
+
+                /* Also removes the transport from the poll set
+                 * (in rd_kafka_broker_fail()) */
+                rd_kafka_broker_decommission(rkb);
+                return;
+        }
+
+        rkb->rkb_reactor.ts_wakeup = next;
+
+        rd_kafka_reactor_transport_sync(rtt, rkb);
+}
+
+
+/**
+ * @brief IO thread main loop.
+ */
+static int rd_kafka_reactor_thread_main (void *arg) {
+        rd_kafka_reactor_thread_t *rtt = arg;
+        struct epoll_event evs[64];
+
+        rd_kafka_set_thread_name("io");
+        rd_kafka_set_thread_sysname("rdk:io");
+
+        (void)rd_atomic32_add(&rd_kafka_thread_cnt_curr, 1);
+
+        while (1) {
+                rd_kafka_broker_t *rkb, *tmp;
+                rd_ts_t now, next;
+                int timeout_ms;
+                int r, i;
+
+                /* Pick up newly assigned brokers */
+                mtx_lock(&rtt->rtt_lock);
+                while ((rkb = TAILQ_FIRST(&rtt->rtt_pending))) {
+                        TAILQ_REMOVE(&rtt->rtt_pending, rkb,
+                                     rkb_reactor.link);
+                        mtx_unlock(&rtt->rtt_lock);
+                        rd_kafka_reactor_thread_adopt(rtt, rkb);
+                        mtx_lock(&rtt->rtt_lock);
+                }
+
+                if (rtt->rtt_terminate && rtt->rtt_broker_cnt == 0) {
+                        mtx_unlock(&rtt->rtt_lock);
+                        break;
+                }
+                mtx_unlock(&rtt->rtt_lock);
+
+                /* Wait no longer than until the next broker is due. */
+                now = rd_clock();
+                next = now + 1000*1000;
+                TAILQ_FOREACH(rkb, &rtt->rtt_brokers, rkb_reactor.link)
+                        if (rkb->rkb_reactor.ts_wakeup < next)
+                                next = rkb->rkb_reactor.ts_wakeup;
+
+                if (next <= now)
+                        timeout_ms = 0;
+                else
+                        timeout_ms = (int)((next - now + 999) / 1000);
+
+                r = epoll_wait(rtt->rtt_epfd, evs, (int)RD_ARRAYSIZE(evs),
+                               timeout_ms);
+
+                for (i = 0 ; i < r ; i++) {
+                        uintptr_t tag = (uintptr_t)evs[i].data.ptr;
+
+                        if (!tag) {
+                                rd_kafka_reactor_drain_fd(
+                                        rtt->rtt_wakeup_fd[0]);
+                                continue;
+                        }
+
+                        rkb = (rd_kafka_broker_t *)
+                                (tag & ~(uintptr_t)
+                                 RD_KAFKA_REACTOR_TAG_TRANSPORT);
+
+                        if (tag & RD_KAFKA_REACTOR_TAG_TRANSPORT)
+                                rkb->rkb_reactor.revents |=
+                                        rd_kafka_reactor_epoll2poll(
+                                                evs[i].events);
+                        else
+                                rd_kafka_reactor_drain_fd(
+                                        rkb->rkb_wakeup_fd[0]);
+
+                        rkb->rkb_reactor.ts_wakeup = 0;
+                }
+
+                /* Serve brokers that have events or are due. */
+                now = rd_clock();
+                TAILQ_FOREACH_SAFE(rkb, &rtt->rtt_brokers,
+                                   rkb_reactor.link, tmp) {
+                        if (rkb->rkb_reactor.ts_wakeup <= now)
+                                rd_kafka_reactor_thread_serve(rtt, rkb);
+                }
+        }
+
+#if WITH_SSL
+        /* Remove OpenSSL per-thread error state to avoid memory leaks */
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(LIBRESSL_VERSION_NUMBER)
+        /*(OpenSSL libraries handle thread init and deinit)
+         * https://github.com/openssl/openssl/pull/1048 */
+#elif OPENSSL_VERSION_NUMBER >= 0x10000000L
+        ERR_remove_thread_state(NULL);
+#endif
+#endif
+
+        (void)rd_atomic32_sub(&rd_kafka_thread_cnt_curr, 1);
+
+        return 0;
+}
+
+
+/**
+ * @brief Remove the broker's transport socket from the IO thread's
+ *        poll set, must be called before the socket is closed.
+ *
+ * @locality IO thread
+ */
+void rd_kafka_reactor_transport_del (rd_kafka_broker_t *rkb) {
+        rd_kafka_reactor_thread_t *rtt = rkb->rkb_reactor.thrd;
+
+        rd_assert(rkb->rkb_reactor.fd != -1);
+
+        epoll_ctl(rtt->rtt_epfd, EPOLL_CTL_DEL, rkb->rkb_reactor.fd, NULL);
+
+        rkb->rkb_reactor.fd      = -1;
+        rkb->rkb_reactor.events  = 0;
+        rkb->rkb_reactor.revents = 0;
+}
+
+
+/**
+ * @brief Assign the new broker \p rkb to one of the IO threads,
+ *        which takes over the caller's broker thread refcount.
+ *
+ * The broker lock must be held by the caller, the IO thread will not
+ * start serving the broker until it is released.
+ */
+void rd_kafka_reactor_add (rd_kafka_reactor_t *rktor, rd_kafka_broker_t *rkb) {
+        rd_kafka_reactor_thread_t *rtt;
+
+        rtt = &rktor->rktor_thrds[(rd_atomic32_add(&rktor->rktor_next, 1) &
+                                   0x7fffffff) % rktor->rktor_thrd_cnt];
+
+        /* The IO thread is the broker thread */
+        rkb->rkb_reactor.thrd = rtt;
+        rkb->rkb_thread = rtt->rtt_thrd;
+
+        mtx_lock(&rtt->rtt_lock);
+        TAILQ_INSERT_TAIL(&rtt->rtt_pending, rkb, rkb_reactor.link);
+        mtx_unlock(&rtt->rtt_lock);
+
+        rd_kafka_reactor_thread_wakeup(rtt);
+}
+
+
+/**
+ * @brief Release the IO thread's resources, the thread must not be
+ *        running.
+ */
+static void rd_kafka_reactor_thread_destroy (rd_kafka_reactor_thread_t *rtt) {
+        if (rtt->rtt_epfd != -1)
+                rd_close(rtt->rtt_epfd);
+        if (rtt->rtt_wakeup_fd[0] != -1)
+                rd_close(rtt->rtt_wakeup_fd[0]);
+        if (rtt->rtt_wakeup_fd[1] != -1)
+                rd_close(rtt->rtt_wakeup_fd[1]);
+        mtx_destroy(&rtt->rtt_lock);
+}
+
+
+/**
+ * @brief Set up and start IO thread \p rtt.
+ *
+ * @returns 0 on success or -1 on failure in which case an error
+ *          string is written to \p errstr.
+ */
+static int rd_kafka_reactor_thread_init (rd_kafka_reactor_t *rktor,
+                                         rd_kafka_reactor_thread_t *rtt,
+                                         char *errstr, size_t errstr_size) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+        int r;
+
+        rtt->rtt_rktor = rktor;
+        rtt->rtt_wakeup_fd[0] = -1;
+        rtt->rtt_wakeup_fd[1] = -1;
+        mtx_init(&rtt->rtt_lock, mtx_plain);
+        TAILQ_INIT(&rtt->rtt_pending);
+        TAILQ_INIT(&rtt->rtt_brokers);
+
+        if ((rtt->rtt_epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+                rd_snprintf(errstr, errstr_size,
+                            "Failed to create IO thread epoll instance: %s",
+                            rd_strerror(errno));
+                goto fail;
+        }
+
+        if ((r = rd_pipe_nonblocking(rtt->rtt_wakeup_fd))) {
+                rd_snprintf(errstr, errstr_size,
+                            "Failed to create IO thread wake-up fds: %s",
+                            rd_strerror(r));
+                goto fail;
+        }
+
+        if (epoll_ctl(rtt->rtt_epfd, EPOLL_CTL_ADD,
+                      rtt->rtt_wakeup_fd[0], &ev) == -1) {
+                rd_snprintf(errstr, errstr_size,
+                            "Failed to add IO thread wake-up fd: %s",
+                            rd_strerror(errno));
+                goto fail;
+        }
+
+        if (thrd_create(&rtt->rtt_thrd,
+                        rd_kafka_reactor_thread_main, rtt) != thrd_success) {
+                rd_snprintf(errstr, errstr_size,
+                            "Failed to create IO thread: %s (%i)",
+                            rd_strerror(errno), errno);
+                goto fail;
+        }
+
+        return 0;
+
+ fail:
+        rd_kafka_reactor_thread_destroy(rtt);
+        return -1;
+}
+
+
+/**
+ * @brief Create a new reactor with \p thread_cnt IO threads.
+ *
+ * @returns the new reactor, or NULL on failure (or if not supported
+ *          on this platform) in which case an error string is written
+ *          to \p errstr.
+ */
+rd_kafka_reactor_t *rd_kafka_reactor_new (rd_kafka_t *rk, int thread_cnt,
+                                          char *errstr, size_t errstr_size) {
+        rd_kafka_reactor_t *rktor;
+        int i;
+
+        rd_assert(thread_cnt > 0);
+
+        rktor = rd_calloc(1, sizeof(*rktor));
+        rktor->rktor_rk    = rk;
+        rktor->rktor_thrds = rd_calloc(thread_cnt,
+                                       sizeof(*rktor->rktor_thrds));
+        rd_atomic32_init(&rktor->rktor_next, 0);
+
+        for (i = 0 ; i < thread_cnt ; i++) {
+                if (rd_kafka_reactor_thread_init(rktor,
+                                                 &rktor->rktor_thrds[i],
+                                                 errstr, errstr_size) == -1) {
+                        rd_kafka_reactor_destroy(rktor);
+                        return NULL;
+                }
+                rktor->rktor_thrd_cnt++;
+        }
+
+        return rktor;
+}
+
+
+/**
+ * @brief Wait for the IO threads to exit, which they do when all their
+ *        brokers have been decommissioned, and destroy the reactor.
+ *
+ * @locality any thread but the IO threads.
+ */
+void rd_kafka_reactor_destroy (rd_kafka_reactor_t *rktor) {
+        int i;
+
+        for (i = 0 ; i < rktor->rktor_thrd_cnt ; i++) {
+                rd_kafka_reactor_thread_t *rtt = &rktor->rktor_thrds[i];
+
+                mtx_lock(&rtt->rtt_lock);
+                rtt->rtt_terminate = 1;
+                mtx_unlock(&rtt->rtt_lock);
+                rd_kafka_reactor_thread_wakeup(rtt);
+        }
+
+        for (i = 0 ; i < rktor->rktor_thrd_cnt ; i++) {
+                thrd_join(rktor->rktor_thrds[i].rtt_thrd, NULL);
+                rd_kafka_reactor_thread_destroy(&rktor->rktor_thrds[i]);
+        }
+
+        rd_free(rktor->rktor_thrds);
+        rd_free(rktor);
+}
+
+
+#else /* !HAVE_EPOLL */
+
+rd_kafka_reactor_t *rd_kafka_reactor_new (rd_kafka_t *rk, int thread_cnt,
+                                          char *errstr, size_t errstr_size) {
+        rd_snprintf(errstr, errstr_size,
+                    "broker.io.threads is not supported on this platform "
+                    "(requires epoll)");
+        return NULL;
+}
+
+void rd_kafka_reactor_destroy (rd_kafka_reactor_t *rktor) {
+}
+
+void rd_kafka_reactor_add (rd_kafka_reactor_t *rktor, rd_kafka_broker_t *rkb) {
+        rd_assert(!*"broker.io.threads not supported");
+}
+
+void rd_kafka_reactor_transport_del (rd_kafka_broker_t *rkb) {
+}
+
+#endif /* HAVE_EPOLL */
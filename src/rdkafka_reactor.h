@@ -0,0 +1,61 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDKAFKA_REACTOR_H_
+#define _RDKAFKA_REACTOR_H_
+
+
+/**
+ * @name Broker IO reactor
+ *
+ * A fixed number of IO threads (`broker.io.threads`) that each serve
+ * a share of the handle's brokers, rather than one thread per broker.
+ *
+ * Each IO thread waits for socket and op queue wake-up events on
+ * all its brokers' file descriptors with a single epoll instance
+ * and drives each broker's state machine one non-blocking round at a time
+ * through rd_kafka_broker_reactor_serve().
+ *
+ * Brokers are assigned to IO threads round-robin when they are added and
+ * remain on the same IO thread until they are decommissioned, the IO
+ * thread thus acts as the broker thread for all broker-thread locality
+ * purposes.
+ */
+
+typedef struct rd_kafka_reactor_s rd_kafka_reactor_t;
+typedef struct rd_kafka_reactor_thread_s rd_kafka_reactor_thread_t;
+
+rd_kafka_reactor_t *rd_kafka_reactor_new (rd_kafka_t *rk, int thread_cnt,
+                                          char *errstr, size_t errstr_size);
+void rd_kafka_reactor_destroy (rd_kafka_reactor_t *rktor);
+
+void rd_kafka_reactor_add (rd_kafka_reactor_t *rktor,
+                           struct rd_kafka_broker_s *rkb);
+void rd_kafka_reactor_transport_del (struct rd_kafka_broker_s *rkb);
+
+#endif /* _RDKAFKA_REACTOR_H_ */
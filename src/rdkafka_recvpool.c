@@ -0,0 +1,463 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rd.h"
+#include "rdsysqueue.h"
+#include "rdunittest.h"
+#include "rdkafka_recvpool.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+
+/**< Maximum number of size classes: 64KB .. 2GB */
+#define RD_KAFKA_RECVPOOL_CLS_CNT   16
+
+/**< Maximum number of free chunks cached per class. */
+#define RD_KAFKA_RECVPOOL_FREE_MAX  4
+
+/**< Chunks of at least this size are huge-page aligned. */
+#define RD_KAFKA_RECVPOOL_HUGEPAGE_SIZE  (2*1024*1024)
+
+
+/**
+ * @brief Chunk header, precedes the payload memory of every chunk.
+ *        Padded to a cache line to keep the payload aligned.
+ */
+typedef union rd_kafka_recvpool_chunk_u {
+        struct {
+                rd_kafka_recvpool_t *rpool;  /**< Owning pool */
+                union rd_kafka_recvpool_chunk_u *next; /**< Free list link */
+                int cls;                     /**< Size class */
+        } c;
+        char _pad[64];
+} rd_kafka_recvpool_chunk_t;
+
+
+struct rd_kafka_recvpool_s {
+        mtx_t    rpool_lock;
+        int      rpool_refcnt;   /**< Owner (1) + outstanding chunks */
+        int      rpool_cls_cnt;  /**< Number of size classes in use */
+
+        struct {
+                rd_kafka_recvpool_chunk_t *free; /**< Cached chunks */
+                int cnt;                         /**< Number of cached */
+        } rpool_cls[RD_KAFKA_RECVPOOL_CLS_CNT];
+
+        int64_t  rpool_hits;
+        int64_t  rpool_misses;
+        int64_t  rpool_chunk_cnt;
+        int64_t  rpool_chunk_bytes;
+};
+
+
+/**
+ * @returns the total size of chunks (including header) of class \p cls
+ */
+static RD_INLINE size_t rd_kafka_recvpool_cls_size (int cls) {
+        return (size_t)RD_KAFKA_RECVPOOL_SIZE_MIN << cls;
+}
+
+/**
+ * @returns the size class for a payload of \p size bytes, or -1 if
+ *          the payload does not fit any of the pool's classes.
+ */
+static int rd_kafka_recvpool_size2cls (const rd_kafka_recvpool_t *rpool,
+                                       size_t size) {
+        int cls;
+
+        size += sizeof(rd_kafka_recvpool_chunk_t);
+
+        for (cls = 0 ; cls < rpool->rpool_cls_cnt ; cls++)
+                if (size <= rd_kafka_recvpool_cls_size(cls))
+                        return cls;
+
+        return -1;
+}
+
+
+/**
+ * @brief Allocate backing memory for a chunk of \p size bytes.
+ */
+static void *rd_kafka_recvpool_mem_alloc (size_t size) {
+#if defined(MADV_HUGEPAGE)
+        if (size >= RD_KAFKA_RECVPOOL_HUGEPAGE_SIZE) {
+                void *p;
+
+                if (!posix_memalign(&p, RD_KAFKA_RECVPOOL_HUGEPAGE_SIZE,
+                                    size)) {
+                        /* Advisory only, ignore failure. */
+                        (void)madvise(p, size, MADV_HUGEPAGE);
+                        return p;
+                }
+        }
+#endif
+        return rd_malloc(size);
+}
+
+
+/**
+ * @brief Drop a pool reference, freeing the pool when it reaches zero.
+ * @locks rpool_lock MUST be held, and is released by this function.
+ */
+static void rd_kafka_recvpool_unlock_decref (rd_kafka_recvpool_t *rpool) {
+        int destroy = --rpool->rpool_refcnt == 0;
+
+        mtx_unlock(&rpool->rpool_lock);
+
+        if (!destroy)
+                return;
+
+        mtx_destroy(&rpool->rpool_lock);
+        rd_free(rpool);
+}
+
+
+/**
+ * @brief Borrow a chunk of at least \p size bytes from the pool.
+ *
+ * @param sizep is set to the usable size of the returned memory.
+ *
+ * @returns the payload memory, to be returned with rd_kafka_recvpool_free(),
+ *          or NULL if \p size exceeds the pool's maximum size.
+ *
+ * @locality any
+ */
+void *rd_kafka_recvpool_alloc (rd_kafka_recvpool_t *rpool, size_t size,
+                               size_t *sizep) {
+        rd_kafka_recvpool_chunk_t *chunk;
+        int cls;
+
+        if ((cls = rd_kafka_recvpool_size2cls(rpool, size)) == -1)
+                return NULL;
+
+        mtx_lock(&rpool->rpool_lock);
+        rpool->rpool_refcnt++;
+        if ((chunk = rpool->rpool_cls[cls].free)) {
+                rpool->rpool_cls[cls].free = chunk->c.next;
+                rpool->rpool_cls[cls].cnt--;
+                rpool->rpool_hits++;
+        } else {
+                rpool->rpool_misses++;
+                rpool->rpool_chunk_cnt++;
+                rpool->rpool_chunk_bytes += rd_kafka_recvpool_cls_size(cls);
+        }
+        mtx_unlock(&rpool->rpool_lock);
+
+        if (!chunk) {
+                chunk = rd_kafka_recvpool_mem_alloc(
+                        rd_kafka_recvpool_cls_size(cls));
+                chunk->c.rpool = rpool;
+                chunk->c.cls   = cls;
+        }
+
+        *sizep = rd_kafka_recvpool_cls_size(cls) - sizeof(*chunk);
+
+        return chunk+1;
+}
+
+
+/**
+ * @brief Return memory previously borrowed with rd_kafka_recvpool_alloc()
+ *        to its pool.
+ *
+ * @remark Matches the rd_segment_t seg_free signature.
+ *
+ * @locality any
+ */
+void rd_kafka_recvpool_free (void *ptr) {
+        rd_kafka_recvpool_chunk_t *chunk =
+                ((rd_kafka_recvpool_chunk_t *)ptr) - 1;
+        rd_kafka_recvpool_t *rpool = chunk->c.rpool;
+        int cls = chunk->c.cls;
+
+        mtx_lock(&rpool->rpool_lock);
+
+        /* Cache the chunk unless the class' free list is full or
+         * the pool is being destroyed (only chunk references remain). */
+        if (rpool->rpool_cls[cls].cnt < RD_KAFKA_RECVPOOL_FREE_MAX &&
+            rpool->rpool_refcnt > 1) {
+                chunk->c.next = rpool->rpool_cls[cls].free;
+                rpool->rpool_cls[cls].free = chunk;
+                rpool->rpool_cls[cls].cnt++;
+        } else {
+                rpool->rpool_chunk_cnt--;
+                rpool->rpool_chunk_bytes -= rd_kafka_recvpool_cls_size(cls);
+                rd_free(chunk);
+        }
+
+        rd_kafka_recvpool_unlock_decref(rpool);
+}
+
+
+/**
+ * @brief Get pool statistics.
+ */
+void rd_kafka_recvpool_stats (rd_kafka_recvpool_t *rpool,
+                              struct rd_kafka_recvpool_stats *stats) {
+        mtx_lock(&rpool->rpool_lock);
+        stats->hits        = rpool->rpool_hits;
+        stats->misses      = rpool->rpool_misses;
+        stats->chunk_cnt   = rpool->rpool_chunk_cnt;
+        stats->chunk_bytes = rpool->rpool_chunk_bytes;
+        mtx_unlock(&rpool->rpool_lock);
+}
+
+
+/**
+ * @brief Create a new receive pool serving payloads of up to
+ *        \p max_size bytes.
+ */
+rd_kafka_recvpool_t *rd_kafka_recvpool_new (size_t max_size) {
+        rd_kafka_recvpool_t *rpool;
+
+        rpool = rd_calloc(1, sizeof(*rpool));
+        mtx_init(&rpool->rpool_lock, mtx_plain);
+        rpool->rpool_refcnt = 1;
+
+        max_size += sizeof(rd_kafka_recvpool_chunk_t);
+        while (rpool->rpool_cls_cnt < RD_KAFKA_RECVPOOL_CLS_CNT &&
+               rd_kafka_recvpool_cls_size(rpool->rpool_cls_cnt) < max_size)
+                rpool->rpool_cls_cnt++;
+        /* Include the class that fits max_size */
+        if (rpool->rpool_cls_cnt < RD_KAFKA_RECVPOOL_CLS_CNT)
+                rpool->rpool_cls_cnt++;
+
+        return rpool;
+}
+
+
+/**
+ * @brief Destroy the pool's cached chunks and drop the owner's reference.
+ *        Chunks still in use are freed when they are returned, after which
+ *        the pool is freed.
+ */
+void rd_kafka_recvpool_destroy (rd_kafka_recvpool_t *rpool) {
+        int cls;
+
+        mtx_lock(&rpool->rpool_lock);
+        for (cls = 0 ; cls < rpool->rpool_cls_cnt ; cls++) {
+                rd_kafka_recvpool_chunk_t *chunk;
+
+                while ((chunk = rpool->rpool_cls[cls].free)) {
+                        rpool->rpool_cls[cls].free = chunk->c.next;
+                        rpool->rpool_chunk_cnt--;
+                        rpool->rpool_chunk_bytes -=
+                                rd_kafka_recvpool_cls_size(cls);
+                        rd_free(chunk);
+                }
+                rpool->rpool_cls[cls].cnt = 0;
+        }
+
+        rd_kafka_recvpool_unlock_decref(rpool);
+}
+
+
+
+/**
+ * @brief Make exactly \p size contiguous bytes writable at the end of
+ *        \p rbuf, borrowing the memory from \p rpool (optional) if
+ *        \p size is large enough to be served by the pool.
+ *
+ * The writable space is capped to \p size, not the chunk's size, so that
+ * a read into \p rbuf does not consume data past this response, e.g.,
+ * a subsequent response received by the same read.
+ */
+void rd_kafka_recvpool_buf_reserve (rd_kafka_recvpool_t *rpool,
+                                    rd_buf_t *rbuf, size_t size) {
+        void *p = NULL;
+        size_t chunk_size;
+
+        if (rpool && size >= RD_KAFKA_RECVPOOL_SIZE_MIN)
+                p = rd_kafka_recvpool_alloc(rpool, size, &chunk_size);
+
+        if (p)
+                rd_buf_push_writable(rbuf, p, size, rd_kafka_recvpool_free);
+        else
+                rd_buf_write_ensure_contig(rbuf, size);
+}
+
+
+/**
+ * @name Unit tests
+ */
+
+/**
+ * @brief Emulate a single socket read of up to \p len bytes from \p src
+ *        into the writable space of \p rbuf.
+ *
+ * @returns the number of bytes read.
+ */
+static size_t ut_recv (rd_buf_t *rbuf, const char *src, size_t len) {
+        struct iovec iov[8];
+        size_t iovcnt, i;
+        size_t of = 0;
+
+        rd_buf_get_write_iov(rbuf, iov, &iovcnt, RD_ARRAYSIZE(iov), len);
+        for (i = 0 ; i < iovcnt && of < len ; i++) {
+                size_t r = RD_MIN(iov[i].iov_len, len - of);
+                memcpy(iov[i].iov_base, src + of, r);
+                of += r;
+        }
+
+        rd_buf_write(rbuf, NULL, of);
+
+        return of;
+}
+
+/**
+ * @brief Receive two back-to-back responses, the first one into a pool
+ *        chunk, from a single read: the first response's buffer must not
+ *        consume any of the second response.
+ */
+static int ut_back_to_back (void) {
+        rd_kafka_recvpool_t *rpool;
+        const size_t sizes[2] = { 100*1024, 1000 }; /* Payload sizes */
+        char *stream;
+        size_t stream_len = 0, of = 0;
+        int i;
+
+        rpool = rd_kafka_recvpool_new(1024*1024);
+
+        /* Size, CorrId, Payload */
+        stream = rd_malloc(2 * 8 + sizes[0] + sizes[1]);
+        for (i = 0 ; i < 2 ; i++) {
+                int32_t be32 = htobe32((int32_t)(4 + sizes[i]));
+                memcpy(stream+stream_len, &be32, 4);
+                be32 = htobe32(i);
+                memcpy(stream+stream_len+4, &be32, 4);
+                memset(stream+stream_len+8, 'a'+i, sizes[i]);
+                stream_len += 8 + sizes[i];
+        }
+
+        for (i = 0 ; i < 2 ; i++) {
+                rd_buf_t rbuf;
+                rd_slice_t slice;
+                int32_t corrid;
+                char c;
+                size_t r;
+
+                /* Response header, then the payload as in rd_kafka_recv() */
+                rd_buf_init(&rbuf, 2, 8);
+                rd_buf_write_ensure(&rbuf, 8, 8);
+                r = ut_recv(&rbuf, stream+of, stream_len-of);
+                RD_UT_ASSERT(r == 8, "response #%d: header read %"PRIusz
+                             " bytes", i, r);
+                of += r;
+
+                rd_kafka_recvpool_buf_reserve(rpool, &rbuf, sizes[i]);
+                r = ut_recv(&rbuf, stream+of, stream_len-of);
+                RD_UT_ASSERT(r == sizes[i],
+                             "response #%d: payload read %"PRIusz
+                             " bytes, expected %"PRIusz, i, r, sizes[i]);
+                of += r;
+
+                rd_slice_init_full(&slice, &rbuf);
+                rd_slice_read(&slice, NULL, 4);
+                rd_slice_read(&slice, &corrid, 4);
+                RD_UT_ASSERT(be32toh(corrid) == i,
+                             "response #%d: wrong CorrId %d",
+                             i, (int)be32toh(corrid));
+                while (rd_slice_read(&slice, &c, 1))
+                        RD_UT_ASSERT(c == 'a'+i,
+                                     "response #%d: corrupt payload", i);
+
+                rd_buf_destroy(&rbuf);
+        }
+
+        RD_UT_ASSERT(of == stream_len, "%"PRIusz" bytes left unread",
+                     stream_len - of);
+
+        rd_free(stream);
+        rd_kafka_recvpool_destroy(rpool);
+
+        RD_UT_PASS();
+}
+
+
+int unittest_recvpool (void) {
+        rd_kafka_recvpool_t *rpool;
+        struct rd_kafka_recvpool_stats stats;
+        const size_t max_size = 4*1024*1024;
+        void *ptrs[RD_KAFKA_RECVPOOL_FREE_MAX+2];
+        size_t size;
+        void *p;
+        int i;
+
+        rpool = rd_kafka_recvpool_new(max_size);
+
+        /* Smallest and largest payloads, contents must be writable */
+        p = rd_kafka_recvpool_alloc(rpool, 1, &size);
+        RD_UT_ASSERT(p && size >= 1 &&
+                     size < RD_KAFKA_RECVPOOL_SIZE_MIN,
+                     "unexpected usable size %"PRIusz" for 1 byte", size);
+        memset(p, 0x1, size);
+        rd_kafka_recvpool_free(p);
+
+        p = rd_kafka_recvpool_alloc(rpool, max_size, &size);
+        RD_UT_ASSERT(p && size >= max_size,
+                     "max_size allocation failed (%"PRIusz")", size);
+        memset(p, 0x2, max_size);
+        rd_kafka_recvpool_free(p);
+
+        RD_UT_ASSERT(!rd_kafka_recvpool_alloc(rpool, max_size * 2, &size),
+                     "oversized allocation should fail");
+
+        /* Cached chunks are reused */
+        p = rd_kafka_recvpool_alloc(rpool, max_size, &size);
+        rd_kafka_recvpool_free(p);
+        rd_kafka_recvpool_stats(rpool, &stats);
+        RD_UT_ASSERT(stats.hits == 1 && stats.misses == 2,
+                     "expected 1 hit and 2 misses, not %"PRId64" and %"PRId64,
+                     stats.hits, stats.misses);
+        RD_UT_ASSERT(stats.chunk_cnt == 2,
+                     "expected 2 cached chunks, not %"PRId64,
+                     stats.chunk_cnt);
+
+        /* The per-class cache is bounded */
+        for (i = 0 ; i < RD_KAFKA_RECVPOOL_FREE_MAX+2 ; i++)
+                ptrs[i] = rd_kafka_recvpool_alloc(rpool, 100*1024, &size);
+        for (i = 0 ; i < RD_KAFKA_RECVPOOL_FREE_MAX+2 ; i++)
+                rd_kafka_recvpool_free(ptrs[i]);
+        rd_kafka_recvpool_stats(rpool, &stats);
+        RD_UT_ASSERT(stats.chunk_cnt == 2 + RD_KAFKA_RECVPOOL_FREE_MAX,
+                     "expected %d cached chunks, not %"PRId64,
+                     2 + RD_KAFKA_RECVPOOL_FREE_MAX, stats.chunk_cnt);
+
+        /* Chunks outlive the pool's owner */
+        p = rd_kafka_recvpool_alloc(rpool, 1000, &size);
+        rd_kafka_recvpool_destroy(rpool);
+        memset(p, 0x3, size);
+        rd_kafka_recvpool_free(p);
+
+        if (ut_back_to_back())
+                return 1;
+
+        RD_UT_PASS();
+}
@@ -0,0 +1,84 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDKAFKA_RECVPOOL_H_
+#define _RDKAFKA_RECVPOOL_H_
+
+#include "rdbuf.h"
+
+
+/**
+ * @name Per-broker pool of large receive buffers.
+ *
+ * Large response payloads (typically FetchResponses) are received into
+ * chunks borrowed from the broker's pool rather than into freshly
+ * allocated memory, avoiding a multi-megabyte malloc and the page faults
+ * of touching new memory for every response.
+ *
+ * Chunks are sized in power-of-two classes from 64 kilobytes up to the
+ * pool's maximum size (derived from fetch.max.bytes) and are returned to
+ * the pool when the segment referencing them is destroyed, i.e., when the
+ * last reference to the response buffer is released, which may happen
+ * on any thread.
+ * Chunks of two megabytes or more are huge-page aligned and advised
+ * as such where supported.
+ *
+ * The pool itself is reference counted by its outstanding chunks and
+ * is thus not freed until the last chunk is returned, even if the
+ * owning broker has been destroyed.
+ */
+
+typedef struct rd_kafka_recvpool_s rd_kafka_recvpool_t;
+
+/**
+ * @brief Pool statistics, see rd_kafka_recvpool_stats().
+ */
+struct rd_kafka_recvpool_stats {
+        int64_t hits;        /**< Allocations served from a cached chunk */
+        int64_t misses;      /**< Allocations requiring a new chunk */
+        int64_t chunk_cnt;   /**< Number of chunks held (in use or cached) */
+        int64_t chunk_bytes; /**< Total memory held by chunks */
+};
+
+rd_kafka_recvpool_t *rd_kafka_recvpool_new (size_t max_size);
+void rd_kafka_recvpool_destroy (rd_kafka_recvpool_t *rpool);
+void *rd_kafka_recvpool_alloc (rd_kafka_recvpool_t *rpool, size_t size,
+                               size_t *sizep);
+void rd_kafka_recvpool_free (void *ptr);
+void rd_kafka_recvpool_stats (rd_kafka_recvpool_t *rpool,
+                              struct rd_kafka_recvpool_stats *stats);
+void rd_kafka_recvpool_buf_reserve (rd_kafka_recvpool_t *rpool,
+                                    rd_buf_t *rbuf, size_t size);
+
+/**< Smallest size served by the pool, smaller payloads are allocated
+ *   by the regular buffer code. */
+#define RD_KAFKA_RECVPOOL_SIZE_MIN  (64*1024)
+
+int unittest_recvpool (void);
+
+#endif /* _RDKAFKA_RECVPOOL_H_ */
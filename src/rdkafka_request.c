@@ -1746,6 +1746,11 @@ rd_kafka_handle_Produce_parse (rd_kafka_broker_t *rkb,
                 rd_kafka_buf_read_i64(rkbuf, timestampp);
         }
 
+        if (request->rkbuf_reqhdr.ApiVersion >= 5) {
+                int64_t LogStartOffset;
+                rd_kafka_buf_read_i64(rkbuf, &LogStartOffset);
+        }
+
         if (request->rkbuf_reqhdr.ApiVersion >= 1) {
                 int32_t Throttle_Time;
                 rd_kafka_buf_read_i32(rkbuf, &Throttle_Time);
@@ -1794,6 +1799,21 @@ static void rd_kafka_handle_Produce (rd_kafka_t *rk,
                            rktp->rktp_rkt->rkt_topic->str, rktp->rktp_partition,
                            request->rkbuf_msgq.rkmq_msg_cnt);
 
+                /* Message enqueue to acknowledgement latency,
+                 * recorded for the whole batch under a single lock.
+                 * ra_enabled is constant after rd_kafka_toppar_new0(). */
+                if (rktp->rktp_avg_produce_latency.ra_enabled) {
+                        rd_avg_t *ra = &rktp->rktp_avg_produce_latency;
+                        const rd_ts_t now = rd_clock();
+                        rd_kafka_msg_t *rkm;
+
+                        mtx_lock(&ra->ra_lock);
+                        TAILQ_FOREACH(rkm, &request->rkbuf_msgq.rkmq_msgs,
+                                      rkm_link)
+                                rd_avg_add0(ra, now - rkm->rkm_ts_enq, 1);
+                        mtx_unlock(&ra->ra_lock);
+                }
+
         } else {
                 /* Error */
                 int actions;
@@ -1936,35 +1956,22 @@ static void rd_kafka_handle_Produce (rd_kafka_t *rk,
 
 
 /**
- * @brief Send ProduceRequest for messages in toppar queue.
+ * @brief Set the timeout of, and enqueue, ProduceRequest \p rkbuf
+ *        on its broker for transmission.
  *
- * @returns the number of messages included, or 0 on error / no messages.
- *
- * @locality broker thread
+ * @locality any thread
  */
-int rd_kafka_ProduceRequest (rd_kafka_broker_t *rkb, rd_kafka_toppar_t *rktp) {
-        rd_kafka_buf_t *rkbuf;
+static void rd_kafka_ProduceRequest_enq (rd_kafka_toppar_t *rktp,
+                                         rd_kafka_buf_t *rkbuf,
+                                         size_t MessageSetSize) {
         rd_kafka_itopic_t *rkt = rktp->rktp_rkt;
-        size_t MessageSetSize = 0;
-        int cnt;
         rd_ts_t now;
         int64_t first_msg_timeout;
         int tmout;
 
-        /**
-         * Create ProduceRequest with as many messages from the toppar
-         * transmit queue as possible.
-         */
-        rkbuf = rd_kafka_msgset_create_ProduceRequest(rkb, rktp,
-                                                      &MessageSetSize);
-        if (unlikely(!rkbuf))
-                return 0;
-
-        cnt = rkbuf->rkbuf_msgq.rkmq_msg_cnt;
-        rd_dassert(cnt > 0);
-
-        rd_avg_add(&rktp->rktp_rkt->rkt_avg_batchcnt, (int64_t)cnt);
-        rd_avg_add(&rktp->rktp_rkt->rkt_avg_batchsize, (int64_t)MessageSetSize);
+        rd_avg_add(&rkt->rkt_avg_batchcnt,
+                   (int64_t)rkbuf->rkbuf_msgq.rkmq_msg_cnt);
+        rd_avg_add(&rkt->rkt_avg_batchsize, (int64_t)MessageSetSize);
 
         if (!rkt->rkt_conf.required_acks)
                 rkbuf->rkbuf_flags |= RD_KAFKA_OP_F_NO_RESPONSE;
@@ -1987,11 +1994,153 @@ int rd_kafka_ProduceRequest (rd_kafka_broker_t *rkb, rd_kafka_toppar_t *rktp) {
          * capped by socket.timeout.ms */
         rd_kafka_buf_set_abs_timeout(rkbuf, tmout, now);
 
-        rd_kafka_broker_buf_enq_replyq(rkb, rkbuf,
+        rd_kafka_broker_buf_enq_replyq(rkbuf->rkbuf_rkb, rkbuf,
                                        RD_KAFKA_NO_REPLYQ,
                                        rd_kafka_handle_Produce,
                                        /* toppar ref for handle_Produce() */
                                        rd_kafka_toppar_keep(rktp));
+}
+
+
+/**
+ * @brief Add the finalized ProduceRequest in \p rko to the toppar's
+ *        list of MessageSets waiting for transmission and transmit
+ *        those that are next in sequence.
+ *
+ * MessageSets created while earlier ones are still being compressed
+ * by the offload pool are held back here to maintain the per-partition
+ * ordering.
+ *
+ * @locality any broker thread
+ * @locks none
+ */
+static void rd_kafka_ProduceRequest_offload_xmit (rd_kafka_toppar_t *rktp,
+                                                  rd_kafka_op_t *rko) {
+        struct rd_kafka_op_head_s xmitq = TAILQ_HEAD_INITIALIZER(xmitq);
+        rd_kafka_op_t *rko2;
+
+        rd_kafka_toppar_lock(rktp);
+
+        /* Insert in sequence order */
+        TAILQ_FOREACH(rko2, &rktp->rktp_offload.doneq, rko_link)
+                if (rko2->rko_u.offload.seq > rko->rko_u.offload.seq)
+                        break;
+        if (rko2)
+                TAILQ_INSERT_BEFORE(rko2, rko, rko_link);
+        else
+                TAILQ_INSERT_TAIL(&rktp->rktp_offload.doneq, rko, rko_link);
+
+        /* Move all MessageSets that are next in sequence to xmitq */
+        while ((rko2 = TAILQ_FIRST(&rktp->rktp_offload.doneq)) &&
+               rko2->rko_u.offload.seq == rktp->rktp_offload.xmit_seq) {
+                TAILQ_REMOVE(&rktp->rktp_offload.doneq, rko2, rko_link);
+                TAILQ_INSERT_TAIL(&xmitq, rko2, rko_link);
+                rktp->rktp_offload.xmit_seq++;
+        }
+
+        rd_kafka_toppar_unlock(rktp);
+
+        /* Each op holds a toppar reference,
+         * the last one may be dropped by op_destroy(). */
+        while ((rko2 = TAILQ_FIRST(&xmitq))) {
+                TAILQ_REMOVE(&xmitq, rko2, rko_link);
+                rd_kafka_ProduceRequest_enq(rktp, rko2->rko_u.offload.rkbuf,
+                                            rko2->rko_u.offload.
+                                            MessageSetSize);
+                rko2->rko_u.offload.rkbuf = NULL;
+                rd_kafka_op_destroy(rko2);
+        }
+}
+
+
+/**
+ * @brief Offload job done callback: the MessageSet has been compressed
+ *        and finalized, transmit it in sequence.
+ *
+ * @locality broker thread
+ */
+static void rd_kafka_ProduceRequest_offload_done (rd_kafka_t *rk,
+                                                  rd_kafka_op_t *rko) {
+        rd_kafka_buf_t *rkbuf = rko->rko_u.offload.rkbuf;
+
+        rkbuf->rkbuf_rkb->rkb_offload_cnt--;
+
+        rd_kafka_ProduceRequest_offload_xmit(
+                rd_kafka_toppar_s2i(rko->rko_rktp), rko);
+}
+
+
+/**
+ * @brief Send ProduceRequest for messages in toppar queue.
+ *
+ * If a compression offload pool is configured (`compression.threads`)
+ * large MessageSets are compressed by the pool and transmitted
+ * when done, in order.
+ *
+ * @returns the number of messages included, or 0 on error / no messages.
+ *
+ * @locality broker thread
+ */
+int rd_kafka_ProduceRequest (rd_kafka_broker_t *rkb, rd_kafka_toppar_t *rktp) {
+        rd_kafka_buf_t *rkbuf;
+        rd_kafka_op_t *rko = NULL;
+        size_t MessageSetSize = 0;
+        int64_t seq = -1;
+        int cnt;
+
+        /**
+         * Create ProduceRequest with as many messages from the toppar
+         * transmit queue as possible.
+         */
+        rkbuf = rd_kafka_msgset_create_ProduceRequest(rkb, rktp,
+                                                      &MessageSetSize,
+                                                      rkb->rkb_rk->rk_offload ?
+                                                      &rko : NULL);
+        if (rko) {
+                /* Compression offloaded: transmitted by
+                 * rd_kafka_ProduceRequest_offload_done() */
+                rkbuf = rko->rko_u.offload.rkbuf;
+                cnt = rkbuf->rkbuf_msgq.rkmq_msg_cnt;
+
+                rd_kafka_toppar_lock(rktp);
+                rko->rko_u.offload.seq = rktp->rktp_offload.next_seq++;
+                rd_kafka_toppar_unlock(rktp);
+
+                rko->rko_u.offload.done = rd_kafka_ProduceRequest_offload_done;
+                rko->rko_replyq = RD_KAFKA_REPLYQ(rkb->rkb_ops, 0);
+                rko->rko_rktp = rd_kafka_toppar_keep(rktp);
+
+                rkb->rkb_offload_cnt++;
+                rd_kafka_offload_enq(rkb->rkb_rk->rk_offload, rko);
+
+                return cnt;
+        }
+
+        if (unlikely(!rkbuf))
+                return 0;
+
+        cnt = rkbuf->rkbuf_msgq.rkmq_msg_cnt;
+        rd_dassert(cnt > 0);
+
+        if (rkb->rkb_rk->rk_offload) {
+                /* Hold back the MessageSet if earlier ones are still
+                 * being compressed. */
+                rd_kafka_toppar_lock(rktp);
+                if (rktp->rktp_offload.next_seq !=
+                    rktp->rktp_offload.xmit_seq)
+                        seq = rktp->rktp_offload.next_seq++;
+                rd_kafka_toppar_unlock(rktp);
+        }
+
+        if (seq != -1) {
+                rko = rd_kafka_op_new_offload(NULL, NULL, NULL);
+                rko->rko_u.offload.rkbuf = rkbuf;
+                rko->rko_u.offload.MessageSetSize = MessageSetSize;
+                rko->rko_u.offload.seq = seq;
+                rko->rko_rktp = rd_kafka_toppar_keep(rktp);
+                rd_kafka_ProduceRequest_offload_xmit(rktp, rko);
+        } else
+                rd_kafka_ProduceRequest_enq(rktp, rkbuf, MessageSetSize);
 
         return cnt;
 }
@@ -0,0 +1,588 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "rdkafka_int.h"
+#include "rdkafka_stats.h"
+#include "rdkafka_broker.h"
+#include "rdkafka_topic.h"
+#include "rdkafka_partition.h"
+#include "rdvarint.h"
+
+
+/**
+ * @brief Object types
+ */
+typedef enum {
+        RD_KAFKA_STATS_BIN_HANDLE,
+        RD_KAFKA_STATS_BIN_BROKER,
+        RD_KAFKA_STATS_BIN_TOPIC,
+        RD_KAFKA_STATS_BIN_PARTITION,
+        RD_KAFKA_STATS_BIN__CNT
+} rd_kafka_stats_bin_type_t;
+
+/**
+ * @brief Record types
+ */
+#define RD_KAFKA_STATS_BIN_R_FIELDS  1  /* Field names of an object type */
+#define RD_KAFKA_STATS_BIN_R_OBJECT  2  /* Object definition */
+#define RD_KAFKA_STATS_BIN_R_VALUES  3  /* Object value deltas */
+
+#define RD_KAFKA_STATS_BIN_MAGIC     "RKSB"
+#define RD_KAFKA_STATS_BIN_VERSION   1
+#define RD_KAFKA_STATS_BIN_F_FULL    0x1  /* Full snapshot */
+
+
+/**
+ * @brief Handle field indices
+ */
+typedef enum {
+        RD_KAFKA_STATS_BIN_H_REPLYQ,
+        RD_KAFKA_STATS_BIN_H_MSG_CNT,
+        RD_KAFKA_STATS_BIN_H_MSG_SIZE,
+        RD_KAFKA_STATS_BIN_H_MSG_MAX,
+        RD_KAFKA_STATS_BIN_H_MSG_SIZE_MAX,
+        RD_KAFKA_STATS_BIN_H_SIMPLE_CNT,
+        RD_KAFKA_STATS_BIN_H_METADATA_CACHE_CNT,
+        RD_KAFKA_STATS_BIN_H_FETCHQ_BYTES,
+        RD_KAFKA_STATS_BIN_H_FETCHQ_MAX_BYTES,
+        RD_KAFKA_STATS_BIN_H_FETCHQ_PROCESS_BYTES,
+        RD_KAFKA_STATS_BIN_H_TX,
+        RD_KAFKA_STATS_BIN_H_TX_BYTES,
+        RD_KAFKA_STATS_BIN_H_RX,
+        RD_KAFKA_STATS_BIN_H_RX_BYTES,
+        RD_KAFKA_STATS_BIN_H_TXMSGS,
+        RD_KAFKA_STATS_BIN_H_TXMSG_BYTES,
+        RD_KAFKA_STATS_BIN_H_RXMSGS,
+        RD_KAFKA_STATS_BIN_H_RXMSG_BYTES,
+        RD_KAFKA_STATS_BIN_H__CNT
+} rd_kafka_stats_bin_handle_field_t;
+
+/**
+ * @brief Broker field indices
+ */
+typedef enum {
+        RD_KAFKA_STATS_BIN_B_NODEID,
+        RD_KAFKA_STATS_BIN_B_STATE,
+        RD_KAFKA_STATS_BIN_B_STATEAGE,
+        RD_KAFKA_STATS_BIN_B_OUTBUF_CNT,
+        RD_KAFKA_STATS_BIN_B_OUTBUF_MSG_CNT,
+        RD_KAFKA_STATS_BIN_B_WAITRESP_CNT,
+        RD_KAFKA_STATS_BIN_B_WAITRESP_MSG_CNT,
+        RD_KAFKA_STATS_BIN_B_TX,
+        RD_KAFKA_STATS_BIN_B_TXBYTES,
+        RD_KAFKA_STATS_BIN_B_TXERRS,
+        RD_KAFKA_STATS_BIN_B_TXRETRIES,
+        RD_KAFKA_STATS_BIN_B_REQ_TIMEOUTS,
+        RD_KAFKA_STATS_BIN_B_RX,
+        RD_KAFKA_STATS_BIN_B_RXBYTES,
+        RD_KAFKA_STATS_BIN_B_RXERRS,
+        RD_KAFKA_STATS_BIN_B_RXCORRIDERRS,
+        RD_KAFKA_STATS_BIN_B_RXPARTIAL,
+        RD_KAFKA_STATS_BIN_B_ZBUF_GROW,
+        RD_KAFKA_STATS_BIN_B_BUF_GROW,
+        RD_KAFKA_STATS_BIN_B_WAKEUPS,
+        RD_KAFKA_STATS_BIN_B_IO_SYSCALLS,
+        RD_KAFKA_STATS_BIN_B__CNT
+} rd_kafka_stats_bin_broker_field_t;
+
+
+/**
+ * Field names per object type, same names as in the JSON statistics.
+ * The handle and broker collectors below fill in the values by the
+ * field indices above, the others in the same order as the names.
+ */
+static const char *
+rd_kafka_stats_bin_handle_fields[RD_KAFKA_STATS_BIN_H__CNT] = {
+        [RD_KAFKA_STATS_BIN_H_REPLYQ]               = "replyq",
+        [RD_KAFKA_STATS_BIN_H_MSG_CNT]              = "msg_cnt",
+        [RD_KAFKA_STATS_BIN_H_MSG_SIZE]             = "msg_size",
+        [RD_KAFKA_STATS_BIN_H_MSG_MAX]              = "msg_max",
+        [RD_KAFKA_STATS_BIN_H_MSG_SIZE_MAX]         = "msg_size_max",
+        [RD_KAFKA_STATS_BIN_H_SIMPLE_CNT]           = "simple_cnt",
+        [RD_KAFKA_STATS_BIN_H_METADATA_CACHE_CNT]   = "metadata_cache_cnt",
+        [RD_KAFKA_STATS_BIN_H_FETCHQ_BYTES]         = "fetchq_bytes",
+        [RD_KAFKA_STATS_BIN_H_FETCHQ_MAX_BYTES]     = "fetchq_max_bytes",
+        [RD_KAFKA_STATS_BIN_H_FETCHQ_PROCESS_BYTES] = "fetchq_process_bytes",
+        [RD_KAFKA_STATS_BIN_H_TX]                   = "tx",
+        [RD_KAFKA_STATS_BIN_H_TX_BYTES]             = "tx_bytes",
+        [RD_KAFKA_STATS_BIN_H_RX]                   = "rx",
+        [RD_KAFKA_STATS_BIN_H_RX_BYTES]             = "rx_bytes",
+        [RD_KAFKA_STATS_BIN_H_TXMSGS]               = "txmsgs",
+        [RD_KAFKA_STATS_BIN_H_TXMSG_BYTES]          = "txmsg_bytes",
+        [RD_KAFKA_STATS_BIN_H_RXMSGS]               = "rxmsgs",
+        [RD_KAFKA_STATS_BIN_H_RXMSG_BYTES]          = "rxmsg_bytes"
+};
+
+static const char *
+rd_kafka_stats_bin_broker_fields[RD_KAFKA_STATS_BIN_B__CNT] = {
+        [RD_KAFKA_STATS_BIN_B_NODEID]           = "nodeid",
+        [RD_KAFKA_STATS_BIN_B_STATE]            = "state",
+        [RD_KAFKA_STATS_BIN_B_STATEAGE]         = "stateage",
+        [RD_KAFKA_STATS_BIN_B_OUTBUF_CNT]       = "outbuf_cnt",
+        [RD_KAFKA_STATS_BIN_B_OUTBUF_MSG_CNT]   = "outbuf_msg_cnt",
+        [RD_KAFKA_STATS_BIN_B_WAITRESP_CNT]     = "waitresp_cnt",
+        [RD_KAFKA_STATS_BIN_B_WAITRESP_MSG_CNT] = "waitresp_msg_cnt",
+        [RD_KAFKA_STATS_BIN_B_TX]               = "tx",
+        [RD_KAFKA_STATS_BIN_B_TXBYTES]          = "txbytes",
+        [RD_KAFKA_STATS_BIN_B_TXERRS]           = "txerrs",
+        [RD_KAFKA_STATS_BIN_B_TXRETRIES]        = "txretries",
+        [RD_KAFKA_STATS_BIN_B_REQ_TIMEOUTS]     = "req_timeouts",
+        [RD_KAFKA_STATS_BIN_B_RX]               = "rx",
+        [RD_KAFKA_STATS_BIN_B_RXBYTES]          = "rxbytes",
+        [RD_KAFKA_STATS_BIN_B_RXERRS]           = "rxerrs",
+        [RD_KAFKA_STATS_BIN_B_RXCORRIDERRS]     = "rxcorriderrs",
+        [RD_KAFKA_STATS_BIN_B_RXPARTIAL]        = "rxpartial",
+        [RD_KAFKA_STATS_BIN_B_ZBUF_GROW]        = "zbuf_grow",
+        [RD_KAFKA_STATS_BIN_B_BUF_GROW]         = "buf_grow",
+        [RD_KAFKA_STATS_BIN_B_WAKEUPS]          = "wakeups",
+        [RD_KAFKA_STATS_BIN_B_IO_SYSCALLS]      = "io_syscalls"
+};
+
+static const char *rd_kafka_stats_bin_topic_fields[] = {
+        "metadata_age"
+};
+
+static const char *rd_kafka_stats_bin_partition_fields[] = {
+        "leader", "desired", "unknown",
+        "msgq_cnt", "msgq_bytes",
+        "fetchq_cnt", "fetchq_size", "fetchq_bytes",
+        "fetch_state", "fetch_size",
+        "query_offset", "next_offset", "app_offset", "stored_offset",
+        "committed_offset", "eof_offset", "lo_offset", "hi_offset",
+        "consumer_lag",
+        "txmsgs", "txbytes", "rxmsgs", "rxbytes", "msgs", "rx_ver_drops"
+};
+
+static const struct {
+        const char **names;
+        int cnt;
+} rd_kafka_stats_bin_fields[RD_KAFKA_STATS_BIN__CNT] = {
+#define _FIELDS(arr) { arr, (int)RD_ARRAYSIZE(arr) }
+        [RD_KAFKA_STATS_BIN_HANDLE] =
+        _FIELDS(rd_kafka_stats_bin_handle_fields),
+        [RD_KAFKA_STATS_BIN_BROKER] =
+        _FIELDS(rd_kafka_stats_bin_broker_fields),
+        [RD_KAFKA_STATS_BIN_TOPIC] =
+        _FIELDS(rd_kafka_stats_bin_topic_fields),
+        [RD_KAFKA_STATS_BIN_PARTITION] =
+        _FIELDS(rd_kafka_stats_bin_partition_fields),
+#undef _FIELDS
+};
+
+/* Largest field count of any object type */
+#define RD_KAFKA_STATS_BIN_FIELDS_MAX                                   \
+        RD_ARRAYSIZE(rd_kafka_stats_bin_partition_fields)
+
+
+/**
+ * @brief Emitter state
+ */
+struct rd_kafka_stats_bin_emit {
+        rd_kafka_t *rk;
+        char   *buf;      /* Pointer to allocated buffer */
+        size_t  size;     /* Current allocated size of buf */
+        size_t  of;       /* Current write-offset in buf */
+        int     full;     /* Full snapshot */
+};
+
+
+/**
+ * @brief Make room for at least \p len more bytes.
+ */
+static RD_INLINE void rd_kafka_stats_bin_reserve (
+        struct rd_kafka_stats_bin_emit *st, size_t len) {
+        if (unlikely(st->of + len > st->size)) {
+                while (st->of + len > st->size)
+                        st->size *= 2;
+                st->buf = rd_realloc(st->buf, st->size);
+        }
+}
+
+static RD_INLINE void rd_kafka_stats_bin_uvarint (
+        struct rd_kafka_stats_bin_emit *st, uint64_t v) {
+        rd_kafka_stats_bin_reserve(st, RD_UVARINT_ENC_SIZEOF(uint64_t));
+        st->of += rd_uvarint_enc_u64(st->buf + st->of, st->size - st->of, v);
+}
+
+static RD_INLINE void rd_kafka_stats_bin_varint (
+        struct rd_kafka_stats_bin_emit *st, int64_t v) {
+        rd_kafka_stats_bin_reserve(st, RD_UVARINT_ENC_SIZEOF(int64_t));
+        st->of += rd_uvarint_enc_i64(st->buf + st->of, st->size - st->of, v);
+}
+
+static void rd_kafka_stats_bin_str (struct rd_kafka_stats_bin_emit *st,
+                                    const char *str, size_t len) {
+        rd_kafka_stats_bin_uvarint(st, len);
+        rd_kafka_stats_bin_reserve(st, len);
+        memcpy(st->buf + st->of, str, len);
+        st->of += len;
+}
+
+
+/**
+ * @brief Emit an OBJECT record for \p obj if it has not been emitted
+ *        before, or if this is a full snapshot.
+ *
+ * @returns the object id.
+ */
+static int32_t rd_kafka_stats_bin_obj_define (
+        struct rd_kafka_stats_bin_emit *st,
+        rd_kafka_stats_bin_obj_t *obj,
+        rd_kafka_stats_bin_type_t type,
+        int32_t parent_id,
+        const char *name, size_t namelen) {
+
+        if (obj->id && !st->full)
+                return obj->id;
+
+        if (!obj->id) {
+                obj->id = ++st->rk->rk_stats_bin.next_id;
+                obj->last = rd_calloc(rd_kafka_stats_bin_fields[type].cnt,
+                                      sizeof(*obj->last));
+        } else {
+                /* Full snapshot: values are relative to zero */
+                memset(obj->last, 0,
+                       sizeof(*obj->last) *
+                       rd_kafka_stats_bin_fields[type].cnt);
+        }
+
+        rd_kafka_stats_bin_uvarint(st, RD_KAFKA_STATS_BIN_R_OBJECT);
+        rd_kafka_stats_bin_uvarint(st, obj->id);
+        rd_kafka_stats_bin_uvarint(st, type);
+        rd_kafka_stats_bin_uvarint(st, parent_id);
+        rd_kafka_stats_bin_str(st, name, namelen);
+
+        return obj->id;
+}
+
+
+/**
+ * @brief Emit a VALUES record with the values \p v of \p obj that
+ *        changed since they were last emitted, if any.
+ */
+static void rd_kafka_stats_bin_obj_values (struct rd_kafka_stats_bin_emit *st,
+                                           rd_kafka_stats_bin_obj_t *obj,
+                                           rd_kafka_stats_bin_type_t type,
+                                           const int64_t *v) {
+        int i;
+        int changed = 0;
+
+        for (i = 0 ; i < rd_kafka_stats_bin_fields[type].cnt ; i++) {
+                int64_t delta = v[i] - obj->last[i];
+
+                if (!delta)
+                        continue;
+
+                if (!changed++) {
+                        rd_kafka_stats_bin_uvarint(
+                                st, RD_KAFKA_STATS_BIN_R_VALUES);
+                        rd_kafka_stats_bin_uvarint(st, obj->id);
+                }
+
+                rd_kafka_stats_bin_uvarint(st, i + 1);
+                rd_kafka_stats_bin_varint(st, delta);
+                obj->last[i] = v[i];
+        }
+
+        if (changed)
+                rd_kafka_stats_bin_uvarint(st, 0); /* End of values */
+}
+
+
+/**
+ * @brief Emit partition \p rktp of topic object \p topic_id.
+ */
+static void rd_kafka_stats_bin_toppar (struct rd_kafka_stats_bin_emit *st,
+                                       int32_t topic_id,
+                                       rd_kafka_toppar_t *rktp,
+                                       int64_t *tot_v) {
+        rd_kafka_t *rk = st->rk;
+        int64_t v[RD_ARRAYSIZE(rd_kafka_stats_bin_partition_fields)];
+        int64_t consumer_lag = -1;
+        int32_t leader_nodeid = -1;
+        char name[16];
+        int i = 0;
+
+        rd_kafka_toppar_lock(rktp);
+        rd_kafka_toppar_ingress_drain(rktp);
+
+        if (rktp->rktp_leader) {
+                rd_kafka_broker_lock(rktp->rktp_leader);
+                leader_nodeid = rktp->rktp_leader->rkb_nodeid;
+                rd_kafka_broker_unlock(rktp->rktp_leader);
+        }
+
+        if (rktp->rktp_hi_offset != RD_KAFKA_OFFSET_INVALID &&
+            rktp->rktp_app_offset >= 0) {
+                if (unlikely(rktp->rktp_app_offset > rktp->rktp_hi_offset))
+                        consumer_lag = 0;
+                else
+                        consumer_lag = rktp->rktp_hi_offset -
+                                rktp->rktp_app_offset;
+        }
+
+        v[i++] = leader_nodeid;
+        v[i++] = !!(rktp->rktp_flags & RD_KAFKA_TOPPAR_F_DESIRED);
+        v[i++] = !!(rktp->rktp_flags & RD_KAFKA_TOPPAR_F_UNKNOWN);
+        v[i++] = rd_kafka_msgq_len(&rktp->rktp_msgq);
+        v[i++] = rd_kafka_msgq_size(&rktp->rktp_msgq);
+        v[i++] = rd_kafka_q_len(rktp->rktp_fetchq);
+        v[i++] = rd_kafka_q_size(rktp->rktp_fetchq);
+        v[i++] = rd_atomic64_get(&rktp->rktp_fetchq_bytes);
+        v[i++] = rktp->rktp_fetch_state;
+        v[i++] = rktp->rktp_fetch_msg_max_bytes;
+        v[i++] = rktp->rktp_query_offset;
+        v[i++] = rktp->rktp_offsets_fin.fetch_offset;
+        v[i++] = rktp->rktp_app_offset;
+        v[i++] = rktp->rktp_stored_offset;
+        v[i++] = rktp->rktp_committed_offset;
+        v[i++] = rktp->rktp_offsets_fin.eof_offset;
+        v[i++] = rktp->rktp_lo_offset;
+        v[i++] = rktp->rktp_hi_offset;
+        v[i++] = consumer_lag;
+        v[i++] = rd_atomic64_get(&rktp->rktp_c.tx_msgs);
+        v[i++] = rd_atomic64_get(&rktp->rktp_c.tx_msg_bytes);
+        v[i++] = rd_atomic64_get(&rktp->rktp_c.rx_msgs);
+        v[i++] = rd_atomic64_get(&rktp->rktp_c.rx_msg_bytes);
+        v[i++] = rk->rk_type == RD_KAFKA_PRODUCER ?
+                rd_atomic64_get(&rktp->rktp_c.producer_enq_msgs) :
+                rd_atomic64_get(&rktp->rktp_c.rx_msgs);
+        v[i++] = rd_atomic64_get(&rktp->rktp_c.rx_ver_drops);
+        rd_dassert(i == (int)RD_ARRAYSIZE(v));
+
+        rd_kafka_toppar_unlock(rktp);
+
+        if (tot_v) {
+                tot_v[RD_KAFKA_STATS_BIN_H_TXMSGS] +=
+                        rd_atomic64_get(&rktp->rktp_c.tx_msgs);
+                tot_v[RD_KAFKA_STATS_BIN_H_TXMSG_BYTES] +=
+                        rd_atomic64_get(&rktp->rktp_c.tx_msg_bytes);
+                tot_v[RD_KAFKA_STATS_BIN_H_RXMSGS] +=
+                        rd_atomic64_get(&rktp->rktp_c.rx_msgs);
+                tot_v[RD_KAFKA_STATS_BIN_H_RXMSG_BYTES] +=
+                        rd_atomic64_get(&rktp->rktp_c.rx_msg_bytes);
+        }
+
+        rd_snprintf(name, sizeof(name), "%"PRId32, rktp->rktp_partition);
+        rd_kafka_stats_bin_obj_define(st, &rktp->rktp_stats_bin,
+                                      RD_KAFKA_STATS_BIN_PARTITION,
+                                      topic_id, name, strlen(name));
+        rd_kafka_stats_bin_obj_values(st, &rktp->rktp_stats_bin,
+                                      RD_KAFKA_STATS_BIN_PARTITION, v);
+}
+
+
+/**
+ * @brief Emit binary statistics for the handle, its brokers, topics and
+ *        partitions to the application (RD_KAFKA_OP_STATS_BINARY).
+ *
+ * @locality rdkafka main thread
+ */
+void rd_kafka_stats_emit_binary (rd_kafka_t *rk) {
+        struct rd_kafka_stats_bin_emit stx = { .rk = rk, .size = 1024 };
+        struct rd_kafka_stats_bin_emit *st = &stx;
+        int64_t hv[RD_KAFKA_STATS_BIN_H__CNT];
+        rd_kafka_broker_t *rkb;
+        rd_kafka_itopic_t *rkt;
+        unsigned int tot_cnt;
+        size_t tot_size;
+        int32_t rk_id;
+        rd_ts_t now;
+        rd_kafka_op_t *rko;
+        int i;
+
+        st->buf = rd_malloc(st->size);
+        st->full = !(rk->rk_stats_bin.seq % RD_KAFKA_STATS_BIN_FULL_INTERVAL);
+
+        now = rd_clock();
+
+        /* Header */
+        rd_kafka_stats_bin_reserve(st, 4);
+        memcpy(st->buf, RD_KAFKA_STATS_BIN_MAGIC, 4);
+        st->of += 4;
+        rd_kafka_stats_bin_uvarint(st, RD_KAFKA_STATS_BIN_VERSION);
+        rd_kafka_stats_bin_uvarint(st, st->full ?
+                                   RD_KAFKA_STATS_BIN_F_FULL : 0);
+        rd_kafka_stats_bin_uvarint(st, rk->rk_stats_bin.seq++);
+        rd_kafka_stats_bin_varint(st, now);
+        rd_kafka_stats_bin_varint(st, (int64_t)time(NULL));
+
+        if (st->full) {
+                int type;
+                for (type = 0 ; type < RD_KAFKA_STATS_BIN__CNT ; type++) {
+                        rd_kafka_stats_bin_uvarint(
+                                st, RD_KAFKA_STATS_BIN_R_FIELDS);
+                        rd_kafka_stats_bin_uvarint(st, type);
+                        rd_kafka_stats_bin_uvarint(
+                                st, rd_kafka_stats_bin_fields[type].cnt);
+                        for (i = 0 ;
+                             i < rd_kafka_stats_bin_fields[type].cnt ; i++)
+                                rd_kafka_stats_bin_str(
+                                        st,
+                                        rd_kafka_stats_bin_fields[type].
+                                        names[i],
+                                        strlen(rd_kafka_stats_bin_fields
+                                               [type].names[i]));
+                }
+        }
+
+        rk_id = rd_kafka_stats_bin_obj_define(st, &rk->rk_stats_bin.obj,
+                                              RD_KAFKA_STATS_BIN_HANDLE, 0,
+                                              rk->rk_name,
+                                              strlen(rk->rk_name));
+
+        memset(hv, 0, sizeof(hv));
+
+        rd_kafka_curr_msgs_get(rk, &tot_cnt, &tot_size);
+        rd_kafka_rdlock(rk);
+
+        TAILQ_FOREACH(rkb, &rk->rk_brokers, rkb_link) {
+                int64_t v[RD_KAFKA_STATS_BIN_B__CNT];
+
+                rd_kafka_broker_lock(rkb);
+                v[RD_KAFKA_STATS_BIN_B_NODEID] = rkb->rkb_nodeid;
+                v[RD_KAFKA_STATS_BIN_B_STATE] = rkb->rkb_state;
+                v[RD_KAFKA_STATS_BIN_B_STATEAGE] =
+                        rkb->rkb_ts_state ? now - rkb->rkb_ts_state : 0;
+                v[RD_KAFKA_STATS_BIN_B_OUTBUF_CNT] =
+                        rd_atomic32_get(&rkb->rkb_outbufs.rkbq_cnt);
+                v[RD_KAFKA_STATS_BIN_B_OUTBUF_MSG_CNT] =
+                        rd_atomic32_get(&rkb->rkb_outbufs.rkbq_msg_cnt);
+                v[RD_KAFKA_STATS_BIN_B_WAITRESP_CNT] =
+                        rd_atomic32_get(&rkb->rkb_waitresps.rkbq_cnt);
+                v[RD_KAFKA_STATS_BIN_B_WAITRESP_MSG_CNT] =
+                        rd_atomic32_get(&rkb->rkb_waitresps.rkbq_msg_cnt);
+                v[RD_KAFKA_STATS_BIN_B_TX] = rd_atomic64_get(&rkb->rkb_c.tx);
+                v[RD_KAFKA_STATS_BIN_B_TXBYTES] =
+                        rd_atomic64_get(&rkb->rkb_c.tx_bytes);
+                v[RD_KAFKA_STATS_BIN_B_TXERRS] =
+                        rd_atomic64_get(&rkb->rkb_c.tx_err);
+                v[RD_KAFKA_STATS_BIN_B_TXRETRIES] =
+                        rd_atomic64_get(&rkb->rkb_c.tx_retries);
+                v[RD_KAFKA_STATS_BIN_B_REQ_TIMEOUTS] =
+                        rd_atomic64_get(&rkb->rkb_c.req_timeouts);
+                v[RD_KAFKA_STATS_BIN_B_RX] = rd_atomic64_get(&rkb->rkb_c.rx);
+                v[RD_KAFKA_STATS_BIN_B_RXBYTES] =
+                        rd_atomic64_get(&rkb->rkb_c.rx_bytes);
+                v[RD_KAFKA_STATS_BIN_B_RXERRS] =
+                        rd_atomic64_get(&rkb->rkb_c.rx_err);
+                v[RD_KAFKA_STATS_BIN_B_RXCORRIDERRS] =
+                        rd_atomic64_get(&rkb->rkb_c.rx_corrid_err);
+                v[RD_KAFKA_STATS_BIN_B_RXPARTIAL] =
+                        rd_atomic64_get(&rkb->rkb_c.rx_partial);
+                v[RD_KAFKA_STATS_BIN_B_ZBUF_GROW] =
+                        rd_atomic64_get(&rkb->rkb_c.zbuf_grow);
+                v[RD_KAFKA_STATS_BIN_B_BUF_GROW] =
+                        rd_atomic64_get(&rkb->rkb_c.buf_grow);
+                v[RD_KAFKA_STATS_BIN_B_WAKEUPS] =
+                        rd_atomic64_get(&rkb->rkb_c.wakeups);
+                v[RD_KAFKA_STATS_BIN_B_IO_SYSCALLS] =
+                        rd_atomic64_get(&rkb->rkb_c.io_syscalls);
+
+                rd_kafka_stats_bin_obj_define(st, &rkb->rkb_stats_bin,
+                                              RD_KAFKA_STATS_BIN_BROKER,
+                                              rk_id, rkb->rkb_name,
+                                              strlen(rkb->rkb_name));
+                rd_kafka_broker_unlock(rkb);
+
+                rd_kafka_stats_bin_obj_values(st, &rkb->rkb_stats_bin,
+                                              RD_KAFKA_STATS_BIN_BROKER, v);
+
+                hv[RD_KAFKA_STATS_BIN_H_TX] += v[RD_KAFKA_STATS_BIN_B_TX];
+                hv[RD_KAFKA_STATS_BIN_H_TX_BYTES] +=
+                        v[RD_KAFKA_STATS_BIN_B_TXBYTES];
+                hv[RD_KAFKA_STATS_BIN_H_RX] += v[RD_KAFKA_STATS_BIN_B_RX];
+                hv[RD_KAFKA_STATS_BIN_H_RX_BYTES] +=
+                        v[RD_KAFKA_STATS_BIN_B_RXBYTES];
+        }
+
+        TAILQ_FOREACH(rkt, &rk->rk_topics, rkt_link) {
+                shptr_rd_kafka_toppar_t *s_rktp;
+                int64_t v[RD_ARRAYSIZE(rd_kafka_stats_bin_topic_fields)];
+                int32_t rkt_id;
+                int j;
+
+                rd_kafka_topic_rdlock(rkt);
+
+                v[0] = rkt->rkt_ts_metadata ?
+                        (now - rkt->rkt_ts_metadata) / 1000 : 0;
+
+                rkt_id = rd_kafka_stats_bin_obj_define(
+                        st, &rkt->rkt_stats_bin, RD_KAFKA_STATS_BIN_TOPIC,
+                        rk_id, rkt->rkt_topic->str,
+                        (size_t)RD_KAFKAP_STR_LEN(rkt->rkt_topic));
+                rd_kafka_stats_bin_obj_values(st, &rkt->rkt_stats_bin,
+                                              RD_KAFKA_STATS_BIN_TOPIC, v);
+
+                for (i = 0 ; i < rkt->rkt_partition_cnt ; i++)
+                        rd_kafka_stats_bin_toppar(
+                                st, rkt_id,
+                                rd_kafka_toppar_s2i(rkt->rkt_p[i]), hv);
+
+                RD_LIST_FOREACH(s_rktp, &rkt->rkt_desp, j)
+                        rd_kafka_stats_bin_toppar(
+                                st, rkt_id, rd_kafka_toppar_s2i(s_rktp), hv);
+
+                if (rkt->rkt_ua)
+                        rd_kafka_stats_bin_toppar(
+                                st, rkt_id,
+                                rd_kafka_toppar_s2i(rkt->rkt_ua), NULL);
+
+                rd_kafka_topic_rdunlock(rkt);
+        }
+
+        hv[RD_KAFKA_STATS_BIN_H_REPLYQ] = rd_kafka_q_len(rk->rk_rep);
+        hv[RD_KAFKA_STATS_BIN_H_MSG_CNT] = tot_cnt;
+        hv[RD_KAFKA_STATS_BIN_H_MSG_SIZE] = tot_size;
+        hv[RD_KAFKA_STATS_BIN_H_MSG_MAX] = rk->rk_curr_msgs.max_cnt;
+        hv[RD_KAFKA_STATS_BIN_H_MSG_SIZE_MAX] = rk->rk_curr_msgs.max_size;
+        hv[RD_KAFKA_STATS_BIN_H_SIMPLE_CNT] =
+                rd_atomic32_get(&rk->rk_simple_cnt);
+        hv[RD_KAFKA_STATS_BIN_H_METADATA_CACHE_CNT] =
+                rk->rk_metadata_cache.rkmc_cnt;
+        hv[RD_KAFKA_STATS_BIN_H_FETCHQ_BYTES] =
+                rd_atomic64_get(&rk->rk_fetchq.bytes);
+        hv[RD_KAFKA_STATS_BIN_H_FETCHQ_MAX_BYTES] =
+                rk->rk_conf.queued_max_total_bytes;
+        hv[RD_KAFKA_STATS_BIN_H_FETCHQ_PROCESS_BYTES] =
+                rd_atomic64_get(&rd_kafka_fetchq_global.bytes);
+        /* The tx, rx and msg totals were summed up above */
+
+        rd_kafka_rdunlock(rk);
+
+        rd_kafka_stats_bin_obj_values(st, &rk->rk_stats_bin.obj,
+                                      RD_KAFKA_STATS_BIN_HANDLE, hv);
+
+        /* Enqueue op for application */
+        rko = rd_kafka_op_new(RD_KAFKA_OP_STATS_BINARY);
+        rd_kafka_op_set_prio(rko, RD_KAFKA_PRIO_HIGH);
+        rko->rko_u.stats_binary.buf = st->buf;
+        rko->rko_u.stats_binary.size = st->of;
+        rd_kafka_q_enq(rk->rk_rep, rko);
+}
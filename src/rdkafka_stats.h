@@ -0,0 +1,69 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _RDKAFKA_STATS_H_
+#define _RDKAFKA_STATS_H_
+
+
+/**
+ * @name Binary statistics (statistics.format=binary)
+ *
+ * A compact encoding of the numeric statistics of the handle, its
+ * brokers, topics and partitions, carrying only the values that changed
+ * since the previous emit. See STATISTICS.md for the format.
+ *
+ * Each object keeps the values it was last emitted with.
+ * This state is only accessed by the rdkafka main thread,
+ * and by the object's final destructor.
+ */
+
+/**
+ * Emit a full snapshot (all objects and values, relative to zero)
+ * every this many emits, allowing decoders to (re)synchronize.
+ */
+#define RD_KAFKA_STATS_BIN_FULL_INTERVAL  60
+
+typedef struct rd_kafka_stats_bin_obj_s {
+        int32_t  id;    /* Object id, 0 until first emitted. */
+        int64_t *last;  /* Last emitted values, indexed by field. */
+} rd_kafka_stats_bin_obj_t;
+
+/**
+ * @brief Free object \p obj 's binary stats state.
+ */
+static RD_INLINE RD_UNUSED
+void rd_kafka_stats_bin_obj_destroy (rd_kafka_stats_bin_obj_t *obj) {
+        if (obj->last)
+                rd_free(obj->last);
+        obj->last = NULL;
+}
+
+void rd_kafka_stats_emit_binary (rd_kafka_t *rk);
+
+#endif /* _RDKAFKA_STATS_H_ */
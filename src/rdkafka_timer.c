@@ -30,6 +30,8 @@
 #include "rd.h"
 #include "rdtime.h"
 #include "rdsysqueue.h"
+#include "rdunittest.h"
+#include "rdrand.h"
 
 
 static RD_INLINE void rd_kafka_timers_lock (rd_kafka_timers_t *rkts) {
@@ -51,20 +53,62 @@ static RD_INLINE int rd_kafka_timer_scheduled (const rd_kafka_timer_t *rtmr) {
 }
 
 
-static int rd_kafka_timer_cmp (const void *_a, const void *_b) {
-	const rd_kafka_timer_t *a = _a, *b = _b;
-	return (int)(a->rtmr_next - b->rtmr_next);
+/**
+ * @returns the timing wheel tick of time \p ts
+ */
+#define RD_KAFKA_TIMER_TICK(ts)  ((ts) / RD_KAFKA_TIMER_WHEEL_TICK_US)
+
+/**
+ * @returns the slot index of \p tick at wheel level \p level
+ */
+#define RD_KAFKA_TIMER_SLOT(tick,level)                                 \
+        (int)(((tick) >> ((level) * RD_KAFKA_TIMER_WHEEL_BITS)) &       \
+              (RD_KAFKA_TIMER_WHEEL_SLOTS - 1))
+
+
+/**
+ * @brief Place scheduled timer \p rtmr in its wheel slot
+ *        relative to the current tick.
+ */
+static void rd_kafka_timer_place (rd_kafka_timers_t *rkts,
+                                  rd_kafka_timer_t *rtmr) {
+        rd_ts_t tick = RD_KAFKA_TIMER_TICK(rtmr->rtmr_next);
+        rd_ts_t delta;
+        int level;
+
+        if (tick < rkts->rkts_tick)
+                tick = rkts->rkts_tick;
+        delta = tick - rkts->rkts_tick;
+
+        for (level = 0 ; level < RD_KAFKA_TIMER_WHEEL_LEVELS - 1 ; level++)
+                if (delta < ((rd_ts_t)1 <<
+                             ((level + 1) * RD_KAFKA_TIMER_WHEEL_BITS)))
+                        break;
+
+        if (level == RD_KAFKA_TIMER_WHEEL_LEVELS - 1 &&
+            delta >= ((rd_ts_t)1 << (RD_KAFKA_TIMER_WHEEL_LEVELS *
+                                     RD_KAFKA_TIMER_WHEEL_BITS)))
+                /* Beyond the wheel: place it in the last slot and
+                 * re-place it when that slot is cascaded. */
+                tick = rkts->rkts_tick +
+                        ((rd_ts_t)1 << (RD_KAFKA_TIMER_WHEEL_LEVELS *
+                                        RD_KAFKA_TIMER_WHEEL_BITS)) - 1;
+
+        LIST_INSERT_HEAD(&rkts->rkts_wheel[level]
+                         [RD_KAFKA_TIMER_SLOT(tick, level)],
+                         rtmr, rtmr_link);
 }
 
+
 static void rd_kafka_timer_unschedule (rd_kafka_timers_t *rkts,
                                        rd_kafka_timer_t *rtmr) {
-	TAILQ_REMOVE(&rkts->rkts_timers, rtmr, rtmr_link);
+	LIST_REMOVE(rtmr, rtmr_link);
 	rtmr->rtmr_next = 0;
+        rkts->rkts_cnt--;
 }
 
 static void rd_kafka_timer_schedule (rd_kafka_timers_t *rkts,
 				     rd_kafka_timer_t *rtmr, int extra_us) {
-	rd_kafka_timer_t *first;
 
 	/* Timer has been stopped */
 	if (!rtmr->rtmr_interval)
@@ -76,16 +120,84 @@ static void rd_kafka_timer_schedule (rd_kafka_timers_t *rkts,
 
 	rtmr->rtmr_next = rd_clock() + rtmr->rtmr_interval + extra_us;
 
-	if (!(first = TAILQ_FIRST(&rkts->rkts_timers)) ||
-	    first->rtmr_next > rtmr->rtmr_next) {
-		TAILQ_INSERT_HEAD(&rkts->rkts_timers, rtmr, rtmr_link);
+        rd_kafka_timer_place(rkts, rtmr);
+        rkts->rkts_cnt++;
+
+        /* Wake up rd_kafka_timers_run() if it sleeps past this timer */
+        if (rkts->rkts_wakeup && rtmr->rtmr_next < rkts->rkts_wakeup)
                 cnd_signal(&rkts->rkts_cond);
-	} else
-		TAILQ_INSERT_SORTED(&rkts->rkts_timers, rtmr,
-                                    rd_kafka_timer_t *, rtmr_link,
-				    rd_kafka_timer_cmp);
 }
 
+
+/**
+ * @brief Re-place the timers of slot \p slot at wheel level \p level
+ *        in lower levels.
+ */
+static void rd_kafka_timers_cascade (rd_kafka_timers_t *rkts,
+                                     int level, int slot) {
+        struct rd_kafka_timer_list_s *list = &rkts->rkts_wheel[level][slot];
+        rd_kafka_timer_t *rtmr;
+
+        while ((rtmr = LIST_FIRST(list))) {
+                LIST_REMOVE(rtmr, rtmr_link);
+                rd_kafka_timer_place(rkts, rtmr);
+        }
+}
+
+
+/**
+ * @brief Advance the current tick to that of \p now, cascading higher
+ *        level slots as their ticks are reached, and move all timers
+ *        that are due at \p now to \p due.
+ *
+ * Each level 0 slot holds the timers of a single tick, which are all
+ * due unless it is the current tick.
+ */
+static void rd_kafka_timers_advance (rd_kafka_timers_t *rkts, rd_ts_t now,
+                                     struct rd_kafka_timer_list_s *due) {
+        rd_ts_t target = RD_KAFKA_TIMER_TICK(now);
+
+        if (!rkts->rkts_cnt) {
+                if (target > rkts->rkts_tick)
+                        rkts->rkts_tick = target;
+                return;
+        }
+
+        while (1) {
+                struct rd_kafka_timer_list_s *list =
+                        &rkts->rkts_wheel[0][RD_KAFKA_TIMER_SLOT(
+                                        rkts->rkts_tick, 0)];
+                rd_kafka_timer_t *rtmr, *next;
+                int level;
+
+                for (rtmr = LIST_FIRST(list) ; rtmr ; rtmr = next) {
+                        next = LIST_NEXT(rtmr, rtmr_link);
+                        if (rtmr->rtmr_next <= now) {
+                                LIST_REMOVE(rtmr, rtmr_link);
+                                LIST_INSERT_HEAD(due, rtmr, rtmr_link);
+                        }
+                }
+
+                if (rkts->rkts_tick >= target)
+                        break;
+
+                rkts->rkts_tick++;
+
+                /* Cascade the higher level slots starting at this tick */
+                for (level = 1 ; level < RD_KAFKA_TIMER_WHEEL_LEVELS ;
+                     level++) {
+                        if (rkts->rkts_tick &
+                            (((rd_ts_t)1 << (level *
+                                             RD_KAFKA_TIMER_WHEEL_BITS)) - 1))
+                                break;
+                        rd_kafka_timers_cascade(
+                                rkts, level,
+                                RD_KAFKA_TIMER_SLOT(rkts->rkts_tick, level));
+                }
+        }
+}
+
+
 /**
  * Stop a timer that may be started.
  * If called from inside a timer callback 'lock' must be 0, else 1.
@@ -187,24 +299,66 @@ void rd_kafka_timers_interrupt (rd_kafka_timers_t *rkts) {
 
 /**
  * Returns the delta time to the next timer to fire, capped by 'timeout_ms'.
+ *
+ * Timers in higher wheel levels are accounted for by the time their
+ * slot is cascaded, which is no later than their expiry.
  */
 rd_ts_t rd_kafka_timers_next (rd_kafka_timers_t *rkts, int timeout_us,
 			      int do_lock) {
 	rd_ts_t now = rd_clock();
-	rd_ts_t sleeptime = 0;
-	rd_kafka_timer_t *rtmr;
+	rd_ts_t sleeptime = (rd_ts_t)timeout_us;
+	rd_ts_t next = 0;
+	int level;
 
 	if (do_lock)
 		rd_kafka_timers_lock(rkts);
 
-	if (likely((rtmr = TAILQ_FIRST(&rkts->rkts_timers)) != NULL)) {
-		sleeptime = rtmr->rtmr_next - now;
+        for (level = 0 ;
+             rkts->rkts_cnt > 0 && level < RD_KAFKA_TIMER_WHEEL_LEVELS ;
+             level++) {
+                const int shift = level * RD_KAFKA_TIMER_WHEEL_BITS;
+                rd_ts_t base = rkts->rkts_tick >> shift;
+                int i;
+
+                /* The current slot of higher levels has already been
+                 * cascaded, it is only used for timers a full
+                 * revolution away. */
+                for (i = level > 0 ? 1 : 0 ;
+                     i <= RD_KAFKA_TIMER_WHEEL_SLOTS ; i++) {
+                        const struct rd_kafka_timer_list_s *list =
+                                &rkts->rkts_wheel[level]
+                                [(int)((base + i) &
+                                       (RD_KAFKA_TIMER_WHEEL_SLOTS - 1))];
+                        rd_ts_t t;
+
+                        if (LIST_EMPTY(list))
+                                continue;
+
+                        if (level == 0) {
+                                /* Exact expiry of the slot's first timer */
+                                const rd_kafka_timer_t *rtmr;
+
+                                t = 0;
+                                LIST_FOREACH(rtmr, list, rtmr_link)
+                                        if (!t || rtmr->rtmr_next < t)
+                                                t = rtmr->rtmr_next;
+                        } else
+                                t = ((base + i) << shift) *
+                                        RD_KAFKA_TIMER_WHEEL_TICK_US;
+
+                        if (!next || t < next)
+                                next = t;
+                        break;
+                }
+        }
+
+	if (next) {
+		sleeptime = next - now;
 		if (sleeptime < 0)
 			sleeptime = 0;
 		else if (sleeptime > (rd_ts_t)timeout_us)
 			sleeptime = (rd_ts_t)timeout_us;
-	} else
-		sleeptime = (rd_ts_t)timeout_us;
+	}
 
 	if (do_lock)
 		rd_kafka_timers_unlock(rkts);
@@ -226,6 +380,7 @@ void rd_kafka_timers_run (rd_kafka_timers_t *rkts, int timeout_us) {
 	while (!rd_atomic32_get(&rkts->rkts_rk->rk_terminate) && now <= end) {
 		int64_t sleeptime;
 		rd_kafka_timer_t *rtmr;
+                struct rd_kafka_timer_list_s due = LIST_HEAD_INITIALIZER(due);
 
 		if (timeout_us != RD_POLL_NOWAIT) {
 			sleeptime = rd_kafka_timers_next(rkts,
@@ -233,17 +388,22 @@ void rd_kafka_timers_run (rd_kafka_timers_t *rkts, int timeout_us) {
 							 0/*no-lock*/);
 
 			if (sleeptime > 0) {
+                                rkts->rkts_wakeup = now + sleeptime;
 				cnd_timedwait_ms(&rkts->rkts_cond,
 						 &rkts->rkts_lock,
 						 (int)(sleeptime / 1000));
-
+                                rkts->rkts_wakeup = 0;
 			}
 		}
 
 		now = rd_clock();
 
-		while ((rtmr = TAILQ_FIRST(&rkts->rkts_timers)) &&
-		       rtmr->rtmr_next <= now) {
+                rd_kafka_timers_advance(rkts, now, &due);
+
+                /* Due timers remain scheduled (on the due list) until
+                 * their callback is called, so they may be stopped,
+                 * or backed off, by earlier callbacks. */
+		while ((rtmr = LIST_FIRST(&due))) {
 
 			rd_kafka_timer_unschedule(rkts, rtmr);
                         rd_kafka_timers_unlock(rkts);
@@ -269,13 +429,19 @@ void rd_kafka_timers_run (rd_kafka_timers_t *rkts, int timeout_us) {
 
 
 void rd_kafka_timers_destroy (rd_kafka_timers_t *rkts) {
-        rd_kafka_timer_t *rtmr;
+        int level, slot;
 
         rd_kafka_timers_lock(rkts);
         rkts->rkts_enabled = 0;
-        while ((rtmr = TAILQ_FIRST(&rkts->rkts_timers)))
-                rd_kafka_timer_stop(rkts, rtmr, 0);
-        rd_kafka_assert(rkts->rkts_rk, TAILQ_EMPTY(&rkts->rkts_timers));
+        for (level = 0 ; level < RD_KAFKA_TIMER_WHEEL_LEVELS ; level++) {
+                for (slot = 0 ; slot < RD_KAFKA_TIMER_WHEEL_SLOTS ; slot++) {
+                        rd_kafka_timer_t *rtmr;
+                        while ((rtmr = LIST_FIRST(&rkts->rkts_wheel
+                                                  [level][slot])))
+                                rd_kafka_timer_stop(rkts, rtmr, 0);
+                }
+        }
+        rd_kafka_assert(rkts->rkts_rk, rkts->rkts_cnt == 0);
         rd_kafka_timers_unlock(rkts);
 
         cnd_destroy(&rkts->rkts_cond);
@@ -283,10 +449,193 @@ void rd_kafka_timers_destroy (rd_kafka_timers_t *rkts) {
 }
 
 void rd_kafka_timers_init (rd_kafka_timers_t *rkts, rd_kafka_t *rk) {
+        int level, slot;
+
         memset(rkts, 0, sizeof(*rkts));
         rkts->rkts_rk = rk;
-        TAILQ_INIT(&rkts->rkts_timers);
+        for (level = 0 ; level < RD_KAFKA_TIMER_WHEEL_LEVELS ; level++)
+                for (slot = 0 ; slot < RD_KAFKA_TIMER_WHEEL_SLOTS ; slot++)
+                        LIST_INIT(&rkts->rkts_wheel[level][slot]);
+        rkts->rkts_tick = RD_KAFKA_TIMER_TICK(rd_clock());
         mtx_init(&rkts->rkts_lock, mtx_plain);
         cnd_init(&rkts->rkts_cond);
         rkts->rkts_enabled = 1;
 }
+
+
+/**
+ * @name Unit tests
+ */
+
+#define UT_TIMER_CNT        100000
+#define UT_TIMER_BENCH_CNT  10000
+
+struct ut_timer {
+        rd_kafka_timer_t tmr;
+        rd_ts_t          ts_start; /* Time of start() */
+        int              fired;
+        int              early;    /* Fired before its interval elapsed */
+        int             *fired_cntp;
+};
+
+static void ut_timer_cb (rd_kafka_timers_t *rkts, void *arg) {
+        struct ut_timer *ut = arg;
+
+        if (rd_clock() < ut->ts_start + ut->tmr.rtmr_interval)
+                ut->early++;
+        ut->fired++;
+        (*ut->fired_cntp)++;
+        rd_kafka_timer_stop(rkts, &ut->tmr, 1/*lock*/);
+}
+
+/**
+ * Timer on a sorted list, as scheduled before the timing wheel,
+ * for benchmark comparison.
+ */
+struct ut_sorted_timer {
+        TAILQ_ENTRY(ut_sorted_timer) link;
+        rd_ts_t next;
+};
+
+static int ut_sorted_timer_cmp (const void *_a, const void *_b) {
+        const struct ut_sorted_timer *a = _a, *b = _b;
+        return (a->next > b->next) - (a->next < b->next);
+}
+
+static void ut_timer_noop_cb (rd_kafka_timers_t *rkts, void *arg) {
+}
+
+/**
+ * @brief Compare start and stop of UT_TIMER_BENCH_CNT timers with random
+ *        intervals up to 200ms on the sorted list and the timing wheel.
+ */
+static int ut_timer_bench (void) {
+        rd_kafka_t *rk;
+        rd_kafka_timers_t rkts;
+        TAILQ_HEAD(, ut_sorted_timer) sorted = TAILQ_HEAD_INITIALIZER(sorted);
+        struct ut_sorted_timer *sts;
+        rd_kafka_timer_t *tmrs;
+        rd_ts_t *intervals;
+        rd_ts_t now, ts_start;
+        rd_ts_t list_start, list_stop, wheel_start, wheel_stop;
+        int i;
+
+        rk = rd_calloc(1, sizeof(*rk));
+        rd_kafka_timers_init(&rkts, rk);
+
+        sts = rd_calloc(UT_TIMER_BENCH_CNT, sizeof(*sts));
+        tmrs = rd_calloc(UT_TIMER_BENCH_CNT, sizeof(*tmrs));
+        intervals = rd_calloc(UT_TIMER_BENCH_CNT, sizeof(*intervals));
+        for (i = 0 ; i < UT_TIMER_BENCH_CNT ; i++)
+                intervals[i] = (rd_jitter(0, 200) * 1000) + 1;
+
+        now = rd_clock();
+        ts_start = rd_clock();
+        for (i = 0 ; i < UT_TIMER_BENCH_CNT ; i++) {
+                sts[i].next = now + intervals[i];
+                TAILQ_INSERT_SORTED(&sorted, &sts[i], struct ut_sorted_timer *,
+                                    link, ut_sorted_timer_cmp);
+        }
+        list_start = rd_clock() - ts_start;
+
+        ts_start = rd_clock();
+        for (i = 0 ; i < UT_TIMER_BENCH_CNT ; i++)
+                TAILQ_REMOVE(&sorted, &sts[i], link);
+        list_stop = rd_clock() - ts_start;
+
+        ts_start = rd_clock();
+        for (i = 0 ; i < UT_TIMER_BENCH_CNT ; i++)
+                rd_kafka_timer_start(&rkts, &tmrs[i], intervals[i],
+                                     ut_timer_noop_cb, NULL);
+        wheel_start = rd_clock() - ts_start;
+
+        ts_start = rd_clock();
+        for (i = 0 ; i < UT_TIMER_BENCH_CNT ; i++)
+                rd_kafka_timer_stop(&rkts, &tmrs[i], 1/*lock*/);
+        wheel_stop = rd_clock() - ts_start;
+
+        RD_UT_SAY("%d timers: sorted list: start %.3fus/timer, "
+                  "stop %.3fus/timer", UT_TIMER_BENCH_CNT,
+                  (double)list_start / (double)UT_TIMER_BENCH_CNT,
+                  (double)list_stop / (double)UT_TIMER_BENCH_CNT);
+        RD_UT_SAY("%d timers: timing wheel: start %.3fus/timer, "
+                  "stop %.3fus/timer", UT_TIMER_BENCH_CNT,
+                  (double)wheel_start / (double)UT_TIMER_BENCH_CNT,
+                  (double)wheel_stop / (double)UT_TIMER_BENCH_CNT);
+
+        rd_kafka_timers_destroy(&rkts);
+        rd_free(intervals);
+        rd_free(tmrs);
+        rd_free(sts);
+        rd_free(rk);
+
+        return 0;
+}
+
+
+/**
+ * @brief Start UT_TIMER_CNT timers with random intervals up to 200ms,
+ *        stop every other one and verify the remaining ones
+ *        fire once, and not early.
+ */
+int unittest_timer (void) {
+        rd_kafka_t *rk;
+        rd_kafka_timers_t rkts;
+        struct ut_timer *uts;
+        int fired_cnt = 0;
+        rd_ts_t ts_start, ts_end;
+        rd_ts_t dur_start, dur_stop;
+        int i;
+
+        rk = rd_calloc(1, sizeof(*rk));
+        rd_kafka_timers_init(&rkts, rk);
+
+        uts = rd_calloc(UT_TIMER_CNT, sizeof(*uts));
+
+        ts_start = rd_clock();
+        for (i = 0 ; i < UT_TIMER_CNT ; i++) {
+                uts[i].fired_cntp = &fired_cnt;
+                uts[i].ts_start = rd_clock();
+                rd_kafka_timer_start(&rkts, &uts[i].tmr,
+                                     (rd_jitter(0, 200) * 1000) + 1,
+                                     ut_timer_cb, &uts[i]);
+        }
+        dur_start = rd_clock() - ts_start;
+
+        ts_start = rd_clock();
+        for (i = 0 ; i < UT_TIMER_CNT ; i += 2)
+                rd_kafka_timer_stop(&rkts, &uts[i].tmr, 1/*lock*/);
+        dur_stop = rd_clock() - ts_start;
+
+        RD_UT_SAY("%d timers: start %.3fus/timer, stop %.3fus/timer",
+                  UT_TIMER_CNT,
+                  (double)dur_start / (double)UT_TIMER_CNT,
+                  (double)dur_stop / (double)(UT_TIMER_CNT / 2));
+
+        ts_end = rd_clock() + 5 * 1000 * 1000;
+        while (fired_cnt < UT_TIMER_CNT / 2 && rd_clock() < ts_end)
+                rd_kafka_timers_run(&rkts, 100 * 1000);
+
+        RD_UT_ASSERT(fired_cnt == UT_TIMER_CNT / 2,
+                     "expected %d timers to fire, not %d",
+                     UT_TIMER_CNT / 2, fired_cnt);
+
+        for (i = 0 ; i < UT_TIMER_CNT ; i++) {
+                int exp_fired = i & 1;
+                RD_UT_ASSERT(uts[i].fired == exp_fired,
+                             "timer #%d fired %d times, expected %d",
+                             i, uts[i].fired, exp_fired);
+                RD_UT_ASSERT(!uts[i].early,
+                             "timer #%d (interval %"PRId64"us) fired early",
+                             i, uts[i].tmr.rtmr_interval);
+        }
+
+        rd_kafka_timers_destroy(&rkts);
+        rd_free(uts);
+        rd_free(rk);
+
+        if (ut_timer_bench())
+                return 1;
+
+        RD_UT_PASS();
+}
@@ -31,10 +31,37 @@
 
 #include "rd.h"
 
+/**
+ * Hierarchical timing wheel parameters:
+ * RD_KAFKA_TIMER_WHEEL_LEVELS levels of RD_KAFKA_TIMER_WHEEL_SLOTS slots,
+ * level 0 slots being RD_KAFKA_TIMER_WHEEL_TICK_US long and each
+ * higher level's slots spanning an entire lower level,
+ * covering 64^4 ms (4.6 hours). Timers further away than that are
+ * placed in the last level and re-placed as it is cascaded.
+ */
+#define RD_KAFKA_TIMER_WHEEL_TICK_US   1000
+#define RD_KAFKA_TIMER_WHEEL_BITS      6
+#define RD_KAFKA_TIMER_WHEEL_SLOTS     (1 << RD_KAFKA_TIMER_WHEEL_BITS)
+#define RD_KAFKA_TIMER_WHEEL_LEVELS    4
+
+LIST_HEAD(rd_kafka_timer_list_s, rd_kafka_timer_s);
+
 /* A timer engine. */
 typedef struct rd_kafka_timers_s {
 
-        TAILQ_HEAD(, rd_kafka_timer_s) rkts_timers;
+        /* Timing wheel: a timer is placed in the level 0 slot of its
+         * expiry tick if it expires within RD_KAFKA_TIMER_WHEEL_SLOTS
+         * ticks, else in the slot of the first higher level covering
+         * its expiry tick. Higher level slots are cascaded (their timers
+         * re-placed in lower levels) as rkts_tick reaches them. */
+        struct rd_kafka_timer_list_s
+                    rkts_wheel[RD_KAFKA_TIMER_WHEEL_LEVELS]
+                              [RD_KAFKA_TIMER_WHEEL_SLOTS];
+        rd_ts_t     rkts_tick;     /* Current tick: all earlier ticks
+                                    * have been expired. */
+        int         rkts_cnt;      /* Number of scheduled timers */
+        rd_ts_t     rkts_wakeup;   /* Time rd_kafka_timers_run() is
+                                    * sleeping until, or 0. */
 
         struct rd_kafka_s *rkts_rk;
 
@@ -46,7 +73,8 @@ typedef struct rd_kafka_timers_s {
 
 
 typedef struct rd_kafka_timer_s {
-	TAILQ_ENTRY(rd_kafka_timer_s)  rtmr_link;
+	LIST_ENTRY(rd_kafka_timer_s)  rtmr_link;  /* Wheel slot or
+                                                   * due list */
 
 	rd_ts_t rtmr_next;
 	rd_ts_t rtmr_interval;   /* interval in microseconds */
@@ -77,4 +105,6 @@ void rd_kafka_timers_run (rd_kafka_timers_t *rkts, int timeout_us);
 void rd_kafka_timers_destroy (rd_kafka_timers_t *rkts);
 void rd_kafka_timers_init (rd_kafka_timers_t *rkte, rd_kafka_t *rk);
 
+int unittest_timer (void);
+
 #endif /* _RDKAFKA_TIMER_H_ */
@@ -111,6 +111,7 @@ void rd_kafka_topic_destroy_final (rd_kafka_itopic_t *rkt) {
 
         rd_kafka_wrlock(rkt->rkt_rk);
         TAILQ_REMOVE(&rkt->rkt_rk->rk_topics, rkt, rkt_link);
+        RD_AVL_REMOVE_ELM(&rkt->rkt_rk->rk_topic_avl, rkt);
         rkt->rkt_rk->rk_topic_cnt--;
         rd_kafka_wrunlock(rkt->rkt_rk);
 
@@ -119,6 +120,7 @@ void rd_kafka_topic_destroy_final (rd_kafka_itopic_t *rkt) {
 
         rd_avg_destroy(&rkt->rkt_avg_batchsize);
         rd_avg_destroy(&rkt->rkt_avg_batchcnt);
+        rd_kafka_stats_bin_obj_destroy(&rkt->rkt_stats_bin);
 
 	if (rkt->rkt_topic)
 		rd_kafkap_str_destroy(rkt->rkt_topic);
@@ -140,6 +142,32 @@ void rd_kafka_topic_destroy (rd_kafka_topic_t *app_rkt) {
 }
 
 
+/**
+ * @brief Compare topics by name, used for rk_topic_avl.
+ */
+int rd_kafka_topic_cmp_rkt (const void *_a, const void *_b) {
+        const rd_kafka_itopic_t *rkt_a = _a, *rkt_b = _b;
+
+        return rd_kafkap_str_cmp(rkt_a->rkt_topic, rkt_b->rkt_topic);
+}
+
+
+/**
+ * @brief Look up topic by name in the rk_topic_avl index.
+ *
+ * @returns the topic (without increasing its refcount), or NULL.
+ *
+ * @locks rd_kafka_*lock() MUST be held.
+ */
+static rd_kafka_itopic_t *rd_kafka_topic_find_nl (rd_kafka_t *rk,
+                                                  const rd_kafkap_str_t *topic) {
+        rd_kafka_itopic_t skel;
+
+        skel.rkt_topic = (rd_kafkap_str_t *)topic;
+        return RD_AVL_FIND(&rk->rk_topic_avl, &skel);
+}
+
+
 /**
  * Finds and returns a topic based on its name, or NULL if not found.
  * The 'rkt' refcount is increased by one and the caller must call
@@ -151,17 +179,14 @@ void rd_kafka_topic_destroy (rd_kafka_topic_t *app_rkt) {
 shptr_rd_kafka_itopic_t *rd_kafka_topic_find_fl (const char *func, int line,
                                                 rd_kafka_t *rk,
                                                 const char *topic, int do_lock){
+        rd_kafkap_str_t kstr = { (int)strlen(topic), topic };
 	rd_kafka_itopic_t *rkt;
         shptr_rd_kafka_itopic_t *s_rkt = NULL;
 
         if (do_lock)
                 rd_kafka_rdlock(rk);
-	TAILQ_FOREACH(rkt, &rk->rk_topics, rkt_link) {
-		if (!rd_kafkap_str_cmp_str(rkt->rkt_topic, topic)) {
-                        s_rkt = rd_kafka_topic_keep(rkt);
-			break;
-		}
-	}
+        if ((rkt = rd_kafka_topic_find_nl(rk, &kstr)))
+                s_rkt = rd_kafka_topic_keep(rkt);
         if (do_lock)
                 rd_kafka_rdunlock(rk);
 
@@ -178,12 +203,8 @@ shptr_rd_kafka_itopic_t *rd_kafka_topic_find0_fl (const char *func, int line,
         shptr_rd_kafka_itopic_t *s_rkt = NULL;
 
 	rd_kafka_rdlock(rk);
-	TAILQ_FOREACH(rkt, &rk->rk_topics, rkt_link) {
-		if (!rd_kafkap_str_cmp(rkt->rkt_topic, topic)) {
-                        s_rkt = rd_kafka_topic_keep(rkt);
-			break;
-		}
-	}
+        if ((rkt = rd_kafka_topic_find_nl(rk, topic)))
+                s_rkt = rd_kafka_topic_keep(rkt);
 	rd_kafka_rdunlock(rk);
 
 	return s_rkt;
@@ -279,6 +300,8 @@ shptr_rd_kafka_itopic_t *rd_kafka_topic_new0 (rd_kafka_t *rk,
                           (void *)rd_kafka_msg_partitioner_murmur2 },
                         { "murmur2_random",
                           (void *)rd_kafka_msg_partitioner_murmur2_random },
+                        { "sticky",
+                          (void *)rd_kafka_msg_partitioner_sticky },
                         { NULL }
                 };
                 int i;
@@ -320,6 +343,11 @@ shptr_rd_kafka_itopic_t *rd_kafka_topic_new0 (rd_kafka_t *rk,
                     rk->rk_conf.batch_num_messages, 2,
                     rk->rk_conf.stats_interval_ms ? 1 : 0);
 
+        rd_atomic32_init(&rkt->rkt_sticky.partition, RD_KAFKA_PARTITION_UA);
+        rd_atomic32_init(&rkt->rkt_sticky.msgcnt, 0);
+        rd_atomic64_init(&rkt->rkt_sticky.bytes, 0);
+        rd_atomic64_init(&rkt->rkt_sticky.ts_switch, 0);
+
 	rd_kafka_dbg(rk, TOPIC, "TOPIC", "New local topic: %.*s",
 		     RD_KAFKAP_STR_PR(rkt->rkt_topic));
 
@@ -335,6 +363,7 @@ shptr_rd_kafka_itopic_t *rd_kafka_topic_new0 (rd_kafka_t *rk,
 	rkt->rkt_ua = rd_kafka_toppar_new(rkt, RD_KAFKA_PARTITION_UA);
 
 	TAILQ_INSERT_TAIL(&rk->rk_topics, rkt, rkt_link);
+        RD_AVL_INSERT(&rk->rk_topic_avl, rkt, rkt_avlnode);
 	rk->rk_topic_cnt++;
 
         /* Populate from metadata cache. */
@@ -692,6 +721,7 @@ static void rd_kafka_topic_assign_uas (rd_kafka_itopic_t *rkt,
 
 	/* Assign all unassigned messages to new topics. */
         rd_kafka_toppar_lock(rktp_ua);
+        rd_kafka_toppar_ingress_drain(rktp_ua);
 
         rd_kafka_dbg(rk, TOPIC, "PARTCNT",
                      "Partitioning %i unassigned messages in topic %.*s to "
@@ -1001,6 +1031,7 @@ void rd_kafka_topic_partitions_remove (rd_kafka_itopic_t *rkt) {
 		rd_kafka_toppar_t *rktp = rd_kafka_toppar_s2i(s_rktp);
 
 		rd_kafka_toppar_lock(rktp);
+                rd_kafka_toppar_ingress_drain(rktp);
 		rd_kafka_msgq_purge(rkt->rkt_rk, &rktp->rktp_msgq);
 		rd_kafka_toppar_purge_queues(rktp);
 		rd_kafka_toppar_unlock(rktp);
@@ -1051,30 +1082,31 @@ void rd_kafka_topic_partitions_remove (rd_kafka_itopic_t *rkt) {
 
 /**
  * @brief Scan all topics and partitions for:
- *  - timed out messages.
+ *  - timed out messages (only partitions with timed out messages
+ *    are visited, see rd_kafka_toppar_msgq_tmout_scan()).
  *  - topics that needs to be created on the broker.
  *  - topics who's metadata is too old.
  *
+ * @returns the number of timed out messages.
+ *
  * @locality rdkafka main thread
  */
 int rd_kafka_topic_scan_all (rd_kafka_t *rk, rd_ts_t now) {
 	rd_kafka_itopic_t *rkt;
 	rd_kafka_toppar_t *rktp;
         shptr_rd_kafka_toppar_t *s_rktp;
-	int totcnt = 0;
+	int totcnt;
         rd_list_t query_topics;
 
+        totcnt = rd_kafka_toppar_msgq_tmout_scan(rk, now);
+
         rd_list_init(&query_topics, 0, rd_free);
 
 	rd_kafka_rdlock(rk);
 	TAILQ_FOREACH(rkt, &rk->rk_topics, rkt_link) {
 		int p;
-                int cnt = 0, tpcnt = 0;
-                rd_kafka_msgq_t timedout;
                 int query_this = 0;
 
-                rd_kafka_msgq_init(&timedout);
-
 		rd_kafka_topic_wrlock(rkt);
 
                 /* Check if metadata information has timed out. */
@@ -1111,7 +1143,6 @@ int rd_kafka_topic_scan_all (rd_kafka_t *rk, rd_ts_t now) {
 
 		for (p = RD_KAFKA_PARTITION_UA ;
 		     p < rkt->rkt_partition_cnt ; p++) {
-			int did_tmout = 0;
 
 			if (!(s_rktp = rd_kafka_toppar_get(rkt, p, 0)))
 				continue;
@@ -1140,32 +1171,16 @@ int rd_kafka_topic_scan_all (rd_kafka_t *rk, rd_ts_t now) {
                                 query_this = 1;
                         }
 
-			if (rd_kafka_msgq_age_scan(&rktp->rktp_msgq,
-						   &timedout, now) > 0)
-				did_tmout = 1;
-
-			tpcnt += did_tmout;
-
 			rd_kafka_toppar_unlock(rktp);
 			rd_kafka_toppar_destroy(s_rktp);
 		}
 
                 rd_kafka_topic_rdunlock(rkt);
 
-                if ((cnt = timedout.rkmq_msg_cnt) > 0) {
-                        totcnt += cnt;
-                        rd_kafka_dbg(rk, MSG, "TIMEOUT",
-                                     "%s: %"PRId32" message(s) "
-                                     "from %i toppar(s) timed out",
-                                     rkt->rkt_topic->str, cnt, tpcnt);
-                        rd_kafka_dr_msgq(rkt, &timedout,
-                                         RD_KAFKA_RESP_ERR__MSG_TIMED_OUT);
-                }
-
-                /* Need to re-query this topic's leader. */
-                if (query_this &&
-                    !rd_list_find(&query_topics, rkt->rkt_topic->str,
-                                  (void *)strcmp))
+                /* Need to re-query this topic's leader.
+                 * Topic names are unique in rk_topics so there is no need
+                 * to look for duplicates, which would be O(N^2). */
+                if (query_this)
                         rd_list_add(&query_topics,
                                     rd_strdup(rkt->rkt_topic->str));
 
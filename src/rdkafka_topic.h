@@ -37,6 +37,7 @@ extern const char *rd_kafka_topic_state_names[];
 /* rd_kafka_itopic_t: internal representation of a topic */
 struct rd_kafka_itopic_s {
 	TAILQ_ENTRY(rd_kafka_itopic_s) rkt_link;
+        rd_avl_node_t      rkt_avlnode;   /* rk_topic_avl */
 
 	rd_refcnt_t        rkt_refcnt;
 
@@ -77,6 +78,17 @@ struct rd_kafka_itopic_s {
         rd_avg_t          rkt_avg_batchsize; /**< Average batch size */
         rd_avg_t          rkt_avg_batchcnt;  /**< Average batch message count */
 
+        rd_kafka_stats_bin_obj_t rkt_stats_bin; /**< Binary stats state */
+
+        /**< Sticky partitioner state for keyless messages */
+        struct {
+                rd_atomic32_t partition;  /**< Current partition,
+                                           *   or RD_KAFKA_PARTITION_UA */
+                rd_atomic32_t msgcnt;     /**< Messages since switch */
+                rd_atomic64_t bytes;      /**< Payload bytes since switch */
+                rd_atomic64_t ts_switch;  /**< Time of last switch */
+        } rkt_sticky;
+
         shptr_rd_kafka_itopic_t *rkt_shptr_app; /* Application's topic_new() */
 
 	rd_kafka_topic_conf_t rkt_conf;
@@ -147,6 +159,7 @@ shptr_rd_kafka_itopic_t *rd_kafka_topic_find0_fl (const char *func, int line,
 #define rd_kafka_topic_find0(rk,topic)                                  \
         rd_kafka_topic_find0_fl(__FUNCTION__,__LINE__,rk,topic)
 int rd_kafka_topic_cmp_s_rkt (const void *_a, const void *_b);
+int rd_kafka_topic_cmp_rkt (const void *_a, const void *_b);
 
 void rd_kafka_topic_partitions_remove (rd_kafka_itopic_t *rkt);
 
@@ -101,6 +101,12 @@ void rd_kafka_transport_close (rd_kafka_transport_t *rktrans) {
 
         rd_kafka_sasl_close(rktrans);
 
+#if HAVE_IO_URING
+        /* Outstanding IO must be cancelled before the socket is closed. */
+        if (rktrans->rktrans_uring)
+                rd_kafka_transport_uring_term(rktrans);
+#endif
+
 	if (rktrans->rktrans_recv_buf)
 		rd_kafka_buf_destroy(rktrans->rktrans_recv_buf);
 
@@ -148,6 +154,7 @@ ssize_t rd_kafka_transport_socket_sendmsg (rd_kafka_transport_t *rktrans,
         socket_errno = EAGAIN;
 #endif
 
+        rd_atomic64_add(&rktrans->rktrans_rkb->rkb_c.io_syscalls, 1);
         r = sendmsg(rktrans->rktrans_s, &msg, MSG_DONTWAIT
 #ifdef MSG_NOSIGNAL
                     | MSG_NOSIGNAL
@@ -182,6 +189,7 @@ rd_kafka_transport_socket_send0 (rd_kafka_transport_t *rktrans,
         while ((rlen = rd_slice_peeker(slice, &p))) {
                 ssize_t r;
 
+                rd_atomic64_add(&rktrans->rktrans_rkb->rkb_c.io_syscalls, 1);
                 r = send(rktrans->rktrans_s, p,
 #ifdef _MSC_VER
                          (int)rlen, (int)0
@@ -266,6 +274,7 @@ rd_kafka_transport_socket_recvmsg (rd_kafka_transport_t *rktrans,
          * due to no data and MSG_DONTWAIT is set. */
         socket_errno = EAGAIN;
 #endif
+        rd_atomic64_add(&rktrans->rktrans_rkb->rkb_c.io_syscalls, 1);
         r = recvmsg(rktrans->rktrans_s, &msg, MSG_DONTWAIT);
         if (unlikely(r <= 0)) {
                 if (r == -1 && socket_errno == EAGAIN)
@@ -304,6 +313,7 @@ rd_kafka_transport_socket_recv0 (rd_kafka_transport_t *rktrans,
         while ((len = rd_buf_get_writable(rbuf, &p))) {
                 ssize_t r;
 
+                rd_atomic64_add(&rktrans->rktrans_rkb->rkb_c.io_syscalls, 1);
                 r = recv(rktrans->rktrans_s, p,
 #ifdef _MSC_VER
                          (int)
@@ -1080,9 +1090,34 @@ rd_kafka_transport_send (rd_kafka_transport_t *rktrans,
 }
 
 
+/**
+ * @brief Send request \p rkbuf, same as rd_kafka_transport_send() on
+ *        the request's reader slice, but the io_uring backend accepts
+ *        the entire request for asynchronous sending, holding a reference
+ *        to it until it is written.
+ */
+ssize_t
+rd_kafka_transport_send_buf (rd_kafka_transport_t *rktrans,
+                             rd_kafka_buf_t *rkbuf,
+                             char *errstr, size_t errstr_size) {
+#if HAVE_IO_URING
+        if (rktrans->rktrans_uring)
+                return rd_kafka_transport_uring_send(rktrans, rkbuf,
+                                                     errstr, errstr_size);
+#endif
+        return rd_kafka_transport_send(rktrans, &rkbuf->rkbuf_reader,
+                                       errstr, errstr_size);
+}
+
+
 ssize_t
 rd_kafka_transport_recv (rd_kafka_transport_t *rktrans, rd_buf_t *rbuf,
                          char *errstr, size_t errstr_size) {
+#if HAVE_IO_URING
+        if (rktrans->rktrans_uring)
+                return rd_kafka_transport_uring_recv(rktrans, rbuf,
+                                                     errstr, errstr_size);
+#endif
 #if WITH_SSL
 	if (rktrans->rktrans_ssl)
                 return rd_kafka_transport_ssl_recv(rktrans, rbuf,
@@ -1313,6 +1348,22 @@ static void rd_kafka_transport_connected (rd_kafka_transport_t *rktrans) {
 	}
 #endif
 
+#if HAVE_IO_URING
+        if (rkb->rkb_rk->rk_conf.socket_io_uring_enable &&
+            rkb->rkb_proto == RD_KAFKA_PROTO_PLAINTEXT &&
+            !rkb->rkb_rk->rk_reactor) {
+                int err;
+
+                if ((err = rd_kafka_transport_uring_init(rktrans)))
+                        rd_rkb_dbg(rkb, BROKER, "IOURING",
+                                   "io_uring not available, using poll(): "
+                                   "%s", rd_strerror(err));
+                else
+                        rd_rkb_dbg(rkb, BROKER, "IOURING",
+                                   "Using io_uring for socket IO");
+        }
+#endif
+
 	/* Propagate connect success */
 	rd_kafka_transport_connect_done(rktrans, NULL);
 }
@@ -1442,6 +1493,46 @@ static void rd_kafka_transport_io_event (rd_kafka_transport_t *rktrans,
 }
 
 
+/**
+ * @brief Update the wanted poll events: POLLOUT is wanted if there
+ *        are requests to send and the in-flight limit allows it.
+ *
+ * @returns the POLL* events to wait for on the transport socket.
+ *
+ * Locality: broker thread
+ */
+int rd_kafka_transport_poll_prepare (rd_kafka_transport_t *rktrans) {
+	rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
+
+	if (rd_kafka_bufq_cnt(&rkb->rkb_waitresps) < rkb->rkb_max_inflight &&
+	    rd_kafka_bufq_cnt(&rkb->rkb_outbufs) > 0)
+		rd_kafka_transport_poll_set(rktrans, POLLOUT);
+
+	return rktrans->rktrans_pfd[0].events;
+}
+
+
+/**
+ * @brief Serve the POLL* \p events raised on the transport socket.
+ *
+ * Locality: broker thread
+ */
+void rd_kafka_transport_io_events (rd_kafka_transport_t *rktrans,
+                                   int events) {
+        rd_kafka_transport_poll_clear(rktrans, POLLOUT);
+
+	rd_kafka_transport_io_event(rktrans, events);
+}
+
+
+/**
+ * @returns the transport socket.
+ */
+int rd_kafka_transport_fd (rd_kafka_transport_t *rktrans) {
+        return rktrans->rktrans_s;
+}
+
+
 /**
  * Poll and serve IOs
  *
@@ -1449,19 +1540,22 @@ static void rd_kafka_transport_io_event (rd_kafka_transport_t *rktrans,
  */
 void rd_kafka_transport_io_serve (rd_kafka_transport_t *rktrans,
                                   int timeout_ms) {
-	rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
 	int events;
 
-	if (rd_kafka_bufq_cnt(&rkb->rkb_waitresps) < rkb->rkb_max_inflight &&
-	    rd_kafka_bufq_cnt(&rkb->rkb_outbufs) > 0)
-		rd_kafka_transport_poll_set(rkb->rkb_transport, POLLOUT);
+#if HAVE_IO_URING
+        if (rktrans->rktrans_uring &&
+            rktrans->rktrans_rkb->rkb_state >= RD_KAFKA_BROKER_STATE_UP) {
+                rd_kafka_transport_uring_io_serve(rktrans, timeout_ms);
+                return;
+        }
+#endif
+
+	rd_kafka_transport_poll_prepare(rktrans);
 
 	if ((events = rd_kafka_transport_poll(rktrans, timeout_ms)) <= 0)
                 return;
 
-        rd_kafka_transport_poll_clear(rktrans, POLLOUT);
-
-	rd_kafka_transport_io_event(rktrans, events);
+	rd_kafka_transport_io_events(rktrans, events);
 }
 
 
@@ -1596,6 +1690,8 @@ void rd_kafka_transport_poll_clear(rd_kafka_transport_t *rktrans, int event) {
 
 int rd_kafka_transport_poll(rd_kafka_transport_t *rktrans, int tmout) {
         int r;
+
+        rd_atomic64_add(&rktrans->rktrans_rkb->rkb_c.io_syscalls, 1);
 #ifndef _MSC_VER
 	r = poll(rktrans->rktrans_pfd, rktrans->rktrans_pfd_cnt, tmout);
 	if (r <= 0)
@@ -1634,6 +1730,7 @@ int rd_kafka_transport_poll(rd_kafka_transport_t *rktrans, int tmout) {
         if (rktrans->rktrans_pfd[1].revents & POLLIN) {
                 /* Read wake-up fd data and throw away, just used for wake-ups*/
                 char buf[512];
+                rd_atomic64_add(&rktrans->rktrans_rkb->rkb_c.io_syscalls, 1);
                 if (rd_read((int)rktrans->rktrans_pfd[1].fd,
                             buf, sizeof(buf)) == -1) {
                         /* Ignore warning */
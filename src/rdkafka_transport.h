@@ -40,10 +40,17 @@ typedef struct rd_kafka_transport_s rd_kafka_transport_t;
 
 void rd_kafka_transport_io_serve (rd_kafka_transport_t *rktrans,
                                   int timeout_ms);
+int rd_kafka_transport_poll_prepare (rd_kafka_transport_t *rktrans);
+void rd_kafka_transport_io_events (rd_kafka_transport_t *rktrans,
+                                   int events);
+int rd_kafka_transport_fd (rd_kafka_transport_t *rktrans);
 
 ssize_t rd_kafka_transport_send (rd_kafka_transport_t *rktrans,
                                  rd_slice_t *slice,
                                  char *errstr, size_t errstr_size);
+ssize_t rd_kafka_transport_send_buf (rd_kafka_transport_t *rktrans,
+                                     rd_kafka_buf_t *rkbuf,
+                                     char *errstr, size_t errstr_size);
 ssize_t rd_kafka_transport_recv (rd_kafka_transport_t *rktrans,
                                  rd_buf_t *rbuf,
                                  char *errstr, size_t errstr_size);
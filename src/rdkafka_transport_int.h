@@ -82,6 +82,26 @@ struct rd_kafka_transport_s {
 
         size_t rktrans_rcvbuf_size;    /**< Socket receive buffer size */
         size_t rktrans_sndbuf_size;    /**< Socket send buffer size */
+
+#if HAVE_IO_URING
+        struct rd_kafka_transport_uring_s *rktrans_uring; /**< io_uring IO
+                                                           *   backend,
+                                                           *   or NULL. */
+#endif
 };
 
+
+#if HAVE_IO_URING
+int rd_kafka_transport_uring_init (rd_kafka_transport_t *rktrans);
+void rd_kafka_transport_uring_term (rd_kafka_transport_t *rktrans);
+ssize_t rd_kafka_transport_uring_send (rd_kafka_transport_t *rktrans,
+                                       rd_kafka_buf_t *rkbuf,
+                                       char *errstr, size_t errstr_size);
+ssize_t rd_kafka_transport_uring_recv (rd_kafka_transport_t *rktrans,
+                                       rd_buf_t *rbuf,
+                                       char *errstr, size_t errstr_size);
+void rd_kafka_transport_uring_io_serve (rd_kafka_transport_t *rktrans,
+                                        int timeout_ms);
+#endif
+
 #endif /* _RDKAFKA_TRANSPORT_INT_H_ */
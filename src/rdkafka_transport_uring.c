@@ -0,0 +1,562 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @name io_uring transport IO backend (`socket.io_uring.enable`)
+ *
+ * Replaces the poll() + sendmsg() + recvmsg() system calls of the
+ * broker thread's IO loop with a single io_uring_enter() per loop
+ * iteration that both submits the IO operations and waits for their
+ * completion, for plaintext broker connections.
+ *
+ * The completions are translated back into the POLLIN/POLLOUT events
+ * expected by rd_kafka_transport_io_event(), so the broker's send and
+ * receive code paths are the same as for the poll() backend:
+ *
+ *  - Sends: requests passed to rd_kafka_transport_send_buf() are accepted
+ *    immediately and queued on the transport's send queue, holding a
+ *    reference to the request buffer until it has been written.
+ *    The send queue is written with one IORING_OP_SENDMSG covering as many
+ *    queued requests as fit in IOV_MAX iovecs (and the socket send buffer).
+ *  - Receives: one receive is kept outstanding, either into the
+ *    (registered) receive staging buffer from which
+ *    rd_kafka_transport_recv() copies the small response headers and
+ *    payloads, or, for large payloads, directly into the receive
+ *    buffer's segments.
+ *  - Broker op queue wake-ups: an IORING_OP_POLL_ADD on the wake-up fd.
+ *
+ * If io_uring can't be set up the poll() backend is used.
+ */
+
+#include "rdkafka_int.h"
+#include "rdkafka_broker.h"
+#include "rdkafka_buf.h"
+#include "rdkafka_transport.h"
+#include "rdkafka_transport_int.h"
+
+#if HAVE_IO_URING
+
+#include "rduring.h"
+
+#include <poll.h>
+
+
+/**< Receive staging buffer size */
+#define RD_KAFKA_URING_RX_SIZE      (64 * 1024)
+
+/**< Receive payloads of at least this size directly into the
+ *   receive buffer rather than via the staging buffer. */
+#define RD_KAFKA_URING_DIRECT_MIN   (16 * 1024)
+
+/**< Operation identifiers (user_data) */
+#define RD_KAFKA_URING_OP_RECV      1
+#define RD_KAFKA_URING_OP_SEND      2
+#define RD_KAFKA_URING_OP_WAKEUP    3
+#define RD_KAFKA_URING_OP_CANCEL    4
+
+
+/**
+ * @brief Send queue entry: a request (partially) waiting to be written.
+ */
+typedef struct rd_kafka_uring_send_s {
+        TAILQ_ENTRY(rd_kafka_uring_send_s) link;
+        rd_kafka_buf_t *rkbuf;   /**< Request, refcount held */
+        rd_slice_t      slice;   /**< Remaining data to write */
+} rd_kafka_uring_send_t;
+
+
+struct rd_kafka_transport_uring_s {
+        rd_uring_t ring;
+
+        /* Receive */
+        char     *rx_buf;        /**< Staging buffer */
+        size_t    rx_rof;        /**< Staging read offset */
+        size_t    rx_len;        /**< Staging data length */
+        int       rx_inflight;   /**< Receive outstanding */
+        rd_buf_t *rx_direct;     /**< Direct receive target buffer */
+        size_t    rx_direct_len; /**< Bytes received into rx_direct */
+        int       rx_err;        /**< Receive failed: errno, or -1 on
+                                  *   connection close. */
+        int       rx_fixed;      /**< Staging buffer is registered */
+        struct msghdr rx_msg;
+        struct iovec  rx_iov[IOV_MAX];
+
+        /* Send */
+        TAILQ_HEAD(, rd_kafka_uring_send_s) sendq;
+        int       tx_inflight;   /**< Send outstanding */
+        int       tx_err;        /**< Send failed: errno */
+        struct msghdr tx_msg;
+        struct iovec  tx_iov[IOV_MAX];
+
+        /* Broker op queue wake-ups */
+        int       wakeup_fd;
+        int       wakeup_inflight;
+};
+
+
+/**
+ * @brief Increase the broker's IO system call counter.
+ */
+#define rd_kafka_uring_syscall(rktrans)                                 \
+        rd_atomic64_add(&(rktrans)->rktrans_rkb->rkb_c.io_syscalls, 1)
+
+
+/**
+ * @brief Set up the io_uring backend for \p rktrans.
+ *
+ * @returns 0 on success, else an errno in which case the poll()
+ *          backend remains in use.
+ *
+ * @locality broker thread
+ */
+int rd_kafka_transport_uring_init (rd_kafka_transport_t *rktrans) {
+        struct rd_kafka_transport_uring_s *ur;
+        struct iovec iov;
+        int err;
+
+        ur = rd_calloc(1, sizeof(*ur));
+
+        if ((err = rd_uring_init(&ur->ring, 8))) {
+                rd_free(ur);
+                return err;
+        }
+
+        ur->rx_buf = rd_malloc(RD_KAFKA_URING_RX_SIZE);
+        TAILQ_INIT(&ur->sendq);
+
+        /* Registering the staging buffer avoids the per-operation
+         * page pinning, but is not required. */
+        iov.iov_base = ur->rx_buf;
+        iov.iov_len  = RD_KAFKA_URING_RX_SIZE;
+        ur->rx_fixed = !rd_uring_register_buffers(&ur->ring, &iov, 1);
+
+        ur->wakeup_fd = rktrans->rktrans_pfd_cnt > 1 ?
+                (int)rktrans->rktrans_pfd[1].fd : -1;
+
+        rktrans->rktrans_uring = ur;
+
+        return 0;
+}
+
+
+/**
+ * @brief Cancel all outstanding operations, wait for their completion and
+ *        destroy the io_uring backend.
+ *        Must be called before the socket and receive buffer are closed.
+ *
+ * @locality broker thread
+ */
+void rd_kafka_transport_uring_term (rd_kafka_transport_t *rktrans) {
+        struct rd_kafka_transport_uring_s *ur = rktrans->rktrans_uring;
+        rd_kafka_uring_send_t *send;
+        int tries = 10;
+
+        while ((ur->rx_inflight || ur->tx_inflight || ur->wakeup_inflight) &&
+               tries-- > 0) {
+                struct io_uring_cqe *cqe;
+                static const uint64_t ops[] = {
+                        RD_KAFKA_URING_OP_RECV,
+                        RD_KAFKA_URING_OP_SEND,
+                        RD_KAFKA_URING_OP_WAKEUP
+                };
+                int i;
+
+                for (i = 0 ; i < (int)RD_ARRAYSIZE(ops) ; i++) {
+                        struct io_uring_sqe *sqe;
+
+                        if (!(sqe = rd_uring_sqe_get(&ur->ring)))
+                                break;
+                        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+                        sqe->addr      = ops[i];
+                        sqe->user_data = RD_KAFKA_URING_OP_CANCEL;
+                }
+
+                rd_uring_enter(&ur->ring, 1, 100);
+
+                while ((cqe = rd_uring_cqe_peek(&ur->ring))) {
+                        switch (cqe->user_data)
+                        {
+                        case RD_KAFKA_URING_OP_RECV:
+                                ur->rx_inflight = 0;
+                                break;
+                        case RD_KAFKA_URING_OP_SEND:
+                                ur->tx_inflight = 0;
+                                break;
+                        case RD_KAFKA_URING_OP_WAKEUP:
+                                ur->wakeup_inflight = 0;
+                                break;
+                        }
+                        rd_uring_cqe_seen(&ur->ring);
+                }
+        }
+
+        /* Closing the ring cancels anything left */
+        rd_uring_destroy(&ur->ring);
+
+        while ((send = TAILQ_FIRST(&ur->sendq))) {
+                TAILQ_REMOVE(&ur->sendq, send, link);
+                rd_kafka_buf_destroy(send->rkbuf);
+                rd_free(send);
+        }
+
+        rd_free(ur->rx_buf);
+        rd_free(ur);
+        rktrans->rktrans_uring = NULL;
+}
+
+
+/**
+ * @brief Accept request \p rkbuf for sending: the remainder of its
+ *        reader slice is queued on the send queue and the slice
+ *        is advanced to its end.
+ *
+ * @returns the number of bytes accepted, or -1 if a previous send
+ *          failed (\p errstr is set).
+ *
+ * @locality broker thread
+ */
+ssize_t rd_kafka_transport_uring_send (rd_kafka_transport_t *rktrans,
+                                       rd_kafka_buf_t *rkbuf,
+                                       char *errstr, size_t errstr_size) {
+        struct rd_kafka_transport_uring_s *ur = rktrans->rktrans_uring;
+        rd_kafka_uring_send_t *send;
+        size_t len;
+
+        if (unlikely(ur->tx_err)) {
+                rd_snprintf(errstr, errstr_size, "%s",
+                            rd_strerror(ur->tx_err));
+                return -1;
+        }
+
+        len = rd_slice_remains(&rkbuf->rkbuf_reader);
+
+        send = rd_malloc(sizeof(*send));
+        send->rkbuf = rkbuf;
+        rd_kafka_buf_keep(rkbuf);
+        send->slice = rkbuf->rkbuf_reader;
+        TAILQ_INSERT_TAIL(&ur->sendq, send, link);
+
+        rd_slice_read(&rkbuf->rkbuf_reader, NULL, len);
+
+        return (ssize_t)len;
+}
+
+
+/**
+ * @brief Copy received data from the staging buffer or account for
+ *        data received directly into \p rbuf.
+ *
+ * @returns the number of bytes received into \p rbuf, 0 if no data is
+ *          available, or -1 on error or connection close (\p errstr
+ *          is set).
+ *
+ * @locality broker thread
+ */
+ssize_t rd_kafka_transport_uring_recv (rd_kafka_transport_t *rktrans,
+                                       rd_buf_t *rbuf,
+                                       char *errstr, size_t errstr_size) {
+        struct rd_kafka_transport_uring_s *ur = rktrans->rktrans_uring;
+        size_t len;
+
+        if (ur->rx_len > ur->rx_rof) {
+                len = RD_MIN(ur->rx_len - ur->rx_rof,
+                             rd_buf_write_remains(rbuf));
+                rd_buf_write(rbuf, ur->rx_buf + ur->rx_rof, len);
+                ur->rx_rof += len;
+                return (ssize_t)len;
+        }
+
+        if (ur->rx_direct_len > 0) {
+                rd_assert(ur->rx_direct == rbuf);
+                len = ur->rx_direct_len;
+                rd_buf_write(rbuf, NULL, len);
+                ur->rx_direct     = NULL;
+                ur->rx_direct_len = 0;
+                return (ssize_t)len;
+        }
+
+        if (ur->rx_err) {
+                if (ur->rx_err == -1)
+                        rd_snprintf(errstr, errstr_size, "Disconnected");
+                else
+                        rd_snprintf(errstr, errstr_size, "%s",
+                                    rd_strerror(ur->rx_err));
+                return -1;
+        }
+
+        return 0;
+}
+
+
+/**
+ * @returns true if there is received data (or a receive error) to be
+ *          served by rd_kafka_transport_uring_recv().
+ */
+static RD_INLINE int
+rd_kafka_transport_uring_rx_ready (const struct rd_kafka_transport_uring_s
+                                   *ur) {
+        return ur->rx_len > ur->rx_rof || ur->rx_direct_len > 0 ||
+                ur->rx_err;
+}
+
+
+/**
+ * @brief Queue the receive, send and wake-up operations that are not
+ *        already outstanding.
+ */
+static void rd_kafka_transport_uring_prepare (rd_kafka_transport_t *rktrans) {
+        struct rd_kafka_transport_uring_s *ur = rktrans->rktrans_uring;
+        rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
+        struct io_uring_sqe *sqe;
+
+        if (!ur->rx_inflight && !rd_kafka_transport_uring_rx_ready(ur) &&
+            (sqe = rd_uring_sqe_get(&ur->ring))) {
+                rd_kafka_buf_t *rkbuf = rkb->rkb_recv_buf;
+
+                sqe->fd        = rktrans->rktrans_s;
+                sqe->user_data = RD_KAFKA_URING_OP_RECV;
+
+                if (rkbuf && rkbuf->rkbuf_totlen > 0 &&
+                    rd_buf_write_remains(&rkbuf->rkbuf_buf) >=
+                    RD_KAFKA_URING_DIRECT_MIN) {
+                        /* Large payload: receive directly into the
+                         * response buffer. */
+                        size_t iovlen;
+
+                        rd_buf_get_write_iov(&rkbuf->rkbuf_buf,
+                                             ur->rx_iov, &iovlen, IOV_MAX,
+                                             rktrans->rktrans_rcvbuf_size);
+                        ur->rx_msg.msg_iov    = ur->rx_iov;
+                        ur->rx_msg.msg_iovlen = iovlen;
+                        ur->rx_direct         = &rkbuf->rkbuf_buf;
+
+                        sqe->opcode = IORING_OP_RECVMSG;
+                        sqe->addr   = (uint64_t)(uintptr_t)&ur->rx_msg;
+                        sqe->len    = 1;
+
+                } else {
+                        /* Headers and small payloads:
+                         * receive into the staging buffer */
+                        ur->rx_rof = ur->rx_len = 0;
+                        ur->rx_direct = NULL;
+
+                        sqe->opcode = ur->rx_fixed ?
+                                IORING_OP_READ_FIXED : IORING_OP_RECV;
+                        sqe->addr   = (uint64_t)(uintptr_t)ur->rx_buf;
+                        sqe->len    = RD_KAFKA_URING_RX_SIZE;
+                }
+
+                ur->rx_inflight = 1;
+        }
+
+        if (!ur->tx_inflight && !TAILQ_EMPTY(&ur->sendq) &&
+            (sqe = rd_uring_sqe_get(&ur->ring))) {
+                rd_kafka_uring_send_t *send;
+                size_t iovcnt = 0, sum = 0;
+
+                /* Write as many of the queued requests as possible
+                 * with a single sendmsg. */
+                TAILQ_FOREACH(send, &ur->sendq, link) {
+                        size_t iovlen;
+
+                        if (iovcnt == IOV_MAX ||
+                            sum >= rktrans->rktrans_sndbuf_size)
+                                break;
+
+                        sum += rd_slice_get_iov(&send->slice,
+                                                ur->tx_iov + iovcnt, &iovlen,
+                                                IOV_MAX - iovcnt,
+                                                rktrans->rktrans_sndbuf_size -
+                                                sum);
+                        iovcnt += iovlen;
+                }
+
+                ur->tx_msg.msg_iov    = ur->tx_iov;
+                ur->tx_msg.msg_iovlen = iovcnt;
+
+                sqe->opcode    = IORING_OP_SENDMSG;
+                sqe->fd        = rktrans->rktrans_s;
+                sqe->addr      = (uint64_t)(uintptr_t)&ur->tx_msg;
+                sqe->len       = 1;
+                sqe->msg_flags = MSG_NOSIGNAL;
+                sqe->user_data = RD_KAFKA_URING_OP_SEND;
+
+                ur->tx_inflight = 1;
+        }
+
+        if (!ur->wakeup_inflight && ur->wakeup_fd != -1 &&
+            (sqe = rd_uring_sqe_get(&ur->ring))) {
+                sqe->opcode      = IORING_OP_POLL_ADD;
+                sqe->fd          = ur->wakeup_fd;
+                sqe->poll_events = POLLIN;
+                sqe->user_data   = RD_KAFKA_URING_OP_WAKEUP;
+
+                ur->wakeup_inflight = 1;
+        }
+}
+
+
+/**
+ * @brief Account for \p len bytes written from the send queue,
+ *        releasing the fully written requests.
+ */
+static void rd_kafka_transport_uring_sent (struct rd_kafka_transport_uring_s
+                                           *ur, size_t len) {
+        rd_kafka_uring_send_t *send;
+
+        while (len > 0 && (send = TAILQ_FIRST(&ur->sendq))) {
+                len -= rd_slice_read(&send->slice, NULL,
+                                     RD_MIN(len,
+                                            rd_slice_remains(&send->slice)));
+
+                if (rd_slice_remains(&send->slice) > 0)
+                        break; /* Partially written */
+
+                TAILQ_REMOVE(&ur->sendq, send, link);
+                rd_kafka_buf_destroy(send->rkbuf);
+                rd_free(send);
+        }
+}
+
+
+/**
+ * @brief Serve completed operations.
+ */
+static void rd_kafka_transport_uring_reap (rd_kafka_transport_t *rktrans) {
+        struct rd_kafka_transport_uring_s *ur = rktrans->rktrans_uring;
+        struct io_uring_cqe *cqe;
+
+        while ((cqe = rd_uring_cqe_peek(&ur->ring))) {
+                int res = cqe->res;
+
+                switch (cqe->user_data)
+                {
+                case RD_KAFKA_URING_OP_RECV:
+                        ur->rx_inflight = 0;
+                        if (res > 0) {
+                                if (ur->rx_direct)
+                                        ur->rx_direct_len = (size_t)res;
+                                else
+                                        ur->rx_len = (size_t)res;
+                        } else if (res == 0) {
+                                /* Connection closed */
+                                ur->rx_err = -1;
+                        } else if (res != -EAGAIN && res != -EINTR) {
+                                ur->rx_err = -res;
+                        }
+                        break;
+
+                case RD_KAFKA_URING_OP_SEND:
+                        ur->tx_inflight = 0;
+                        if (res >= 0)
+                                rd_kafka_transport_uring_sent(ur, (size_t)res);
+                        else if (res != -EAGAIN && res != -EINTR)
+                                ur->tx_err = -res;
+                        break;
+
+                case RD_KAFKA_URING_OP_WAKEUP:
+                {
+                        char buf[512];
+
+                        ur->wakeup_inflight = 0;
+
+                        /* Read wake-up fd data and throw away,
+                         * just used for wake-ups */
+                        rd_kafka_uring_syscall(rktrans);
+                        if (rd_read(ur->wakeup_fd, buf, sizeof(buf)) == -1) {
+                                /* Ignore warning */
+                        }
+                        break;
+                }
+                }
+
+                rd_uring_cqe_seen(&ur->ring);
+        }
+}
+
+
+/**
+ * @brief io_uring counterpart of rd_kafka_transport_io_serve():
+ *        submit outstanding IO, wait at most \p timeout_ms for any of it
+ *        to complete and serve the resulting events.
+ *
+ * @locality broker thread
+ */
+void rd_kafka_transport_uring_io_serve (rd_kafka_transport_t *rktrans,
+                                        int timeout_ms) {
+        struct rd_kafka_transport_uring_s *ur = rktrans->rktrans_uring;
+        rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
+        int events;
+        int err;
+
+        /* Move requests from the outbuf queue to the send queue */
+        if (rd_kafka_transport_poll_prepare(rktrans) & POLLOUT) {
+                rd_kafka_transport_io_events(rktrans, POLLOUT);
+                if (rkb->rkb_transport != rktrans)
+                        return; /* Transport failed and was closed */
+        }
+
+        rd_kafka_transport_uring_prepare(rktrans);
+
+        /* Submit and wait in one system call.
+         * Don't wait if there's already received data to serve. */
+        rd_kafka_uring_syscall(rktrans);
+        err = rd_uring_enter(&ur->ring,
+                             rd_kafka_transport_uring_rx_ready(ur) ? 0 : 1,
+                             timeout_ms);
+        if (unlikely(err)) {
+                rd_kafka_broker_fail(rkb, LOG_ERR,
+                                     RD_KAFKA_RESP_ERR__TRANSPORT,
+                                     "io_uring_enter failed: %s",
+                                     rd_strerror(err));
+                return;
+        }
+
+        rd_kafka_transport_uring_reap(rktrans);
+
+        if (unlikely(ur->tx_err)) {
+                rd_kafka_broker_fail(rkb, LOG_ERR,
+                                     RD_KAFKA_RESP_ERR__TRANSPORT,
+                                     "Send failed: %s",
+                                     rd_strerror(ur->tx_err));
+                return;
+        }
+
+        events = rd_kafka_transport_poll_prepare(rktrans) & POLLOUT;
+        if (rd_kafka_transport_uring_rx_ready(ur))
+                events |= POLLIN;
+
+        if (!events)
+                return;
+
+        rd_atomic64_add(&rkb->rkb_c.wakeups, 1);
+
+        rd_kafka_transport_io_events(rktrans, events);
+}
+
+#endif /* HAVE_IO_URING */
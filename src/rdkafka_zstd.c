@@ -0,0 +1,258 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rdkafka_int.h"
+#include "rdkafka_zstd.h"
+
+#include "rdbuf.h"
+
+#include <zstd.h>
+
+
+/**
+ * @brief Decompress all zstd frames in \p inbuf.
+ *
+ * Kafka producers typically use the zstd streaming API which does not
+ * store the uncompressed size in the frame header, in which case
+ * the output buffer is sized by estimate and grown as needed,
+ * up to receive.message.max.bytes.
+ *
+ * @returns allocated buffer in \p *outbuf, length in \p *outlenp.
+ */
+rd_kafka_resp_err_t
+rd_kafka_zstd_decompress (rd_kafka_broker_t *rkb, int64_t Offset,
+                          const char *inbuf, size_t inlen,
+                          void **outbuf, size_t *outlenp) {
+        ZSTD_DStream *dstream;
+        ZSTD_inBuffer in = { inbuf, inlen, 0 };
+        ZSTD_outBuffer out = { NULL, 0, 0 };
+        unsigned long long content_size;
+        rd_kafka_resp_err_t err = RD_KAFKA_RESP_ERR_NO_ERROR;
+        /* Don't let a corrupt or crafted frame exhaust memory */
+        const size_t out_max = (size_t)rkb->rkb_rk->rk_conf.recv_max_msg_size;
+        size_t r = 1;
+
+        *outbuf = NULL;
+
+        content_size = ZSTD_getFrameContentSize(inbuf, inlen);
+        if (content_size == ZSTD_CONTENTSIZE_ERROR) {
+                rd_rkb_dbg(rkb, MSG, "ZSTD",
+                           "Failed to decompress ZSTD message "
+                           "(offset %"PRId64"): invalid frame header",
+                           Offset);
+                return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+        }
+
+        if (content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+            content_size > (unsigned long long)out_max) {
+                rd_rkb_dbg(rkb, MSG, "ZSTD",
+                           "Failed to decompress ZSTD message "
+                           "(offset %"PRId64"): uncompressed size %llu "
+                           "exceeds receive.message.max.bytes %"PRIusz,
+                           Offset, content_size, out_max);
+                return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+        }
+
+        /* If the uncompressed size is unknown or out of bounds start
+         * with a multiple of the compressed size (4x compression) and
+         * grow the buffer geometrically as needed below, rather than
+         * allocating up to message.max.bytes for every message. */
+        if (content_size == ZSTD_CONTENTSIZE_UNKNOWN ||
+            content_size == 0 || content_size > (unsigned long long)inlen * 255)
+                out.size = RD_MIN(RD_MAX(inlen * 4, 1024), out_max);
+        else
+                out.size = (size_t)content_size;
+
+        out.dst = rd_malloc(out.size);
+
+        dstream = ZSTD_createDStream();
+        if (!dstream) {
+                rd_rkb_dbg(rkb, MSG, "ZSTD",
+                           "Unable to create ZSTD decompression stream");
+                rd_free(out.dst);
+                return RD_KAFKA_RESP_ERR__CRIT_SYS_RESOURCE;
+        }
+
+        ZSTD_initDStream(dstream);
+
+        /* The input may consist of multiple concatenated frames,
+         * r is 0 when the current frame is fully decoded and flushed. */
+        while (in.pos < in.size || r != 0) {
+                if (unlikely(out.pos == out.size)) {
+                        /* Grow exponentially with some factor > 1
+                         * (using 1.75) for amortized O(1) copying */
+                        size_t extra = RD_MAX(out.size * 3 / 4, 1024);
+
+                        if (unlikely(out.size >= out_max)) {
+                                rd_rkb_dbg(rkb, MSG, "ZSTD",
+                                           "Failed to decompress ZSTD "
+                                           "message (offset %"PRId64"): "
+                                           "uncompressed size exceeds "
+                                           "receive.message.max.bytes "
+                                           "%"PRIusz,
+                                           Offset, out_max);
+                                err = RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+                                break;
+                        }
+
+                        extra = RD_MIN(extra, out_max - out.size);
+
+                        rd_atomic64_add(&rkb->rkb_c.zbuf_grow, 1);
+
+                        out.dst = rd_realloc(out.dst, out.size + extra);
+                        out.size += extra;
+                }
+
+                r = ZSTD_decompressStream(dstream, &out, &in);
+                if (unlikely(ZSTD_isError(r))) {
+                        rd_rkb_dbg(rkb, MSG, "ZSTD",
+                                   "Failed to decompress ZSTD message "
+                                   "(offset %"PRId64") at "
+                                   "payload offset %"PRIusz"/%"PRIusz": %s",
+                                   Offset, in.pos, in.size,
+                                   ZSTD_getErrorName(r));
+                        err = RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+                        break;
+                }
+
+                if (r != 0 && in.pos == in.size && out.pos < out.size) {
+                        /* Decoder wants more input than there is */
+                        rd_rkb_dbg(rkb, MSG, "ZSTD",
+                                   "Failed to decompress ZSTD message "
+                                   "(offset %"PRId64"): truncated frame "
+                                   "(%"PRIusz" bytes)",
+                                   Offset, in.size);
+                        err = RD_KAFKA_RESP_ERR__BAD_MSG;
+                        break;
+                }
+        }
+
+        ZSTD_freeDStream(dstream);
+
+        if (err) {
+                rd_free(out.dst);
+                return err;
+        }
+
+        *outbuf = out.dst;
+        *outlenp = out.pos;
+
+        return RD_KAFKA_RESP_ERR_NO_ERROR;
+}
+
+
+/**
+ * @brief Allocate space for \p *outbuf and compress the remaining contents
+ *        of \p slice with zstd at level \p comp_level (-1 for the
+ *        library default).
+ *
+ * @returns allocated buffer in \p *outbuf, length in \p *outlenp.
+ */
+rd_kafka_resp_err_t
+rd_kafka_zstd_compress (rd_kafka_broker_t *rkb, int comp_level,
+                        rd_slice_t *slice, void **outbuf, size_t *outlenp) {
+        ZSTD_CStream *cstream;
+        rd_kafka_resp_err_t err = RD_KAFKA_RESP_ERR_NO_ERROR;
+        size_t len = rd_slice_remains(slice);
+        ZSTD_outBuffer out;
+        const void *p;
+        size_t rlen;
+        size_t r;
+
+        *outbuf = NULL;
+
+        /* The output buffer is sized by the worst case compressed size
+         * so that the frame can be completed without reallocation. */
+        out.size = ZSTD_compressBound(len);
+        out.pos = 0;
+        out.dst = rd_malloc(out.size);
+
+        cstream = ZSTD_createCStream();
+        if (!cstream) {
+                rd_rkb_dbg(rkb, MSG, "ZSTDCOMPR",
+                           "Unable to create ZSTD compression stream");
+                rd_free(out.dst);
+                return RD_KAFKA_RESP_ERR__CRIT_SYS_RESOURCE;
+        }
+
+        /* Level 0 selects the zstd default level */
+        r = ZSTD_initCStream(cstream, comp_level == -1 ? 0 : comp_level);
+        if (ZSTD_isError(r)) {
+                rd_rkb_dbg(rkb, MSG, "ZSTDCOMPR",
+                           "Unable to begin ZSTD compression "
+                           "(level %d): %s",
+                           comp_level, ZSTD_getErrorName(r));
+                err = RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+                goto done;
+        }
+
+        while ((rlen = rd_slice_reader(slice, &p))) {
+                ZSTD_inBuffer in = { p, rlen, 0 };
+
+                while (in.pos < in.size) {
+                        r = ZSTD_compressStream(cstream, &out, &in);
+                        if (unlikely(ZSTD_isError(r))) {
+                                rd_rkb_dbg(rkb, MSG, "ZSTDCOMPR",
+                                           "ZSTD compression failed "
+                                           "(at %"PRIusz" of %"PRIusz" "
+                                           "input bytes): %s",
+                                           len - rd_slice_remains(slice),
+                                           len, ZSTD_getErrorName(r));
+                                err = RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+                                goto done;
+                        }
+                }
+        }
+
+        rd_assert(rd_slice_remains(slice) == 0);
+
+        /* Flush and end the frame, r is the number of bytes
+         * left to flush. */
+        r = ZSTD_endStream(cstream, &out);
+        if (unlikely(ZSTD_isError(r) || r > 0)) {
+                rd_rkb_dbg(rkb, MSG, "ZSTDCOMPR",
+                           "Failed to finalize ZSTD compression "
+                           "of %"PRIusz" bytes: %s",
+                           len,
+                           ZSTD_isError(r) ? ZSTD_getErrorName(r) :
+                           "output buffer full");
+                err = RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+                goto done;
+        }
+
+        *outbuf = out.dst;
+        *outlenp = out.pos;
+
+ done:
+        ZSTD_freeCStream(cstream);
+
+        if (err)
+                rd_free(out.dst);
+
+        return err;
+}
@@ -32,7 +32,11 @@
 #include "rdvarint.h"
 #include "rdbuf.h"
 #include "crc32c.h"
+#include "rdcrc32.h"
 #include "rdmurmur2.h"
+#include "rdkafka_msgpool.h"
+#include "rdkafka_recvpool.h"
+#include "rduring.h"
 #if WITH_HDRHISTOGRAM
 #include "rdhdrhistogram.h"
 #endif
@@ -46,10 +50,20 @@ int rd_unittest (void) {
                 int (*call) (void);
         } unittests[] = {
                 { "rdbuf",    unittest_rdbuf },
+                { "rdheap",   unittest_rdheap },
                 { "rdvarint", unittest_rdvarint },
                 { "crc32c",   unittest_crc32c },
+                { "crc32",    unittest_crc32 },
                 { "msg",      unittest_msg },
+                { "queue",    unittest_queue },
+                { "timer",    unittest_timer },
+                { "msgpool",  unittest_msgpool },
+                { "recvpool", unittest_recvpool },
+                { "offload",  unittest_offload },
                 { "murmurhash", unittest_murmur2 },
+#if HAVE_IO_URING
+                { "uring",    unittest_uring },
+#endif
 #if WITH_HDRHISTOGRAM
                 { "rdhdrhistogram", unittest_rdhdrhistogram },
 #endif
@@ -0,0 +1,361 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rd.h"
+#include "rduring.h"
+#include "rdtime.h"
+#include "rdunittest.h"
+
+#if HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+
+
+static int rd_uring_sys_setup (unsigned int entries,
+                               struct io_uring_params *p) {
+        return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int rd_uring_sys_enter (int fd, unsigned int to_submit,
+                               unsigned int min_complete, unsigned int flags,
+                               const void *arg, size_t argsz) {
+        return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                            flags, arg, argsz);
+}
+
+static int rd_uring_sys_register (int fd, unsigned int opcode,
+                                  const void *arg, unsigned int nr_args) {
+        return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+
+/**
+ * @brief Set up a new io_uring instance with (at least) \p entries
+ *        submission queue entries.
+ *
+ * @returns 0 on success or an errno on failure, such as ENOSYS if
+ *          io_uring is not supported (or not permitted) by the kernel,
+ *          or EOPNOTSUPP if the kernel lacks required features.
+ */
+int rd_uring_init (rd_uring_t *ur, unsigned int entries) {
+        struct io_uring_params p;
+        int err;
+
+        memset(ur, 0, sizeof(*ur));
+        memset(&p, 0, sizeof(p));
+
+        if ((ur->ur_fd = rd_uring_sys_setup(entries, &p)) == -1)
+                return errno;
+
+        /* Timed waits are implemented with IORING_ENTER_EXT_ARG */
+        if (!(p.features & IORING_FEAT_EXT_ARG)) {
+                err = EOPNOTSUPP;
+                goto fail;
+        }
+
+        ur->ur_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        ur->ur_cq_ring_size = p.cq_off.cqes +
+                p.cq_entries * sizeof(struct io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+                ur->ur_sq_ring_size = ur->ur_cq_ring_size =
+                        RD_MAX(ur->ur_sq_ring_size, ur->ur_cq_ring_size);
+
+        ur->ur_sq_ring = mmap(NULL, ur->ur_sq_ring_size,
+                              PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                              ur->ur_fd, IORING_OFF_SQ_RING);
+        if (ur->ur_sq_ring == MAP_FAILED) {
+                ur->ur_sq_ring = NULL;
+                err = errno;
+                goto fail;
+        }
+
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+                ur->ur_cq_ring = ur->ur_sq_ring;
+        else {
+                ur->ur_cq_ring = mmap(NULL, ur->ur_cq_ring_size,
+                                      PROT_READ|PROT_WRITE,
+                                      MAP_SHARED|MAP_POPULATE,
+                                      ur->ur_fd, IORING_OFF_CQ_RING);
+                if (ur->ur_cq_ring == MAP_FAILED) {
+                        ur->ur_cq_ring = NULL;
+                        err = errno;
+                        goto fail;
+                }
+        }
+
+        ur->ur_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        ur->ur_sqes = mmap(NULL, ur->ur_sqes_size,
+                           PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                           ur->ur_fd, IORING_OFF_SQES);
+        if (ur->ur_sqes == MAP_FAILED) {
+                ur->ur_sqes = NULL;
+                err = errno;
+                goto fail;
+        }
+
+        ur->ur_sq_head  = (unsigned *)((char *)ur->ur_sq_ring +
+                                       p.sq_off.head);
+        ur->ur_sq_tail  = (unsigned *)((char *)ur->ur_sq_ring +
+                                       p.sq_off.tail);
+        ur->ur_sq_mask  = *(unsigned *)((char *)ur->ur_sq_ring +
+                                        p.sq_off.ring_mask);
+        ur->ur_sq_array = (unsigned *)((char *)ur->ur_sq_ring +
+                                       p.sq_off.array);
+
+        ur->ur_cq_head  = (unsigned *)((char *)ur->ur_cq_ring +
+                                       p.cq_off.head);
+        ur->ur_cq_tail  = (unsigned *)((char *)ur->ur_cq_ring +
+                                       p.cq_off.tail);
+        ur->ur_cq_mask  = *(unsigned *)((char *)ur->ur_cq_ring +
+                                        p.cq_off.ring_mask);
+        ur->ur_cqes     = (struct io_uring_cqe *)((char *)ur->ur_cq_ring +
+                                                  p.cq_off.cqes);
+
+        return 0;
+
+ fail:
+        rd_uring_destroy(ur);
+        return err;
+}
+
+
+/**
+ * @brief Unmap the rings and close the io_uring instance,
+ *        which cancels any operations still in flight.
+ */
+void rd_uring_destroy (rd_uring_t *ur) {
+        if (ur->ur_sqes)
+                munmap(ur->ur_sqes, ur->ur_sqes_size);
+        if (ur->ur_cq_ring && ur->ur_cq_ring != ur->ur_sq_ring)
+                munmap(ur->ur_cq_ring, ur->ur_cq_ring_size);
+        if (ur->ur_sq_ring)
+                munmap(ur->ur_sq_ring, ur->ur_sq_ring_size);
+        if (ur->ur_fd != -1)
+                close(ur->ur_fd);
+
+        memset(ur, 0, sizeof(*ur));
+        ur->ur_fd = -1;
+}
+
+
+/**
+ * @returns a zeroed submission queue entry to be filled in by the caller,
+ *          which is submitted by the next rd_uring_enter(),
+ *          or NULL if the submission queue is full.
+ */
+struct io_uring_sqe *rd_uring_sqe_get (rd_uring_t *ur) {
+        unsigned tail = *ur->ur_sq_tail + ur->ur_sq_pending;
+        struct io_uring_sqe *sqe;
+
+        if (tail - __atomic_load_n(ur->ur_sq_head, __ATOMIC_ACQUIRE) >
+            ur->ur_sq_mask)
+                return NULL;
+
+        sqe = &ur->ur_sqes[tail & ur->ur_sq_mask];
+        memset(sqe, 0, sizeof(*sqe));
+        ur->ur_sq_array[tail & ur->ur_sq_mask] = tail & ur->ur_sq_mask;
+        ur->ur_sq_pending++;
+
+        return sqe;
+}
+
+
+/**
+ * @brief Submit the queued submission entries and wait for at least
+ *        \p wait_nr completions, at most \p timeout_ms milliseconds.
+ *
+ * This is a single system call.
+ *
+ * @returns 0 on success (also on timeout or signal interruption), or
+ *          an errno on failure.
+ */
+int rd_uring_enter (rd_uring_t *ur, unsigned int wait_nr, int timeout_ms) {
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        unsigned int to_submit = ur->ur_sq_pending;
+        unsigned int flags = 0;
+        int r;
+
+        if (to_submit)
+                __atomic_store_n(ur->ur_sq_tail, *ur->ur_sq_tail + to_submit,
+                                 __ATOMIC_RELEASE);
+        ur->ur_sq_pending = 0;
+
+        if (wait_nr > 0)
+                flags |= IORING_ENTER_GETEVENTS;
+
+        if (timeout_ms < 0) {
+                /* Infinite wait */
+                r = rd_uring_sys_enter(ur->ur_fd, to_submit, wait_nr, flags,
+                                       NULL, 0);
+        } else {
+                memset(&arg, 0, sizeof(arg));
+                ts.tv_sec  = timeout_ms / 1000;
+                ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+                arg.ts     = (uint64_t)(uintptr_t)&ts;
+                r = rd_uring_sys_enter(ur->ur_fd, to_submit, wait_nr,
+                                       flags | IORING_ENTER_EXT_ARG,
+                                       &arg, sizeof(arg));
+        }
+
+        if (r == -1 && errno != ETIME && errno != EINTR)
+                return errno;
+
+        return 0;
+}
+
+
+/**
+ * @brief Register \p cnt fixed buffers for use with
+ *        IORING_OP_READ_FIXED and IORING_OP_WRITE_FIXED.
+ *
+ * @returns 0 on success or an errno on failure.
+ */
+int rd_uring_register_buffers (rd_uring_t *ur,
+                               const struct iovec *iov, unsigned int cnt) {
+        if (rd_uring_sys_register(ur->ur_fd, IORING_REGISTER_BUFFERS,
+                                  iov, cnt) == -1)
+                return errno;
+        return 0;
+}
+
+
+
+/**
+ * @name Unit tests
+ * @{
+ */
+
+int unittest_uring (void) {
+        rd_uring_t ur;
+        struct io_uring_sqe *sqe;
+        struct io_uring_cqe *cqe;
+        int fds[2];
+        char sbuf[1000], rbuf[sizeof(sbuf)];
+        struct iovec iov = { rbuf, sizeof(rbuf) };
+        int err, i, cnt;
+        int64_t ts;
+
+        if ((err = rd_uring_init(&ur, 8))) {
+                RD_UT_SAY("io_uring not available: %s: skipping",
+                          rd_strerror(err));
+                RD_UT_PASS();
+        }
+
+        RD_UT_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0,
+                     "socketpair: %s", rd_strerror(errno));
+
+        for (i = 0 ; i < (int)sizeof(sbuf) ; i++)
+                sbuf[i] = (char)i;
+
+        /* Receive into a fixed buffer and send in the same submission. */
+        err = rd_uring_register_buffers(&ur, &iov, 1);
+        RD_UT_ASSERT(!err, "register_buffers: %s", rd_strerror(err));
+
+        sqe = rd_uring_sqe_get(&ur);
+        sqe->opcode    = IORING_OP_READ_FIXED;
+        sqe->fd        = fds[1];
+        sqe->addr      = (uint64_t)(uintptr_t)rbuf;
+        sqe->len       = sizeof(rbuf);
+        sqe->buf_index = 0;
+        sqe->user_data = 1;
+
+        sqe = rd_uring_sqe_get(&ur);
+        sqe->opcode    = IORING_OP_SEND;
+        sqe->fd        = fds[0];
+        sqe->addr      = (uint64_t)(uintptr_t)sbuf;
+        sqe->len       = sizeof(sbuf);
+        sqe->user_data = 2;
+
+        cnt = 0;
+        while (cnt < 2) {
+                err = rd_uring_enter(&ur, 1, 1000);
+                RD_UT_ASSERT(!err, "enter: %s", rd_strerror(err));
+
+                while ((cqe = rd_uring_cqe_peek(&ur))) {
+                        RD_UT_ASSERT(cqe->res == (int)sizeof(sbuf),
+                                     "op %d: expected %d bytes, not %d",
+                                     (int)cqe->user_data, (int)sizeof(sbuf),
+                                     cqe->res);
+                        rd_uring_cqe_seen(&ur);
+                        cnt++;
+                }
+        }
+
+        RD_UT_ASSERT(!memcmp(sbuf, rbuf, sizeof(sbuf)),
+                     "received data mismatch");
+
+        /* Timed wait without completions */
+        sqe = rd_uring_sqe_get(&ur);
+        sqe->opcode    = IORING_OP_RECV;
+        sqe->fd        = fds[1];
+        sqe->addr      = (uint64_t)(uintptr_t)rbuf;
+        sqe->len       = sizeof(rbuf);
+        sqe->user_data = 3;
+
+        ts = rd_clock();
+        err = rd_uring_enter(&ur, 1, 100);
+        ts = rd_clock() - ts;
+        RD_UT_ASSERT(!err, "enter: %s", rd_strerror(err));
+        RD_UT_ASSERT(!rd_uring_cqe_peek(&ur), "unexpected completion");
+        RD_UT_ASSERT(ts >= 90*1000 && ts < 1000*1000,
+                     "expected 100ms wait, not %dms", (int)(ts / 1000));
+
+        /* Cancel the pending receive */
+        sqe = rd_uring_sqe_get(&ur);
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->addr      = 3;
+        sqe->user_data = 4;
+
+        cnt = 0;
+        while (cnt < 2) {
+                err = rd_uring_enter(&ur, 1, 1000);
+                RD_UT_ASSERT(!err, "enter: %s", rd_strerror(err));
+
+                while ((cqe = rd_uring_cqe_peek(&ur))) {
+                        if (cqe->user_data == 3)
+                                RD_UT_ASSERT(cqe->res == -ECANCELED,
+                                             "expected receive to be "
+                                             "cancelled, not %d", cqe->res);
+                        rd_uring_cqe_seen(&ur);
+                        cnt++;
+                }
+        }
+
+        close(fds[0]);
+        close(fds[1]);
+        rd_uring_destroy(&ur);
+
+        RD_UT_PASS();
+}
+
+/**@}*/
+
+#endif /* HAVE_IO_URING */
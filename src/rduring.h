@@ -0,0 +1,114 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDURING_H_
+#define _RDURING_H_
+
+#include "rd.h"
+
+#if HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+/**
+ * @name Minimal io_uring interface
+ *
+ * A thin wrapper around the io_uring system calls and the shared
+ * submission and completion rings, for a single thread submitting and
+ * reaping its own operations.
+ * liburing is not required.
+ *
+ * Requires a Linux kernel with IORING_FEAT_EXT_ARG (5.11 or later),
+ * rd_uring_init() fails on older kernels.
+ */
+
+typedef struct rd_uring_s {
+        int        ur_fd;
+
+        /* Submission queue */
+        unsigned  *ur_sq_head;
+        unsigned  *ur_sq_tail;
+        unsigned   ur_sq_mask;
+        unsigned  *ur_sq_array;
+        struct io_uring_sqe *ur_sqes;
+        unsigned   ur_sq_pending;   /**< SQEs queued but not yet
+                                     *   submitted */
+
+        /* Completion queue */
+        unsigned  *ur_cq_head;
+        unsigned  *ur_cq_tail;
+        unsigned   ur_cq_mask;
+        struct io_uring_cqe *ur_cqes;
+
+        void      *ur_sq_ring;
+        size_t     ur_sq_ring_size;
+        void      *ur_cq_ring;      /**< Same as ur_sq_ring if
+                                     *   IORING_FEAT_SINGLE_MMAP */
+        size_t     ur_cq_ring_size;
+        size_t     ur_sqes_size;
+} rd_uring_t;
+
+
+int rd_uring_init (rd_uring_t *ur, unsigned int entries);
+void rd_uring_destroy (rd_uring_t *ur);
+
+struct io_uring_sqe *rd_uring_sqe_get (rd_uring_t *ur);
+int rd_uring_enter (rd_uring_t *ur, unsigned int wait_nr, int timeout_ms);
+int rd_uring_register_buffers (rd_uring_t *ur,
+                               const struct iovec *iov, unsigned int cnt);
+
+
+/**
+ * @returns the next completion, or NULL if there is none.
+ *          The completion must be released with rd_uring_cqe_seen().
+ */
+static RD_INLINE RD_UNUSED
+struct io_uring_cqe *rd_uring_cqe_peek (rd_uring_t *ur) {
+        unsigned head = *ur->ur_cq_head;
+
+        if (head == __atomic_load_n(ur->ur_cq_tail, __ATOMIC_ACQUIRE))
+                return NULL;
+
+        return &ur->ur_cqes[head & ur->ur_cq_mask];
+}
+
+/**
+ * @brief Release the completion returned by rd_uring_cqe_peek().
+ */
+static RD_INLINE RD_UNUSED
+void rd_uring_cqe_seen (rd_uring_t *ur) {
+        __atomic_store_n(ur->ur_cq_head, *ur->ur_cq_head + 1,
+                         __ATOMIC_RELEASE);
+}
+
+int unittest_uring (void);
+
+#endif /* HAVE_IO_URING */
+
+#endif /* _RDURING_H_ */
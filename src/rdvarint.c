@@ -29,17 +29,18 @@
 
 #include "rdvarint.h"
 #include "rdunittest.h"
+#include "rdtime.h"
 
 
 /**
- * @brief Read a varint-encoded signed integer from \p slice.
+ * @brief Read a varint-encoded signed integer from \p slice one byte at
+ *        a time, for varints spanning segments.
  */
-size_t rd_varint_dec_slice (rd_slice_t *slice, int64_t *nump) {
+static size_t rd_varint_dec_slice0 (rd_slice_t *slice, int64_t *nump) {
         size_t num = 0;
         int shift = 0;
         unsigned char oct;
 
-        /* FIXME: Optimize to use something better than read() */
         do {
                 size_t r = rd_slice_read(slice, &oct, sizeof(oct));
                 if (unlikely(r == 0))
@@ -54,6 +55,30 @@ size_t rd_varint_dec_slice (rd_slice_t *slice, int64_t *nump) {
 }
 
 
+/**
+ * @brief Read a varint-encoded signed integer from \p slice.
+ */
+size_t rd_varint_dec_slice (rd_slice_t *slice, int64_t *nump) {
+        size_t num;
+        size_t r;
+
+        /* Fast path: decode directly from the current segment's memory
+         * if the varint is contiguous in it. */
+        if (likely(slice->seg != NULL) &&
+            likely((r = rd_uvarint_dec(slice->seg->seg_p + slice->rof,
+                                       RD_MIN(slice->seg->seg_of -
+                                              slice->rof,
+                                              rd_slice_remains(slice)),
+                                       &num)) > 0)) {
+                slice->rof += r;
+                *nump = (int64_t)((num >> 1) ^ -(int64_t)(num & 1));
+                return r;
+        }
+
+        return rd_varint_dec_slice0(slice, nump);
+}
+
+
 
 
 
@@ -114,6 +139,128 @@ static int do_test_rd_uvarint_enc_i64 (const char *file, int line,
 }
 
 
+/**
+ * @brief Verify that the word-at-a-time (SWAR), contiguous slice and
+ *        byte-wise slice decoders agree on varints of all lengths.
+ */
+static int do_test_rd_varint_dec_all (void) {
+        int bits;
+
+        for (bits = 0 ; bits < 64 ; bits++) {
+                int64_t nums[] = {
+                        (int64_t)1 << bits,
+                        ((int64_t)1 << bits) - 1,
+                        -((int64_t)1 << bits),
+                };
+                size_t i;
+
+                for (i = 0 ; i < RD_ARRAYSIZE(nums) ; i++) {
+                        char buf[RD_UVARINT_ENC_SIZEOF(int64_t) + 8];
+                        size_t sz, r;
+                        int64_t num;
+                        rd_buf_t b;
+                        rd_slice_t slice;
+
+                        /* Trailing garbage with continuation bits set */
+                        memset(buf, 0xff, sizeof(buf));
+                        sz = rd_uvarint_enc_i64(buf, sizeof(buf), nums[i]);
+
+                        r = rd_varint_dec_i64(buf, sizeof(buf), &num);
+                        RD_UT_ASSERT(r == sz && num == nums[i],
+                                     "decode of %"PRId64" returned "
+                                     "%"PRId64" (%"PRIusz" bytes, "
+                                     "expected %"PRIusz")",
+                                     nums[i], num, r, sz);
+
+                        /* Split the varint across two segments to
+                         * exercise the byte-wise slice decoder. */
+                        rd_buf_init(&b, 2, 0);
+                        if (sz > 1)
+                                rd_buf_push(&b, buf, sz / 2, NULL);
+                        rd_buf_push(&b, buf + sz / 2, sz - sz / 2, NULL);
+                        rd_slice_init_full(&slice, &b);
+                        num = -1;
+                        r = rd_varint_dec_slice(&slice, &num);
+                        RD_UT_ASSERT(r == sz && num == nums[i],
+                                     "slice decode of %"PRId64" returned "
+                                     "%"PRId64" (%"PRIusz" bytes, "
+                                     "expected %"PRIusz")",
+                                     nums[i], num, r, sz);
+                        rd_buf_destroy(&b);
+                }
+        }
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Benchmark the slice decoders on the varints of a v2 record
+ *        with a ~100 byte value: Length, TimestampDelta, OffsetDelta,
+ *        KeyLen, ValueLen and HeaderCount.
+ */
+static int do_test_rd_varint_dec_bench (void) {
+        const int reccnt = 100000;
+        const int fieldcnt = 6;
+        struct {
+                const char *name;
+                size_t (*dec) (rd_slice_t *slice, int64_t *nump);
+        } impls[] = {
+                { "byte-wise", rd_varint_dec_slice0 },
+                { "contiguous", rd_varint_dec_slice },
+        };
+        char *buf, *p;
+        rd_buf_t b;
+        int i, j;
+        int64_t sums[RD_ARRAYSIZE(impls)];
+
+        p = buf = rd_malloc(reccnt * fieldcnt *
+                            RD_UVARINT_ENC_SIZEOF(int64_t));
+        for (i = 0 ; i < reccnt ; i++) {
+                p += rd_uvarint_enc_i64(p, 16, 120);         /* Length */
+                p += rd_uvarint_enc_i64(p, 16, i * 3);       /* TsDelta */
+                p += rd_uvarint_enc_i64(p, 16, i % 500);     /* OffsDelta */
+                p += rd_uvarint_enc_i64(p, 16, -1);          /* KeyLen */
+                p += rd_uvarint_enc_i64(p, 16, 100);         /* ValueLen */
+                p += rd_uvarint_enc_i64(p, 16, 0);           /* HdrCnt */
+        }
+
+        rd_buf_init(&b, 1, 0);
+        rd_buf_push(&b, buf, (size_t)(p - buf), NULL);
+
+        for (j = 0 ; j < (int)RD_ARRAYSIZE(impls) ; j++) {
+                rd_slice_t slice;
+                rd_ts_t ts_start;
+                int64_t num;
+
+                sums[j] = 0;
+                rd_slice_init_full(&slice, &b);
+                ts_start = rd_clock();
+                for (i = 0 ; i < reccnt * fieldcnt ; i++) {
+                        size_t r = impls[j].dec(&slice, &num);
+                        RD_UT_ASSERT(r > 0, "%s: decode of varint #%d "
+                                     "failed", impls[j].name, i);
+                        sums[j] += num;
+                }
+
+                RD_UT_SAY("varint decode %s: %.2f ns/varint",
+                          impls[j].name,
+                          (double)(rd_clock() - ts_start) * 1000.0 /
+                          (double)(reccnt * fieldcnt));
+
+                RD_UT_ASSERT(sums[j] == sums[0],
+                             "%s: sum %"PRId64" != %s sum %"PRId64,
+                             impls[j].name, sums[j],
+                             impls[0].name, sums[0]);
+        }
+
+        rd_buf_destroy(&b);
+        rd_free(buf);
+
+        RD_UT_PASS();
+}
+
+
 int unittest_rdvarint (void) {
         int fails = 0;
 
@@ -121,6 +268,8 @@ int unittest_rdvarint (void) {
                                             (const char[]){ 23<<1 }, 1);
         fails += do_test_rd_uvarint_enc_i64(__FILE__, __LINE__, 253,
                                             (const char[]){ 0xfa,  3 }, 2);
+        fails += do_test_rd_varint_dec_all();
+        fails += do_test_rd_varint_dec_bench();
 
         return fails;
 }
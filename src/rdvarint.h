@@ -32,6 +32,11 @@
 
 #include "rd.h"
 #include "rdbuf.h"
+#include "rdendian.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 /**
  * @name signed varint zig-zag encoder/decoder
@@ -100,6 +105,67 @@ size_t rd_uvarint_enc_i32 (char *dst, size_t dstsize, int32_t num) {
         (RD_UVARINT_UNDERFLOW(DEC_RETVAL) || RD_UVARINT_OVERFLOW(DEC_RETVAL))
 
 
+/**
+ * @returns the number of trailing zero bits in \p v, which must not be 0.
+ */
+static RD_INLINE RD_UNUSED int rd_varint_ctz64 (uint64_t v) {
+#ifdef _MSC_VER
+        unsigned long r;
+#ifdef _WIN64
+        _BitScanForward64(&r, v);
+#else
+        if ((uint32_t)v)
+                _BitScanForward(&r, (uint32_t)v);
+        else {
+                _BitScanForward(&r, (uint32_t)(v >> 32));
+                r += 32;
+        }
+#endif
+        return (int)r;
+#else
+        return __builtin_ctzll(v);
+#endif
+}
+
+
+/**
+ * @brief Decodes the unsigned-varint at \p src, of which at least 8 bytes
+ *        must be readable, a word at a time (SWAR): the end of the varint
+ *        is found from the continuation bits of all 8 bytes at once and
+ *        the 7-bit groups are then combined with three mask-and-shift
+ *        steps rather than one step per byte.
+ *
+ * @returns the number of bytes read (1..8), or 0 if the varint is longer
+ *          than 8 bytes, in which case rd_uvarint_dec() must be used.
+ */
+static RD_INLINE RD_UNUSED
+size_t rd_uvarint_dec_swar (const char *src, uint64_t *nump) {
+        uint64_t x, stop;
+        size_t of;
+
+        memcpy(&x, src, sizeof(x));
+        x = le64toh(x);
+
+        /* The last byte is the first one without the continuation bit */
+        stop = ~x & 0x8080808080808080ULL;
+        if (unlikely(!stop))
+                return 0;
+
+        of = (size_t)(rd_varint_ctz64(stop) + 1) / 8;
+        if (of < 8)
+                x &= (1ULL << (of * 8)) - 1;
+
+        /* Drop the continuation bits and combine the 7-bit groups
+         * pairwise into 14, 28 and finally 56 bits. */
+        x = ((x & 0x7f007f007f007f00ULL) >> 1) | (x & 0x007f007f007f007fULL);
+        x = ((x & 0x3fff00003fff0000ULL) >> 2) | (x & 0x00003fff00003fffULL);
+        x = ((x & 0x0fffffff00000000ULL) >> 4) | (x & 0x000000000fffffffULL);
+
+        *nump = x;
+        return of;
+}
+
+
 /**
  * @brief Decodes the unsigned-varint in buffer \p src of size \p srcsize
  *        and stores the decoded unsigned integer in \p nump.
@@ -117,6 +183,18 @@ size_t rd_uvarint_dec (const char *src, size_t srcsize, size_t *nump) {
         size_t num = 0;
         int shift = 0;
 
+        if (likely(srcsize > 0 && !(src[0] & 0x80))) {
+                /* Single byte: lengths and deltas of small records */
+                *nump = (size_t)(unsigned char)src[0];
+                return 1;
+        } else if (likely(srcsize >= 8)) {
+                uint64_t n;
+                if (likely((of = rd_uvarint_dec_swar(src, &n)) > 0)) {
+                        *nump = (size_t)n;
+                        return of;
+                }
+        }
+
         do {
                 if (unlikely(srcsize-- == 0))
                         return 0; /* Underflow */
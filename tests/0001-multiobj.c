@@ -62,6 +62,13 @@ int main_0001_multiobj (int argc, char **argv) {
                 /* Speed up produce to cut down on cycle time */
                 test_conf_set(conf, "queue.buffering.max.ms", "10");
 
+#ifdef __linux__
+                /* Alternate between broker threads and shared
+                 * broker IO threads. */
+                if (i & 1)
+                        test_conf_set(conf, "broker.io.threads", "1");
+#endif
+
                 TIMING_START(&t_full, "full create-produce-destroy cycle");
 		rk = test_create_handle(RD_KAFKA_PRODUCER, conf);
 
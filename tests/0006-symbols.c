@@ -56,6 +56,7 @@ int main_0006_symbols (int argc, char **argv) {
                 rd_kafka_conf_set_dr_msg_cb(NULL, NULL);
                 rd_kafka_conf_set_error_cb(NULL, NULL);
                 rd_kafka_conf_set_stats_cb(NULL, NULL);
+                rd_kafka_conf_set_stats_binary_cb(NULL, NULL);
                 rd_kafka_conf_set_log_cb(NULL, NULL);
                 rd_kafka_conf_set_socket_cb(NULL, NULL);
 		rd_kafka_conf_set_rebalance_cb(NULL, NULL);
@@ -103,6 +104,9 @@ int main_0006_symbols (int argc, char **argv) {
                 rd_kafka_offset_store(NULL, 0, 0);
                 rd_kafka_produce(NULL, 0, 0, NULL, 0, NULL, 0, NULL);
                 rd_kafka_produce_batch(NULL, 0, 0, NULL, 0);
+                rd_kafka_payload_ref_new(NULL, 0, NULL, NULL);
+                rd_kafka_payload_ref_keep(NULL);
+                rd_kafka_payload_ref_destroy(NULL);
                 rd_kafka_poll(NULL, 0);
                 rd_kafka_brokers_add(NULL, NULL);
                 /* DEPRECATED: rd_kafka_set_logger(NULL, NULL); */
@@ -123,6 +127,14 @@ int main_0006_symbols (int argc, char **argv) {
                 rd_kafka_consume_queue(NULL, 0);
                 rd_kafka_consume_batch_queue(NULL, 0, NULL, 0);
                 rd_kafka_consume_callback_queue(NULL, 0, NULL, NULL);
+                rd_kafka_consume_recordbatch_queue(NULL, 0);
+                rd_kafka_recordbatch_topic(NULL);
+                rd_kafka_recordbatch_partition(NULL);
+                rd_kafka_recordbatch_base_offset(NULL);
+                rd_kafka_recordbatch_message_count(NULL);
+                rd_kafka_recordbatch_error(NULL);
+                rd_kafka_recordbatch_message_next(NULL);
+                rd_kafka_recordbatch_destroy(NULL);
                 rd_kafka_seek(NULL, 0, 0, 0);
                 rd_kafka_yield(NULL);
                 rd_kafka_mem_free(NULL, NULL);
@@ -35,6 +35,11 @@
 
 /**
 * Basic compression tests, with rather lacking verification.
+*
+* Each codec is tested with inline compression as well as with
+* compression offloaded to the compression.threads pool, in which case
+* smaller batches are used to have several offloaded MessageSets
+* per partition in flight, which must be transmitted in order.
 */
 
 
@@ -43,7 +48,7 @@ int main_0017_compression(int argc, char **argv) {
         const int msg_cnt = 1000;
         int msg_base = 0;
         uint64_t testid;
-#define CODEC_CNT 4
+#define CODEC_CNT 5
         const char *codecs[CODEC_CNT+1] = {
                 "none",
 #if WITH_ZLIB
@@ -53,63 +58,101 @@ int main_0017_compression(int argc, char **argv) {
                 "snappy",
 #endif
                 "lz4",
+#if WITH_ZSTD
+                "zstd",
+#endif
                 NULL
         };
-        const char *topics[CODEC_CNT];
+        const char *topics[2][CODEC_CNT];
         const int32_t partition = 0;
         int i;
-        int crc;
+        int pass;
+        int offload;
 
         testid = test_id_generate();
 
-        /* Produce messages */
-        rk_p = test_create_producer();
-        for (i = 0; codecs[i] != NULL ; i++) {
-                rd_kafka_topic_t *rkt_p;
-
-                topics[i] = test_mk_topic_name(codecs[i], 1);
-                TEST_SAY("Produce %d messages with %s compression to "
-                         "topic %s\n",
-                        msg_cnt, codecs[i], topics[i]);
-                rkt_p = test_create_producer_topic(rk_p, topics[i],
-                        "compression.codec", codecs[i], NULL);
-
-                /* Produce small message that will not decrease with
-                 * compression (issue #781) */
-                test_produce_msgs(rk_p, rkt_p, testid, partition,
-                                  msg_base + (partition*msg_cnt), 1,
-                                  NULL, 5);
-
-                /* Produce standard sized messages */
-                test_produce_msgs(rk_p, rkt_p, testid, partition,
-                                  msg_base + (partition*msg_cnt) + 1, msg_cnt-1,
-                                  NULL, 512);
-                rd_kafka_topic_destroy(rkt_p);
+#if WITH_ZSTD
+        /* zstd requires broker >= 2.1.0 (KIP-110) */
+        if (test_broker_version < TEST_BRKVER(2,1,0,0)) {
+                for (i = 0 ; codecs[i] != NULL ; i++)
+                        if (!strcmp(codecs[i], "zstd"))
+                                codecs[i] = NULL;
         }
+#endif
+
+        /* Produce messages, without and with compression offloading */
+        for (offload = 0 ; offload < 2 ; offload++) {
+                rd_kafka_conf_t *conf;
+
+                test_conf_init(&conf, NULL, 0);
+                rd_kafka_conf_set_dr_cb(conf, test_dr_cb);
+                if (offload) {
+                        test_conf_set(conf, "compression.threads", "2");
+                        test_conf_set(conf, "batch.num.messages", "100");
+                        test_conf_set(conf, "queue.buffering.max.ms", "100");
+                }
+                rk_p = test_create_handle(RD_KAFKA_PRODUCER, conf);
 
-        rd_kafka_destroy(rk_p);
+                for (i = 0; codecs[i] != NULL ; i++) {
+                        rd_kafka_topic_t *rkt_p;
+
+                        topics[offload][i] =
+                                rd_strdup(test_mk_topic_name(codecs[i], 1));
+                        TEST_SAY("Produce %d messages with %s compression "
+                                 "(%s) to topic %s\n",
+                                 msg_cnt, codecs[i],
+                                 offload ? "offloaded" : "inline",
+                                 topics[offload][i]);
+                        rkt_p = test_create_producer_topic(
+                                rk_p, topics[offload][i],
+                                "compression.codec", codecs[i],
+                                /* Non-default level, ignored by all
+                                 * but zstd */
+                                "compression.level", "6", NULL);
+
+                        /* Produce small message that will not decrease
+                         * with compression (issue #781) */
+                        test_produce_msgs(rk_p, rkt_p, testid, partition,
+                                          msg_base + (partition*msg_cnt), 1,
+                                          NULL, 5);
+
+                        /* Produce standard sized messages */
+                        test_produce_msgs(rk_p, rkt_p, testid, partition,
+                                          msg_base + (partition*msg_cnt) + 1,
+                                          msg_cnt-1, NULL, 512);
+                        rd_kafka_topic_destroy(rkt_p);
+                }
+
+                rd_kafka_destroy(rk_p);
+        }
 
 
         /* restart timeout (mainly for helgrind use since it is very slow) */
         test_timeout_set(30);
 
-        /* Consume messages: Without and with CRC checking */
-        for (crc = 0 ; crc < 2 ; crc++) {
-                const char *crc_tof = crc ? "true":"false";
+        /* Consume messages: Without and with CRC checking,
+         * and with parsing offloaded to the decompression.threads pool. */
+        for (pass = 0 ; pass < 3 ; pass++) {
+                const char *crc_tof = pass > 0 ? "true":"false";
                 rd_kafka_conf_t *conf;
 
                 test_conf_init(&conf, NULL, 0);
                 test_conf_set(conf, "check.crcs", crc_tof);
+                if (pass == 2)
+                        test_conf_set(conf, "decompression.threads", "2");
 
                 rk_c = test_create_consumer(NULL, NULL, conf, NULL);
 
                 for (i = 0; codecs[i] != NULL ; i++) {
-                        rd_kafka_topic_t *rkt_c = rd_kafka_topic_new(rk_c,
-                                                                     topics[i],
-                                                                     NULL);
-
-                        TEST_SAY("Consume %d messages from topic %s (crc=%s)\n",
-                                 msg_cnt, topics[i], crc_tof);
+                    for (offload = 0 ; offload < 2 ; offload++) {
+                        rd_kafka_topic_t *rkt_c =
+                                rd_kafka_topic_new(rk_c, topics[offload][i],
+                                                   NULL);
+
+                        TEST_SAY("Consume %d messages from topic %s "
+                                 "(crc=%s, decompression.threads=%d)\n",
+                                 msg_cnt, topics[offload][i], crc_tof,
+                                 pass == 2 ? 2 : 0);
                         /* Start consuming */
                         test_consumer_start(codecs[i], rkt_c, partition,
                                             RD_KAFKA_OFFSET_BEGINNING);
@@ -128,11 +171,16 @@ int main_0017_compression(int argc, char **argv) {
                         test_consumer_stop(codecs[i], rkt_c, partition);
 
                         rd_kafka_topic_destroy(rkt_c);
+                    }
                 }
 
                 rd_kafka_destroy(rk_c);
         }
 
+        for (offload = 0 ; offload < 2 ; offload++)
+                for (i = 0; codecs[i] != NULL ; i++)
+                        rd_free((char *)topics[offload][i]);
+
 
         return 0;
 }
@@ -219,6 +219,67 @@ static void assign_consume_many (char **topics, int topic_cnt, uint64_t testid){
 
 
 
+/**
+ * Benchmark topic object creation and lookup with \p topic_cnt topics
+ * in a single producer instance.
+ * No brokers are configured since only the local topic objects
+ * are of interest.
+ */
+static void lookup_many (int topic_cnt) {
+	rd_kafka_t *rk;
+	rd_kafka_conf_t *conf;
+	rd_kafka_topic_t **rkts;
+	char errstr[512];
+	char topic[64];
+	test_timing_t t_create, t_lookup;
+	int i;
+
+	TEST_SAY(_C_MAG "%s\n" _C_CLR, __FUNCTION__);
+
+	conf = rd_kafka_conf_new();
+	rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+	if (!rk)
+		TEST_FAIL("Failed to create producer: %s", errstr);
+
+	rkts = malloc(sizeof(*rkts) * topic_cnt);
+
+	TIMING_START(&t_create, "Topic object create (%d topics)",
+		     topic_cnt);
+	for (i = 0 ; i < topic_cnt ; i++) {
+		rd_snprintf(topic, sizeof(topic), "0042_lookup_%d", i);
+		rkts[i] = rd_kafka_topic_new(rk, topic, NULL);
+		TEST_ASSERT(rkts[i], "topic_new(%s) failed: %s",
+			    topic, rd_kafka_err2str(rd_kafka_last_error()));
+	}
+	TIMING_STOP(&t_create);
+
+	/* Creating an existing topic object is a lookup */
+	TIMING_START(&t_lookup, "Topic object lookup (%d topics)",
+		     topic_cnt);
+	for (i = 0 ; i < topic_cnt ; i++) {
+		rd_kafka_topic_t *rkt;
+
+		rd_snprintf(topic, sizeof(topic), "0042_lookup_%d", i);
+		rkt = rd_kafka_topic_new(rk, topic, NULL);
+		TEST_ASSERT(rkt == rkts[i],
+			    "Expected existing topic object for %s", topic);
+		rd_kafka_topic_destroy(rkt);
+	}
+	TIMING_STOP(&t_lookup);
+
+	TEST_SAY("%d topics: %.3fus/create, %.3fus/lookup\n",
+		 topic_cnt,
+		 (double)TIMING_DURATION(&t_create) / topic_cnt,
+		 (double)TIMING_DURATION(&t_lookup) / topic_cnt);
+
+	for (i = 0 ; i < topic_cnt ; i++)
+		rd_kafka_topic_destroy(rkts[i]);
+	free(rkts);
+
+	rd_kafka_destroy(rk);
+}
+
+
 int main_0042_many_topics (int argc, char **argv) {
 	char **topics;
 	const int topic_cnt = 20; /* up this as needed, topic creation
@@ -237,6 +298,8 @@ int main_0042_many_topics (int argc, char **argv) {
 	for (i = 0 ; i < topic_cnt ; i++)
 		topics[i] = rd_strdup(test_mk_topic_name(__FUNCTION__, 1));
 
+	lookup_many(20000);
+
 	produce_many(topics, topic_cnt, testid);
 	legacy_consume_many(topics, topic_cnt, testid);
 	if (test_broker_version >= TEST_BRKVER(0,9,0,0)) {
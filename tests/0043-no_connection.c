@@ -70,8 +70,71 @@ static void test_producer_no_connection (void) {
 	TIMING_STOP(&t_destroy);
 }
 
+
+static int tmout_dr_cnt;
+
+static void tmout_dr_msg_cb (rd_kafka_t *rk,
+                             const rd_kafka_message_t *rkmessage,
+                             void *opaque) {
+        if (rkmessage->err != RD_KAFKA_RESP_ERR__MSG_TIMED_OUT)
+                TEST_FAIL("Expected message to time out, not %s",
+                          rd_kafka_err2str(rkmessage->err));
+        tmout_dr_cnt++;
+}
+
+/**
+ * Messages queued for unavailable (and not yet known) partitions must
+ * time out, regardless of queuing strategy.
+ */
+static void test_producer_msg_timeout (const char *queuing_strategy) {
+	rd_kafka_t *rk;
+	rd_kafka_conf_t *conf;
+	rd_kafka_topic_t *rkt;
+	int i;
+	const int partition_cnt = 4;
+        const int msgs_per_partition = 50000;
+	int msgcnt = 0;
+	test_timing_t t_tmout;
+
+        TEST_SAY("Message timeouts with queuing.strategy=%s\n",
+                 queuing_strategy);
+
+	test_conf_init(&conf, NULL, 30);
+
+	test_conf_set(conf, "bootstrap.servers", NULL);
+        test_conf_set(conf, "queue.buffering.max.messages", "1000000");
+        rd_kafka_conf_set_dr_msg_cb(conf, tmout_dr_msg_cb);
+        tmout_dr_cnt = 0;
+
+	rk = test_create_handle(RD_KAFKA_PRODUCER, conf);
+	rkt = test_create_topic_object(rk, __FUNCTION__,
+				       "message.timeout.ms", "2000",
+                                       "queuing.strategy", queuing_strategy,
+                                       NULL);
+
+	test_produce_msgs_nowait(rk, rkt, 0, RD_KAFKA_PARTITION_UA, 0,
+                                 msgs_per_partition, NULL, 10, &msgcnt);
+	for (i = 0 ; i < partition_cnt ; i++)
+		test_produce_msgs_nowait(rk, rkt, 0, i,
+					 0, msgs_per_partition, NULL, 10,
+                                         &msgcnt);
+
+        TIMING_START(&t_tmout, "%d message timeouts", msgcnt);
+        while (tmout_dr_cnt < msgcnt)
+                rd_kafka_poll(rk, 100);
+        TIMING_STOP(&t_tmout);
+
+        TEST_ASSERT(rd_kafka_outq_len(rk) == 0,
+                    "Expected empty queue, not %d", rd_kafka_outq_len(rk));
+
+	rd_kafka_topic_destroy(rkt);
+	rd_kafka_destroy(rk);
+}
+
 int main_0043_no_connection (int argc, char **argv) {
 	test_producer_no_connection();
+        test_producer_msg_timeout("fifo");
+        test_producer_msg_timeout("lifo");
 
         return 0;
 }
@@ -267,6 +267,13 @@ static void do_test_partitioners (void) {
                                 0x4f7703da % _PART_CNT,
                                 0x5ec19395 % _PART_CNT
                         } },
+                { "sticky", {
+                                -1,
+                                -1,
+                                0xb1b451d7 % _PART_CNT,
+                                0xb0150df7 % _PART_CNT,
+                                0xd077037e % _PART_CNT
+                        } },
                 { NULL }
         };
         int pi;
@@ -280,9 +287,93 @@ static void do_test_partitioners (void) {
         }
 }
 
+
+/**
+ * @brief Verify that the sticky partitioner assigns keyless messages
+ *        to the same partition until batch.num.messages is reached.
+ */
+static void do_test_sticky_partitioner (void) {
+#define _STICKY_PART_CNT 4
+#define _STICKY_MSG_CNT  1000
+#define _STICKY_BATCH    100
+        rd_kafka_t *rk;
+        rd_kafka_conf_t *conf;
+        const char *topic = test_mk_topic_name(__FUNCTION__, 1);
+        int32_t parts[_STICKY_MSG_CNT];
+        int remains = _STICKY_MSG_CNT;
+        int switches = 0;
+        rd_kafka_topic_t *rkt;
+        const struct rd_kafka_metadata *md;
+        rd_kafka_resp_err_t err;
+        int i;
+
+        TEST_SAY(_C_MAG "Test sticky partitioner batch affinity\n");
+
+        test_create_topic(topic, _STICKY_PART_CNT, 1);
+
+        test_conf_init(&conf, NULL, 30);
+        rd_kafka_conf_set_opaque(conf, &remains);
+        rd_kafka_conf_set_dr_msg_cb(conf, part_dr_msg_cb);
+        test_conf_set(conf, "partitioner", "sticky");
+        test_conf_set(conf, "batch.num.messages",
+                      tsprintf("%d", _STICKY_BATCH));
+        /* Make sure only full batches cause partition switches */
+        test_conf_set(conf, "sticky.partitioning.linger.ms", "900000");
+
+        rk = test_create_handle(RD_KAFKA_PRODUCER, conf);
+
+        /* Query metadata so that all messages are partitioned
+         * directly rather than through the UA partition. */
+        rkt = test_create_topic_object(rk, topic, NULL);
+        err = rd_kafka_metadata(rk, 0, rkt, &md, tmout_multip(5000));
+        TEST_ASSERT(!err, "metadata() failed: %s", rd_kafka_err2str(err));
+        rd_kafka_metadata_destroy(md);
+
+        for (i = 0 ; i < _STICKY_MSG_CNT ; i++) {
+                parts[i] = -1;
+                err = rd_kafka_producev(rk,
+                                        RD_KAFKA_V_TOPIC(topic),
+                                        RD_KAFKA_V_VALUE("hi", 2),
+                                        RD_KAFKA_V_OPAQUE(&parts[i]),
+                                        RD_KAFKA_V_END);
+                TEST_ASSERT(!err,
+                            "producev() failed: %s", rd_kafka_err2str(err));
+        }
+
+        rd_kafka_flush(rk, tmout_multip(10000));
+
+        TEST_ASSERT(remains == 0,
+                    "Expected remains=%d, not %d for %d messages",
+                    0, remains, _STICKY_MSG_CNT);
+
+        for (i = 0 ; i < _STICKY_MSG_CNT ; i++) {
+                TEST_ASSERT(parts[i] != -1,
+                            "Message #%d was not successfully produced", i);
+                if (i > 0 && parts[i] != parts[i-1]) {
+                        int on_boundary = (i % _STICKY_BATCH) == 0;
+                        TEST_ASSERT(on_boundary,
+                                    "Message #%d switched partition "
+                                    "%"PRId32" -> %"PRId32" mid-batch",
+                                    i, parts[i-1], parts[i]);
+                        switches++;
+                }
+        }
+
+        TEST_ASSERT(switches == (_STICKY_MSG_CNT / _STICKY_BATCH) - 1,
+                    "Expected %d partition switches, not %d",
+                    (_STICKY_MSG_CNT / _STICKY_BATCH) - 1, switches);
+
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+
+        TEST_SAY(_C_GRN "Test sticky partitioner batch affinity: PASS\n");
+}
+
 int main_0048_partitioner (int argc, char **argv) {
-        if (test_can_create_topics(0))
+        if (test_can_create_topics(0)) {
                 do_test_partitioners();
+                do_test_sticky_partitioner();
+        }
 	do_test_failed_partitioning();
 	return 0;
 }
@@ -61,7 +61,68 @@ static void do_test_srkt_leak (void) {
 }
 
 
+/**
+ * @brief Verify RD_KAFKA_V_VALUE_REF(): the same payload produced to
+ *        multiple topics is released exactly once, after both the
+ *        application and all messages have released their references.
+ */
+static int pref_free_cnt;
+
+static void pref_free_cb (void *payload, size_t len, void *opaque) {
+        TEST_ASSERT(opaque == (void *)&pref_free_cnt,
+                    "unexpected opaque %p", opaque);
+        TEST_ASSERT(len == 100, "unexpected len %"PRIusz, len);
+        pref_free_cnt++;
+        free(payload);
+}
+
+static void do_test_payload_ref (void) {
+        rd_kafka_t *rk;
+        rd_kafka_payload_ref_t *pref;
+        rd_kafka_resp_err_t err;
+        const char *topics[] = { "test_a", "test_b", "test_c" };
+        char buf[10];
+        int i;
+
+        rk = test_create_handle(RD_KAFKA_PRODUCER, NULL);
+
+        pref = rd_kafka_payload_ref_new(calloc(1, 100), 100,
+                                        pref_free_cb, &pref_free_cnt);
+
+        for (i = 0 ; i < (int)RD_ARRAYSIZE(topics) ; i++) {
+                err = rd_kafka_producev(rk,
+                                        RD_KAFKA_V_TOPIC(topics[i]),
+                                        RD_KAFKA_V_VALUE_REF(pref),
+                                        RD_KAFKA_V_END);
+                TEST_ASSERT(!err, "producev(%s) failed: %s",
+                            topics[i], rd_kafka_err2str(err));
+        }
+
+        /* Mixing _VALUE and _VALUE_REF must fail without holding
+         * on to a reference. */
+        err = rd_kafka_producev(rk,
+                                RD_KAFKA_V_TOPIC(topics[0]),
+                                RD_KAFKA_V_VALUE(buf, sizeof(buf)),
+                                RD_KAFKA_V_VALUE_REF(pref),
+                                RD_KAFKA_V_END);
+        TEST_ASSERT(err == RD_KAFKA_RESP_ERR__CONFLICT,
+                    "expected CONFLICT, not %s", rd_kafka_err2str(err));
+
+        rd_kafka_payload_ref_destroy(pref);
+        TEST_ASSERT(pref_free_cnt == 0,
+                    "payload freed while messages are still queued");
+
+        /* Purges the queued messages */
+        rd_kafka_destroy(rk);
+
+        TEST_ASSERT(pref_free_cnt == 1,
+                    "expected payload to be freed once, not %d times",
+                    pref_free_cnt);
+}
+
+
 int main_0074_producev (int argc, char **argv) {
         do_test_srkt_leak();
+        do_test_payload_ref();
         return 0;
 }
@@ -0,0 +1,151 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "test.h"
+#include "rdkafka.h"
+
+
+/**
+ * Produce and consume the same data with the regular poll() based
+ * transport and with the io_uring transport (socket.io_uring.enable)
+ * and report the number of socket IO syscalls per MB transferred,
+ * as reported by the per-broker io_syscalls statistic.
+ *
+ * The io_uring transport falls back to the poll() based transport
+ * when io_uring is not available, so the test passes regardless.
+ */
+
+struct io_stats {
+        int64_t syscalls;  /**< Sum of brokers[].io_syscalls */
+        int64_t bytes;     /**< tx_bytes + rx_bytes */
+        int calls;
+};
+
+static struct io_stats last_stats;
+
+
+static int64_t json_sum (const char *json, const char *field) {
+        const char *s = json;
+        size_t flen = strlen(field);
+        int64_t sum = 0;
+
+        while ((s = strstr(s, field))) {
+                s += flen;
+                sum += strtoll(s, NULL, 10);
+        }
+
+        return sum;
+}
+
+static int stats_cb (rd_kafka_t *rk, char *json, size_t json_len,
+                     void *opaque) {
+        last_stats.syscalls = json_sum(json, "\"io_syscalls\":");
+        last_stats.bytes = json_sum(json, "\"tx_bytes\":") +
+                json_sum(json, "\"rx_bytes\":");
+        last_stats.calls++;
+        return 0;
+}
+
+/**
+ * @brief Wait for a fresh stats callback so that the totals cover
+ *        all IO performed so far.
+ */
+static void wait_stats (rd_kafka_t *rk) {
+        int calls = last_stats.calls;
+
+        while (last_stats.calls < calls + 2)
+                rd_kafka_poll(rk, 50);
+}
+
+static void report (const char *what, int uring, const struct io_stats *st) {
+        double mb = (double)st->bytes / (1024.0*1024.0);
+
+        TEST_SAY("%s with io_uring %s: %"PRId64" syscalls for %.2fMB: "
+                 "%.1f syscalls/MB\n",
+                 what, uring ? "enabled" : "disabled",
+                 st->syscalls, mb, mb > 0.0 ? (double)st->syscalls / mb : 0.0);
+}
+
+
+int main_0082_io_uring (int argc, char **argv) {
+        const int msgcnt = 20000;
+        const int msgsize = 1024;
+        const int32_t partition = 0;
+        uint64_t testid = test_id_generate();
+        const char *topic = test_mk_topic_name("0082_io_uring", 1);
+        int uring;
+
+        for (uring = 0 ; uring < 2 ; uring++) {
+                rd_kafka_conf_t *conf;
+                rd_kafka_t *rk;
+                rd_kafka_topic_t *rkt;
+                const char *tof = uring ? "true" : "false";
+
+                /* Produce */
+                test_conf_init(&conf, NULL, 60);
+                test_conf_set(conf, "socket.io_uring.enable", tof);
+                test_conf_set(conf, "statistics.interval.ms", "100");
+                rd_kafka_conf_set_stats_cb(conf, stats_cb);
+                rd_kafka_conf_set_dr_cb(conf, test_dr_cb);
+                rk = test_create_handle(RD_KAFKA_PRODUCER, conf);
+                rkt = test_create_producer_topic(rk, topic, NULL);
+
+                test_produce_msgs(rk, rkt, testid, partition,
+                                  uring * msgcnt, msgcnt, NULL, msgsize);
+                wait_stats(rk);
+                report("Produce", uring, &last_stats);
+
+                rd_kafka_topic_destroy(rkt);
+                rd_kafka_destroy(rk);
+
+                /* Consume */
+                memset(&last_stats, 0, sizeof(last_stats));
+                test_conf_init(&conf, NULL, 60);
+                test_conf_set(conf, "socket.io_uring.enable", tof);
+                test_conf_set(conf, "statistics.interval.ms", "100");
+                rd_kafka_conf_set_stats_cb(conf, stats_cb);
+                rk = test_create_consumer(NULL, NULL, conf, NULL);
+                rkt = rd_kafka_topic_new(rk, topic, NULL);
+
+                test_consumer_start("consume", rkt, partition,
+                                    uring * msgcnt);
+                test_consume_msgs("consume", rkt, testid, partition,
+                                  TEST_NO_SEEK, uring * msgcnt, msgcnt,
+                                  1 /* parse format */);
+                wait_stats(rk);
+                report("Consume", uring, &last_stats);
+                test_consumer_stop("consume", rkt, partition);
+
+                rd_kafka_topic_destroy(rkt);
+                rd_kafka_destroy(rk);
+
+                memset(&last_stats, 0, sizeof(last_stats));
+        }
+
+        return 0;
+}
@@ -0,0 +1,213 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "test.h"
+#include "rdkafka.h"
+
+
+/**
+ * Consume from all partitions of a topic using incremental fetch sessions
+ * (KIP-227, on brokers >= 1.1.0) where only a few partitions have data,
+ * verifying that:
+ *  - all messages and a PARTITION_EOF per partition are received,
+ *  - new messages are received for partitions that are idle in the
+ *    fetch session (not included in incremental FetchRequests),
+ * and report the FetchRequest/Response byte counts from the statistics.
+ */
+
+struct fetch_stats {
+        int64_t full;
+        int64_t incremental;
+        int64_t txbytes;
+        int64_t rxbytes;
+        int64_t session_errs;
+        int calls;
+};
+
+static struct fetch_stats last_stats;
+
+
+static int stats_cb (rd_kafka_t *rk, char *json, size_t json_len,
+                     void *opaque) {
+        struct fetch_stats st = { 0 };
+        const char *s = json;
+
+        /* Sum the per-broker "fetch" objects */
+        while ((s = strstr(s, "\"fetch\": { "))) {
+                int64_t full, incr, txbytes, rxbytes, errs;
+                int32_t id, epoch;
+                int cnt;
+
+                if (sscanf(s, "\"fetch\": { \"full\":%"SCNd64", "
+                           "\"incremental\":%"SCNd64", "
+                           "\"txbytes\":%"SCNd64", "
+                           "\"rxbytes\":%"SCNd64", "
+                           "\"session_id\":%"SCNd32", "
+                           "\"session_epoch\":%"SCNd32", "
+                           "\"session_partitions\":%d, "
+                           "\"session_errs\":%"SCNd64,
+                           &full, &incr, &txbytes, &rxbytes,
+                           &id, &epoch, &cnt, &errs) == 8) {
+                        st.full += full;
+                        st.incremental += incr;
+                        st.txbytes += txbytes;
+                        st.rxbytes += rxbytes;
+                        st.session_errs += errs;
+                }
+                s++;
+        }
+
+        st.calls = last_stats.calls + 1;
+        last_stats = st;
+        return 0;
+}
+
+
+/**
+ * @brief Consume \p exp_msgcnt messages and \p exp_eofcnt PARTITION_EOFs
+ *        from \p rkq.
+ */
+static void consume_queue (rd_kafka_queue_t *rkq, uint64_t testid,
+                           int exp_msgcnt, int exp_eofcnt) {
+        int msgcnt = 0, eofcnt = 0;
+
+        while (msgcnt < exp_msgcnt || eofcnt < exp_eofcnt) {
+                rd_kafka_message_t *rkm;
+
+                rkm = rd_kafka_consume_queue(rkq, 1000);
+                if (!rkm)
+                        continue;
+
+                if (rkm->err == RD_KAFKA_RESP_ERR__PARTITION_EOF) {
+                        /* EOFs are only expected after all messages */
+                        if (msgcnt == exp_msgcnt)
+                                eofcnt++;
+                } else if (rkm->err) {
+                        TEST_FAIL("Consume error: %s",
+                                  rd_kafka_message_errstr(rkm));
+                } else {
+                        int msgid;
+                        test_msg_parse(testid, rkm, rkm->partition, &msgid);
+                        msgcnt++;
+                }
+
+                rd_kafka_message_destroy(rkm);
+        }
+
+        TEST_ASSERT(msgcnt == exp_msgcnt,
+                    "Expected %d messages, got %d", exp_msgcnt, msgcnt);
+        TEST_SAY("Consumed %d messages and %d EOFs\n", msgcnt, eofcnt);
+}
+
+
+/**
+ * @brief Produce \p msgcnt messages to \p partition
+ */
+static void produce (const char *topic, uint64_t testid,
+                     int32_t partition, int msg_base, int msgcnt) {
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        rd_kafka_conf_t *conf;
+
+        test_conf_init(&conf, NULL, 0);
+        rd_kafka_conf_set_dr_cb(conf, test_dr_cb);
+        rk = test_create_handle(RD_KAFKA_PRODUCER, conf);
+        rkt = test_create_producer_topic(rk, topic, NULL);
+        test_produce_msgs(rk, rkt, testid, partition, msg_base, msgcnt,
+                          NULL, 100);
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+}
+
+
+int main_0083_fetch_session (int argc, char **argv) {
+        const char *topic = test_mk_topic_name("0083_fetch_session", 1);
+        uint64_t testid = test_id_generate();
+        const int msgcnt = 1000;
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        rd_kafka_conf_t *conf;
+        rd_kafka_queue_t *rkq;
+        int partition_cnt;
+        int calls;
+        int32_t i;
+
+        produce(topic, testid, 0, 0, msgcnt);
+
+        test_conf_init(&conf, NULL, 60);
+        test_conf_set(conf, "statistics.interval.ms", "100");
+        test_conf_set(conf, "enable.partition.eof", "true");
+        rd_kafka_conf_set_stats_cb(conf, stats_cb);
+        rk = test_create_consumer(NULL, NULL, conf, NULL);
+        rkt = rd_kafka_topic_new(rk, topic, NULL);
+        rkq = rd_kafka_queue_new(rk);
+
+        partition_cnt = test_get_partition_count(rk, topic);
+        TEST_SAY("Consuming %d partition(s) of %s\n", partition_cnt, topic);
+
+        for (i = 0 ; i < partition_cnt ; i++)
+                TEST_ASSERT(!rd_kafka_consume_start_queue(
+                                    rkt, i, RD_KAFKA_OFFSET_BEGINNING, rkq),
+                            "consume_start_queue(%"PRId32") failed: %s",
+                            i, rd_kafka_err2str(rd_kafka_last_error()));
+
+        consume_queue(rkq, testid, msgcnt, partition_cnt);
+
+        /* The last partition is now idle in the fetch session,
+         * produce to it and verify its new messages are fetched. */
+        produce(topic, testid, partition_cnt-1, msgcnt, msgcnt);
+        consume_queue(rkq, testid, msgcnt, 1);
+
+        /* Serve statistics emitted while consuming, then wait for
+         * fresh statistics. */
+        rd_kafka_poll(rk, 0);
+        calls = last_stats.calls;
+        while (last_stats.calls < calls + 2)
+                rd_kafka_poll(rk, 100);
+
+        TEST_SAY("%"PRId64" full and %"PRId64" incremental FetchRequests: "
+                 "%"PRId64" request bytes (%"PRId64" per request), "
+                 "%"PRId64" response bytes, %"PRId64" session errors\n",
+                 last_stats.full, last_stats.incremental,
+                 last_stats.txbytes,
+                 last_stats.txbytes /
+                 RD_MAX(1, last_stats.full + last_stats.incremental),
+                 last_stats.rxbytes, last_stats.session_errs);
+
+        TEST_ASSERT(last_stats.full + last_stats.incremental > 0,
+                    "No FetchRequests in statistics");
+
+        for (i = 0 ; i < partition_cnt ; i++)
+                rd_kafka_consume_stop(rkt, i);
+
+        rd_kafka_queue_destroy(rkq);
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+
+        return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "test.h"
+#include "rdkafka.h"
+
+
+/**
+ * Consume a topic where all messages are in the first (hot) partition
+ * while the other (cold) partitions are empty, with static and with
+ * adaptive (fetch.adaptive.enable) fetch sizes, and verify that with
+ * adaptive fetch sizes:
+ *  - the hot partition's fetch size grows beyond fetch.message.max.bytes,
+ *  - the cold partitions' fetch size shrinks below it,
+ *  - no more FetchRequests are needed to consume the messages.
+ */
+
+struct fetch_stats {
+        int64_t requests;       /* Full + incremental FetchRequests */
+        int32_t hot_size_max;   /* Max fetch_size of the hot partition */
+        int32_t cold_size;      /* Current fetch_size of a cold partition */
+        int calls;
+};
+
+static struct fetch_stats last_stats;
+static int32_t cold_partition;
+
+
+static int stats_cb (rd_kafka_t *rk, char *json, size_t json_len,
+                     void *opaque) {
+        struct fetch_stats st = { 0 };
+        const char *s;
+
+        /* Sum the per-broker "fetch" objects */
+        s = json;
+        while ((s = strstr(s, "\"fetch\": { "))) {
+                int64_t full, incr;
+
+                if (sscanf(s, "\"fetch\": { \"full\":%"SCNd64", "
+                           "\"incremental\":%"SCNd64,
+                           &full, &incr) == 2)
+                        st.requests += full + incr;
+                s++;
+        }
+
+        /* Partition fetch sizes */
+        st.hot_size_max = last_stats.hot_size_max;
+        st.cold_size = last_stats.cold_size;
+        s = json;
+        while ((s = strstr(s, "\"partition\":"))) {
+                int32_t partition, leader, size;
+                const char *t;
+
+                if (sscanf(s, "\"partition\":%"SCNd32", "
+                           "\"leader\":%"SCNd32,
+                           &partition, &leader) == 2 &&
+                    (t = strstr(s, "\"fetch_size\":")) &&
+                    sscanf(t, "\"fetch_size\":%"SCNd32, &size) == 1) {
+                        if (partition == 0 && size > st.hot_size_max)
+                                st.hot_size_max = size;
+                        else if (partition == cold_partition)
+                                st.cold_size = size;
+                }
+                s++;
+        }
+
+        st.calls = last_stats.calls + 1;
+        last_stats = st;
+        return 0;
+}
+
+
+/**
+ * @brief Consume \p msgcnt messages from all \p partition_cnt partitions
+ *        of \p topic and return the resulting statistics.
+ */
+static struct fetch_stats do_consume (const char *topic, uint64_t testid,
+                                      int partition_cnt, int msgcnt,
+                                      int adaptive) {
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        rd_kafka_conf_t *conf;
+        rd_kafka_queue_t *rkq;
+        int cnt = 0;
+        int calls;
+        int32_t i;
+        test_timing_t t_consume;
+
+        memset(&last_stats, 0, sizeof(last_stats));
+
+        test_conf_init(&conf, NULL, 60);
+        test_conf_set(conf, "statistics.interval.ms", "100");
+        test_conf_set(conf, "enable.partition.eof", "false");
+        test_conf_set(conf, "fetch.adaptive.enable",
+                      adaptive ? "true" : "false");
+        rd_kafka_conf_set_stats_cb(conf, stats_cb);
+        rk = test_create_consumer(NULL, NULL, conf, NULL);
+        rkt = rd_kafka_topic_new(rk, topic, NULL);
+        rkq = rd_kafka_queue_new(rk);
+
+        for (i = 0 ; i < partition_cnt ; i++)
+                TEST_ASSERT(!rd_kafka_consume_start_queue(
+                                    rkt, i, RD_KAFKA_OFFSET_BEGINNING, rkq),
+                            "consume_start_queue(%"PRId32") failed: %s",
+                            i, rd_kafka_err2str(rd_kafka_last_error()));
+
+        TIMING_START(&t_consume, "CONSUME.%s",
+                     adaptive ? "ADAPTIVE" : "STATIC");
+        while (cnt < msgcnt) {
+                rd_kafka_message_t *rkm;
+                int msgid;
+
+                rkm = rd_kafka_consume_queue(rkq, 1000);
+                if (!rkm)
+                        continue;
+
+                if (rkm->err)
+                        TEST_FAIL("Consume error: %s",
+                                  rd_kafka_message_errstr(rkm));
+
+                test_msg_parse(testid, rkm, 0, &msgid);
+                cnt++;
+                rd_kafka_message_destroy(rkm);
+        }
+        TIMING_STOP(&t_consume);
+
+        /* Serve statistics emitted while consuming, then wait for
+         * fresh statistics. */
+        rd_kafka_poll(rk, 0);
+        calls = last_stats.calls;
+        while (last_stats.calls < calls + 2)
+                rd_kafka_poll(rk, 100);
+
+        TEST_SAY("%s fetch sizes: %"PRId64" FetchRequests, "
+                 "hot partition fetch size up to %"PRId32", "
+                 "cold partition fetch size %"PRId32"\n",
+                 adaptive ? "Adaptive" : "Static",
+                 last_stats.requests, last_stats.hot_size_max,
+                 last_stats.cold_size);
+
+        for (i = 0 ; i < partition_cnt ; i++)
+                rd_kafka_consume_stop(rkt, i);
+
+        rd_kafka_queue_destroy(rkq);
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+
+        return last_stats;
+}
+
+
+int main_0084_fetch_adaptive (int argc, char **argv) {
+        const char *topic = test_mk_topic_name("0084_fetch_adaptive", 1);
+        uint64_t testid = test_id_generate();
+        const int msgcnt = 10000;
+        const int msgsize = 1000;
+        const int32_t fetch_msg_max_bytes = 1024*1024; /* default */
+        struct fetch_stats st_static, st_adaptive;
+        int partition_cnt;
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+
+        rk = test_create_producer();
+        rkt = test_create_producer_topic(rk, topic, NULL);
+        test_produce_msgs(rk, rkt, testid, 0, 0, msgcnt, NULL, msgsize);
+        partition_cnt = test_get_partition_count(rk, topic);
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+
+        cold_partition = partition_cnt - 1;
+        TEST_SAY("Consuming %d messages from %d partition(s) of %s\n",
+                 msgcnt, partition_cnt, topic);
+
+        st_static = do_consume(topic, testid, partition_cnt, msgcnt, 0);
+        st_adaptive = do_consume(topic, testid, partition_cnt, msgcnt, 1);
+
+        TEST_ASSERT(st_static.hot_size_max == fetch_msg_max_bytes,
+                    "Expected static hot partition fetch size %"PRId32", "
+                    "not %"PRId32,
+                    fetch_msg_max_bytes, st_static.hot_size_max);
+
+        TEST_ASSERT(st_adaptive.hot_size_max > fetch_msg_max_bytes,
+                    "Expected adaptive hot partition fetch size "
+                    "to grow beyond %"PRId32", not %"PRId32,
+                    fetch_msg_max_bytes, st_adaptive.hot_size_max);
+
+        if (partition_cnt > 1)
+                TEST_ASSERT(st_adaptive.cold_size < fetch_msg_max_bytes,
+                            "Expected adaptive cold partition fetch size "
+                            "to shrink below %"PRId32", not %"PRId32,
+                            fetch_msg_max_bytes, st_adaptive.cold_size);
+
+        TEST_ASSERT(st_adaptive.requests <= st_static.requests,
+                    "Expected no more FetchRequests with adaptive fetch "
+                    "sizes (%"PRId64") than with static ones (%"PRId64")",
+                    st_adaptive.requests, st_static.requests);
+
+        return 0;
+}
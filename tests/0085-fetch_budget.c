@@ -0,0 +1,201 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "test.h"
+#include "rdkafka.h"
+
+
+/**
+ * Let a consumer prefetch messages from all partitions of a topic
+ * without consuming them, with and without a prefetch memory budget
+ * (queued.max.total.kbytes), and verify that:
+ *  - the buffered bytes (stats "fetchq_bytes") stay within the budget,
+ *    give or take one FetchResponse per broker,
+ *  - all messages are still consumed,
+ *  - the buffered bytes drop to zero once all messages are destroyed.
+ */
+
+static int64_t fetchq_bytes;
+static int64_t fetchq_bytes_max;
+static int stats_calls;
+
+
+static int stats_cb (rd_kafka_t *rk, char *json, size_t json_len,
+                     void *opaque) {
+        const char *s;
+        int64_t bytes;
+
+        /* The first "fetchq_bytes" is the instance-wide one */
+        if ((s = strstr(json, "\"fetchq_bytes\":")) &&
+            sscanf(s, "\"fetchq_bytes\":%"SCNd64, &bytes) == 1) {
+                fetchq_bytes = bytes;
+                if (bytes > fetchq_bytes_max)
+                        fetchq_bytes_max = bytes;
+        }
+
+        stats_calls++;
+        return 0;
+}
+
+
+/**
+ * @brief Wait for \p cnt fresh statistics callbacks.
+ */
+static void wait_stats (rd_kafka_t *rk, int cnt) {
+        int calls;
+
+        /* Serve statistics emitted while consuming first. */
+        rd_kafka_poll(rk, 0);
+        calls = stats_calls;
+        while (stats_calls < calls + cnt)
+                rd_kafka_poll(rk, 100);
+}
+
+
+/**
+ * @returns the max number of bytes buffered while prefetching.
+ */
+static int64_t do_consume (const char *topic, uint64_t testid,
+                           int partition_cnt, int msgcnt,
+                           const char *budget_kbytes) {
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        rd_kafka_conf_t *conf;
+        rd_kafka_queue_t *rkq;
+        int cnt = 0;
+        int32_t i;
+
+        fetchq_bytes = fetchq_bytes_max = 0;
+        stats_calls = 0;
+
+        test_conf_init(&conf, NULL, 60);
+        test_conf_set(conf, "statistics.interval.ms", "100");
+        test_conf_set(conf, "enable.partition.eof", "false");
+        test_conf_set(conf, "message.max.bytes", "1000000");
+        test_conf_set(conf, "fetch.max.bytes", "1000000");
+        test_conf_set(conf, "queued.max.total.kbytes", budget_kbytes);
+        rd_kafka_conf_set_stats_cb(conf, stats_cb);
+        rk = test_create_consumer(NULL, NULL, conf, NULL);
+        rkt = rd_kafka_topic_new(rk, topic, NULL);
+        rkq = rd_kafka_queue_new(rk);
+
+        for (i = 0 ; i < partition_cnt ; i++)
+                TEST_ASSERT(!rd_kafka_consume_start_queue(
+                                    rkt, i, RD_KAFKA_OFFSET_BEGINNING, rkq),
+                            "consume_start_queue(%"PRId32") failed: %s",
+                            i, rd_kafka_err2str(rd_kafka_last_error()));
+
+        /* Let the consumer prefetch as much as it is allowed to. */
+        TEST_SAY("Prefetching with queued.max.total.kbytes=%s\n",
+                 budget_kbytes);
+        wait_stats(rk, 20);
+
+        while (cnt < msgcnt) {
+                rd_kafka_message_t *rkm;
+                int msgid;
+
+                rkm = rd_kafka_consume_queue(rkq, 1000);
+                if (!rkm)
+                        continue;
+
+                if (rkm->err)
+                        TEST_FAIL("Consume error: %s",
+                                  rd_kafka_message_errstr(rkm));
+
+                test_msg_parse(testid, rkm, RD_KAFKA_PARTITION_UA, &msgid);
+                cnt++;
+                rd_kafka_message_destroy(rkm);
+        }
+
+        for (i = 0 ; i < partition_cnt ; i++)
+                rd_kafka_consume_stop(rkt, i);
+
+        wait_stats(rk, 2);
+
+        TEST_SAY("queued.max.total.kbytes=%s: up to %"PRId64" bytes "
+                 "buffered, %"PRId64" bytes buffered after consuming "
+                 "all messages\n",
+                 budget_kbytes, fetchq_bytes_max, fetchq_bytes);
+
+        TEST_ASSERT(fetchq_bytes == 0,
+                    "Expected no buffered bytes after stopping, "
+                    "not %"PRId64, fetchq_bytes);
+
+        rd_kafka_queue_destroy(rkq);
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+
+        return fetchq_bytes_max;
+}
+
+
+int main_0085_fetch_budget (int argc, char **argv) {
+        const char *topic = test_mk_topic_name("0085_fetch_budget", 1);
+        uint64_t testid = test_id_generate();
+        const int msgcnt = 20000;
+        const int msgsize = 1000;
+        const int64_t budget = 4000 * 1000;
+        /* A FetchResponse may exceed fetch.max.bytes by a RecordBatch,
+         * which is at most fetch.message.max.bytes (default 1MB). */
+        const int64_t fetch_max_bytes = 1000000 + 1024*1024;
+        int64_t max_unlimited, max_budget;
+        int partition_cnt, broker_cnt;
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        const struct rd_kafka_metadata *md;
+
+        rk = test_create_producer();
+        rkt = test_create_producer_topic(rk, topic, NULL);
+        test_produce_msgs(rk, rkt, testid, RD_KAFKA_PARTITION_UA, 0, msgcnt,
+                          NULL, msgsize);
+        partition_cnt = test_get_partition_count(rk, topic);
+        TEST_ASSERT(!rd_kafka_metadata(rk, 0, NULL, &md, 5000));
+        broker_cnt = md->broker_cnt;
+        rd_kafka_metadata_destroy(md);
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+
+        TEST_SAY("Consuming %d messages from %d partition(s) of %s "
+                 "on %d broker(s)\n",
+                 msgcnt, partition_cnt, topic, broker_cnt);
+
+        max_unlimited = do_consume(topic, testid, partition_cnt, msgcnt, "0");
+        max_budget = do_consume(topic, testid, partition_cnt, msgcnt, "4000");
+
+        TEST_ASSERT(max_unlimited > budget,
+                    "Expected more than %"PRId64" bytes to be prefetched "
+                    "without a budget, not %"PRId64,
+                    budget, max_unlimited);
+
+        TEST_ASSERT(max_budget <= budget + broker_cnt * fetch_max_bytes,
+                    "Expected at most %"PRId64" + %d*%"PRId64" bytes to be "
+                    "prefetched with a budget, not %"PRId64,
+                    budget, broker_cnt, fetch_max_bytes, max_budget);
+
+        return 0;
+}
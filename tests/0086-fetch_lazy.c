@@ -0,0 +1,364 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "test.h"
+#include "rdkafka.h"
+
+
+/**
+ * Consume messages with keys, headers and timestamps with RecordBatch
+ * views (fetch.lazy.enable) through the per-message, batch, callback
+ * and RecordBatch consume APIs and verify that the materialized messages
+ * are identical to what was produced, in order, and that fewer ops than
+ * messages are queued.
+ * A second run produces RecordBatches larger than the RecordBatch view cap
+ * and verifies that they are returned in parts.
+ */
+
+/* Must match RD_KAFKA_MSGSET_READER_BATCH_SIZE_MAX */
+#define RECORDBATCH_VIEW_MAX 4096
+
+static uint64_t testid;
+static int msgcnt;
+static int partition_cnt;
+
+
+struct consume_state {
+        int cnt;
+        int64_t *next_offsets;  /* Per partition */
+        size_t max_batch_cnt;   /* Largest RecordBatch view */
+};
+
+
+/**
+ * @brief Verify a consumed message.
+ */
+static void verify_msg (struct consume_state *state,
+                        rd_kafka_message_t *rkm) {
+        rd_kafka_headers_t *hdrs;
+        rd_kafka_timestamp_type_t tstype;
+        const void *hdr;
+        size_t size;
+        char value[32];
+        int msgid, hdr_msgid;
+
+        if (rkm->err)
+                TEST_FAIL("Consume error: %s", rd_kafka_message_errstr(rkm));
+
+        test_msg_parse(testid, rkm, rkm->partition, &msgid);
+
+        rd_snprintf(value, sizeof(value), "value%d", msgid);
+        TEST_ASSERT(rkm->len == strlen(value) &&
+                    !memcmp(rkm->payload, value, rkm->len),
+                    "Message %d: expected value %s, not %.*s",
+                    msgid, value, (int)rkm->len,
+                    (const char *)rkm->payload);
+
+        TEST_ASSERT(!rd_kafka_message_headers(rkm, &hdrs) &&
+                    !rd_kafka_header_get_last(hdrs, "msgid", &hdr, &size) &&
+                    size == sizeof(hdr_msgid),
+                    "Message %d: missing msgid header", msgid);
+        memcpy(&hdr_msgid, hdr, sizeof(hdr_msgid));
+        TEST_ASSERT(hdr_msgid == msgid,
+                    "Message %d: expected msgid header %d, not %d",
+                    msgid, msgid, hdr_msgid);
+
+        TEST_ASSERT(rd_kafka_message_timestamp(rkm, &tstype) ==
+                    1000000 + msgid &&
+                    tstype == RD_KAFKA_TIMESTAMP_CREATE_TIME,
+                    "Message %d: expected timestamp %d, not %"PRId64,
+                    msgid, 1000000 + msgid,
+                    rd_kafka_message_timestamp(rkm, NULL));
+
+        TEST_ASSERT(rkm->offset == state->next_offsets[rkm->partition],
+                    "Message %d: expected offset %"PRId64" "
+                    "for partition %"PRId32", not %"PRId64,
+                    msgid, state->next_offsets[rkm->partition],
+                    rkm->partition, rkm->offset);
+        state->next_offsets[rkm->partition]++;
+
+        state->cnt++;
+}
+
+
+static void consume_cb (rd_kafka_message_t *rkm, void *opaque) {
+        verify_msg((struct consume_state *)opaque, rkm);
+}
+
+
+typedef enum {
+        CONSUME_QUEUE,
+        CONSUME_BATCH,
+        CONSUME_CALLBACK,
+        CONSUME_RECORDBATCH
+} consume_api_t;
+
+static const char *consume_api_names[] = {
+        "consume_queue", "consume_batch_queue", "consume_callback_queue",
+        "consume_recordbatch_queue"
+};
+
+
+/**
+ * @brief Verify all messages of a RecordBatch.
+ */
+static void verify_recordbatch (struct consume_state *state,
+                                rd_kafka_recordbatch_t *rkrb) {
+        const rd_kafka_message_t *rkm;
+        int32_t partition = rd_kafka_recordbatch_partition(rkrb);
+        int64_t base_offset = rd_kafka_recordbatch_base_offset(rkrb);
+        size_t cnt = 0;
+
+        TEST_ASSERT(!rd_kafka_recordbatch_error(rkrb),
+                    "Consume error: %s",
+                    rd_kafka_err2str(rd_kafka_recordbatch_error(rkrb)));
+        TEST_ASSERT(partition >= 0 && partition < partition_cnt,
+                    "Unexpected partition %"PRId32, partition);
+        TEST_ASSERT(base_offset == state->next_offsets[partition],
+                    "Expected base offset %"PRId64" for partition "
+                    "%"PRId32", not %"PRId64,
+                    state->next_offsets[partition], partition, base_offset);
+
+        while ((rkm = rd_kafka_recordbatch_message_next(rkrb))) {
+                TEST_ASSERT(rkm->partition == partition,
+                            "Expected partition %"PRId32", not %"PRId32,
+                            partition, rkm->partition);
+                verify_msg(state, (rd_kafka_message_t *)rkm);
+                cnt++;
+        }
+
+        TEST_ASSERT(cnt == rd_kafka_recordbatch_message_count(rkrb),
+                    "Expected %"PRIusz" messages in batch, got %"PRIusz,
+                    rd_kafka_recordbatch_message_count(rkrb), cnt);
+        TEST_ASSERT(cnt <= RECORDBATCH_VIEW_MAX,
+                    "Expected at most %d messages in batch, got %"PRIusz,
+                    RECORDBATCH_VIEW_MAX, cnt);
+
+        if (cnt > state->max_batch_cnt)
+                state->max_batch_cnt = cnt;
+}
+
+
+/**
+ * @returns the largest RecordBatch view for CONSUME_RECORDBATCH, else 0.
+ */
+static size_t do_consume (const char *topic, consume_api_t api) {
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        rd_kafka_conf_t *conf;
+        rd_kafka_queue_t *rkq;
+        struct consume_state state = RD_ZERO_INIT;
+        size_t qlen;
+        int batch_cnt = 0;
+        int32_t i;
+        test_timing_t t_consume;
+
+        state.next_offsets = calloc(partition_cnt,
+                                    sizeof(*state.next_offsets));
+
+        test_conf_init(&conf, NULL, 60);
+        test_conf_set(conf, "enable.partition.eof", "false");
+        test_conf_set(conf, "fetch.lazy.enable", "true");
+        rk = test_create_consumer(NULL, NULL, conf, NULL);
+        rkt = rd_kafka_topic_new(rk, topic, NULL);
+        rkq = rd_kafka_queue_new(rk);
+
+        for (i = 0 ; i < partition_cnt ; i++)
+                TEST_ASSERT(!rd_kafka_consume_start_queue(
+                                    rkt, i, RD_KAFKA_OFFSET_BEGINNING, rkq),
+                            "consume_start_queue(%"PRId32") failed: %s",
+                            i, rd_kafka_err2str(rd_kafka_last_error()));
+
+        /* Let all messages be fetched */
+        rd_sleep(2);
+        qlen = rd_kafka_queue_length(rkq);
+        TEST_SAY("%s: %"PRIusz" ops queued for %d messages\n",
+                 consume_api_names[api], qlen, msgcnt);
+        TEST_ASSERT(qlen > 0 && qlen < (size_t)msgcnt,
+                    "Expected RecordBatch views to be queued, "
+                    "not %"PRIusz" ops for %d messages", qlen, msgcnt);
+
+        TIMING_START(&t_consume, "CONSUME.%s", consume_api_names[api]);
+        while (state.cnt < msgcnt) {
+                rd_kafka_message_t *rkm, *rkms[100];
+                ssize_t r, j;
+
+                switch (api)
+                {
+                case CONSUME_QUEUE:
+                        if (!(rkm = rd_kafka_consume_queue(rkq, 1000)))
+                                break;
+                        verify_msg(&state, rkm);
+                        rd_kafka_message_destroy(rkm);
+                        break;
+
+                case CONSUME_BATCH:
+                        r = rd_kafka_consume_batch_queue(rkq, 1000, rkms,
+                                                         RD_ARRAYSIZE(rkms));
+                        TEST_ASSERT(r >= 0, "consume_batch_queue() failed: "
+                                    "%s", rd_kafka_err2str(
+                                            rd_kafka_last_error()));
+                        for (j = 0 ; j < r ; j++) {
+                                verify_msg(&state, rkms[j]);
+                                rd_kafka_message_destroy(rkms[j]);
+                        }
+                        break;
+
+                case CONSUME_CALLBACK:
+                        r = rd_kafka_consume_callback_queue(rkq, 1000,
+                                                            consume_cb,
+                                                            &state);
+                        TEST_ASSERT(r >= 0, "consume_callback_queue() "
+                                    "failed: %s", rd_kafka_err2str(
+                                            rd_kafka_last_error()));
+                        break;
+
+                case CONSUME_RECORDBATCH:
+                {
+                        rd_kafka_recordbatch_t *rkrb;
+
+                        if (!(rkrb = rd_kafka_consume_recordbatch_queue(
+                                      rkq, 1000)))
+                                break;
+                        verify_recordbatch(&state, rkrb);
+                        rd_kafka_recordbatch_destroy(rkrb);
+                        batch_cnt++;
+                        break;
+                }
+                }
+        }
+        TIMING_STOP(&t_consume);
+
+        if (api == CONSUME_RECORDBATCH) {
+                TEST_SAY("%d messages consumed in %d batches "
+                         "(largest %"PRIusz")\n",
+                         state.cnt, batch_cnt, state.max_batch_cnt);
+                TEST_ASSERT(batch_cnt < msgcnt,
+                            "Expected fewer batches than messages, "
+                            "not %d batches for %d messages",
+                            batch_cnt, msgcnt);
+        }
+
+        TEST_ASSERT(state.cnt == msgcnt,
+                    "Expected %d messages, consumed %d", msgcnt, state.cnt);
+
+        for (i = 0 ; i < partition_cnt ; i++)
+                rd_kafka_consume_stop(rkt, i);
+
+        rd_kafka_queue_destroy(rkq);
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+        free(state.next_offsets);
+
+        return state.max_batch_cnt;
+}
+
+
+/**
+ * @brief Produce \p msgcnt messages to \p topic.
+ *
+ * @param large_batches If true all messages are produced to partition 0
+ *                      with a long linger time to create RecordBatches
+ *                      of as many records as possible.
+ */
+static void do_produce (const char *topic, int large_batches) {
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        rd_kafka_conf_t *conf;
+        int remains;
+        int i;
+
+        test_conf_init(&conf, NULL, 0);
+        if (large_batches)
+                test_conf_set(conf, "queue.buffering.max.ms", "1000");
+        rd_kafka_conf_set_dr_cb(conf, test_dr_cb);
+        rk = test_create_handle(RD_KAFKA_PRODUCER, conf);
+        rkt = test_create_producer_topic(rk, topic, NULL);
+        partition_cnt = test_get_partition_count(rk, topic);
+
+        TEST_SAY("Producing %d messages to %d partition(s) of %s\n",
+                 msgcnt, partition_cnt, topic);
+        remains = msgcnt;
+        for (i = 0 ; i < msgcnt ; i++) {
+                int32_t partition = large_batches ? 0 : i % partition_cnt;
+                char key[128], value[32];
+                rd_kafka_resp_err_t err;
+
+                test_msg_fmt(key, sizeof(key), testid, partition, i);
+                rd_snprintf(value, sizeof(value), "value%d", i);
+
+                err = rd_kafka_producev(
+                        rk,
+                        RD_KAFKA_V_RKT(rkt),
+                        RD_KAFKA_V_PARTITION(partition),
+                        RD_KAFKA_V_KEY(key, strlen(key)),
+                        RD_KAFKA_V_VALUE(value, strlen(value)),
+                        RD_KAFKA_V_HEADER("msgid", &i, sizeof(i)),
+                        RD_KAFKA_V_TIMESTAMP((int64_t)(1000000 + i)),
+                        RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+                        RD_KAFKA_V_OPAQUE(&remains),
+                        RD_KAFKA_V_END);
+                TEST_ASSERT(!err, "producev() failed: %s",
+                            rd_kafka_err2str(err));
+        }
+        test_wait_delivery(rk, &remains);
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+}
+
+
+int main_0086_fetch_lazy (int argc, char **argv) {
+        const char *topic = test_mk_topic_name("0086_fetch_lazy", 1);
+        size_t max_batch_cnt;
+
+        testid = test_id_generate();
+        msgcnt = 3000;
+
+        do_produce(topic, 0);
+
+        do_consume(topic, CONSUME_QUEUE);
+        do_consume(topic, CONSUME_BATCH);
+        do_consume(topic, CONSUME_CALLBACK);
+        do_consume(topic, CONSUME_RECORDBATCH);
+
+        /* RecordBatches larger than the view cap are split. */
+        topic = test_mk_topic_name("0086_fetch_lazy_large", 1);
+        testid = test_id_generate();
+        msgcnt = 10000;
+
+        do_produce(topic, 1);
+
+        do_consume(topic, CONSUME_QUEUE);
+        max_batch_cnt = do_consume(topic, CONSUME_RECORDBATCH);
+        TEST_ASSERT(max_batch_cnt == RECORDBATCH_VIEW_MAX,
+                    "Expected RecordBatch views of %d messages, "
+                    "largest was %"PRIusz,
+                    RECORDBATCH_VIEW_MAX, max_batch_cnt);
+
+        return 0;
+}
@@ -0,0 +1,283 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "test.h"
+#include "rdkafka.h"
+
+
+/**
+ * Tests statistics.format=binary: decodes the binary statistics,
+ * applies the value deltas and verifies the reconstructed values
+ * against what was produced.
+ */
+
+
+#define MAX_OBJS    256
+#define MAX_FIELDS  64
+
+static struct {
+        int      calls;
+        int      json_calls;
+        size_t   json_bytes;
+        size_t   bin_bytes;
+        uint64_t seq;
+        int      full_cnt;
+
+        /* Field names per object type, from the FIELDS records */
+        char     fields[4][MAX_FIELDS][32];
+        int      field_cnt[4];
+
+        /* Decoded objects, indexed by object id */
+        struct {
+                int     type;   /* -1 if not defined */
+                int32_t parent;
+                char    name[128];
+                int64_t v[MAX_FIELDS];
+        } objs[MAX_OBJS];
+} state;
+
+
+static uint64_t dec_uvarint (const char **p, const char *end) {
+        uint64_t v = 0;
+        int shift = 0;
+
+        while (*p < end) {
+                unsigned char c = (unsigned char)*((*p)++);
+                v |= (uint64_t)(c & 0x7f) << shift;
+                if (!(c & 0x80))
+                        return v;
+                shift += 7;
+        }
+
+        TEST_FAIL("Truncated varint");
+        return 0;
+}
+
+static int64_t dec_varint (const char **p, const char *end) {
+        uint64_t v = dec_uvarint(p, end);
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static void dec_str (const char **p, const char *end,
+                     char *dst, size_t dsize) {
+        uint64_t len = dec_uvarint(p, end);
+
+        TEST_ASSERT(*p + len <= end, "Truncated string");
+        TEST_ASSERT(len < dsize, "String too long: %"PRIu64, len);
+        memcpy(dst, *p, (size_t)len);
+        dst[len] = '\0';
+        *p += len;
+}
+
+static int field_idx (int type, const char *name) {
+        int i;
+        for (i = 0 ; i < state.field_cnt[type] ; i++)
+                if (!strcmp(state.fields[type][i], name))
+                        return i;
+        TEST_FAIL("Field %s not found for object type %d", name, type);
+        return -1;
+}
+
+static int stats_binary_cb (rd_kafka_t *rk, char *buf, size_t size,
+                            void *opaque) {
+        const char *p = buf, *end = buf + size;
+        uint64_t flags, seq;
+        int64_t ts;
+
+        TEST_ASSERT(size > 4 && !memcmp(buf, "RKSB", 4),
+                    "Invalid binary stats magic");
+        p += 4;
+
+        TEST_ASSERT(dec_uvarint(&p, end) == 1, "Unsupported version");
+        flags = dec_uvarint(&p, end);
+        seq = dec_uvarint(&p, end);
+        ts = dec_varint(&p, end);
+        dec_varint(&p, end); /* wallclock time */
+
+        TEST_ASSERT(ts > 0, "Invalid timestamp %"PRId64, ts);
+        TEST_ASSERT(seq == state.seq,
+                    "Expected seq %"PRIu64", not %"PRIu64, state.seq, seq);
+        TEST_ASSERT(seq > 0 || (flags & 0x1),
+                    "Expected first emit to be a full snapshot");
+        state.seq++;
+        if (flags & 0x1)
+                state.full_cnt++;
+
+        while (p < end) {
+                int rtype = (int)dec_uvarint(&p, end);
+                int type, id, i, cnt;
+
+                switch (rtype)
+                {
+                case 1: /* FIELDS */
+                        type = (int)dec_uvarint(&p, end);
+                        cnt = (int)dec_uvarint(&p, end);
+                        TEST_ASSERT(type < 4 && cnt <= MAX_FIELDS,
+                                    "Invalid FIELDS record");
+                        for (i = 0 ; i < cnt ; i++)
+                                dec_str(&p, end, state.fields[type][i],
+                                        sizeof(state.fields[type][i]));
+                        state.field_cnt[type] = cnt;
+                        break;
+
+                case 2: /* OBJECT */
+                        id = (int)dec_uvarint(&p, end);
+                        TEST_ASSERT(id > 0 && id < MAX_OBJS,
+                                    "Invalid object id %d", id);
+                        state.objs[id].type = (int)dec_uvarint(&p, end);
+                        state.objs[id].parent = (int32_t)dec_uvarint(&p, end);
+                        dec_str(&p, end, state.objs[id].name,
+                                sizeof(state.objs[id].name));
+                        /* Values start over from zero */
+                        memset(state.objs[id].v, 0,
+                               sizeof(state.objs[id].v));
+                        break;
+
+                case 3: /* VALUES */
+                        id = (int)dec_uvarint(&p, end);
+                        TEST_ASSERT(id > 0 && id < MAX_OBJS &&
+                                    state.objs[id].type != -1,
+                                    "Values for undefined object %d", id);
+                        while ((i = (int)dec_uvarint(&p, end)) != 0) {
+                                TEST_ASSERT(i <= state.field_cnt[state.objs
+                                                                 [id].type],
+                                            "Invalid field %d", i);
+                                state.objs[id].v[i-1] += dec_varint(&p, end);
+                        }
+                        break;
+
+                default:
+                        TEST_FAIL("Unknown record type %d", rtype);
+                }
+        }
+
+        state.calls++;
+        state.bin_bytes += size;
+
+        return 0;
+}
+
+static int stats_cb (rd_kafka_t *rk, char *json, size_t json_len,
+                     void *opaque) {
+        state.json_calls++;
+        state.json_bytes += json_len;
+        return 0;
+}
+
+
+int main_0087_stats_binary (int argc, char **argv) {
+        const char *topic = test_mk_topic_name("0087_stats_binary", 0);
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        rd_kafka_conf_t *conf;
+        const int msgcnt = 1000;
+        int64_t msgq_cnt = 0;
+        int i, handle_id = -1;
+        int64_t now;
+
+        memset(&state, 0, sizeof(state));
+        for (i = 0 ; i < MAX_OBJS ; i++)
+                state.objs[i].type = -1;
+
+        test_conf_init(&conf, NULL, 30);
+        test_conf_set(conf, "bootstrap.servers", NULL); /*no need for brokers*/
+        test_conf_set(conf, "statistics.interval.ms", "100");
+        test_conf_set(conf, "statistics.format", "json,binary");
+        test_conf_set(conf, "message.timeout.ms", "300000");
+        rd_kafka_conf_set_stats_cb(conf, stats_cb);
+        rd_kafka_conf_set_stats_binary_cb(conf, stats_binary_cb);
+
+        rk = test_create_handle(RD_KAFKA_PRODUCER, conf);
+        rkt = test_create_producer_topic(rk, topic, NULL);
+
+        for (i = 0 ; i < msgcnt ; i++)
+                if (rd_kafka_produce(rkt, i % 4, RD_KAFKA_MSG_F_COPY,
+                                     "hi", 2, NULL, 0, NULL) == -1)
+                        TEST_FAIL("Produce failed: %s",
+                                  rd_kafka_err2str(rd_kafka_last_error()));
+
+        now = test_clock();
+        while (test_clock() < now + 1500*1000)
+                rd_kafka_poll(rk, 100);
+
+        TEST_SAY("%d binary stats emits (%"PRIusz" bytes), "
+                 "%d JSON stats emits (%"PRIusz" bytes)\n",
+                 state.calls, state.bin_bytes,
+                 state.json_calls, state.json_bytes);
+
+        TEST_ASSERT(state.calls >= 5, "Expected at least 5 binary emits, "
+                    "not %d", state.calls);
+        TEST_ASSERT(state.json_calls > 0, "Expected JSON emits as well");
+        TEST_ASSERT(state.full_cnt >= 1, "Expected a full snapshot");
+        TEST_ASSERT(state.bin_bytes < state.json_bytes,
+                    "Expected binary stats to be smaller than JSON");
+
+        for (i = 1 ; i < MAX_OBJS ; i++) {
+                if (state.objs[i].type == 0)
+                        handle_id = i;
+                else if (state.objs[i].type == 3) {
+                        int32_t parent = state.objs[i].parent;
+
+                        /* Without a broker the messages are held in the
+                         * unassigned partition (-1). */
+                        TEST_SAY("Partition %s: msgq_cnt %"PRId64"\n",
+                                 state.objs[i].name,
+                                 state.objs[i].v[field_idx(3, "msgq_cnt")]);
+                        TEST_ASSERT(parent > 0 && parent < MAX_OBJS &&
+                                    state.objs[parent].type == 2 &&
+                                    !strcmp(state.objs[parent].name, topic),
+                                    "Partition %s: expected parent topic %s",
+                                    state.objs[i].name, topic);
+                        msgq_cnt += state.objs[i].v[field_idx(3,
+                                                              "msgq_cnt")];
+                }
+        }
+
+        TEST_ASSERT(handle_id != -1, "No handle object decoded");
+        TEST_ASSERT(!strcmp(state.objs[handle_id].name, rd_kafka_name(rk)),
+                    "Expected handle name %s, not %s",
+                    rd_kafka_name(rk), state.objs[handle_id].name);
+        TEST_ASSERT(state.objs[handle_id].v[field_idx(0, "msg_cnt")] ==
+                    msgcnt,
+                    "Expected msg_cnt %d, not %"PRId64,
+                    msgcnt,
+                    state.objs[handle_id].v[field_idx(0, "msg_cnt")]);
+        TEST_ASSERT(state.objs[handle_id].v[field_idx(0, "msg_size")] ==
+                    msgcnt * 2,
+                    "Expected msg_size %d, not %"PRId64,
+                    msgcnt * 2,
+                    state.objs[handle_id].v[field_idx(0, "msg_size")]);
+        TEST_ASSERT(msgq_cnt == msgcnt,
+                    "Expected %d messages in partition queues, not %"PRId64,
+                    msgcnt, msgq_cnt);
+
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+
+        return 0;
+}
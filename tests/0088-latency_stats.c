@@ -0,0 +1,287 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "test.h"
+#include "rdkafka.h"
+
+
+/**
+ * Verify the per-partition latency window stats (produce_latency,
+ * fetch_latency, fetchq_latency) and the per-ApiKey broker RTT (rtt_api)
+ * in the JSON statistics: each produced message is accounted once in
+ * produce_latency and each consumed message once in fetchq_latency,
+ * also for compressed messages and when consumed by RecordBatch.
+ */
+
+
+struct window_sum {
+        int64_t cnt;     /* Sum of cnt over all windows and emits */
+        int64_t p50_max; /* Highest p50 seen */
+        int64_t p99_max; /* Highest p99 seen */
+        int     bad;     /* Windows with p50 > p99 */
+};
+
+static struct {
+        struct window_sum produce_latency;
+        struct window_sum fetch_latency;
+        struct window_sum fetchq_latency;
+        struct window_sum rtt_Produce;
+        struct window_sum rtt_Fetch;
+        int calls;
+} state;
+
+
+/**
+ * @brief Add up all windows named \p name in \p json to \p sum.
+ */
+static void window_sum (const char *json, const char *name,
+                        struct window_sum *sum) {
+        char key[64];
+        const char *s = json;
+
+        rd_snprintf(key, sizeof(key), "\"%s\": {", name);
+
+        while ((s = strstr(s, key))) {
+                const char *end = strchr(s, '}');
+                const char *t;
+                int64_t v;
+                int64_t p50 = 0, p99 = 0;
+                int has_cnt;
+
+                TEST_ASSERT(end, "Unterminated %s window", name);
+
+                if ((t = strstr(s, "\"p50\":")) && t < end &&
+                    sscanf(t, "\"p50\": %"SCNd64, &v) == 1)
+                        p50 = v;
+                if ((t = strstr(s, "\"p99\":")) && t < end &&
+                    sscanf(t, "\"p99\": %"SCNd64, &v) == 1)
+                        p99 = v;
+                t = strstr(s, "\"cnt\":");
+                has_cnt = t && t < end &&
+                        sscanf(t, "\"cnt\":%"SCNd64, &v) == 1;
+                TEST_ASSERT(has_cnt, "No cnt in %s window", name);
+
+                sum->cnt += v;
+                if (p50 > sum->p50_max)
+                        sum->p50_max = p50;
+                if (p99 > sum->p99_max)
+                        sum->p99_max = p99;
+                if (p50 > p99)
+                        sum->bad++;
+
+                s = end;
+        }
+}
+
+static int stats_cb (rd_kafka_t *rk, char *json, size_t json_len,
+                     void *opaque) {
+        window_sum(json, "produce_latency", &state.produce_latency);
+        window_sum(json, "fetch_latency", &state.fetch_latency);
+        window_sum(json, "fetchq_latency", &state.fetchq_latency);
+        window_sum(json, "Produce", &state.rtt_Produce);
+        window_sum(json, "Fetch", &state.rtt_Fetch);
+        state.calls++;
+        return 0;
+}
+
+
+static void poll_stats (rd_kafka_t *rk) {
+        int calls;
+
+        /* Serve the stats emitted so far, then wait for an emit that
+         * was made after all latencies were recorded. */
+        while (rd_kafka_poll(rk, 0) > 0)
+                ;
+
+        calls = state.calls;
+        while (state.calls < calls + 1)
+                rd_kafka_poll(rk, 100);
+}
+
+static void print_window (const char *name, const struct window_sum *sum) {
+        TEST_SAY("%s: cnt %"PRId64", max p50 %"PRId64"us, "
+                 "max p99 %"PRId64"us\n",
+                 name, sum->cnt, sum->p50_max, sum->p99_max);
+        TEST_ASSERT(!sum->bad, "%s: %d window(s) with p50 > p99",
+                    name, sum->bad);
+}
+
+
+static void do_produce (const char *topic, uint64_t testid,
+                        int32_t partition, int msgcnt, const char *codec) {
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        rd_kafka_conf_t *conf;
+
+        TEST_SAY("Producing %d messages with compression.codec=%s\n",
+                 msgcnt, codec);
+
+        memset(&state, 0, sizeof(state));
+        test_conf_init(&conf, NULL, 60);
+        test_conf_set(conf, "statistics.interval.ms", "200");
+        test_conf_set(conf, "compression.codec", codec);
+        rd_kafka_conf_set_stats_cb(conf, stats_cb);
+        rd_kafka_conf_set_dr_cb(conf, test_dr_cb);
+        rk = test_create_handle(RD_KAFKA_PRODUCER, conf);
+        rkt = test_create_producer_topic(rk, topic, NULL);
+
+        test_produce_msgs(rk, rkt, testid, partition, 0, msgcnt, NULL, 10);
+        poll_stats(rk);
+
+        print_window("produce_latency", &state.produce_latency);
+        print_window("rtt_api.Produce", &state.rtt_Produce);
+
+        TEST_ASSERT(state.produce_latency.cnt == msgcnt,
+                    "Expected %d produce latencies, not %"PRId64,
+                    msgcnt, state.produce_latency.cnt);
+        TEST_ASSERT(state.produce_latency.p99_max > 0,
+                    "Expected produce latency percentiles");
+        TEST_ASSERT(state.rtt_Produce.cnt > 0,
+                    "Expected Produce request RTTs");
+        TEST_ASSERT(state.fetchq_latency.cnt == 0,
+                    "Expected no fetchq latencies for producer, "
+                    "not %"PRId64, state.fetchq_latency.cnt);
+
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+}
+
+
+/**
+ * @brief Consume \p msgcnt messages, one at a time or, if
+ *        \p recordbatch, by RecordBatch with
+ *        rd_kafka_consume_recordbatch_queue().
+ *        \p decompression_threads is passed to decompression.threads.
+ */
+static void do_consume (const char *topic, uint64_t testid,
+                        int32_t partition, int msgcnt, int recordbatch,
+                        const char *decompression_threads) {
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        rd_kafka_conf_t *conf;
+
+        TEST_SAY("Consuming %d messages %s, decompression.threads=%s\n",
+                 msgcnt, recordbatch ? "by RecordBatch" : "one by one",
+                 decompression_threads);
+
+        memset(&state, 0, sizeof(state));
+        test_conf_init(&conf, NULL, 60);
+        test_conf_set(conf, "statistics.interval.ms", "200");
+        test_conf_set(conf, "decompression.threads", decompression_threads);
+        if (recordbatch)
+                test_conf_set(conf, "fetch.lazy.enable", "true");
+        rd_kafka_conf_set_stats_cb(conf, stats_cb);
+        rk = test_create_consumer(NULL, NULL, conf, NULL);
+        rkt = test_create_consumer_topic(rk, topic);
+
+        if (recordbatch) {
+                rd_kafka_queue_t *rkq = rd_kafka_queue_new(rk);
+                int cnt = 0;
+
+                if (rd_kafka_consume_start_queue(rkt, partition,
+                                                 RD_KAFKA_OFFSET_BEGINNING,
+                                                 rkq) == -1)
+                        TEST_FAIL("consume_start_queue() failed: %s",
+                                  rd_kafka_err2str(rd_kafka_last_error()));
+
+                while (cnt < msgcnt) {
+                        rd_kafka_recordbatch_t *rkrb;
+
+                        if (!(rkrb = rd_kafka_consume_recordbatch_queue(
+                                      rkq, 1000)))
+                                continue;
+                        TEST_ASSERT(!rd_kafka_recordbatch_error(rkrb),
+                                    "Consume error: %s",
+                                    rd_kafka_err2str(
+                                            rd_kafka_recordbatch_error(rkrb)));
+                        cnt += (int)rd_kafka_recordbatch_message_count(rkrb);
+                        rd_kafka_recordbatch_destroy(rkrb);
+                }
+
+                TEST_ASSERT(cnt == msgcnt, "Expected %d messages, got %d",
+                            msgcnt, cnt);
+
+                rd_kafka_consume_stop(rkt, partition);
+                rd_kafka_queue_destroy(rkq);
+        } else {
+                test_consumer_start("consume", rkt, partition,
+                                    RD_KAFKA_OFFSET_BEGINNING);
+                test_consume_msgs("consume", rkt, testid, partition,
+                                  TEST_NO_SEEK, 0, msgcnt, 1);
+        }
+
+        poll_stats(rk);
+
+        print_window("fetch_latency", &state.fetch_latency);
+        print_window("fetchq_latency", &state.fetchq_latency);
+        print_window("rtt_api.Fetch", &state.rtt_Fetch);
+
+        TEST_ASSERT(state.fetchq_latency.cnt == msgcnt,
+                    "Expected %d fetchq latencies, not %"PRId64,
+                    msgcnt, state.fetchq_latency.cnt);
+        TEST_ASSERT(state.fetch_latency.cnt > 0,
+                    "Expected fetch latencies");
+        TEST_ASSERT(state.rtt_Fetch.cnt >= state.fetch_latency.cnt,
+                    "Expected at least as many Fetch RTTs (%"PRId64") as "
+                    "fetch latencies (%"PRId64")",
+                    state.rtt_Fetch.cnt, state.fetch_latency.cnt);
+        TEST_ASSERT(state.produce_latency.cnt == 0,
+                    "Expected no produce latencies for consumer, "
+                    "not %"PRId64, state.produce_latency.cnt);
+
+        if (!recordbatch)
+                test_consumer_stop("consume", rkt, partition);
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+}
+
+
+int main_0088_latency_stats (int argc, char **argv) {
+        const char *topic;
+        const int msgcnt = 5000;
+        const int32_t partition = 0;
+        uint64_t testid;
+
+        /* Uncompressed */
+        testid = test_id_generate();
+        topic = test_mk_topic_name("0088_latency_stats", 1);
+        do_produce(topic, testid, partition, msgcnt, "none");
+        do_consume(topic, testid, partition, msgcnt, 0, "0");
+        do_consume(topic, testid, partition, msgcnt, 1, "0");
+
+        /* Compressed: the messages reference the decompressed buffer,
+         * which is parsed from a view of the response buffer
+         * with decompression.threads. */
+        testid = test_id_generate();
+        topic = test_mk_topic_name("0088_latency_stats", 1);
+        do_produce(topic, testid, partition, msgcnt, "gzip");
+        do_consume(topic, testid, partition, msgcnt, 0, "0");
+        do_consume(topic, testid, partition, msgcnt, 0, "2");
+
+        return 0;
+}
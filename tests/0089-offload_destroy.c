@@ -0,0 +1,142 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2018 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "test.h"
+#include "rdkafka.h"
+
+
+/**
+ * Destroy the producer and the consumer while their MessageSets are being
+ * compressed or parsed by the offload pool (compression.threads,
+ * decompression.threads): the broker threads must wait for the jobs and
+ * release their buffers, messages and partition references.
+ */
+
+
+static void do_test_producer (const char *topic, int msgcnt) {
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        rd_kafka_conf_t *conf;
+        char buf[10000];
+        int msgcounter = 0;
+        int i;
+
+        TEST_SAY("Destroying producer with compression offload in progress\n");
+
+        test_conf_init(&conf, NULL, 60);
+        test_conf_set(conf, "compression.codec", "gzip");
+        test_conf_set(conf, "compression.threads", "2");
+        test_conf_set(conf, "message.max.bytes", "10000000");
+        test_conf_set(conf, "batch.num.messages", "1000");
+        rd_kafka_conf_set_dr_cb(conf, test_dr_cb);
+        rk = test_create_handle(RD_KAFKA_PRODUCER, conf);
+        rkt = test_create_producer_topic(rk, topic, NULL);
+
+        /* Wait for the connection to be up */
+        test_produce_msgs(rk, rkt, 0, 0, 0, 1, NULL, 0);
+
+        /* Incompressible payload to keep the workers busy */
+        for (i = 0 ; i < (int)sizeof(buf) ; i++)
+                buf[i] = (char)jitter(0, 255);
+
+        for (i = 0 ; i < msgcnt ; i++) {
+                if (rd_kafka_produce(rkt, 0, RD_KAFKA_MSG_F_COPY,
+                                     buf, sizeof(buf), NULL, 0,
+                                     &msgcounter) == -1)
+                        TEST_FAIL("Failed to produce message %d: %s", i,
+                                  rd_kafka_err2str(rd_kafka_last_error()));
+                msgcounter++;
+                rd_kafka_poll(rk, 0);
+        }
+
+        TEST_SAY("Destroying producer with %d message(s) in queue\n",
+                 rd_kafka_outq_len(rk));
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+}
+
+
+static void do_test_consumer (const char *topic, uint64_t testid,
+                              int msgcnt) {
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        rd_kafka_conf_t *conf;
+        int consumed = 0;
+
+        TEST_SAY("Destroying consumer with decompression offload "
+                 "in progress\n");
+
+        /* Compressed messages to consume */
+        test_conf_init(&conf, NULL, 60);
+        test_conf_set(conf, "compression.codec", "gzip");
+        rd_kafka_conf_set_dr_cb(conf, test_dr_cb);
+        rk = test_create_handle(RD_KAFKA_PRODUCER, conf);
+        rkt = test_create_producer_topic(rk, topic, NULL);
+        test_produce_msgs(rk, rkt, testid, 0, 0, msgcnt, NULL, 1024);
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+
+        test_conf_init(&conf, NULL, 60);
+        test_conf_set(conf, "decompression.threads", "2");
+        rk = test_create_consumer(NULL, NULL, conf, NULL);
+        rkt = test_create_consumer_topic(rk, topic);
+
+        test_consumer_start("consume", rkt, 0, RD_KAFKA_OFFSET_BEGINNING);
+
+        /* Consume the first messages, the next Fetch response is then
+         * likely being parsed by the pool. */
+        while (consumed < 10) {
+                rd_kafka_message_t *rkmessage;
+
+                rkmessage = rd_kafka_consume(rkt, 0, 1000);
+                if (!rkmessage)
+                        continue;
+
+                TEST_ASSERT(!rkmessage->err, "Consume error: %s",
+                            rd_kafka_message_errstr(rkmessage));
+                consumed++;
+                rd_kafka_message_destroy(rkmessage);
+        }
+
+        TEST_SAY("Destroying consumer after %d message(s)\n", consumed);
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+}
+
+
+int main_0089_offload_destroy (int argc, char **argv) {
+        uint64_t testid = test_id_generate();
+        const int msgcnt = 20000;
+
+        do_test_producer(test_mk_topic_name("0089_offload_destroy_p", 1),
+                         2000);
+        do_test_consumer(test_mk_topic_name("0089_offload_destroy_c", 1),
+                         testid, msgcnt);
+
+        return 0;
+}
@@ -166,6 +166,14 @@ _TEST_DECL(0077_compaction);
 _TEST_DECL(0078_c_from_cpp);
 _TEST_DECL(0079_fork);
 _TEST_DECL(0081_fetch_max_bytes);
+_TEST_DECL(0082_io_uring);
+_TEST_DECL(0083_fetch_session);
+_TEST_DECL(0084_fetch_adaptive);
+_TEST_DECL(0085_fetch_budget);
+_TEST_DECL(0086_fetch_lazy);
+_TEST_DECL(0087_stats_binary);
+_TEST_DECL(0088_latency_stats);
+_TEST_DECL(0089_offload_destroy);
 
 
 /* Manual tests */
@@ -269,6 +277,14 @@ struct test tests[] = {
               .extra = "using a fork():ed rd_kafka_t is not supported and will "
               "most likely hang"),
         _TEST(0081_fetch_max_bytes, 0, TEST_BRKVER(0,10,1,0)),
+        _TEST(0082_io_uring, 0),
+        _TEST(0083_fetch_session, 0),
+        _TEST(0084_fetch_adaptive, 0),
+        _TEST(0085_fetch_budget, 0),
+        _TEST(0086_fetch_lazy, 0),
+        _TEST(0087_stats_binary, TEST_F_LOCAL),
+        _TEST(0088_latency_stats, 0),
+        _TEST(0089_offload_destroy, 0),
 
         /* Manual tests */
         _TEST(8000_idle, TEST_F_MANUAL),